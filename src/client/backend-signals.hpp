@@ -22,15 +22,37 @@
  *
  * @brief  Helper class for Log, StatusChange and AttentionRequired
  *         sending signals
+ *
+ *         Signals triggered by the OpenVPN 3 Core library's client thread
+ *         are passed through a lock-free queue to the GLib main loop,
+ *         which does the actual D-Bus signal emission.
  */
 
 #ifndef OPENVPN3_DBUS_CLIENT_BACKENDSIGNALS_HPP
 #define OPENVPN3_DBUS_CLIENT_BACKENDSIGNALS_HPP
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
 #include <openvpn/common/rc.hpp>
 
+#include "common/spsc-queue.hpp"
 #include "log/logwriter.hpp"
 
+/**
+ *  Sends the Log, StatusChange and AttentionRequired signals of a VPN
+ *  backend client.
+ *
+ *  This object must be created in the thread running the GLib main loop.
+ *  Any other thread calling the logging and signal methods, which is
+ *  the thread running the OpenVPN 3 Core library client, only adds the
+ *  signal to a queue; it never blocks on the D-Bus connection.  The
+ *  queue is drained and the signals sent from the main loop.  The
+ *  thread registered with SetProducerThread() uses a lock-free queue,
+ *  any other thread a queue protected by a mutex.
+ */
 class BackendSignals : public LogSender,
                        public RC<thread_unsafe_refcount>
 {
@@ -39,20 +61,113 @@ public:
     BackendSignals(GDBusConnection *conn, LogGroup lgroup,
                    std::string object_path, LogWriter *logwr)
         : LogSender(conn, lgroup, OpenVPN3DBus_interf_backends,
-                    object_path, logwr)
+                    object_path, logwr),
+          mainloop_thread(std::this_thread::get_id()),
+          queue(default_queue_size)
     {
         SetLogLevel(default_log_level);
+
+        // A flapping connection can produce the same log events
+        // over and over again; avoid flooding the D-Bus and log files
+        SetLogDuplicateSuppression(true);
+        SetLogRateLimit(lgroup, default_log_rate, default_log_burst);
+
+        // The summary of repeated log events is otherwise only sent
+        // when a differing log event arrives
+        log_flush_timer = g_timeout_add_seconds(1, log_flush_callback, this);
+    }
+
+    ~BackendSignals()
+    {
+        g_source_remove(log_flush_timer);
+        g_source_remove_by_user_data(this);
+    }
+
+
+    /**
+     *  Sets the log level.  Log events not allowed by the log level are
+     *  discarded before being queued, so they do not cost anything for
+     *  the thread logging them.
+     *
+     * @param loglev  unsigned int with the log level to use (0-6)
+     */
+    void SetLogLevel(unsigned int loglev)
+    {
+        LogSender::SetLogLevel(loglev);
+        queue_log_level.store(loglev, std::memory_order_relaxed);
+    }
+
+
+    /**
+     *  Sets the thread which may add signals to the lock-free queue.
+     *  This must be called by the thread running the VPN client when it
+     *  starts, and after the previous such thread has returned.
+     *
+     * @param id  std::thread::id of the thread running the VPN client
+     */
+    void SetProducerThread(std::thread::id id)
+    {
+        queue.SetProducer(id);
+    }
+
+
+    /**
+     *  Sets a function to call once a FATAL log event has been sent,
+     *  replacing the default handling which terminates the process by
+     *  sending itself SIGHUP.  The function is called from the main loop.
+     *
+     * @param handler  std::function<void()> to call on fatal errors
+     */
+    void SetFatalHandler(std::function<void()> handler)
+    {
+        fatal_handler = std::move(handler);
+    }
+
+
+    void Debug(std::string msg) override
+    {
+        dispatch(QueuedSignal(LogCategory::DEBUG, msg));
+    }
+
+    void LogVerb2(std::string msg) override
+    {
+        dispatch(QueuedSignal(LogCategory::VERB2, msg));
+    }
+
+    void LogVerb1(std::string msg) override
+    {
+        dispatch(QueuedSignal(LogCategory::VERB1, msg));
+    }
+
+    void LogInfo(std::string msg) override
+    {
+        dispatch(QueuedSignal(LogCategory::INFO, msg));
+    }
+
+    void LogWarn(std::string msg) override
+    {
+        dispatch(QueuedSignal(LogCategory::WARN, msg));
+    }
+
+    void LogError(std::string msg) override
+    {
+        dispatch(QueuedSignal(LogCategory::ERROR, msg));
+    }
+
+    void LogCritical(std::string msg) override
+    {
+        dispatch(QueuedSignal(LogCategory::CRIT, msg));
     }
 
     /**
-     * Sends a FATAL log messages and kills itself
+     * Sends a FATAL log messages and kills itself, unless a fatal
+     * handler has been set with SetFatalHandler()
      *
      * @param Log message to send to the log subscribers
      */
-    void LogFATAL(std::string msg)
+    void LogFATAL(std::string msg) override
     {
-        Log(LogEvent(log_group, LogCategory::FATAL, msg));
-        kill(getpid(), SIGHUP);
+        dispatch(QueuedSignal(LogCategory::FATAL, msg));
     }
 
     /**
@@ -65,10 +180,10 @@ public:
      */
     void StatusChange(const StatusMajor major, const StatusMinor minor, std::string msg)
     {
-        status.major = major;
-        status.minor = minor;
-        status.message = msg;
-        Send("StatusChange", status.GetGVariantTuple());
+        QueuedSignal sig(QueuedSignal::Type::STATUS, msg);
+        sig.code_a = (guint) major;
+        sig.code_b = (guint) minor;
+        dispatch(std::move(sig));
     }
 
     /**
@@ -94,8 +209,10 @@ public:
                       const ClientAttentionGroup att_group,
                       std::string msg)
     {
-        GVariant *params = g_variant_new("(uus)", (guint) att_type, (guint) att_group, msg.c_str());
-        Send("AttentionRequired", params);
+        QueuedSignal sig(QueuedSignal::Type::ATTENTION, msg);
+        sig.code_a = (guint) att_type;
+        sig.code_b = (guint) att_group;
+        dispatch(std::move(sig));
     }
 
     /**
@@ -106,6 +223,7 @@ public:
      */
     GVariant * GetLastStatusChange()
     {
+        flush_queue();
         if( status.empty() )
         {
             return NULL;  // Nothing have been logged, nothing to report
@@ -115,8 +233,175 @@ public:
 
 
 private:
-    const unsigned int default_log_level = 6; // LogCategory::DEBUG
+    /**
+     *  A signal waiting in the queue to be sent from the main loop
+     */
+    struct QueuedSignal
+    {
+        enum class Type
+        {
+            NONE,
+            LOG,
+            STATUS,
+            ATTENTION
+        };
+
+        QueuedSignal() = default;
+
+        QueuedSignal(const Type type, const std::string& message)
+            : type(type), message(message)
+        {
+        }
+
+        QueuedSignal(const LogCategory catg, const std::string& message)
+            : type(Type::LOG), code_a((guint) catg), message(message)
+        {
+        }
+
+        Type type = Type::NONE;
+        guint code_a = 0;   ///< LogCategory, StatusMajor or ClientAttentionType
+        guint code_b = 0;   ///< StatusMinor or ClientAttentionGroup
+        std::string message;
+    };
+
+    const unsigned int default_log_level = 3; // LogCategory::INFO
+    const double default_log_rate = 100.0;    // Log events per second
+    const unsigned int default_log_burst = 500;
+    const size_t default_queue_size = 256;    // Queued signals
+    const size_t queue_reserved = 32;         // Not to be used by log events
+    const std::chrono::seconds log_repeat_quiet{2};
     StatusEvent status;
+
+    const std::thread::id mainloop_thread;
+    CheckedSPSCQueue<QueuedSignal> queue;
+    std::atomic<bool> flush_scheduled{false};
+    guint log_flush_timer = 0;
+    std::atomic<unsigned long> queue_overflows{0};
+    std::atomic<unsigned int> queue_log_level{0};
+    std::function<void()> fatal_handler;
+
+
+    /**
+     *  Sends a signal directly when called from the main loop, otherwise
+     *  it is queued and a flush of the queue is scheduled on the main loop.
+     *  If the queue is full, the signal is discarded and counted.  Log
+     *  events are discarded earlier, leaving room in the queue for the
+     *  less frequent StatusChange and AttentionRequired signals.
+     *
+     * @param sig  QueuedSignal to send
+     */
+    void dispatch(QueuedSignal&& sig)
+    {
+        if (QueuedSignal::Type::LOG == sig.type
+            && !LogLevelAllows(queue_log_level.load(std::memory_order_relaxed),
+                               (LogCategory) sig.code_a))
+        {
+            return;
+        }
+
+        if (std::this_thread::get_id() == mainloop_thread)
+        {
+            // Anything queued earlier must be sent first, to
+            // preserve the ordering of the signals
+            flush_queue();
+            emit(sig);
+            return;
+        }
+
+        if ((QueuedSignal::Type::LOG == sig.type
+             && queue.GetSize() >= queue.GetCapacity() - queue_reserved)
+            || !queue.Push(std::move(sig)))
+        {
+            queue_overflows.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (!flush_scheduled.exchange(true))
+        {
+            g_idle_add(flush_callback, this);
+        }
+    }
+
+
+    static gboolean flush_callback(gpointer this_ptr)
+    {
+        static_cast<BackendSignals *>(this_ptr)->flush_queue();
+        return G_SOURCE_REMOVE;
+    }
+
+
+    /**
+     *  Called every second by the main loop, to send the summary of
+     *  repeated log events once they have stopped for a while
+     */
+    static gboolean log_flush_callback(gpointer this_ptr)
+    {
+        BackendSignals *self = static_cast<BackendSignals *>(this_ptr);
+        self->FlushLog(self->log_repeat_quiet);
+        return G_SOURCE_CONTINUE;
+    }
+
+
+    /**
+     *  Sends all the signals waiting in the queue, in a single batch.
+     *  Must only be called from the main loop.
+     */
+    void flush_queue()
+    {
+        // Cleared before draining, so a signal queued while draining
+        // will always be picked up, either now or by a new flush
+        flush_scheduled.store(false);
+
+        QueuedSignal sig;
+        while (queue.Pop(sig))
+        {
+            emit(sig);
+        }
+
+        unsigned long lost = queue_overflows.exchange(0);
+        if (lost > 0)
+        {
+            Log(LogEvent(log_group, LogCategory::WARN,
+                         std::to_string(lost)
+                         + " signals discarded due to a full signal queue"));
+        }
+    }
+
+
+    void emit(const QueuedSignal& sig)
+    {
+        switch (sig.type)
+        {
+        case QueuedSignal::Type::LOG:
+            Log(LogEvent(log_group, (LogCategory) sig.code_a, sig.message));
+            if (LogCategory::FATAL == (LogCategory) sig.code_a)
+            {
+                if (fatal_handler)
+                {
+                    fatal_handler();
+                }
+                else
+                {
+                    kill(getpid(), SIGHUP);
+                }
+            }
+            break;
+
+        case QueuedSignal::Type::STATUS:
+            status.major = (StatusMajor) sig.code_a;
+            status.minor = (StatusMinor) sig.code_b;
+            status.message = sig.message;
+            Send("StatusChange", status.GetGVariantTuple());
+            break;
+
+        case QueuedSignal::Type::ATTENTION:
+            Send("AttentionRequired",
+                 g_variant_new("(uus)", sig.code_a, sig.code_b,
+                               sig.message.c_str()));
+            break;
+
+        case QueuedSignal::Type::NONE:
+            break;
+        }
+    }
 };
 
 #endif  // OPENVPN3_DBUS_CLIENT_BACKENDSIGNALS_HPP
@@ -29,9 +29,14 @@
 #ifndef OPENVPN3_CORE_CLIENT
 #define OPENVPN3_CORE_CLIENT
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <thread>
 #include <mutex>
+#include <unordered_map>
 
 #include <openvpn/common/platform.hpp>
 
@@ -56,6 +61,36 @@
 using namespace openvpn;
 
 
+/**
+ *  Core library events handled by CoreVPNClient::event(), with the
+ *  event names used by the core library.  OTHER must be the first.
+ */
+#define CORE_CLIENT_EVENTS(X) \
+    X(OTHER) \
+    X(DYNAMIC_CHALLENGE) \
+    X(WARN) \
+    X(INFO) \
+    X(GET_CONFIG) \
+    X(TUN_SETUP_FAILED) \
+    X(TUN_IFACE_CREATE) \
+    X(TUN_IFACE_DISABLED) \
+    X(CONNECTING) \
+    X(WAIT) \
+    X(WAIT_PROXY) \
+    X(CONNECTED) \
+    X(RECONNECTING) \
+    X(PAUSE) \
+    X(RESOLVE) \
+    X(AUTH_FAILED) \
+    X(CERT_VERIFY_FAIL) \
+    X(TLS_VERSION_MIN) \
+    X(CONNECTION_TIMEOUT) \
+    X(INACTIVE_TIMEOUT) \
+    X(PROXY_ERROR) \
+    X(PROXY_NEED_CREDS) \
+    X(DISCONNECTED)
+
+
 /**
  *  Core VPN Client implementation of ClientAPI::OpenVPNClient
  */
@@ -123,7 +158,31 @@ public:
 
 
     /**
-     *  Retrieves the connection statistics of a running tunnel
+     *  Marks the start of a restart.  The time it takes until the
+     *  connection is established again is logged and reported as the
+     *  RESTART_TIME_MS statistics entry.
+     */
+    void MarkRestart()
+    {
+        restart_timer.Start();
+    }
+
+
+    /**
+     *  Marks the wake-up of the system after a suspend.  The time it
+     *  takes until the connection is established again is logged and
+     *  reported as the WAKE_TIME_MS statistics entry.
+     */
+    void MarkWake()
+    {
+        wake_timer.Start();
+    }
+
+
+    /**
+     *  Retrieves the connection statistics of a running tunnel.  The
+     *  per event type counters are not included; they are only available
+     *  through GetCounters().
      *
      * @return Returns a ConnectionStats (std::vector<ConnectionStatDetails>)
      *         blob which contains all the connection statistics.
@@ -143,17 +202,182 @@ public:
                 stats.push_back(s);
             }
         }
+
+        restart_timer.AddStats(stats, "RESTART_TIME_MS");
+        wake_timer.AddStats(stats, "WAKE_TIME_MS");
         return stats;
     }
 
+
+    /**
+     *  Retrieves all the counters of the tunnel, including those which
+     *  are zero, each with a stable ID.  This covers the core library
+     *  transport and tunnel counters (IDs from 0), the EVENT_<name>
+     *  counters (IDs from 1000) and the kernel counters of the tun
+     *  interface (IDs from 3000).  The tun counters are 0 when the
+     *  interface does not exist.
+     *
+     * @return Returns a std::vector of ConnectionStatCounter objects
+     */
+    std::vector<ConnectionStatCounter> GetCounters()
+    {
+        const int n = stats_n();
+        std::vector<long long> bundle = stats_bundle();
+
+        std::vector<ConnectionStatCounter> ret;
+        for (int i = 0; i < n; ++i)
+        {
+            ret.emplace_back(i, stats_name(i), bundle[i]);
+        }
+
+        for (size_t i = 0; i < CoreEventCount; ++i)
+        {
+            ret.emplace_back(1000 + i,
+                             std::string("EVENT_")
+                             + core_event_name((CoreEvent) i),
+                             (long long) event_counts[i].load(std::memory_order_relaxed));
+        }
+
+        static const std::array<std::pair<const char *, const char *>, 5> tun_counters = {{
+                {"TUN_RX_DROPPED", "statistics/rx_dropped"},
+                {"TUN_TX_DROPPED", "statistics/tx_dropped"},
+                {"TUN_RX_ERRORS", "statistics/rx_errors"},
+                {"TUN_TX_ERRORS", "statistics/tx_errors"},
+                {"TUN_TX_QUEUE_LEN", "tx_queue_len"}
+            }};
+        std::string tun = connection_info().tunName;
+        if (std::string::npos != tun.find('/') || '.' == tun[0])
+        {
+            tun.clear();
+        }
+        for (size_t i = 0; i < tun_counters.size(); ++i)
+        {
+            long long value = 0;
+            if (!tun.empty())
+            {
+                std::ifstream f("/sys/class/net/" + tun + "/"
+                                + tun_counters[i].second);
+                if (!(f >> value))
+                {
+                    value = 0;
+                }
+            }
+            ret.emplace_back(3000 + i, tun_counters[i].first, value);
+        }
+        return ret;
+    }
+
 private:
+    /**
+     *  Core library events handled by event().  Events not listed here
+     *  are all counted as OTHER.  The enum, the number of events and the
+     *  event names are all generated from CORE_CLIENT_EVENTS.
+     */
+    enum class CoreEvent : uint8_t
+    {
+#define CORE_CLIENT_EVENT_ENUM(name) name,
+        CORE_CLIENT_EVENTS(CORE_CLIENT_EVENT_ENUM)
+#undef CORE_CLIENT_EVENT_ENUM
+    };
+
+#define CORE_CLIENT_EVENT_COUNT(name) + 1
+    static const size_t CoreEventCount = 0 CORE_CLIENT_EVENTS(CORE_CLIENT_EVENT_COUNT);
+#undef CORE_CLIENT_EVENT_COUNT
+
+
+    /**
+     *  Core library event names, in the same order as CoreEvent
+     */
+    static const char * core_event_name(const CoreEvent ev)
+    {
+        static const std::array<const char *, CoreEventCount> names = {{
+#define CORE_CLIENT_EVENT_NAME(name) #name,
+            CORE_CLIENT_EVENTS(CORE_CLIENT_EVENT_NAME)
+#undef CORE_CLIENT_EVENT_NAME
+        }};
+        return names[(size_t) ev];
+    }
+
+
+    /**
+     *  Looks up the CoreEvent of a core library event name, with a single
+     *  hash lookup in a table built on the first call
+     *
+     * @param name  std::string with the event name
+     *
+     * @return Returns the CoreEvent, CoreEvent::OTHER if not handled
+     */
+    static CoreEvent lookup_event(const std::string& name)
+    {
+        static const std::unordered_map<std::string, CoreEvent> events = []()
+        {
+            std::unordered_map<std::string, CoreEvent> ret;
+            for (size_t i = 1; i < CoreEventCount; ++i)
+            {
+                ret.emplace(core_event_name((CoreEvent) i), (CoreEvent) i);
+            }
+            return ret;
+        }();
+
+        auto it = events.find(name);
+        return (events.end() != it ? it->second : CoreEvent::OTHER);
+    }
+
+
     std::string dc_cookie;
     unsigned long evntcount = 0;
+    std::array<std::atomic<uint64_t>, CoreEventCount> event_counts{};
     BackendSignals *signal;
     RequiresQueue *userinputq;
     std::mutex event_mutex;
     bool failed_signal_sent;
-    StatusMinor run_status;
+    std::atomic<StatusMinor> run_status;  // Read by the main loop thread
+
+    /**
+     *  Measures the time from an event, such as a restart, until the
+     *  connection is established.  Started from the D-Bus thread and
+     *  stopped from the client thread.
+     */
+    struct ReconnectTimer
+    {
+        std::atomic<std::chrono::steady_clock::rep> start{0};
+        std::atomic<long long> elapsed_ms{-1};
+
+        void Start()
+        {
+            start = std::chrono::steady_clock::now().time_since_epoch().count();
+        }
+
+        /**
+         * @return Returns the elapsed time in milliseconds since Start(),
+         *         or -1 if the timer was not started
+         */
+        long long Stop()
+        {
+            const std::chrono::steady_clock::rep t = start.exchange(0);
+            if (0 == t)
+            {
+                return -1;
+            }
+            std::chrono::steady_clock::duration elapsed =
+                std::chrono::steady_clock::now().time_since_epoch()
+                - std::chrono::steady_clock::duration(t);
+            elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+            return elapsed_ms;
+        }
+
+        void AddStats(ConnectionStats& stats, const std::string& name) const
+        {
+            const long long ms = elapsed_ms.load();
+            if (ms >= 0)
+            {
+                stats.emplace_back(name, ms);
+            }
+        }
+    };
+
+    ReconnectTimer restart_timer;
+    ReconnectTimer wake_timer;
 
     virtual bool socket_protect(int socket) override
     {
@@ -167,19 +391,27 @@ private:
      *  evaluated and sent further as D-Bus signals to the session manager
      *  whenever appropriate.
      *
+     *  This runs in the core library's client thread.  The signals are
+     *  only queued here, BackendSignals sends them from the main loop.
+     *
      * @param ev  A ClientAPI::Event object with the current event.
      */
     virtual void event(const ClientAPI::Event& ev) override
     {
         evntcount++;
 
+        const CoreEvent evtype = lookup_event(ev.name);
+        event_counts[(size_t) evtype].fetch_add(1, std::memory_order_relaxed);
+
 #ifdef DEBUG_CORE_EVENTS
         std::stringstream entry;
         entry << " EVENT [" << evntcount << "][name=" << ev.name << "]: " << ev.info;
         signal->Debug(entry.str());
 #endif
 
-        if ("DYNAMIC_CHALLENGE" == ev.name)
+        switch (evtype)
+        {
+        case CoreEvent::DYNAMIC_CHALLENGE:
         {
             dc_cookie = ev.info;
             signal->Debug("DYNAMIC_CHALLENGE: |" + dc_cookie + "|");
@@ -212,30 +444,31 @@ private:
                                      "Dynamic Challenge");
                 run_status = StatusMinor::CFG_REQUIRE_USER;
             }
+            break;
         }
-        else if ("WARN" == ev.name)
-        {
+
+        case CoreEvent::WARN:
             signal->LogWarn(ev.info);
-        }
-        else if ("INFO" == ev.name)
-        {
+            break;
+
+        case CoreEvent::INFO:
             signal->LogInfo(ev.info);
-        }
-        else if ("GET_CONFIG" == ev.name)
-        {
+            break;
+
+        case CoreEvent::GET_CONFIG:
             signal->LogVerb2("Retrieving configuration from server");
-        }
-        else if ("TUN_SETUP_FAILED" == ev.name
-                 && "TUN_IFACE_CREATE" == ev.name
-                 && "TUN_IFACE_DISABLED" == ev.name)
-        {
+            break;
+
+        case CoreEvent::TUN_SETUP_FAILED:
+        case CoreEvent::TUN_IFACE_CREATE:
+        case CoreEvent::TUN_IFACE_DISABLED:
             failed_signal_sent = true;
             signal->StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_FAILED);
             run_status = StatusMinor::CONN_FAILED;
             signal->LogCritical("Failed configuring TUN device (" + ev.name + ")");
-        }
-        else if ("CONNECTING" == ev.name)
-        {
+            break;
+
+        case CoreEvent::CONNECTING:
             // Don't log "Connecting" if we're in reconnect mode
             if (StatusMinor::CONN_RECONNECTING != run_status)
             {
@@ -243,95 +476,103 @@ private:
                 signal->StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_CONNECTING);
                 run_status = StatusMinor::CONN_CONNECTING;
             }
-        }
-        else if ("WAIT" == ev.name)
-        {
+            break;
+
+        case CoreEvent::WAIT:
             signal->LogVerb1("Waiting for server response");
-        }
-        else if ("WAIT_PROXY" == ev.name)
-        {
+            break;
+
+        case CoreEvent::WAIT_PROXY:
             signal->LogVerb1("Waiting for proxy server response");
-        }
-        else if ("CONNECTED" == ev.name)
-        {
+            break;
+
+        case CoreEvent::CONNECTED:
             signal->LogInfo("Connected: " + ev.info);
             signal->StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_CONNECTED);
             run_status = StatusMinor::CONN_CONNECTED;
-        }
-        else if ("RECONNECTING" == ev.name)
-        {
+            log_reconnect_time();
+            break;
+
+        case CoreEvent::RECONNECTING:
             signal->LogInfo("Reconnecting");
             signal->StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_RECONNECTING);
             run_status = StatusMinor::CONN_RECONNECTING;
-        }
-        else if ("RESOLVE" == ev.name)
-        {
+            break;
+
+        case CoreEvent::PAUSE:
+            // The connection to the server has been closed
+            signal->LogVerb2("Paused");
+            run_status = StatusMinor::CONN_PAUSED;
+            break;
+
+        case CoreEvent::RESOLVE:
             signal->LogVerb2("Resolving");
-        }
-        else if ("AUTH_FAILED" == ev.name)
-        {
+            break;
+
+        case CoreEvent::AUTH_FAILED:
             signal->LogVerb1("Authentication failed");
             signal->StatusChange(StatusMajor::CONNECTION,
                                  StatusMinor::CONN_AUTH_FAILED,
                                  "Authentication failed");
             run_status = StatusMinor::CONN_AUTH_FAILED;
             failed_signal_sent = true;
-        }
-        else if ("CERT_VERIFY_FAIL" == ev.name)
-        {
+            break;
+
+        case CoreEvent::CERT_VERIFY_FAIL:
             signal->LogCritical("Certificate verification failed:" + ev.info);
             signal->StatusChange(StatusMajor::CONNECTION,
                                  StatusMinor::CONN_FAILED,
                                  "Certificate verification failed");
             run_status = StatusMinor::CONN_FAILED;
             failed_signal_sent = true;
-        }
-        else if ("TLS_VERSION_MIN" == ev.name)
-        {
+            break;
+
+        case CoreEvent::TLS_VERSION_MIN:
             signal->LogCritical("TLS version is requested by server is too low:" + ev.info);
             signal->StatusChange(StatusMajor::CONNECTION,
                                  StatusMinor::CONN_FAILED,
                                  "TLS version too low");
             run_status = StatusMinor::CONN_FAILED;
             failed_signal_sent = true;
-        }
-        else if ("CONNECTION_TIMEOUT" == ev.name)
-        {
+            break;
+
+        case CoreEvent::CONNECTION_TIMEOUT:
             signal->LogInfo("Connection timeout");
             signal->StatusChange(StatusMajor::CONNECTION,
                                  StatusMinor::CONN_DISCONNECTING,
                                  "Connection timeout");
             run_status = StatusMinor::CONN_DISCONNECTING;
-        }
-        else if ("INACTIVE_TIMEOUT" == ev.name)
-        {
+            break;
+
+        case CoreEvent::INACTIVE_TIMEOUT:
             signal->LogInfo("Connection closing due to inactivity");
             signal->StatusChange(StatusMajor::CONNECTION,
                                  StatusMinor::CONN_DISCONNECTING,
                                  "Connection inactivity");
             run_status = StatusMinor::CONN_DISCONNECTING;
-        }
-        else if ("PROXY_ERROR" == ev.name)
-        {
+            break;
+
+        case CoreEvent::PROXY_ERROR:
             signal->LogCritical("Proxy connection error:" + ev.info);
             signal->StatusChange(StatusMajor::CONNECTION,
                                  StatusMinor::CONN_FAILED,
                                  "Proxy connection error");
             run_status = StatusMinor::CONN_FAILED;
             failed_signal_sent = true;
-        }
-        else if ("PROXY_NEED_CREDS" == ev.name)
-        {
+            break;
+
+        case CoreEvent::PROXY_NEED_CREDS:
             signal->StatusChange(StatusMajor::CONNECTION,
                                  StatusMinor::CONN_FAILED,
                                  "Proxy connection error");
             run_status = StatusMinor::CONN_FAILED;
             failed_signal_sent = true;
             signal->LogCritical("Proxy " + ev.info);
-        }
-        else if (!failed_signal_sent && "DISCONNECTED" == ev.name)
-        {
-            if (StatusMinor::CONN_AUTH_FAILED != run_status
+            break;
+
+        case CoreEvent::DISCONNECTED:
+            if (!failed_signal_sent
+                && StatusMinor::CONN_AUTH_FAILED != run_status
                 && StatusMinor::CFG_REQUIRE_USER != run_status)
             {
                 signal->StatusChange(StatusMajor::CONNECTION,
@@ -339,11 +580,36 @@ private:
                 run_status = StatusMinor::CONN_DISCONNECTED;
                 signal->LogInfo("Disconnected");
             }
+            break;
+
+        case CoreEvent::OTHER:
+            if (ev.fatal)
+            {
+                std::string msgtag = "[" + ev.name + "] ";
+                signal->LogFATAL(msgtag + ev.info);
+            }
+            break;
+        }
+    }
+
+
+    /**
+     *  Logs how long it took to connect again, if the connection was
+     *  restarted or the system woke up from suspend
+     */
+    void log_reconnect_time()
+    {
+        const long long restart_ms = restart_timer.Stop();
+        if (restart_ms >= 0)
+        {
+            signal->LogVerb1("Restart completed in "
+                             + std::to_string(restart_ms) + " ms");
         }
-        else if (ev.fatal)
+        const long long wake_ms = wake_timer.Stop();
+        if (wake_ms >= 0)
         {
-            std::string msgtag = "[" + ev.name + "] ";
-            signal->LogFATAL(msgtag + ev.info);
+            signal->LogVerb1("Connection resumed " + std::to_string(wake_ms)
+                             + " ms after system wake-up");
         }
     }
 
@@ -30,7 +30,10 @@
  *         starts also runs with the appropriate privileges.
  */
 
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <set>
 
 #include <openvpn/common/rc.hpp>
 
@@ -109,16 +112,25 @@ public:
      * @param dbuscon  D-Bus this object is tied to
      * @param busname  D-Bus bus name this service is registered on
      * @param objpath  D-Bus object path to this object
+     * @param client_args   Command line to start a backend client process
+     * @param log_level     Log level to use
+     * @param signal_broadcast  Broadcast all signals instead of sending
+     *                      them only to the log service
+     * @param multi_tunnel  Number of VPN sessions to host in each backend
+     *                      client process.  With 0, each VPN session runs
+     *                      in its own backend client process.
      */
     BackendStarterObject(GDBusConnection *dbuscon, const std::string busname,
                          const std::string objpath,
                          const std::vector<std::string> client_args,
                          unsigned int log_level,
-                         bool signal_broadcast)
+                         bool signal_broadcast,
+                         unsigned int multi_tunnel)
         : DBusObject(objpath),
           BackendStarterSignals(dbuscon, objpath, log_level),
           dbuscon(dbuscon),
-          client_args(client_args)
+          client_args(client_args),
+          multi_tunnel(multi_tunnel)
     {
         if (!signal_broadcast)
         {
@@ -145,6 +157,7 @@ public:
     ~BackendStarterObject()
     {
         LogInfo("Shutting down");
+        stop_host_wait();
         RemoveObject(dbuscon);
     }
 
@@ -179,16 +192,23 @@ public:
             // from the request
             gchar *token = nullptr;
             g_variant_get (params, "(s)", &token);
-            pid_t backend_pid = start_backend_process(token);
-            if (-1 == backend_pid)
+            std::string start_token(token);
+            g_free(token);
+
+            if (0 == multi_tunnel)
+            {
+                reply_start_client(invoc, start_backend_process(start_token, {}));
+            }
+            else if (hosted_busy)
+            {
+                // Another session is being started; this one is started
+                // when it is done, possibly in the same new process
+                queued_starts.push_back(QueuedStart{invoc, start_token});
+            }
+            else
             {
-                GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.backend",
-                                                              "Backend client process died");
-                g_dbus_method_invocation_return_gerror(invoc, err);
-                g_error_free(err);
-                return;
+                start_hosted_session(invoc, start_token);
             }
-            g_dbus_method_invocation_return_value(invoc, g_variant_new("(u)", backend_pid));
         }
     };
 
@@ -270,6 +290,328 @@ public:
 private:
     GDBusConnection *dbuscon;
     const std::vector<std::string> client_args;
+    const unsigned int multi_tunnel;
+    unsigned long host_counter = 0;
+
+
+    /**
+     *  A StartClient call waiting for a new backend client process
+     *  to appear on the D-Bus
+     */
+    struct HostWait
+    {
+        std::string host_id;
+        GDBusMethodInvocation *invoc;
+        pid_t pid;
+        guint watch_id;
+        guint timeout_id;
+    };
+    std::unique_ptr<HostWait> host_wait;
+    bool hosted_busy = false;
+
+
+    /**
+     *  A StartClient call received while waiting for a new backend
+     *  client process
+     */
+    struct QueuedStart
+    {
+        GDBusMethodInvocation *invoc;
+        std::string token;
+    };
+    std::deque<QueuedStart> queued_starts;
+
+
+    /**
+     *  A StartClient call being offered to the running backend client
+     *  processes.  It is passed as the user data of the asynchronous
+     *  StartSession calls.
+     */
+    struct HostedStart
+    {
+        Ptr self;
+        GDBusMethodInvocation *invoc;
+        std::string token;
+        std::set<std::string> hosts;
+        std::set<std::string> tried;
+        std::string current_host;
+    };
+
+
+    /**
+     *  Sends the result of a StartClient method call
+     *
+     * @param invoc  GDBusMethodInvocation of the StartClient call
+     * @param pid    Process ID of the process the session runs in,
+     *               -1 on errors
+     */
+    void reply_start_client(GDBusMethodInvocation *invoc, pid_t pid)
+    {
+        if (-1 == pid)
+        {
+            GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.backend",
+                                                          "Backend client process died");
+            g_dbus_method_invocation_return_gerror(invoc, err);
+            g_error_free(err);
+            return;
+        }
+        g_dbus_method_invocation_return_value(invoc, g_variant_new("(u)", pid));
+    }
+
+
+    /**
+     *  Retrieves the host IDs of all the running backend client processes
+     *  hosting several VPN sessions.
+     *
+     * @return Returns a std::set of host ID strings
+     */
+    std::set<std::string> get_hosts()
+    {
+        std::set<std::string> ret;
+
+        DBusConnectionCreds dbussrv(dbuscon);
+        GVariant *res = dbussrv.Call("ListNames");
+        GVariantIter *names = nullptr;
+        g_variant_get(res, "(as)", &names);
+        gchar *name = nullptr;
+        while (g_variant_iter_loop(names, "s", &name))
+        {
+            std::string n(name);
+            if (0 == n.compare(0, OpenVPN3DBus_name_backends_host.size(),
+                               OpenVPN3DBus_name_backends_host))
+            {
+                ret.insert(n.substr(OpenVPN3DBus_name_backends_host.size()));
+            }
+        }
+        g_variant_iter_free(names);
+        g_variant_unref(res);
+        return ret;
+    }
+
+
+    /**
+     *  Starts a VPN session in one of the running backend client processes
+     *  hosting several VPN sessions.  The running processes are asked one
+     *  at a time, without blocking the main loop while they respond.  If
+     *  none of them can take another session, a new backend client process
+     *  is started.  The StartClient call is then replied to when the new
+     *  process is ready, so the next session can be started in it as well.
+     *
+     *  Only one such start is processed at a time; StartClient calls
+     *  arriving meanwhile are queued and processed by
+     *  hosted_session_done().
+     *
+     * @param invoc  GDBusMethodInvocation of the StartClient call
+     * @param token  String containing the start token identifying the session
+     *               object this process is tied to.
+     */
+    void start_hosted_session(GDBusMethodInvocation *invoc,
+                              const std::string& token)
+    {
+        hosted_busy = true;
+
+        std::set<std::string> hosts;
+        try
+        {
+            hosts = get_hosts();
+        }
+        catch (DBusException& excp)
+        {
+            LogError("Could not retrieve the running backend client "
+                     "processes: " + std::string(excp.what()));
+        }
+
+        try_next_host(new HostedStart{Ptr(this), invoc, token,
+                                      std::move(hosts), {}, {}});
+    }
+
+
+    /**
+     *  Asks the next running backend client process which has not been
+     *  tried yet to start the session.  When all have been tried, a new
+     *  backend client process is started instead.
+     *
+     * @param hs  HostedStart object of the StartClient call, which is
+     *            taken over by this method
+     */
+    void try_next_host(HostedStart *hs)
+    {
+        for (const auto& host_id : hs->hosts)
+        {
+            if (hs->tried.end() != hs->tried.find(host_id))
+            {
+                continue;
+            }
+            hs->tried.insert(host_id);
+            hs->current_host = host_id;
+            g_dbus_connection_call(dbuscon,
+                                   (OpenVPN3DBus_name_backends_host + host_id).c_str(),
+                                   OpenVPN3DBus_rootp_backends_manager.c_str(),
+                                   OpenVPN3DBus_interf_backends_manager.c_str(),
+                                   "StartSession",
+                                   g_variant_new("(s)", hs->token.c_str()),
+                                   G_VARIANT_TYPE("(u)"),
+                                   G_DBUS_CALL_FLAGS_NO_AUTO_START,
+                                   -1, nullptr,
+                                   start_session_reply_cb, hs);
+            return;
+        }
+
+        std::unique_ptr<HostedStart> done(hs);
+        start_host_process(done->invoc, done->token, done->hosts);
+    }
+
+
+    static void start_session_reply_cb(GObject *source, GAsyncResult *result,
+                                       gpointer hs_ptr)
+    {
+        HostedStart *hs = static_cast<HostedStart *>(hs_ptr);
+        Ptr self = hs->self;
+        const std::string host_id = hs->current_host;
+
+        GError *err = nullptr;
+        GVariant *res = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source),
+                                                      result, &err);
+        if (res)
+        {
+            guint32 pid = 0;
+            g_variant_get(res, "(u)", &pid);
+            g_variant_unref(res);
+
+            self->LogVerb2("Session (" + hs->token + ") started in "
+                           + "backend client process " + host_id);
+            self->reply_start_client(hs->invoc, pid);
+            delete hs;
+            self->hosted_session_done();
+            return;
+        }
+
+        gchar *remote_err = g_dbus_error_get_remote_error(err);
+        if (!remote_err
+            || std::string("net.openvpn.v3.backend.error.host-full") != remote_err)
+        {
+            g_dbus_error_strip_remote_error(err);
+            self->LogWarn("Could not start session in backend client "
+                          "process " + host_id + ": " + std::string(err->message));
+        }
+        g_free(remote_err);
+        g_error_free(err);
+
+        self->try_next_host(hs);
+    }
+
+
+    /**
+     *  Starts a new backend client process hosting several VPN sessions,
+     *  with the given session as its first one.
+     *
+     * @param invoc  GDBusMethodInvocation of the StartClient call
+     * @param token  String containing the start token of the session
+     * @param hosts  Host IDs of the already running backend client processes
+     */
+    void start_host_process(GDBusMethodInvocation *invoc,
+                            const std::string& token,
+                            const std::set<std::string>& hosts)
+    {
+        // The host ID must not clash with a process started by an
+        // earlier instance of this service.
+        std::string host_id;
+        do
+        {
+            host_id = std::to_string(getpid()) + "_" + std::to_string(++host_counter);
+        } while (hosts.end() != hosts.find(host_id));
+
+        pid_t backend_pid = start_backend_process(token,
+                                                  {"--multi-tunnel", host_id,
+                                                   "--max-sessions",
+                                                   std::to_string(multi_tunnel)});
+        if (backend_pid <= 0)
+        {
+            reply_start_client(invoc, backend_pid);
+            hosted_session_done();
+            return;
+        }
+
+        // The new process is ready for more VPN sessions once it owns
+        // its bus name.  Until then, further StartClient calls are queued.
+        host_wait.reset(new HostWait{host_id, invoc, backend_pid, 0, 0});
+        host_wait->watch_id = g_bus_watch_name_on_connection(
+                                      dbuscon,
+                                      (OpenVPN3DBus_name_backends_host + host_id).c_str(),
+                                      G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                      host_appeared_cb, nullptr,
+                                      this, nullptr);
+        host_wait->timeout_id = g_timeout_add_seconds(5, host_wait_timeout_cb,
+                                                      this);
+    }
+
+
+    static void host_appeared_cb(GDBusConnection *conn, const gchar *name,
+                                 const gchar *name_owner, gpointer this_ptr)
+    {
+        BackendStarterObject *self = static_cast<BackendStarterObject *>(this_ptr);
+        GDBusMethodInvocation *invoc = self->host_wait->invoc;
+        pid_t pid = self->host_wait->pid;
+        self->stop_host_wait();
+        self->reply_start_client(invoc, pid);
+        self->hosted_session_done();
+    }
+
+
+    /**
+     *  The new backend client process did not claim its bus name in time.
+     *  Its session is reported as failed, and the queued sessions are
+     *  started among the processes which are actually on the D-Bus.
+     */
+    static gboolean host_wait_timeout_cb(gpointer this_ptr)
+    {
+        BackendStarterObject *self = static_cast<BackendStarterObject *>(this_ptr);
+        self->host_wait->timeout_id = 0;
+        self->LogError("Backend client process " + self->host_wait->host_id
+                       + " did not appear on the D-Bus");
+
+        GDBusMethodInvocation *invoc = self->host_wait->invoc;
+        self->stop_host_wait();
+        GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.backend",
+                                                      "Backend client process did not start");
+        g_dbus_method_invocation_return_gerror(invoc, err);
+        g_error_free(err);
+
+        self->hosted_session_done();
+        return G_SOURCE_REMOVE;
+    }
+
+
+    /**
+     *  Called when a StartClient call started by start_hosted_session()
+     *  has been replied to.  Processes the next queued StartClient call.
+     */
+    void hosted_session_done()
+    {
+        hosted_busy = false;
+        if (!queued_starts.empty())
+        {
+            QueuedStart next = queued_starts.front();
+            queued_starts.pop_front();
+            start_hosted_session(next.invoc, next.token);
+        }
+    }
+
+
+    void stop_host_wait()
+    {
+        if (!host_wait)
+        {
+            return;
+        }
+        g_bus_unwatch_name(host_wait->watch_id);
+        if (host_wait->timeout_id > 0)
+        {
+            g_source_remove(host_wait->timeout_id);
+        }
+        host_wait.reset();
+    }
+
 
     /**
      * Forks out a child thread which starts the openvpn3-service-client
@@ -277,9 +619,12 @@ private:
      *
      * @param token  String containing the start token identifying the session
      *               object this process is tied to.
+     * @param extra_args  Additional command line arguments for this
+     *               process.
      * @return Returns the process ID (pid) of the child process.
      */
-    pid_t start_backend_process(char * token)
+    pid_t start_backend_process(const std::string& token,
+                                const std::vector<std::string>& extra_args)
     {
         pid_t backend_pid = fork();
         if (0 == backend_pid)
@@ -292,14 +637,18 @@ private:
             //  to stdout, which will be picked up by other logs on the
             //  system
             //
-            char *args[client_args.size()+2];
+            char *args[client_args.size()+extra_args.size()+2];
             unsigned int i = 0;
 
             for (const auto& arg : client_args)
             {
                 args[i++] = (char *) strdup(arg.c_str());
             }
-            args[i++] = token;
+            for (const auto& arg : extra_args)
+            {
+                args[i++] = (char *) strdup(arg.c_str());
+            }
+            args[i++] = (char *) strdup(token.c_str());
             args[i++] = nullptr;
 
 #ifdef DEBUG_OPTIONS
@@ -327,6 +676,10 @@ private:
             {
                 cmdline << c << " ";
             }
+            for (auto const& c : extra_args)
+            {
+                cmdline << c << " ";
+            }
             cmdline << token;
             LogVerb2(cmdline.str());
 
@@ -366,7 +719,8 @@ public:
     BackendStarterDBus(GDBusConnection *conn,
                        const std::vector<std::string> cliargs,
                        unsigned int log_level,
-                       bool signal_broadcast)
+                       bool signal_broadcast,
+                       unsigned int multi_tunnel)
         : DBus(conn,
                OpenVPN3DBus_name_backends,
                OpenVPN3DBus_rootp_backends,
@@ -374,6 +728,7 @@ public:
           mainobj(nullptr),
           log_level(log_level),
           signal_broadcast(signal_broadcast),
+          multi_tunnel(multi_tunnel),
           procsig(nullptr),
           client_args(cliargs)
     {
@@ -397,7 +752,8 @@ public:
     {
         mainobj.reset(new BackendStarterObject(GetConnection(), GetBusName(),
                                                GetRootPath(), client_args,
-                                               log_level, signal_broadcast));
+                                               log_level, signal_broadcast,
+                                               multi_tunnel));
         mainobj->RegisterObject(GetConnection());
 
         procsig->ProcessChange(StatusMinor::PROC_STARTED);
@@ -443,6 +799,7 @@ private:
     BackendStarterObject::Ptr mainobj;
     unsigned int log_level = 3;
     bool signal_broadcast = true;
+    unsigned int multi_tunnel = 0;
     ProcessSignalProducer::Ptr procsig;
     std::vector<std::string> client_args;
 };
@@ -502,6 +859,19 @@ int backend_starter(ParsedArgs args)
     {
         client_args.push_back("--signal-broadcast");
     }
+    if (args.Present("client-pause-on-sleep"))
+    {
+        client_args.push_back("--pause-on-sleep");
+    }
+    for (const std::string opt : {"cpu-affinity", "sched-policy", "nice", "numa-node",
+                                  "sleep-monitor-service", "stats-windows"})
+    {
+        if (args.Present("client-" + opt))
+        {
+            client_args.push_back("--" + opt);
+            client_args.push_back(args.GetValue("client-" + opt, 0));
+        }
+    }
 
     unsigned int log_level = 3;
     if (args.Present("log-level"))
@@ -526,8 +896,15 @@ int backend_starter(ParsedArgs args)
         logsrvprx->Attach(OpenVPN3DBus_interf_backends);
     }
 
+    unsigned int multi_tunnel = 0;
+    if (args.Present("multi-tunnel"))
+    {
+        int sessions = std::atoi(args.GetValue("multi-tunnel", 0).c_str());
+        multi_tunnel = (sessions > 0 ? sessions : 0);
+    }
+
     BackendStarterDBus backstart(dbus.GetConnection(), client_args,
-                                 log_level, signal_broadcast);
+                                 log_level, signal_broadcast, multi_tunnel);
 
     IdleCheck::Ptr idle_exit;
     if (idle_wait_sec > 0)
@@ -584,6 +961,10 @@ int main(int argc, char **argv)
     cmd.AddOption("idle-exit", "SECONDS", true,
                   "How long to wait before exiting if being idle. "
                   "0 disables it (Default: 10 seconds)");
+    cmd.AddOption("multi-tunnel", "SESSIONS", true,
+                  "Run up to SESSIONS VPN sessions in each "
+                  "openvpn3-service-client process instead of one process "
+                  "per VPN session");
 #ifdef DEBUG_OPTIONS
     cmd.AddOption("run-via", 0, "DEBUG_PROGAM", true,
                   "Debug option: Run openvpn3-service-client via provided executable (full path required)");
@@ -602,6 +983,20 @@ int main(int argc, char **argv)
                   "Adds the --colour argument to openvpn3-service-client");
     cmd.AddOption("client-signal-broadcast", 0,
                   "Debug option: Adds the --signal-broadcast argument to openvpn3-service-client");
+    cmd.AddOption("client-cpu-affinity", "CPUS", true,
+                  "Adds the --cpu-affinity CPUS argument to openvpn3-service-client");
+    cmd.AddOption("client-sched-policy", "POLICY", true,
+                  "Adds the --sched-policy POLICY argument to openvpn3-service-client");
+    cmd.AddOption("client-nice", "NICE", true,
+                  "Adds the --nice NICE argument to openvpn3-service-client");
+    cmd.AddOption("client-numa-node", "NODE", true,
+                  "Adds the --numa-node NODE argument to openvpn3-service-client");
+    cmd.AddOption("client-pause-on-sleep", 0,
+                  "Adds the --pause-on-sleep argument to openvpn3-service-client");
+    cmd.AddOption("client-sleep-monitor-service", "NAME", true,
+                  "Adds the --sleep-monitor-service NAME argument to openvpn3-service-client");
+    cmd.AddOption("client-stats-windows", "LIST", true,
+                  "Adds the --stats-windows LIST argument to openvpn3-service-client");
 
     try
     {
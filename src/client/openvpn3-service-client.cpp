@@ -33,10 +33,14 @@
  *         connection.
  */
 
+#include <atomic>
+#include <functional>
+#include <map>
 #include <sstream>
 
 #define SHUTDOWN_NOTIF_PROCESS_NAME "openvpn3-service-client"
 #include "common/requiresqueue.hpp"
+#include "common/thread-placement.hpp"
 #include "common/utils.hpp"
 #include "common/cmdargparser.hpp"
 #include "configmgr/proxy-configmgr.hpp"
@@ -45,9 +49,12 @@
 #include "dbus/path.hpp"
 #include "log/ansicolours.hpp"
 #include "log/dbus-log.hpp"
+#include "log/log-negotiation.hpp"
 #include "log/logwriter.hpp"
 #include "log/proxy-log.hpp"
 #include "backend-signals.hpp"
+#include "sleep-monitor.hpp"
+#include "statistics-history.hpp"
 #include "core-client.hpp"
 
 using namespace openvpn;
@@ -76,6 +83,9 @@ public:
      *                       itself with the session manager.  This token
      *                       is provided on the command line when starting
      *                       this openvpn3-service-client process.
+     * @param default_log_level  Log level to use until a log consumer
+     *                       requests a log level
+     * @param logwr          LogWriter to use for local logging
      */
     BackendClientObject(GDBusConnection *conn, std::string bus_name,
                          std::string objpath, std::string session_token,
@@ -83,8 +93,8 @@ public:
         : DBusObject(objpath),
           DBusConnectionCreds(conn),
           dbusconn(conn),
-          mainloop(nullptr),
           signal(conn, LogGroup::CLIENT, objpath, logwr),
+          log_levels(default_log_level),
           signal_broadcast(false),
           session_token(session_token),
           registered(false),
@@ -92,10 +102,7 @@ public:
           vpnclient(nullptr),
           client_thread(nullptr)
     {
-        // Initialize the VPN Core
-        CoreVPNClient::init_process();
-
-        signal.SetLogLevel(default_log_level);
+        signal.SetLogLevel(log_levels.GetLogLevel());
 
         std::stringstream introspection_xml;
         introspection_xml << "<node name='" << objpath << "'>"
@@ -134,11 +141,16 @@ public:
                           << "            <arg type='s' name='token' direction='out'/>"
                           << "        </signal>"
                           << "        <property type='a{sx}' name='statistics' access='read'/>"
+                          << "        <property type='(ta(usx)a(uad))' name='statistics_details' access='read'/>"
                           << "        <property type='(uus)' name='status' access='read'/>"
                           <<  "    </interface>"
                           <<  "</node>";
         ParseIntrospectionXML(introspection_xml);
 
+        // Sample the counters regularly, for the rates in the
+        // statistics_details property
+        stats_sampler = g_timeout_add_seconds(1, stats_sampler_cb, this);
+
         // Tell the session manager we are ready.  This
         // request will also carry the correct object path
         // in the response automatically, but the well-known
@@ -155,20 +167,76 @@ public:
 
     ~BackendClientObject()
     {
-        CoreVPNClient::uninit_process();
+        // Normally removed by finish_shutdown() already
+        if (stats_sampler > 0)
+        {
+            g_source_remove(stats_sampler);
+        }
+        stop_client_thread();
     }
 
 
     /**
-     *  Provides a reference to the Glib2 main loop object.  This is used
-     *  to cleanly shutdown this process when the session manager wants to
-     *  shutdown this process via D-Bus.
+     *  Sets the function to call when this session has been shut down
+     *  and the object can be removed.  Without it, this process is
+     *  terminated instead.
      *
-     * @param ml   GMainLoop pointer to the current main loop thread
+     * @param cb  std::function<void()> to call when the session is done
      */
-    void SetMainLoop(GMainLoop *ml)
+    void SetRemoveCallback(std::function<void()> cb)
     {
-        mainloop = ml;
+        remove_callback = std::move(cb);
+    }
+
+
+    /**
+     *  Sends the summary of repeated log events which has not been
+     *  sent yet.  Used when this process stops while the session is
+     *  still running.
+     */
+    void FlushLog()
+    {
+        signal.FlushLog();
+    }
+
+
+    /**
+     *  Sets the CPU affinity, scheduling and NUMA node settings of the
+     *  VPN client thread.  These can be changed per configuration profile
+     *  via overrides.
+     *
+     * @param tp  ThreadPlacement with the settings to use by default
+     */
+    void SetThreadPlacement(const ThreadPlacement& tp)
+    {
+        default_placement = tp;
+        placement = tp;
+    }
+
+
+    /**
+     *  Sets the time windows the rates in the statistics_details
+     *  property are calculated over
+     *
+     * @param windows  std::vector of windows in seconds
+     */
+    void SetStatisticsWindows(const std::vector<unsigned int>& windows)
+    {
+        stats_history.SetWindows(windows);
+    }
+
+
+    /**
+     *  Used when several sessions share this process.  A fatal error in
+     *  this session will then only shut down this session, instead of
+     *  terminating the whole process.
+     */
+    void IsolateFatalErrors()
+    {
+        signal.SetFatalHandler([this]()
+                               {
+                                   shutdown_session();
+                               });
     }
 
 
@@ -186,6 +254,111 @@ public:
     }
 
 
+    /**
+     *  Called before the system is suspended and after it has woken up.
+     *
+     *  Before suspending, a running connection is paused, which closes
+     *  the connection to the server gracefully.  After wake-up it is
+     *  resumed, which connects to the server again right away instead of
+     *  waiting for the keepalive to time out on a connection which went
+     *  stale during the suspend.  Connections paused via the Pause method
+     *  are left alone.
+     *
+     * @param sleeping  Boolean, true before suspending, false after wake-up
+     */
+    void PrepareForSleep(bool sleeping)
+    {
+        std::lock_guard<std::mutex> lg(guard);
+
+        if (sleeping)
+        {
+            if (paused || !connection_active())
+            {
+                return;
+            }
+            signal.LogInfo("Pausing connection for system suspend: "
+                           + GetObjectPath());
+            signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_PAUSING,
+                                "Reason: system suspend");
+            vpnclient->pause("system suspend");
+            paused = true;
+            paused_for_sleep = true;
+            signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_PAUSED);
+        }
+        else if (paused_for_sleep)
+        {
+            paused_for_sleep = false;
+            if (!paused || !vpnclient)
+            {
+                return;
+            }
+            signal.LogInfo("Resuming connection after system suspend: "
+                           + GetObjectPath());
+            signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_RESUMING);
+            vpnclient->MarkWake();
+            vpnclient->resume();
+            paused = false;
+        }
+        else if (!paused && connection_active())
+        {
+            // The connection was not paused before the suspend, most
+            // likely as the system was suspended before this process
+            // could react.  Renegotiate right away.
+            signal.LogInfo("Reconnecting after system suspend: "
+                           + GetObjectPath());
+            vpnclient->MarkWake();
+            vpnclient->reconnect(0);
+        }
+    }
+
+
+    /**
+     *  Checks if a connection paused by PrepareForSleep() has been paused
+     *  by the core library, which is when the connection to the server
+     *  has been closed.
+     *
+     * @return Returns true if the system may be suspended
+     */
+    bool SleepPauseCompleted()
+    {
+        std::lock_guard<std::mutex> lg(guard);
+
+        if (!paused_for_sleep || !client_running || !vpnclient)
+        {
+            return true;
+        }
+        return StatusMinor::CONN_PAUSED == vpnclient->GetRunStatus()
+               || !connection_active();
+    }
+
+
+    /**
+     *  Sets the log level a log consumer wants to receive.  Log events
+     *  are discarded at the source unless the highest log level requested
+     *  by any of the log consumers allows them.
+     *
+     * @param consumer  std::string identifying the log consumer
+     * @param level     unsigned int with the requested log level (0-6)
+     */
+    void RequestLogLevel(const std::string& consumer, unsigned int level)
+    {
+        if (log_levels.Request(consumer, level))
+        {
+            signal.SetLogLevel(log_levels.GetLogLevel());
+        }
+    }
+
+
+    /**
+     * @return Returns the log level in use, as negotiated with the
+     *         log consumers
+     */
+    unsigned int GetLogLevel()
+    {
+        return signal.GetLogLevel();
+    }
+
+
     /**
      *  Callback method which is called each time a D-Bus method call occurs
      *  on this BackendClientObject.
@@ -208,6 +381,7 @@ public:
                               GVariant *params,
                               GDBusMethodInvocation *invoc)
     {
+        const MethodID method_id = lookup_method_id(method_name);
         // Ensure D-Bus method calls are serialized
         std::lock_guard<std::mutex> lg(guard);
 
@@ -234,7 +408,7 @@ public:
                 }
             }
 
-            if ("RegistrationConfirmation" == method_name)
+            if (MethodID::REGISTRATION_CONFIRMATION == method_id)
             {
                 // This is called by the session manager only, as an
                 // acknowledgement from the session manager that it has
@@ -299,7 +473,7 @@ public:
                 }
                 return;
             }
-            else if ("Ping" == method_name)
+            else if (MethodID::PING == method_id)
             {
                 // This is a more narrow Ping test than what the D-Bus
                 // infrastructure provides.  This is a ping response from this
@@ -309,7 +483,7 @@ public:
                 g_dbus_method_invocation_return_value(invoc, g_variant_new("(b)", (bool) true));
                 return;
             }
-            else if ("Ready" == method_name)
+            else if (MethodID::READY == method_id)
             {
                 // This method should just exit without any result if everything is okay.
                 // If there are issues, return an error message
@@ -321,7 +495,7 @@ public:
                     g_error_free(err);
                 }
             }
-            else if ("Connect" == method_name)
+            else if (MethodID::CONNECT == method_id)
             {
                 // This starts the connection against a VPN server
 
@@ -330,6 +504,15 @@ public:
                     THROW_DBUSEXCEPTION("BackendServiceObject", "Backend service is not initialized");
                 }
 
+                if (connection_active())
+                {
+                    GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.backend",
+                                                                  "Connection is already running");
+                    g_dbus_method_invocation_return_gerror(invoc, err);
+                    g_error_free(err);
+                    return;
+                }
+
                 // This re-initializes the client object.  If we have already
                 // tried to connectbut got an AUTH_FAILED, either due to wrong
                 // credentials or a dynamic challenge from the server, we
@@ -347,10 +530,10 @@ public:
                 signal.LogInfo("Starting connection: " + to_string(obj_path));
                 connect();
             }
-            else if ("Disconnect" == method_name)
+            else if (MethodID::DISCONNECT == method_id)
             {
                 // Disconnect from the server.  This will also shutdown this
-                // process.
+                // session, and this process unless it hosts other sessions.
 
                 if (!registered || !vpnclient)
                 {
@@ -359,25 +542,12 @@ public:
 
                 signal.LogInfo("Stopping connection: " + to_string(obj_path));
                 signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_DISCONNECTING);
-                vpnclient->stop();
-                if (client_thread)
-                {
-                    client_thread->join();
-                }
-                signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_DONE);
 
-                // Shutting down our selves.
-                RemoveObject(dbusconn);
-                if (mainloop)
-                {
-                    g_main_loop_quit(mainloop);
-                }
-                else
-                {
-                    kill(getpid(), SIGTERM);
-                }
+                // Shutting down our selves.  CONN_DONE is sent when
+                // the client thread has returned.
+                shutdown_session(true);
             }
-            else if ("UserInputQueueGetTypeGroup"  == method_name)
+            else if (MethodID::USER_INPUT_QUEUE_GET_TYPE_GROUP == method_id)
             {
                 // Return an array of tuples of ClientAttentionTypes and
                 // ClientAttentionGroups which needs to be satisfied before
@@ -394,7 +564,7 @@ public:
                 }
                 return; // QueueCheckTypeGroup() have fed invoc with a result already
             }
-            else if ("UserInputQueueFetch"  == method_name)
+            else if (MethodID::USER_INPUT_QUEUE_FETCH == method_id)
             {
                 // Retrieves a specific RequiresQueue item which the front-end
                 // needs to satisfy.
@@ -409,7 +579,7 @@ public:
                 }
                 return; // QueueFetch() have fed invoc with a result already
             }
-            else if ("UserInputQueueCheck" == method_name)
+            else if (MethodID::USER_INPUT_QUEUE_CHECK == method_id)
             {
                 // Retrieve the RequiresSlot IDs for a specific
                 // ClientAttentionType/ClientAttentionGroup which needs to be
@@ -418,7 +588,7 @@ public:
                 userinputq.QueueCheck(invoc, params);
                 return; // QueueCheck() have fed invoc with a result already
             }
-            else if ("UserInputProvide" == method_name)
+            else if (MethodID::USER_INPUT_PROVIDE == method_id)
             {
                 // This is called each time a RequiresSlot gets an update
                 // with data from the front-end.
@@ -438,7 +608,7 @@ public:
                 }
                 userinputq.UpdateEntry(invoc, params);
             }
-            else if ("Pause" == method_name)
+            else if (MethodID::PAUSE == method_id)
             {
                 // Pauses and suspends an on-going and connected VPN tunnel.
                 // The reason message provided with this call is sent to the
@@ -469,7 +639,7 @@ public:
                 paused = true;
                 signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_PAUSED);
             }
-            else if ("Resume" == method_name)
+            else if (MethodID::RESUME == method_id)
             {
                 // Resumes an already paused VPN session
 
@@ -491,25 +661,37 @@ public:
                 signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_RESUMING);
                 vpnclient->resume();
                 paused = false;
+                paused_for_sleep = false;
             }
-            else if ("Restart" == method_name)
+            else if (MethodID::RESTART == method_id)
             {
                 // Does a complete re-connect for an already running VPN
                 // session.  This will reuse all the credentials already
-                // gathered.
+                // gathered.  If the connection has already ended, a warm
+                // restart is done, which reuses the configuration and
+                // credentials kept in this process instead of requiring
+                // a new session.
 
-                if (!registered || !vpnclient)
+                if (!registered)
                 {
                     THROW_DBUSEXCEPTION("BackendServiceObject", "Backend service is not initialized");
                 }
                 signal.LogInfo("Restarting connection: " + to_string(obj_path));
-                signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_RECONNECTING);
-                vpnclient->reconnect(0);
+                if (connection_active())
+                {
+                    signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_RECONNECTING);
+                    vpnclient->MarkRestart();
+                    vpnclient->reconnect(0);
+                }
+                else
+                {
+                    warm_restart();
+                }
             }
-            else if ("ForceShutdown" == method_name)
+            else if (MethodID::FORCE_SHUTDOWN == method_id)
             {
-                // This is an emergency break for this process.  This
-                // kills this process without considering if we are in
+                // This is an emergency break for this session.  This
+                // kills this session without considering if we are in
                 // an already running state.  This is primarily used to
                 // clean-up stray session objects which is considered dead
                 // by the session manager.
@@ -518,15 +700,7 @@ public:
                 signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_DONE);
 
                 // Shutting down our selves.
-                RemoveObject(dbusconn);
-                if (mainloop)
-                {
-                    g_main_loop_quit(mainloop);
-                }
-                else
-                {
-                    kill(getpid(), SIGTERM);
-                }
+                shutdown_session();
             }
             else
             {
@@ -582,6 +756,7 @@ public:
                                      const std::string property_name,
                                      GError **error)
     {
+        const PropertyID prop_id = lookup_property_id(property_name);
         try {
             // Only the session manager is allowed to get properties
             validate_sender(sender);
@@ -589,7 +764,7 @@ public:
             // Access to properties are controled by the D-Bus policy.
             // Normally only the session manager should have access to
             // to these properties.
-            if ("statistics" == property_name)
+            if (PropertyID::STATISTICS == prop_id)
             {
                 // Returns the current statistics for a running and connected
                 // VPN session
@@ -606,11 +781,45 @@ public:
                 g_variant_builder_unref(b);
                 return ret;
             }
-            else if ("status" == property_name)
+            else if (PropertyID::STATISTICS_DETAILS == prop_id)
+            {
+                // Returns all the counters with their IDs, including
+                // those being zero, and the rate of each counter over
+                // each of the statistics windows.  The timestamp is
+                // the CLOCK_MONOTONIC time of the snapshot, in microseconds.
+                ConnectionStatsSnapshot snap = get_stats_snapshot();
+
+                GVariantBuilder *cb = g_variant_builder_new(G_VARIANT_TYPE("a(usx)"));
+                for (auto& c : snap.counters)
+                {
+                    g_variant_builder_add(cb, "(usx)",
+                                          c.id, c.name.c_str(), c.value);
+                }
+
+                GVariantBuilder *rb = g_variant_builder_new(G_VARIANT_TYPE("a(uad)"));
+                for (auto& r : snap.rates)
+                {
+                    GVariantBuilder *vb = g_variant_builder_new(G_VARIANT_TYPE("ad"));
+                    for (auto& v : r.per_second)
+                    {
+                        g_variant_builder_add(vb, "d", v);
+                    }
+                    g_variant_builder_add(rb, "(uad)", r.window_secs, vb);
+                    g_variant_builder_unref(vb);
+                }
+
+                GVariant *ret = g_variant_new("(ta(usx)a(uad))",
+                                              (guint64) snap.timestamp_us,
+                                              cb, rb);
+                g_variant_builder_unref(cb);
+                g_variant_builder_unref(rb);
+                return ret;
+            }
+            else if (PropertyID::STATUS == prop_id)
             {
                 return signal.GetLastStatusChange();
             }
-            else if ("log_level" == property_name)
+            else if (PropertyID::LOG_LEVEL == prop_id)
             {
                 return g_variant_new_uint32(signal.GetLogLevel());
             }
@@ -662,10 +871,21 @@ public:
 
             if ("log_level" == property_name)
             {
+                // This is the log level the session manager wants,
+                // the log level used may be higher if other log
+                // consumers request that
                 unsigned int log_verb = g_variant_get_uint32(value);
-                signal.SetLogLevel(log_verb);
+                if (log_verb > 6)
+                {
+                    throw DBusPropertyException(G_IO_ERROR,
+                                                G_IO_ERROR_INVALID_DATA,
+                                                obj_path, intf_name,
+                                                property_name,
+                                                "Invalid log level");
+                }
+                RequestLogLevel("session-manager", log_verb);
                 return build_set_property_response(property_name,
-                                                   (guint32) log_verb);
+                                                   (guint32) GetLogLevel());
             }
         }
         catch (DBusCredentialsException& excp)
@@ -688,15 +908,26 @@ public:
 
 private:
     GDBusConnection *dbusconn;
-    GMainLoop *mainloop;
+    std::function<void()> remove_callback;
+    std::atomic<bool> shutdown_done{false};
+    bool shutdown_finished = false;
+    bool report_done = false;
     BackendSignals signal;
+    LogLevelNegotiator log_levels;
     bool signal_broadcast;
     std::string session_token;
     bool registered;
     bool paused;
+    bool paused_for_sleep = false;
     std::string configpath;
     CoreVPNClient::Ptr vpnclient;
     std::unique_ptr<std::thread> client_thread;
+    std::atomic<bool> client_running{false};
+    bool connect_pending = false;
+    StatisticsHistory stats_history;
+    guint stats_sampler = 0;
+    ThreadPlacement default_placement;
+    ThreadPlacement placement;
     ClientAPI::Config vpnconfig;
     ClientAPI::EvalConfig cfgeval;
     ClientAPI::ProvideCreds creds;
@@ -704,6 +935,72 @@ private:
     std::mutex guard;
 
 
+    /**
+     *  Identifiers of the D-Bus methods and properties handled by
+     *  callback_method_call() and callback_get_property()
+     */
+    enum class MethodID
+    {
+        UNKNOWN,
+        REGISTRATION_CONFIRMATION,
+        PING,
+        READY,
+        CONNECT,
+        DISCONNECT,
+        USER_INPUT_QUEUE_GET_TYPE_GROUP,
+        USER_INPUT_QUEUE_FETCH,
+        USER_INPUT_QUEUE_CHECK,
+        USER_INPUT_PROVIDE,
+        PAUSE,
+        RESUME,
+        RESTART,
+        FORCE_SHUTDOWN
+    };
+
+
+    static MethodID lookup_method_id(const std::string& name)
+    {
+        static const DBusDispatchTable<MethodID> methods(
+            MethodID::UNKNOWN,
+            {{"RegistrationConfirmation", MethodID::REGISTRATION_CONFIRMATION},
+             {"Ping", MethodID::PING},
+             {"Ready", MethodID::READY},
+             {"Connect", MethodID::CONNECT},
+             {"Disconnect", MethodID::DISCONNECT},
+             {"UserInputQueueGetTypeGroup", MethodID::USER_INPUT_QUEUE_GET_TYPE_GROUP},
+             {"UserInputQueueFetch", MethodID::USER_INPUT_QUEUE_FETCH},
+             {"UserInputQueueCheck", MethodID::USER_INPUT_QUEUE_CHECK},
+             {"UserInputProvide", MethodID::USER_INPUT_PROVIDE},
+             {"Pause", MethodID::PAUSE},
+             {"Resume", MethodID::RESUME},
+             {"Restart", MethodID::RESTART},
+             {"ForceShutdown", MethodID::FORCE_SHUTDOWN}});
+        return methods.Lookup(name);
+    }
+
+
+    enum class PropertyID
+    {
+        UNKNOWN,
+        STATISTICS,
+        STATISTICS_DETAILS,
+        STATUS,
+        LOG_LEVEL
+    };
+
+
+    static PropertyID lookup_property_id(const std::string& name)
+    {
+        static const DBusDispatchTable<PropertyID> props(
+            PropertyID::UNKNOWN,
+            {{"statistics", PropertyID::STATISTICS},
+             {"statistics_details", PropertyID::STATISTICS_DETAILS},
+             {"status", PropertyID::STATUS},
+             {"log_level", PropertyID::LOG_LEVEL}});
+        return props.Lookup(name);
+    }
+
+
     /**
      *  Validate that the sender is the session manager.  If the sender
      *  is not the session manager, a DBusCredentialsException is thrown.
@@ -725,17 +1022,166 @@ private:
     }
 
 
+    /**
+     *  Stops the VPN client, if running, and waits for the thread
+     *  running it to complete.
+     */
+    void stop_client_thread()
+    {
+        if (vpnclient)
+        {
+            vpnclient->stop();
+        }
+        if (client_thread && client_thread->joinable())
+        {
+            if (std::this_thread::get_id() == client_thread->get_id())
+            {
+                client_thread->detach();
+            }
+            else
+            {
+                client_thread->join();
+            }
+        }
+    }
+
+
+    /**
+     *  Stops this session and removes this object from the D-Bus.  If the
+     *  client thread is running, it is only told to stop; the shutdown
+     *  is completed by client_thread_done_cb() in the main loop when the
+     *  thread has returned, so the main loop shared by the other
+     *  sessions in this process is never blocked waiting for it.
+     *
+     * @param done  Boolean, if true the CONN_DONE status is sent when
+     *              the client thread has returned
+     */
+    void shutdown_session(bool done = false)
+    {
+        if (shutdown_done.exchange(true))
+        {
+            return;
+        }
+        report_done = done;
+
+        if (vpnclient)
+        {
+            vpnclient->stop();
+        }
+        if (!client_thread || !client_thread->joinable())
+        {
+            finish_shutdown();
+        }
+    }
+
+
+    /**
+     *  Completes shutdown_session() when the client thread has returned.
+     *  This always runs in the main loop.  The remove callback takes care of releasing this object, which
+     *  happens after the current D-Bus call or signal has completed.
+     */
+    void finish_shutdown()
+    {
+        if (shutdown_finished)
+        {
+            return;
+        }
+        shutdown_finished = true;
+
+        signal.FlushLog();
+        if (report_done)
+        {
+            signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_DONE);
+        }
+
+        // The sampler uses a plain pointer to this object, so remove it
+        // here in the main loop.  The last reference to this object may
+        // be released by the client thread.
+        g_source_remove(stats_sampler);
+        stats_sampler = 0;
+        RemoveObject(dbusconn);
+        if (remove_callback)
+        {
+            remove_callback();
+        }
+        else
+        {
+            kill(getpid(), SIGTERM);
+        }
+    }
+
+
+    /**
+     *  Passed from a returning client thread to client_thread_done_cb()
+     */
+    struct ClientThreadDone
+    {
+        BackendClientObject::Ptr session;
+        std::thread::id thread_id;
+    };
+
+
+    /**
+     *  Called in the main loop when a client thread has returned.  The
+     *  thread is joined, which does not block as it has completed.  Then
+     *  a shutdown or a connect() waiting for it is completed.  A thread
+     *  which has already been joined is ignored.
+     */
+    static gboolean client_thread_done_cb(gpointer data)
+    {
+        std::unique_ptr<ClientThreadDone> done(static_cast<ClientThreadDone *>(data));
+        BackendClientObject *self = done->session.get();
+
+        if (self->client_thread && self->client_thread->joinable()
+            && done->thread_id == self->client_thread->get_id())
+        {
+            self->client_thread->join();
+        }
+        if (self->client_thread && self->client_thread->joinable())
+        {
+            return G_SOURCE_REMOVE;
+        }
+
+        if (self->shutdown_done)
+        {
+            self->connect_pending = false;
+            self->finish_shutdown();
+        }
+        else if (self->connect_pending)
+        {
+            self->connect_pending = false;
+            self->start_connection_thread();
+        }
+        return G_SOURCE_REMOVE;
+    }
+
+
     /**
      *  This implements the POSIX thread running the CoreVPNClient session
      */
-    void run_connection_thread()
+    void run_connection_thread(CoreVPNClient::Ptr client)
     {
         asio::detail::signal_blocker sigblock; // Block signals in client thread
 
+        // The previous client thread has been joined, so this thread
+        // takes over the lock-free signal queue
+        signal.SetProducerThread(std::this_thread::get_id());
+
+        // This thread runs the data channel, move it to where it
+        // should run before the connection is established
+        if (!placement.Empty())
+        {
+            for (const auto& err : placement.Apply())
+            {
+                signal.LogWarn(err);
+            }
+            signal.LogVerb2("VPN client thread placement: " + placement.str());
+        }
+
         try
         {
             signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_CONNECTING, "");
-            ClientAPI::Status status = vpnclient->connect();
+            ClientAPI::Status status = client->connect();
             if (status.error)
             {
                 std::stringstream msg;
@@ -755,6 +1201,12 @@ private:
         {
             signal.LogFATAL(excp.what());
         }
+        client_running = false;
+        signal.SetProducerThread(std::thread::id());
+
+        // Let the main loop join this thread
+        g_idle_add(client_thread_done_cb,
+                   new ClientThreadDone{Ptr(this), std::this_thread::get_id()});
    }
 
 
@@ -804,9 +1256,9 @@ private:
                 creds.dynamicChallengeCookie = userinputq.GetResponse(ClientAttentionType::CREDENTIALS,
                                                         ClientAttentionGroup::CHALLENGE_DYNAMIC,
                                                         "dynamic_challenge_cookie");
-                creds.response = userinputq.GetResponse(ClientAttentionType::CREDENTIALS,
-                                                        ClientAttentionGroup::CHALLENGE_DYNAMIC,
-                                                        "dynamic_challenge");
+                creds.response = userinputq.TakeResponse(ClientAttentionType::CREDENTIALS,
+                                                         ClientAttentionGroup::CHALLENGE_DYNAMIC,
+                                                         "dynamic_challenge");
                 provide_creds = true;
             }
 
@@ -832,12 +1284,16 @@ private:
                 }
             }
 
-            // Start client thread
-            client_thread.reset(new std::thread([self=Ptr(this)]()
-                                                {
-                                                    self->run_connection_thread();
-                                                }
-                                               ));
+            // A previous client thread has ended its connection, but
+            // may not have returned yet.  Instead of waiting for it here,
+            // the new client thread is started by client_thread_done_cb()
+            // once the previous one has been joined.
+            if (client_thread && client_thread->joinable())
+            {
+                connect_pending = true;
+                return;
+            }
+            start_connection_thread();
         }
         catch(const DBusException& err)
         {
@@ -851,43 +1307,192 @@ private:
 
 
     /**
-     *   Initializes a new CoreVPNClient object
+     *  Starts the client thread running the connection of the current
+     *  VPN client object.
      */
-    void initialize_client()
+    void start_connection_thread()
     {
-        if (vpnconfig.content.empty())
-        {
-            THROW_DBUSEXCEPTION("BackendServiceObject",
-                                "No configuration profile has been parsed");
-        }
+        client_running = true;
+        client_thread.reset(new std::thread([self=Ptr(this), client=vpnclient]()
+                                            {
+                                                self->run_connection_thread(client);
+                                            }
+                                           ));
+    }
 
-        // Create a new VPN client object, which is handling the
-        // tunnel itself.
-        vpnclient.reset(new CoreVPNClient(&signal, &userinputq));
 
-        // We need to provide a copy of the vpnconfig object, as vpnclient
-        // seems to take ownership
-        cfgeval = vpnclient->eval_config(ClientAPI::Config(vpnconfig));
-        if (cfgeval.error)
+    /**
+     *  Checks if the client thread runs a connection which is not about
+     *  to end.  A connection which has failed or is disconnecting is
+     *  considered ended, even if the client thread has not returned yet.
+     *  A connection waiting for the previous client thread to return
+     *  is considered running.
+     *
+     * @return Returns true if the connection is running
+     */
+    bool connection_active()
+    {
+        if (connect_pending)
         {
-            std::stringstream statusmsg;
-            statusmsg << "config_path=" << configpath << ", "
-                      << "eval_message='" << cfgeval.message << "'";
-            signal.LogError("Failed to parse configuration: " + cfgeval.message);
-            signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CFG_ERROR,
-                                statusmsg.str());
-            signal.Debug(statusmsg.str());
-            vpnclient = nullptr;
-            THROW_DBUSEXCEPTION("BackendServiceObject",
-                                "Configuration parsing failed: " + cfgeval.message);
+            return true;
         }
-
-        if (cfgeval.externalPki)
+        if (!client_running || !vpnclient)
         {
-            std::string errmsg = "Failed to parse configuration: "
-                "Configuration requires external PKI which is not implemented yet.";
-            signal.LogError(errmsg);
-            THROW_DBUSEXCEPTION("BackendServiceObject", errmsg);
+            return false;
+        }
+        switch (vpnclient->GetRunStatus())
+        {
+        case StatusMinor::CFG_REQUIRE_USER:
+        case StatusMinor::CONN_AUTH_FAILED:
+        case StatusMinor::CONN_FAILED:
+        case StatusMinor::CONN_DISCONNECTING:
+        case StatusMinor::CONN_DISCONNECTED:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+
+    /**
+     *  Restarts a connection which has ended, without going through a new
+     *  session.  The configuration profile retrieved from the configuration
+     *  manager when this session was registered and the credentials already
+     *  provided are reused, so only the core library needs to evaluate the
+     *  configuration again before the connection is started.
+     *
+     *  A dynamic challenge response can only be used once and its cookie
+     *  belongs to the ended connection, so the dynamic challenge is
+     *  dropped.  The new connection authenticates with the username and
+     *  password, and the server sends a new challenge if needed.  If the
+     *  server rejected the username and password, they are dropped as
+     *  well and the front-end is asked for them again, instead of
+     *  retrying with credentials which may get the account locked.
+     *
+     *  The ended client thread is not waited for; connect() leaves it
+     *  to client_thread_done_cb() to start the new one.
+     */
+    void warm_restart()
+    {
+        const bool auth_failed = (vpnclient
+                                  && StatusMinor::CONN_AUTH_FAILED == vpnclient->GetRunStatus());
+        if (vpnclient)
+        {
+            vpnclient->stop();
+        }
+        paused = false;
+        paused_for_sleep = false;
+        userinputq.RemoveGroup(ClientAttentionType::CREDENTIALS,
+                               ClientAttentionGroup::CHALLENGE_DYNAMIC);
+        if (auth_failed)
+        {
+            userinputq.RemoveGroup(ClientAttentionType::CREDENTIALS,
+                                   ClientAttentionGroup::USER_PASSWORD);
+            creds = ClientAPI::ProvideCreds();
+        }
+        initialize_client();
+        if (!userinputq.QueueAllDone())
+        {
+            THROW_DBUSEXCEPTION("BackendServiceObject",
+                                "Required user input needs to be provided first");
+        }
+        signal.LogVerb1("Warm restart, reusing the configuration and credentials");
+        signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CONN_RECONNECTING);
+        vpnclient->MarkRestart();
+        connect();
+    }
+
+
+    /**
+     *  Takes a snapshot of all the counters of the VPN client, and
+     *  calculates the rates over each statistics window from the
+     *  samples collected by stats_sampler_cb().
+     *
+     * @return Returns a ConnectionStatsSnapshot.  If there is no VPN
+     *         client, it contains no counters.
+     */
+    ConnectionStatsSnapshot get_stats_snapshot()
+    {
+        ConnectionStatsSnapshot snap;
+        snap.timestamp_us = g_get_monotonic_time();
+        if (!vpnclient)
+        {
+            return snap;
+        }
+        snap.counters = vpnclient->GetCounters();
+
+        StatisticsHistory::Sample now{snap.timestamp_us, {}};
+        for (const auto& c : snap.counters)
+        {
+            now.values.push_back(c.value);
+        }
+        for (const auto w : stats_history.GetWindows())
+        {
+            snap.rates.push_back({w, stats_history.Rates(now, w)});
+        }
+        return snap;
+    }
+
+
+    /**
+     *  Called every second by the main loop, to sample the counters
+     *  of a running VPN client.
+     */
+    static gboolean stats_sampler_cb(gpointer data)
+    {
+        BackendClientObject *obj = static_cast<BackendClientObject *>(data);
+        if (obj->vpnclient && obj->client_running)
+        {
+            StatisticsHistory::Sample sample{(uint64_t) g_get_monotonic_time(), {}};
+            for (const auto& c : obj->vpnclient->GetCounters())
+            {
+                sample.values.push_back(c.value);
+            }
+            obj->stats_history.Add(std::move(sample));
+        }
+        return G_SOURCE_CONTINUE;
+    }
+
+
+    /**
+     *   Initializes a new CoreVPNClient object
+     */
+    void initialize_client()
+    {
+        if (vpnconfig.content.empty())
+        {
+            THROW_DBUSEXCEPTION("BackendServiceObject",
+                                "No configuration profile has been parsed");
+        }
+
+        // Create a new VPN client object, which is handling the
+        // tunnel itself.
+        vpnclient.reset(new CoreVPNClient(&signal, &userinputq));
+        stats_history.Clear();
+
+        // We need to provide a copy of the vpnconfig object, as vpnclient
+        // seems to take ownership
+        cfgeval = vpnclient->eval_config(ClientAPI::Config(vpnconfig));
+        if (cfgeval.error)
+        {
+            std::stringstream statusmsg;
+            statusmsg << "config_path=" << configpath << ", "
+                      << "eval_message='" << cfgeval.message << "'";
+            signal.LogError("Failed to parse configuration: " + cfgeval.message);
+            signal.StatusChange(StatusMajor::CONNECTION, StatusMinor::CFG_ERROR,
+                                statusmsg.str());
+            signal.Debug(statusmsg.str());
+            vpnclient = nullptr;
+            THROW_DBUSEXCEPTION("BackendServiceObject",
+                                "Configuration parsing failed: " + cfgeval.message);
+        }
+
+        if (cfgeval.externalPki)
+        {
+            std::string errmsg = "Failed to parse configuration: "
+                "Configuration requires external PKI which is not implemented yet.";
+            signal.LogError(errmsg);
+            THROW_DBUSEXCEPTION("BackendServiceObject", errmsg);
         }
 
         // Do we need username/password?  Or does this configuration allow the
@@ -913,6 +1518,57 @@ private:
     }
 
 
+    /**
+     *  Converts a parsed option list into the key/value list format
+     *  used by ClientAPI::Config::contentList.  The core library splits
+     *  the value into arguments the same way as a configuration file
+     *  line, so arguments are quoted where needed.  Backslashes and
+     *  newlines are escaped, which makes the core library treat inline
+     *  files (certificates, keys, etc) as a single argument.
+     *
+     * @param options  OptionList to convert
+     *
+     * @return Returns a std::vector of ClientAPI::KeyValue objects
+     */
+    static std::vector<ClientAPI::KeyValue> options_to_content_list(const OptionList& options)
+    {
+        std::vector<ClientAPI::KeyValue> ret;
+        ret.reserve(options.size());
+        for (const auto& opt : options)
+        {
+            ret.push_back(ClientAPI::KeyValue(opt.ref(0),
+                                              escape_kv_value(optparser_join_args(opt))));
+        }
+        return ret;
+    }
+
+
+    /**
+     *  Escapes backslashes and newlines in a ClientAPI::KeyValue value
+     */
+    static std::string escape_kv_value(const std::string& value)
+    {
+        std::string ret;
+        ret.reserve(value.size() + value.size() / 64 + 8);
+        for (const auto& c : value)
+        {
+            if ('\\' == c)
+            {
+                ret += "\\\\";
+            }
+            else if ('\n' == c)
+            {
+                ret += "\\n";
+            }
+            else
+            {
+                ret += c;
+            }
+        }
+        return ret;
+    }
+
+
     /**
      *  Retrieves the VPN configuration profile from the configuration
      *  manager.
@@ -941,21 +1597,49 @@ private:
             // GetConfig() call.
             bool tunPersist = cfg_proxy.GetPersistTun();
             std::vector<OverrideValue> overrides = cfg_proxy.GetOverrides();
+            uid_t cfg_owner = cfg_proxy.GetOwner();
+
+            // Retrieve the already parsed option list from the
+            // configuration manager and pass it on to the core library
+            // as a key/value list.  This avoids parsing the configuration
+            // profile text both here and in the core library.  Older
+            // configuration managers without the FetchBinary method
+            // will fail before the configuration is marked as used,
+            // in that case fall back to the configuration profile text.
+            std::string binopts;
+            try
+            {
+                binopts = cfg_proxy.GetConfigBinary();
+            }
+            catch (DBusException& excp)
+            {
+                signal.Debug("FetchBinary failed, using Fetch: "
+                             + std::string(excp.getRawError()));
+            }
 
-            // Parse the configuration
-            ProfileMergeFromString pm(cfg_proxy.GetConfig(), "",
-                                      ProfileMerge::FOLLOW_NONE,
-                                      ProfileParseLimits::MAX_LINE_SIZE,
-                                      ProfileParseLimits::MAX_PROFILE_SIZE);
+            if (!binopts.empty())
+            {
+                OptionListJSON options;
+                options.binary_deserialize(binopts);
+                vpnconfig.content.clear();
+                vpnconfig.contentList = options_to_content_list(options);
+            }
+            else
+            {
+                ProfileMergeFromString pm(cfg_proxy.GetConfig(), "",
+                                          ProfileMerge::FOLLOW_NONE,
+                                          ProfileParseLimits::MAX_LINE_SIZE,
+                                          ProfileParseLimits::MAX_PROFILE_SIZE);
+                vpnconfig.content = pm.profile_content();
+            }
 #ifdef CONFIGURE_GIT_REVISION
             vpnconfig.guiVersion = openvpn::platform_string(PACKAGE_NAME, "git:" CONFIGURE_GIT_REVISION CONFIGURE_GIT_FLAGS);
 #else
             vpnconfig.guiVersion = openvpn::platform_string(PACKAGE_NAME, PACKAGE_GUIVERSION);
 #endif
             vpnconfig.info = true;
-            vpnconfig.content = pm.profile_content();
             vpnconfig.tunPersist = tunPersist;
-            set_overrides(overrides);
+            set_overrides(overrides, cfg_owner);
         }
         catch (std::exception& e)
         {
@@ -966,8 +1650,10 @@ private:
         return config_name;
     }
 
-    void set_overrides(std::vector<OverrideValue> & overrides)
+    void set_overrides(std::vector<OverrideValue> & overrides,
+                       uid_t cfg_owner)
     {
+        placement = default_placement;
         for (const auto & override: overrides)
         {
             if (override.override.key == "server-override")
@@ -1038,16 +1724,295 @@ private:
             {
                 vpnconfig.proxyAllowCleartextAuth = override.boolValue;
             }
+            else if (override.override.key == "cpu-affinity"
+                     || override.override.key == "cpu-sched-policy"
+                     || override.override.key == "cpu-nice"
+                     || override.override.key == "numa-node")
+            {
+                set_placement_override(override.override.key,
+                                       override.strValue, cfg_owner);
+            }
+        }
+    }
+
+
+    /**
+     *  Modifies the VPN client thread placement from a configuration
+     *  profile override.  Invalid values are ignored.
+     *
+     *  This process runs as root, while configuration profiles can be
+     *  imported by any user.  Real-time scheduling policies and negative
+     *  nice values are therefore only accepted from profiles owned by
+     *  root.  Otherwise these must be set by the administrator, with the
+     *  --sched-policy and --nice options.
+     *
+     * @param key        std::string with the override name
+     * @param value      std::string with the override value
+     * @param cfg_owner  uid_t of the owner of the configuration profile
+     */
+    void set_placement_override(const std::string& key,
+                                const std::string& value,
+                                uid_t cfg_owner)
+    {
+        auto set = [&key, &value](ThreadPlacement& tp)
+        {
+            if ("cpu-affinity" == key)
+            {
+                tp.SetCPUs(value);
+            }
+            else if ("cpu-sched-policy" == key)
+            {
+                tp.SetSchedPolicy(value);
+            }
+            else if ("cpu-nice" == key)
+            {
+                tp.SetNice(value);
+            }
+            else if ("numa-node" == key)
+            {
+                tp.SetNUMANode(value);
+            }
+        };
+
+        try
+        {
+            // Validate this setting alone before modifying the placement
+            ThreadPlacement setting;
+            set(setting);
+            if (0 != cfg_owner && setting.IsPrivileged())
+            {
+                signal.LogWarn("Ignoring the " + key + " override '" + value
+                               + "': real-time scheduling and negative nice "
+                               "values are only allowed in profiles owned "
+                               "by root");
+                return;
+            }
+            set(placement);
+        }
+        catch (ThreadPlacementException& excp)
+        {
+            signal.LogWarn("Ignoring the " + key + " override: "
+                           + std::string(excp.what()));
+        }
+    }
+
+};
+
+
+
+/**
+ *  Manager object of a backend client process hosting several VPN
+ *  sessions, enabled with --multi-tunnel.  The backend starter service
+ *  uses this object to start new sessions in an already running process
+ *  instead of starting a new process for each session.
+ */
+class BackendHostObject : public DBusObject,
+                          public DBusConnectionCreds,
+                          public RC<thread_unsafe_refcount>
+{
+public:
+    typedef RCPtr<BackendHostObject> Ptr;
+
+    /**
+     *  Initialize the BackendHostObject
+     *
+     * @param conn           D-Bus connection this object is tied to
+     * @param max_sessions   Maximum number of sessions this process
+     *                       will host
+     * @param start_session  Function starting a new session, called
+     *                       with the session registration token
+     * @param session_count  Function returning the number of sessions
+     *                       currently running in this process
+     */
+    BackendHostObject(GDBusConnection *conn, unsigned int max_sessions,
+                      std::function<void(const std::string&)> start_session,
+                      std::function<size_t()> session_count)
+        : DBusObject(OpenVPN3DBus_rootp_backends_manager),
+          DBusConnectionCreds(conn),
+          dbusconn(conn),
+          max_sessions(max_sessions),
+          start_session(start_session),
+          session_count(session_count)
+    {
+        std::stringstream introspection_xml;
+        introspection_xml << "<node name='" << OpenVPN3DBus_rootp_backends_manager << "'>"
+                          << "    <interface name='" << OpenVPN3DBus_interf_backends_manager << "'>"
+                          << "        <method name='StartSession'>"
+                          << "            <arg type='s' name='token' direction='in'/>"
+                          << "            <arg type='u' name='pid' direction='out'/>"
+                          << "        </method>"
+                          << "        <property type='u' name='session_count' access='read'/>"
+                          << "        <property type='u' name='max_sessions' access='read'/>"
+                          << "    </interface>"
+                          << "</node>";
+        ParseIntrospectionXML(introspection_xml);
+    }
+
+    ~BackendHostObject()
+    {
+        RemoveObject(dbusconn);
+    }
+
+
+    /**
+     *  Callback method which is called each time a D-Bus method call occurs
+     *  on this BackendHostObject.
+     *
+     *  Only the backend starter service may start new sessions.  If
+     *  this process already hosts the maximum number of sessions, the
+     *  net.openvpn.v3.backend.error.host-full error is returned and
+     *  the backend starter will use another process.
+     *
+     * @param conn        D-Bus connection where the method call occurred
+     * @param sender      D-Bus bus name of the sender of the method call
+     * @param obj_path    D-Bus object path of the target object.
+     * @param intf_name   D-Bus interface of the method call
+     * @param method_name D-Bus method name to be executed
+     * @param params      GVariant Glib2 object containing the arguments for
+     *                    the method call
+     * @param invoc       GDBusMethodInvocation where the response/result of
+     *                    the method call will be returned.
+     */
+    void callback_method_call(GDBusConnection *conn,
+                              const std::string sender,
+                              const std::string obj_path,
+                              const std::string intf_name,
+                              const std::string method_name,
+                              GVariant *params,
+                              GDBusMethodInvocation *invoc)
+    {
+        try
+        {
+            if ("StartSession" != method_name)
+            {
+                throw std::invalid_argument("Not implemented method");
+            }
+
+            if (GetUniqueBusID(OpenVPN3DBus_name_backends) != sender)
+            {
+                throw DBusCredentialsException(GetUID(sender),
+                                               "net.openvpn.v3.error.acl.denied",
+                                               "You are not the backend starter");
+            }
+
+            if (session_count() >= max_sessions)
+            {
+                GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.backend.error.host-full",
+                                                              "No more sessions can be started in this process");
+                g_dbus_method_invocation_return_gerror(invoc, err);
+                g_error_free(err);
+                return;
+            }
+
+            gchar *token = nullptr;
+            g_variant_get(params, "(s)", &token);
+            std::string sesstoken(token);
+            g_free(token);
+
+            start_session(sesstoken);
+            g_dbus_method_invocation_return_value(invoc,
+                                                  g_variant_new("(u)", getpid()));
+        }
+        catch (DBusCredentialsException& excp)
+        {
+            excp.SetDBusError(invoc);
+        }
+        catch (const std::exception& excp)
+        {
+            std::string errmsg = "Failed executing D-Bus call '" + method_name + "': " + excp.what();
+            GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.backend.error.standard",
+                                                          errmsg.c_str());
+            g_dbus_method_invocation_return_gerror(invoc, err);
+            g_error_free(err);
         }
     }
 
+
+    /**
+     *   Callback which is used each time a BackendHostObject D-Bus
+     *   property is being read.
+     *
+     * @param conn           D-Bus connection this event occurred on
+     * @param sender         D-Bus bus name of the requester
+     * @param obj_path       D-Bus object path to the object being requested
+     * @param intf_name      D-Bus interface of the property being accessed
+     * @param property_name  The property name being accessed
+     * @param error          A GLib2 GError object if an error occurs
+     *
+     * @return  Returns a GVariant Glib2 object containing the value of the
+     *          requested D-Bus object property.  On errors, NULL is
+     *          returned and the error is returned via the GError object.
+     */
+    GVariant * callback_get_property(GDBusConnection *conn,
+                                     const std::string sender,
+                                     const std::string obj_path,
+                                     const std::string intf_name,
+                                     const std::string property_name,
+                                     GError **error)
+    {
+        if ("session_count" == property_name)
+        {
+            return g_variant_new_uint32(session_count());
+        }
+        else if ("max_sessions" == property_name)
+        {
+            return g_variant_new_uint32(max_sessions);
+        }
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Unknown property");
+        return NULL;
+    }
+
+
+    /**
+     *  Callback method which is used each time a BackendHostObject
+     *  property is being modified over the D-Bus.
+     *
+     *  This will always fail with an exception, as there exists no properties
+     *  which can be modified in a BackendHostObject.
+     *
+     * @param conn           D-Bus connection this event occurred on
+     * @param sender         D-Bus bus name of the requester
+     * @param obj_path       D-Bus object path to the object being requested
+     * @param intf_name      D-Bus interface of the property being accessed
+     * @param property_name  The property name being accessed
+     * @param value          GVariant object containing the value to be stored
+     * @param error          A GLib2 GError object if an error occurs
+     *
+     * @return Will always throw an exception as there are no properties to
+     *         modify.
+     */
+    GVariantBuilder * callback_set_property(GDBusConnection *conn,
+                                            const std::string sender,
+                                            const std::string obj_path,
+                                            const std::string intf_name,
+                                            const std::string property_name,
+                                            GVariant *value,
+                                            GError **error)
+    {
+        THROW_DBUSEXCEPTION("BackendHostObject",
+                            "set property not implemented");
+    }
+
+
+private:
+    GDBusConnection *dbusconn;
+    const unsigned int max_sessions;
+    std::function<void(const std::string&)> start_session;
+    std::function<size_t()> session_count;
 };
 
 
 
 /**
  *  Main Backend Client D-Bus service.  This registers this client process
- *  as a separate and unique D-Bus service
+ *  as a separate and unique D-Bus service.
+ *
+ *  By default this process runs a single VPN session and exits when that
+ *  session is done.  With a host ID, enabled by --multi-tunnel, it hosts
+ *  several VPN sessions, each with its own BackendClientObject and VPN
+ *  client thread.  The D-Bus connection, main loop and log service
+ *  attachment are then shared by all of these sessions.  New sessions
+ *  are started via the BackendHostObject.
  */
 class BackendClientDBus : public DBus
 {
@@ -1061,25 +2026,35 @@ public:
      * @param sesstoken  String containing the session token provided via the
      *                   command line.  This is used when signalling back
      *                   to the session manager.
+     * @param host_id    String with the host ID given by the backend starter
+     *                   when hosting several sessions.  Empty if this
+     *                   process only runs a single session.
      */
     BackendClientDBus(pid_t start_pid, GBusType bus_type,
-                      std::string sesstoken, LogWriter *logwr)
+                      std::string sesstoken, std::string host_id,
+                      LogWriter *logwr)
         : DBus(bus_type,
-               OpenVPN3DBus_name_backends_be + to_string(getpid()),
+               (host_id.empty()
+                ? OpenVPN3DBus_name_backends_be + to_string(getpid())
+                : OpenVPN3DBus_name_backends_host + host_id),
                OpenVPN3DBus_rootp_sessions,
                OpenVPN3DBus_interf_sessions),
           start_pid(start_pid),
           session_token(sesstoken),
+          host_id(host_id),
           logwr(logwr),
           procsig(nullptr),
-          be_obj(nullptr),
           signal(nullptr),
           signal_broadcast(false)
     {
+        // Initialize the VPN Core
+        CoreVPNClient::init_process();
     };
 
     ~BackendClientDBus()
     {
+        g_source_remove_by_user_data(this);
+
         // If we do multicast (!broadcast), detach from the log service
         if (!signal_broadcast)
         {
@@ -1087,34 +2062,101 @@ public:
             logservice->Detach(OpenVPN3DBus_interf_sessions);
         }
         procsig->ProcessChange(StatusMinor::PROC_STOPPED);
+
+        host_obj.reset();
+        sessions.clear();
+        CoreVPNClient::uninit_process();
     }
 
 
     /**
      *  Provides a reference to the Glib2 main loop object.  This is used
-     *  to cleanly shutdown this process when the session manager wants to
-     *  shutdown this process via D-Bus.
+     *  to cleanly shutdown this process when the last session hosted by
+     *  this process is done.
      *
      * @param ml   GMainLoop pointer to the current main loop thread
      */
     void SetMainLoop(GMainLoop *ml)
     {
-        if (be_obj)
+        mainloop = ml;
+    }
+
+
+    /**
+     *  Sends the pending summaries of repeated log events of all the
+     *  sessions in this process.  Called when the main loop has stopped.
+     */
+    void FlushLogs()
+    {
+        for (auto& s : sessions)
         {
-            be_obj->SetMainLoop(ml);
+            s.second->FlushLog();
         }
     }
 
+
+    /**
+     *  Sets the default CPU affinity, scheduling and NUMA node settings
+     *  of the VPN client threads of the sessions in this process.
+     *
+     * @param tp  ThreadPlacement with the settings
+     */
+    void SetThreadPlacement(const ThreadPlacement& tp)
+    {
+        thread_placement = tp;
+    }
+
+
+    /**
+     *  Sets the time windows the rates in the statistics_details
+     *  property of the sessions in this process are calculated over
+     *
+     * @param windows  std::vector of windows in seconds
+     */
+    void SetStatisticsWindows(const std::vector<unsigned int>& windows)
+    {
+        stats_windows = windows;
+    }
+
+
     /**
-     *  Sets the default log level when the backend client starts.  This
-     *  can later on be adjusted by modifying the log_level D-Bus object
-     *  property.  When not being changed, the default log level is 6.
+     *  Pause the VPN sessions in this process before the system is
+     *  suspended, and resume them after wake-up.
      *
-     * @param lvl  Unsigned integer of the default log level.
+     * @param service  std::string with the D-Bus service sending the
+     *                 PrepareForSleep signal, normally systemd-logind.
+     *                 Empty disables this.
      */
-    void SetDefaultLogLevel(unsigned int lvl)
+    void SetSleepMonitor(const std::string& service)
     {
-        default_log_level = lvl;
+        sleep_monitor_service = service;
+    }
+
+
+    /**
+     *  Sets the maximum number of sessions to host in this process.  Only
+     *  used when a host ID has been given.
+     *
+     * @param max  Unsigned integer with the maximum number of sessions
+     */
+    void SetMaxSessions(unsigned int max)
+    {
+        max_sessions = max;
+    }
+
+
+    /**
+     *  Sets a log level the backend client will use at least, regardless
+     *  of the log levels requested by the log service and the session
+     *  manager.  Without this, the highest log level requested by these
+     *  log consumers is used.  If no log consumer is attached, which is
+     *  the case with signal broadcasts enabled, the log level is 6.
+     *
+     * @param lvl  Unsigned integer of the log level.
+     */
+    void SetLogLevel(unsigned int lvl)
+    {
+        cmdline_log_level = lvl;
     }
 
 
@@ -1147,6 +2189,7 @@ public:
                 logservice.reset(new LogServiceProxy(GetConnection()));
                 logservice->Attach(OpenVPN3DBus_interf_backends);
                 logservice->Attach(OpenVPN3DBus_interf_sessions);
+                logservice_level = logservice->GetLogLevel();
             }
             catch (DBusException& excp)
             {
@@ -1157,20 +2200,56 @@ public:
             }
         }
 
-        // Create a new OpenVPN3 client session object
-        object_path = generate_path_uuid(OpenVPN3DBus_rootp_backends_sessions, 'z');
-        be_obj.reset(new BackendClientObject(GetConnection(), GetBusName(),
-                                             object_path,
-                                             session_token,
-                                             default_log_level,
-                                             logwr));
-        be_obj->SetSignalBroadcast(signal_broadcast);
-        be_obj->RegisterObject(GetConnection());
+        if (cmdline_log_level >= 0)
+        {
+            process_log_levels.Request("command-line", cmdline_log_level);
+        }
+        if (logservice)
+        {
+            // Follow the log level changes in the log service, to
+            // not send more log events than it will use
+            process_log_levels.Request("log-service", logservice_level);
+            logservice_level_watch.reset(new LogServiceLevelSubscription(
+                GetConnection(),
+                [this](unsigned int lvl)
+                {
+                    logservice_level = lvl;
+                    process_log_levels.Request("log-service", lvl);
+                    for (auto& s : sessions)
+                    {
+                        s.second->RequestLogLevel("log-service", lvl);
+                    }
+                    signal->SetLogLevel(process_log_levels.GetLogLevel());
+                }));
+        }
+
+        if (host_id.empty())
+        {
+            // Create a new OpenVPN3 client session object
+            object_path = start_session(session_token);
+        }
+        else
+        {
+            // Host several client session objects, the first one
+            // is started right away
+            object_path = OpenVPN3DBus_rootp_backends_manager;
+            host_obj.reset(new BackendHostObject(GetConnection(), max_sessions,
+                                                 [this](const std::string& token)
+                                                 {
+                                                     start_session(token);
+                                                 },
+                                                 [this]()
+                                                 {
+                                                     return sessions.size();
+                                                 }));
+            host_obj->RegisterObject(GetConnection());
+            start_session(session_token);
+        }
 
         // Setup a signal object of the backend
         signal.reset(new BackendSignals(GetConnection(), LogGroup::BACKENDPROC,
                                         object_path, logwr));
-        signal->SetLogLevel(default_log_level);
+        signal->SetLogLevel(process_log_levels.GetLogLevel());
         signal->LogVerb2("Backend client process started as pid " + std::to_string(start_pid)
                          + " daemonized as pid " + std::to_string(getpid()));
         signal->Debug("BackendClientDBus registered on '" + GetBusName()
@@ -1179,6 +2258,11 @@ public:
         procsig.reset(new ProcessSignalProducer(GetConnection(), OpenVPN3DBus_interf_backends,
                                             object_path, "VPN-Client"));
         procsig->ProcessChange(StatusMinor::PROC_STARTED);
+
+        if (!sleep_monitor_service.empty())
+        {
+            start_sleep_monitor();
+        }
     }
 
 
@@ -1215,30 +2299,186 @@ public:
 
 private:
     unsigned int default_log_level = 6; // LogCategory::DEBUG messages
+    int cmdline_log_level = -1;
+    unsigned int logservice_level = 0;
+    LogLevelNegotiator process_log_levels{default_log_level};
     pid_t start_pid;
     std::string session_token;
+    std::string host_id;
+    unsigned int max_sessions = 1;
+    ThreadPlacement thread_placement;
+    std::vector<unsigned int> stats_windows;
     std::string object_path;
     LogWriter *logwr;
+    GMainLoop *mainloop = nullptr;
     ProcessSignalProducer::Ptr procsig;
-    BackendClientObject::Ptr be_obj;
+    BackendHostObject::Ptr host_obj;
+    std::map<std::string, BackendClientObject::Ptr> sessions;
+    std::vector<std::string> removed_sessions;
     BackendSignals::Ptr signal;
     bool signal_broadcast;
     LogServiceProxy::Ptr logservice;
+    std::unique_ptr<LogServiceLevelSubscription> logservice_level_watch;
+    std::string sleep_monitor_service;
+    std::unique_ptr<SleepMonitor> sleep_monitor;
+
+
+    /**
+     *  Subscribes to the PrepareForSleep signal, which is passed on to
+     *  all the sessions in this process
+     */
+    void start_sleep_monitor()
+    {
+        try
+        {
+            sleep_monitor.reset(new SleepMonitor(
+                GetConnection(), sleep_monitor_service,
+                [this](bool sleeping)
+                {
+                    signal->LogVerb1(sleeping ? "System is about to suspend"
+                                              : "System woke up from suspend");
+                    for (auto& s : sessions)
+                    {
+                        s.second->PrepareForSleep(sleeping);
+                    }
+                },
+                [this]()
+                {
+                    for (auto& s : sessions)
+                    {
+                        if (!s.second->SleepPauseCompleted())
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                }));
+        }
+        catch (DBusException& excp)
+        {
+            signal->LogWarn("Could not watch for system suspend: "
+                            + std::string(excp.what()));
+            return;
+        }
+
+        if (!sleep_monitor->HasDelayLock())
+        {
+            signal->LogWarn("Could not take a sleep delay lock, the system "
+                            "may suspend before the VPN sessions are paused: "
+                            + sleep_monitor->GetDelayLockError());
+        }
+    }
+
+
+    /**
+     *  Creates a new VPN client session object, which will register
+     *  itself with the session manager.
+     *
+     * @param token  String with the session registration token
+     *
+     * @return Returns the D-Bus object path of the new session object
+     */
+    std::string start_session(const std::string& token)
+    {
+        std::string path = generate_path_uuid(OpenVPN3DBus_rootp_backends_sessions, 'z');
+        BackendClientObject::Ptr be_obj(new BackendClientObject(GetConnection(),
+                                                                GetBusName(),
+                                                                path, token,
+                                                                default_log_level,
+                                                                logwr));
+        be_obj->SetSignalBroadcast(signal_broadcast);
+        be_obj->SetThreadPlacement(thread_placement);
+        if (!stats_windows.empty())
+        {
+            be_obj->SetStatisticsWindows(stats_windows);
+        }
+        if (cmdline_log_level >= 0)
+        {
+            be_obj->RequestLogLevel("command-line", cmdline_log_level);
+        }
+        if (logservice)
+        {
+            be_obj->RequestLogLevel("log-service", logservice_level);
+        }
+        if (!host_id.empty())
+        {
+            be_obj->IsolateFatalErrors();
+        }
+        be_obj->SetRemoveCallback([this, path]()
+                                  {
+                                      remove_session(path);
+                                  });
+        be_obj->RegisterObject(GetConnection());
+        sessions[path] = be_obj;
+        return path;
+    }
+
+
+    /**
+     *  Schedules the removal of a session object which has been shut
+     *  down.  This is done from the main loop, as the session object
+     *  may be in the middle of processing a D-Bus call.
+     *
+     * @param path  String with the D-Bus object path of the session
+     */
+    void remove_session(const std::string& path)
+    {
+        removed_sessions.push_back(path);
+        if (1 == removed_sessions.size())
+        {
+            g_idle_add(remove_sessions_callback, this);
+        }
+    }
+
+
+    static gboolean remove_sessions_callback(gpointer this_ptr)
+    {
+        BackendClientDBus *self = static_cast<BackendClientDBus *>(this_ptr);
+        for (const auto& path : self->removed_sessions)
+        {
+            self->sessions.erase(path);
+        }
+        self->removed_sessions.clear();
+
+        // This process is done when the last session is gone.  A
+        // session being started in the mean time keeps it running.
+        if (self->sessions.empty())
+        {
+            if (self->mainloop)
+            {
+                g_main_loop_quit(self->mainloop);
+            }
+            else
+            {
+                kill(getpid(), SIGTERM);
+            }
+        }
+        return G_SOURCE_REMOVE;
+    }
 };
 
 
 void start_client_thread(pid_t start_pid, const std::string argv0,
                         const std::string sesstoken, int log_level,
-                        bool signal_broadcast, LogWriter *logwr)
+                        bool signal_broadcast, const std::string host_id,
+                        unsigned int max_sessions,
+                        const ThreadPlacement& thread_placement,
+                        const std::string& sleep_monitor,
+                        const std::vector<unsigned int>& stats_windows,
+                        LogWriter *logwr)
 {
     std::cout << get_version(argv0) << std::endl;
 
     BackendClientDBus backend_service(start_pid, G_BUS_TYPE_SYSTEM,
-                                      sesstoken, logwr);
+                                      sesstoken, host_id, logwr);
     if (log_level > 0)
     {
-        backend_service.SetDefaultLogLevel(log_level);
+        backend_service.SetLogLevel(log_level);
     }
+    backend_service.SetMaxSessions(max_sessions);
+    backend_service.SetThreadPlacement(thread_placement);
+    backend_service.SetSleepMonitor(sleep_monitor);
+    backend_service.SetStatisticsWindows(stats_windows);
     backend_service.SetSignalBroadcast(signal_broadcast);
     backend_service.Setup();
 
@@ -1249,6 +2489,7 @@ void start_client_thread(pid_t start_pid, const std::string argv0,
     g_unix_signal_add(SIGHUP, stop_handler, main_loop);
     backend_service.SetMainLoop(main_loop);
     g_main_loop_run(main_loop);
+    backend_service.FlushLogs();
     usleep(500);
     g_main_loop_unref(main_loop);
 }
@@ -1316,6 +2557,85 @@ int client_service(ParsedArgs args)
         log_level = std::atoi(args.GetValue("log-level", 0).c_str());
     }
 
+    ThreadPlacement thread_placement;
+    try
+    {
+        if (args.Present("cpu-affinity"))
+        {
+            thread_placement.SetCPUs(args.GetValue("cpu-affinity", 0));
+        }
+        if (args.Present("sched-policy"))
+        {
+            thread_placement.SetSchedPolicy(args.GetValue("sched-policy", 0));
+        }
+        if (args.Present("nice"))
+        {
+            thread_placement.SetNice(args.GetValue("nice", 0));
+        }
+        if (args.Present("numa-node"))
+        {
+            thread_placement.SetNUMANode(args.GetValue("numa-node", 0));
+        }
+    }
+    catch (ThreadPlacementException& excp)
+    {
+        std::cerr << "** ERROR ** " << excp.what() << std::endl;
+        return 1;
+    }
+
+    std::string sleep_monitor;
+    if (args.Present("sleep-monitor-service"))
+    {
+        sleep_monitor = args.GetValue("sleep-monitor-service", 0);
+    }
+    else if (args.Present("pause-on-sleep"))
+    {
+        sleep_monitor = SleepMonitor_logind_service;
+    }
+
+    std::vector<unsigned int> stats_windows;
+    if (args.Present("stats-windows"))
+    {
+        try
+        {
+            stats_windows = StatisticsHistory::ParseWindows(args.GetValue("stats-windows", 0));
+        }
+        catch (StatisticsHistoryException& excp)
+        {
+            std::cerr << "** ERROR ** " << excp.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::string host_id;
+    unsigned int max_sessions = 1;
+    if (args.Present("multi-tunnel"))
+    {
+        host_id = args.GetValue("multi-tunnel", 0);
+        for (const char c : host_id)
+        {
+            // Must be usable as part of a D-Bus bus name
+            if (!isalnum(c) && '_' != c)
+            {
+                std::cerr << "** ERROR ** Invalid host ID: " << host_id
+                          << std::endl;
+                return 1;
+            }
+        }
+        int max = 64;
+        if (args.Present("max-sessions"))
+        {
+            max = std::atoi(args.GetValue("max-sessions", 0).c_str());
+        }
+        if (max < 1)
+        {
+            std::cerr << "** ERROR ** --max-sessions must be 1 or more"
+                      << std::endl;
+            return 1;
+        }
+        max_sessions = max;
+    }
+
 #ifdef DEBUG_OPTIONS
     // When debugging, we might not want to do a fork.
     if (args.Present("no-fork"))
@@ -1324,7 +2644,8 @@ int client_service(ParsedArgs args)
         {
             start_client_thread(getpid(), args.GetArgv0(), extra[0],
                                 log_level, args.Present("signal-broadcast"),
-                                logwr.get());
+                                host_id, max_sessions, thread_placement,
+                                sleep_monitor, stats_windows, logwr.get());
             return 0;
         }
         catch (std::exception& excp)
@@ -1349,7 +2670,8 @@ int client_service(ParsedArgs args)
         {
             start_client_thread(start_pid, args.GetArgv0(), extra[0],
                                 log_level, args.Present("signal-broadcast"),
-                                logwr.get());
+                                host_id, max_sessions, thread_placement,
+                                sleep_monitor, stats_windows, logwr.get());
             return 0;
         }
         catch (std::exception& excp)
@@ -1377,13 +2699,44 @@ int main(int argc, char **argv)
                             client_service);
     argparser.AddVersionOption();
     argparser.AddOption("log-level", "LOG-LEVEL", true,
-                        "Sets the default log verbosity level (valid values 0-6, default 4)");
+                        "Sets the minimum log verbosity level (valid values 0-6).  "
+                        "By default the level requested by the log service "
+                        "and session manager is used");
     argparser.AddOption("log-file", "FILE" , true,
                         "Write log data to FILE.  Use 'stdout:' for console logging.");
     argparser.AddOption("colour", 0,
                         "Make the log lines colourful");
     argparser.AddOption("signal-broadcast", 0,
                         "Broadcast all D-Bus signals instead of targeted multicast");
+    argparser.AddOption("multi-tunnel", "HOST-ID", true,
+                        "Host several VPN sessions in this process, identified "
+                        "by HOST-ID.  New sessions are started by the backend "
+                        "starter service");
+    argparser.AddOption("max-sessions", "NUM", true,
+                        "Maximum number of VPN sessions to host with "
+                        "--multi-tunnel (default: 64)");
+    argparser.AddOption("cpu-affinity", "CPUS", true,
+                        "Run the VPN client threads on these CPUs only, "
+                        "such as 0-3,8");
+    argparser.AddOption("sched-policy", "POLICY", true,
+                        "Scheduling policy of the VPN client threads: "
+                        "other, batch, idle, fifo[:PRIO] or rr[:PRIO]");
+    argparser.AddOption("nice", "NICE", true,
+                        "Nice value of the VPN client threads (-20 to 19)");
+    argparser.AddOption("numa-node", "NODE", true,
+                        "Run the VPN client threads on the CPUs of this "
+                        "NUMA node and prefer memory from it");
+    argparser.AddOption("pause-on-sleep", 0,
+                        "Pause the VPN sessions before the system is "
+                        "suspended and reconnect right after wake-up");
+    argparser.AddOption("sleep-monitor-service", "NAME", true,
+                        "Listen for the PrepareForSleep signal from the "
+                        "D-Bus service NAME instead of systemd-logind, "
+                        "used for testing.  Implies --pause-on-sleep");
+    argparser.AddOption("stats-windows", "LIST", true,
+                        "Comma separated list of time windows in seconds "
+                        "to calculate the statistics rates over "
+                        "(default: 1,10,60)");
 #if DEBUG_OPTIONS
     argparser.AddOption("no-fork", 0,
                         "Debug option: Do not fork a child to be run in the background.");
@@ -0,0 +1,282 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   sleep-monitor.hpp
+ *
+ * @brief  Watches the systemd-logind PrepareForSleep signal, to let the
+ *         backend client pause its VPN sessions before the system is
+ *         suspended and resume them right after wake-up.
+ */
+
+#pragma once
+
+#include <unistd.h>
+
+#include <functional>
+#include <string>
+
+#include "dbus/core.hpp"
+#include "dbus/proxy.hpp"
+#include "dbus/signals.hpp"
+
+using namespace openvpn;
+
+
+/**
+ *  Default D-Bus service sending the PrepareForSleep signal
+ */
+const std::string SleepMonitor_logind_service = "org.freedesktop.login1";
+
+
+/**
+ *  Subscribes to the PrepareForSleep signal from systemd-logind.  The
+ *  callback is called with true before the system is suspended or
+ *  hibernated, and with false when it has woken up again.
+ *
+ *  logind only waits for the services which hold a delay inhibitor lock
+ *  before it suspends the system.  SleepMonitor takes such a lock, which
+ *  is released when the ready check reports that the work started by the
+ *  callback has completed.  As logind ignores the lock after
+ *  InhibitDelayMaxSec, the lock is released after a shorter timeout even
+ *  if the ready check never succeeds.  The lock is taken again after
+ *  wake-up.  If the lock cannot be taken, typically due to the polkit
+ *  policy, the signal is still handled, but the system may be suspended
+ *  before the callback has completed.
+ */
+class SleepMonitor : public DBusSignalSubscription
+{
+public:
+    typedef std::function<void(bool)> Callback;
+    typedef std::function<bool()> ReadyCheck;
+
+    /**
+     * @param dbuscon   D-Bus connection to use
+     * @param service   std::string with the D-Bus service sending the
+     *                  PrepareForSleep signal.  This is logind, unless
+     *                  a stand-in service is used for testing.
+     * @param callback  Function called with the sleep state, true before
+     *                  suspending and false after wake-up
+     * @param ready     Function returning true when the system may be
+     *                  suspended, after the callback was called with true
+     */
+    SleepMonitor(GDBusConnection *dbuscon, const std::string& service,
+                 Callback callback, ReadyCheck ready)
+        : DBusSignalSubscription(dbuscon,
+                                 service,
+                                 "org.freedesktop.login1.Manager",
+                                 "/org/freedesktop/login1",
+                                 "PrepareForSleep"),
+          service(service),
+          callback(callback),
+          ready(ready)
+    {
+        take_delay_lock();
+        max_wait_usec = get_max_wait();
+    }
+
+
+    ~SleepMonitor()
+    {
+        stop_ready_poll();
+        release_delay_lock();
+        Cleanup();
+    }
+
+
+    /**
+     * @return Returns true if a delay inhibitor lock is held
+     */
+    bool HasDelayLock() const
+    {
+        return delay_lock >= 0;
+    }
+
+
+    /**
+     * @return Returns the error message from the last failed attempt
+     *         to take the delay inhibitor lock.  Empty if the lock
+     *         was taken.
+     */
+    const std::string& GetDelayLockError() const
+    {
+        return delay_lock_error;
+    }
+
+
+    void callback_signal_handler(GDBusConnection *connection,
+                                 const std::string sender_name,
+                                 const std::string object_path,
+                                 const std::string interface_name,
+                                 const std::string signal_name,
+                                 GVariant *parameters)
+    {
+        gboolean sleeping = false;
+        g_variant_get(parameters, "(b)", &sleeping);
+
+        callback(sleeping);
+        if (sleeping)
+        {
+            if (ready())
+            {
+                // Let logind continue suspending the system
+                release_delay_lock();
+            }
+            else if (HasDelayLock() && 0 == ready_poll)
+            {
+                ready_deadline = g_get_monotonic_time() + max_wait_usec;
+                ready_poll = g_timeout_add(ready_poll_interval_ms,
+                                           ready_poll_cb, this);
+            }
+        }
+        else
+        {
+            stop_ready_poll();
+            take_delay_lock();
+        }
+    }
+
+
+private:
+    /**
+     *  How often the ready check is called while the delay lock is held
+     */
+    static const guint ready_poll_interval_ms = 50;
+
+    /**
+     *  logind's default InhibitDelayMaxSec, used if the InhibitDelayMaxUSec
+     *  property cannot be retrieved
+     */
+    static const guint64 default_inhibit_delay_max_usec = 5000000;
+
+    std::string service;
+    Callback callback;
+    ReadyCheck ready;
+    int delay_lock = -1;
+    std::string delay_lock_error;
+    guint64 max_wait_usec = 0;
+    gint64 ready_deadline = 0;
+    guint ready_poll = 0;
+
+
+    /**
+     *  Calculates how long the delay lock may be held after the system
+     *  is about to suspend.  This is kept well below logind's
+     *  InhibitDelayMaxSec, so the lock is released by this process
+     *  instead of logind giving up on it.
+     *
+     * @return Returns the maximum wait time in microseconds
+     */
+    guint64 get_max_wait()
+    {
+        guint64 delay_max = default_inhibit_delay_max_usec;
+        try
+        {
+            DBusProxy logind(GetConnection(), service,
+                             "org.freedesktop.login1.Manager",
+                             "/org/freedesktop/login1");
+            delay_max = logind.GetUInt64Property("InhibitDelayMaxUSec");
+        }
+        catch (DBusException&)
+        {
+            // Not provided by a stand-in service; use logind's default
+        }
+        if (delay_max > default_inhibit_delay_max_usec)
+        {
+            delay_max = default_inhibit_delay_max_usec;
+        }
+        return delay_max / 5 * 4;
+    }
+
+
+    static gboolean ready_poll_cb(gpointer data)
+    {
+        SleepMonitor *self = static_cast<SleepMonitor *>(data);
+
+        if (!self->ready() && g_get_monotonic_time() < self->ready_deadline)
+        {
+            return G_SOURCE_CONTINUE;
+        }
+        self->ready_poll = 0;
+        self->release_delay_lock();
+        return G_SOURCE_REMOVE;
+    }
+
+
+    void stop_ready_poll()
+    {
+        if (ready_poll > 0)
+        {
+            g_source_remove(ready_poll);
+            ready_poll = 0;
+        }
+    }
+
+
+    void take_delay_lock()
+    {
+        if (delay_lock >= 0)
+        {
+            return;
+        }
+
+        try
+        {
+            DBusProxy logind(GetConnection(), service,
+                             "org.freedesktop.login1.Manager",
+                             "/org/freedesktop/login1");
+            GUnixFDList *fdlist = nullptr;
+            GVariant *res = logind.CallWithFD("Inhibit",
+                                              g_variant_new("(ssss)",
+                                                            "sleep",
+                                                            "OpenVPN 3",
+                                                            "Pausing VPN sessions",
+                                                            "delay"),
+                                              nullptr, &fdlist);
+            gint32 fd_idx = -1;
+            g_variant_get(res, "(h)", &fd_idx);
+            g_variant_unref(res);
+
+            if (nullptr != fdlist)
+            {
+                delay_lock = g_unix_fd_list_get(fdlist, fd_idx, nullptr);
+                g_object_unref(fdlist);
+            }
+            delay_lock_error = (delay_lock < 0 ? "No file descriptor received" : "");
+        }
+        catch (DBusProxyAccessDeniedException& excp)
+        {
+            delay_lock_error = excp.what();
+        }
+        catch (DBusException& excp)
+        {
+            delay_lock_error = excp.what();
+        }
+    }
+
+
+    void release_delay_lock()
+    {
+        if (delay_lock >= 0)
+        {
+            ::close(delay_lock);
+            delay_lock = -1;
+        }
+    }
+};
@@ -0,0 +1,244 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   statistics-history.hpp
+ *
+ * @brief  Keeps recent samples of the connection statistics counters,
+ *         used to calculate rates over a set of time windows
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+class StatisticsHistoryException : public std::exception
+{
+public:
+    StatisticsHistoryException(const std::string& err)
+        : err(err)
+    {
+    }
+
+    virtual const char* what() const noexcept
+    {
+        return err.c_str();
+    }
+
+private:
+    std::string err;
+};
+
+
+/**
+ *  Keeps the counter values sampled over the longest configured time
+ *  window.  All samples must contain the same counters in the same
+ *  order.  The rate of a counter over a window is calculated from the
+ *  newest sample which is at least as old as the window, or from the
+ *  oldest sample if the history does not cover the whole window yet.
+ */
+class StatisticsHistory
+{
+public:
+    /**
+     *  A single sample of all counters
+     */
+    struct Sample
+    {
+        uint64_t timestamp_us;
+        std::vector<long long> values;
+    };
+
+    /**
+     *  The longest time window supported, in seconds
+     */
+    static const unsigned int MaxWindow = 3600;
+
+
+    StatisticsHistory()
+        : windows({1, 10, 60})
+    {
+    }
+
+
+    /**
+     *  Parses a comma separated list of time windows
+     *
+     * @param list  std::string with the list of windows in seconds,
+     *              such as "1,10,60"
+     *
+     * @return Returns a sorted std::vector of the windows
+     */
+    static std::vector<unsigned int> ParseWindows(const std::string& list)
+    {
+        std::vector<unsigned int> ret;
+        std::stringstream items(list);
+        std::string item;
+        while (std::getline(items, item, ','))
+        {
+            char *end = nullptr;
+            errno = 0;
+            unsigned long w = std::strtoul(item.c_str(), &end, 10);
+            if (item.empty() || '\0' != *end || 0 != errno
+                || w < 1 || w > MaxWindow)
+            {
+                throw StatisticsHistoryException("Invalid statistics window '"
+                                                 + item + "'");
+            }
+            ret.push_back((unsigned int) w);
+        }
+        if (ret.empty())
+        {
+            throw StatisticsHistoryException("No statistics windows given");
+        }
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+        return ret;
+    }
+
+
+    /**
+     *  Sets the time windows to calculate rates over.  This clears
+     *  the history.
+     *
+     * @param w  std::vector of windows in seconds, see ParseWindows()
+     */
+    void SetWindows(const std::vector<unsigned int>& w)
+    {
+        windows = w;
+        std::sort(windows.begin(), windows.end());
+        samples.clear();
+    }
+
+
+    /**
+     * @return Returns the time windows, in seconds
+     */
+    const std::vector<unsigned int>& GetWindows() const noexcept
+    {
+        return windows;
+    }
+
+
+    /**
+     *  Drops all samples, used when the counters are reset
+     */
+    void Clear()
+    {
+        samples.clear();
+    }
+
+
+    /**
+     * @return Returns the number of samples kept
+     */
+    size_t GetSize() const noexcept
+    {
+        return samples.size();
+    }
+
+
+    /**
+     *  Adds a sample.  Samples older than needed for the longest
+     *  window are dropped.  A sample with a different number of
+     *  counters than the previous samples clears the history.
+     *
+     * @param sample  Sample to add, must not be older than the last one
+     */
+    void Add(Sample sample)
+    {
+        if (!samples.empty()
+            && (samples.back().values.size() != sample.values.size()
+                || samples.back().timestamp_us > sample.timestamp_us))
+        {
+            samples.clear();
+        }
+        samples.push_back(std::move(sample));
+
+        // Keep the newest sample which is older than the longest window
+        const uint64_t keep = (uint64_t) windows.back() * 1000000;
+        const uint64_t now = samples.back().timestamp_us;
+        while (samples.size() > 1
+               && now - samples[1].timestamp_us >= keep)
+        {
+            samples.pop_front();
+        }
+    }
+
+
+    /**
+     *  Calculates the rate per second of each counter over a window,
+     *  up to a sample which is typically newer than the history.
+     *  Counters which have decreased, such as after a reconnect,
+     *  get a rate of 0.
+     *
+     * @param now     Sample to calculate the rates up to
+     * @param window  Window in seconds
+     *
+     * @return Returns a std::vector with the rate of each counter.
+     *         All rates are 0 if there is no older sample to compare with.
+     */
+    std::vector<double> Rates(const Sample& now, unsigned int window) const
+    {
+        std::vector<double> ret(now.values.size(), 0.0);
+
+        const Sample *from = nullptr;
+        const uint64_t w = (uint64_t) window * 1000000;
+        for (const auto& s : samples)
+        {
+            if (s.timestamp_us >= now.timestamp_us
+                || s.values.size() != now.values.size())
+            {
+                break;
+            }
+            if (nullptr == from || now.timestamp_us - s.timestamp_us >= w)
+            {
+                from = &s;
+            }
+        }
+        if (nullptr == from)
+        {
+            return ret;
+        }
+
+        const double secs = (now.timestamp_us - from->timestamp_us) / 1e6;
+        for (size_t i = 0; i < ret.size(); ++i)
+        {
+            if (now.values[i] >= from->values[i])
+            {
+                ret[i] = (now.values[i] - from->values[i]) / secs;
+            }
+        }
+        return ret;
+    }
+
+
+private:
+    std::vector<unsigned int> windows;
+    std::deque<Sample> samples;
+};
@@ -25,6 +25,11 @@
 
 #ifndef OPENVPN3_DBUS_CLIENT_STATISTICS
 #define OPENVPN3_DBUS_CLIENT_STATISTICS
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
 /**
  *  Used to deliver connection statistics for the tunnel to the
  *  user front end.  The full result will be provided as an
@@ -51,4 +56,47 @@ struct ConnectionStatDetails
  */
 typedef std::vector<ConnectionStatDetails> ConnectionStats;
 
+
+/**
+ *  A single counter in a ConnectionStatsSnapshot.  The ID of a counter
+ *  does not change while the backend client runs, and all counters are
+ *  always present, also when they are zero.
+ */
+struct ConnectionStatCounter
+{
+    ConnectionStatCounter(unsigned int id, const std::string& name,
+                          long long value)
+        : id(id), name(name), value(value)
+    {
+    }
+
+    unsigned int id;
+    std::string name;
+    long long value;
+};
+
+
+/**
+ *  The rates of all the counters in a ConnectionStatsSnapshot, measured
+ *  over the last window_secs seconds.  The rates are in the same order
+ *  as the counters.
+ */
+struct ConnectionStatRates
+{
+    unsigned int window_secs;
+    std::vector<double> per_second;
+};
+
+
+/**
+ *  Structured connection statistics, as provided by the
+ *  statistics_details property
+ */
+struct ConnectionStatsSnapshot
+{
+    uint64_t timestamp_us = 0;  ///< CLOCK_MONOTONIC time of the snapshot
+    std::vector<ConnectionStatCounter> counters;
+    std::vector<ConnectionStatRates> rates;
+};
+
 #endif // OPENVPN3_DBUS_CLIENT_STATISTICS
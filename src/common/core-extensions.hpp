@@ -20,7 +20,13 @@
 #ifndef OPENVPN3_CORE_EXTENSIONS
 #define OPENVPN3_CORE_EXTENSIONS
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <json/json.h>
 #include <openvpn/client/cliconstants.hpp>
 #include <openvpn/common/options.hpp>
@@ -59,24 +65,172 @@ namespace openvpn {
         return ret.str();
     }
 
+    /**
+     *  Quotes an option argument if it contains characters which would
+     *  otherwise split it into several arguments when parsed again.
+     */
+    inline std::string optparser_quote_arg(const std::string& arg)
+    {
+        if (!arg.empty() && "NOARGS" != arg
+            && std::string::npos == arg.find_first_of(" \t\"'\\"))
+        {
+            return arg;
+        }
+
+        std::string ret = "\"";
+        for (const auto& c : arg)
+        {
+            if ('"' == c || '\\' == c)
+            {
+                ret += '\\';
+            }
+            ret += c;
+        }
+        ret += "\"";
+        return ret;
+    }
+
+
+    /**
+     *  Joins the arguments of an option into a single string, as they
+     *  would be written in a configuration profile.  Inline files, which
+     *  are a single argument containing newlines, are returned as-is.
+     *
+     * @param opt  Option to process
+     *
+     * @return Returns a std::string with all the option arguments
+     */
+    inline std::string optparser_join_args(const Option& opt)
+    {
+        if (2 == opt.size() && std::string::npos != opt.ref(1).find('\n'))
+        {
+            return opt.ref(1);
+        }
+
+        std::string ret;
+        for (size_t i = 1; i < opt.size(); i++)
+        {
+            if (i > 1)
+            {
+                ret += " ";
+            }
+            ret += optparser_quote_arg(opt.ref(i));
+        }
+        return ret;
+    }
+
+
+    /**
+     *  Appends a string to a JSON document as a JSON string, including
+     *  the surrounding quotes
+     *
+     * @param out  std::string with the JSON document to append to
+     * @param str  std::string to append
+     */
+    inline void json_append_string(std::string& out, const std::string& str)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        out += '"';
+        for (const auto& ch : str)
+        {
+            unsigned char c = (unsigned char) ch;
+            switch (c)
+            {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                if (c < 0x20)
+                {
+                    out += "\\u00";
+                    out += hex[c >> 4];
+                    out += hex[c & 0x0f];
+                }
+                else
+                {
+                    out += ch;
+                }
+            }
+        }
+        out += '"';
+    }
+
+
     class OptionListJSON : public openvpn::OptionList
     {
     public:
-        std::string json_export()
+        /**
+         *  Exports the option list as a JSON object, with the option name
+         *  as the key and the option arguments as the value.  Options
+         *  present more than once, such as remote, get an array of values.
+         *
+         *  The JSON document is written directly into a preallocated
+         *  string, without building a Json::Value tree first.  The keys
+         *  are in the order the options first appear in the profile.
+         *
+         * @return Returns a std::string with the JSON document
+         */
+        std::string json_export() const
         {
-            Json::Value outdata;
+            typedef std::pair<const std::string, std::vector<size_t>> NameIndex;
 
-            // FIXME: Looks very hacky
-            for(auto element : *this) {
-                outdata[element.ref(0)] = (element.size() > 1 ? element.ref(1) : "");
+            // Group the options by name, in the order of first appearance
+            std::unordered_map<std::string, std::vector<size_t>> index;
+            std::vector<const NameIndex *> names;
+            size_t reserve = 8;
+            for (size_t i = 0; i < size(); i++)
+            {
+                const Option& opt = (*this)[i];
+                auto r = index.emplace(opt.ref(0), std::vector<size_t>());
+                if (r.second)
+                {
+                    names.push_back(&(*r.first));
+                    reserve += opt.ref(0).size() + 8;
+                }
+                r.first->second.push_back(i);
+                for (size_t j = 1; j < opt.size(); j++)
+                {
+                    reserve += opt.ref(j).size() + 4;
+                }
+                reserve += 4;
             }
 
-            std::stringstream output;
-            output << outdata;
-            return output.str();
+            std::string out;
+            out.reserve(reserve + reserve / 16);
+            out += "{";
+            for (size_t n = 0; n < names.size(); n++)
+            {
+                out += (n > 0 ? ",\n\t" : "\n\t");
+                json_append_string(out, names[n]->first);
+                out += " : ";
+
+                const std::vector<size_t>& idx = names[n]->second;
+                if (1 == idx.size())
+                {
+                    json_append_string(out, optparser_join_args((*this)[idx[0]]));
+                    continue;
+                }
+                out += "[ ";
+                for (size_t k = 0; k < idx.size(); k++)
+                {
+                    if (k > 0)
+                    {
+                        out += ", ";
+                    }
+                    json_append_string(out, optparser_join_args((*this)[idx[k]]));
+                }
+                out += " ]";
+            }
+            out += (names.empty() ? "}" : "\n}");
+            return out;
         }
 
-        std::string string_export()
+        std::string string_export() const
         {
             std::stringstream cfgstr;
 
@@ -115,32 +269,451 @@ namespace openvpn {
 
             return cfgstr.str();
         }
+
+
+        /**
+         *  Serializes the parsed option list into a JSON array, where
+         *  each option is an array of the option name and its arguments.
+         *  Unlike json_export(), this keeps the complete option list
+         *  and can be loaded again with json_deserialize() without
+         *  re-parsing the configuration profile.
+         *
+         * @return Returns a Json::Value array with the option list
+         */
+        Json::Value json_serialize() const
+        {
+            Json::Value ret(Json::arrayValue);
+            for (const auto& element : *this)
+            {
+                Json::Value opt(Json::arrayValue);
+                for (size_t i = 0; i < element.size(); i++)
+                {
+                    opt.append(element.ref(i));
+                }
+                ret.append(opt);
+            }
+            return ret;
+        }
+
+
+        /**
+         *  Replaces the option list with the contents of a previously
+         *  serialized option list, see json_serialize().
+         *
+         * @param data  Json::Value array with the option list
+         */
+        void json_deserialize(const Json::Value& data)
+        {
+            clear();
+            reserve(data.size());
+            for (const auto& opt : data)
+            {
+                Option o;
+                for (const auto& arg : opt)
+                {
+                    o.push_back(arg.asString());
+                }
+                push_back(std::move(o));
+            }
+            update_map();
+        }
+
+
+        /**
+         *  Serializes the parsed option list into a compact binary format,
+         *  which can be loaded again with binary_deserialize() without
+         *  parsing the configuration profile text again.
+         *
+         *  The format is a 4 byte magic ("OVOL"), a format version byte
+         *  and the number of options, followed by each option as the
+         *  number of arguments and each argument as a length prefixed
+         *  byte range.  All integers are encoded as unsigned LEB128
+         *  variable length integers.  Inline files, such as certificates
+         *  and keys, are stored as a single argument.
+         *
+         * @return Returns a std::string with the binary encoded option list
+         */
+        std::string binary_serialize() const
+        {
+            size_t reserve = 16;
+            for (const auto& element : *this)
+            {
+                for (size_t i = 0; i < element.size(); i++)
+                {
+                    reserve += element.ref(i).size() + 2;
+                }
+            }
+
+            std::string ret;
+            ret.reserve(reserve);
+            ret.append(binary_magic, 4);
+            ret.push_back((char) binary_version);
+            put_varint(ret, size());
+            for (const auto& element : *this)
+            {
+                put_varint(ret, element.size());
+                for (size_t i = 0; i < element.size(); i++)
+                {
+                    const std::string& arg = element.ref(i);
+                    put_varint(ret, arg.size());
+                    ret.append(arg);
+                }
+            }
+            return ret;
+        }
+
+
+        /**
+         *  Replaces the option list with the contents of a binary encoded
+         *  option list, see binary_serialize().
+         *
+         *  @param data  std::string with the binary encoded option list
+         *
+         *  @throws openvpn::Exception if the data is not a valid
+         *          binary encoded option list
+         */
+        void binary_deserialize(const std::string& data)
+        {
+            size_t pos = 0;
+            if (data.size() < 5 || 0 != data.compare(0, 4, binary_magic, 4))
+            {
+                throw Exception("Invalid binary option list");
+            }
+            if (binary_version != data[4])
+            {
+                throw Exception("Unsupported binary option list version");
+            }
+            pos = 5;
+
+            clear();
+            size_t count = get_varint(data, pos);
+            reserve(std::min(count, data.size()));
+            for (size_t o = 0; o < count; o++)
+            {
+                size_t argc = get_varint(data, pos);
+                Option opt;
+                opt.reserve(std::min(argc, data.size()));
+                for (size_t i = 0; i < argc; i++)
+                {
+                    size_t len = get_varint(data, pos);
+                    if (len > data.size() - pos)
+                    {
+                        throw Exception("Truncated binary option list");
+                    }
+                    opt.push_back(data.substr(pos, len));
+                    pos += len;
+                }
+                push_back(std::move(opt));
+            }
+            update_map();
+        }
+
+
+    private:
+        static constexpr const char *binary_magic = "OVOL";
+        static constexpr char binary_version = 1;
+
+
+        static void put_varint(std::string& out, size_t val)
+        {
+            while (val >= 0x80)
+            {
+                out.push_back((char) ((val & 0x7f) | 0x80));
+                val >>= 7;
+            }
+            out.push_back((char) val);
+        }
+
+
+        static size_t get_varint(const std::string& data, size_t& pos)
+        {
+            size_t ret = 0;
+            for (unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                if (pos >= data.size())
+                {
+                    throw Exception("Truncated binary option list");
+                }
+                unsigned char c = (unsigned char) data[pos++];
+                ret |= ((size_t) (c & 0x7f)) << shift;
+                if (0 == (c & 0x80))
+                {
+                    return ret;
+                }
+            }
+            throw Exception("Invalid length in binary option list");
+        }
     };
 
+    /**
+     *  Streaming reader of JSON documents produced by
+     *  OptionListJSON::json_export(), converting them straight into an
+     *  OpenVPN configuration profile without building a Json::Value tree.
+     *
+     *  The document must be a JSON object.  Each value must be a string,
+     *  or an array of strings for options present more than once.
+     *  Numbers, booleans and null are accepted and used as-is.
+     */
+    class JSONProfileReader
+    {
+    public:
+        JSONProfileReader(const std::string& json)
+            : json(json)
+        {
+        }
+
+
+        /**
+         * @return Returns a std::string with the configuration profile
+         *
+         * @throws openvpn::Exception if the JSON document is invalid
+         */
+        std::string Profile()
+        {
+            std::string profile;
+            profile.reserve(json.size());
+            pos = 0;
+
+            expect('{');
+            if (!consume('}'))
+            {
+                do
+                {
+                    std::string name = read_string();
+                    expect(':');
+                    if (consume('['))
+                    {
+                        if (!consume(']'))
+                        {
+                            do
+                            {
+                                profile += optparser_mkline(name, read_value());
+                            } while (consume(','));
+                            expect(']');
+                        }
+                    }
+                    else
+                    {
+                        profile += optparser_mkline(name, read_value());
+                    }
+                } while (consume(','));
+                expect('}');
+            }
+            skip_ws();
+            if (pos != json.size())
+            {
+                error("trailing data");
+            }
+            return profile;
+        }
+
+
+    private:
+        const std::string& json;
+        size_t pos = 0;
+
+
+        [[noreturn]] void error(const std::string& msg)
+        {
+            throw Exception("Invalid JSON profile: " + msg + " at offset "
+                            + std::to_string(pos));
+        }
+
+
+        void skip_ws()
+        {
+            while (pos < json.size()
+                   && (' ' == json[pos] || '\t' == json[pos]
+                       || '\n' == json[pos] || '\r' == json[pos]))
+            {
+                ++pos;
+            }
+        }
+
+
+        bool consume(char c)
+        {
+            skip_ws();
+            if (pos < json.size() && c == json[pos])
+            {
+                ++pos;
+                return true;
+            }
+            return false;
+        }
+
+
+        void expect(char c)
+        {
+            if (!consume(c))
+            {
+                error(std::string("expected '") + c + "'");
+            }
+        }
+
+
+        std::string read_value()
+        {
+            skip_ws();
+            if (pos < json.size() && '"' == json[pos])
+            {
+                return read_string();
+            }
+
+            // Numbers, true, false and null
+            size_t start = pos;
+            while (pos < json.size()
+                   && (isalnum((unsigned char) json[pos])
+                       || '-' == json[pos] || '+' == json[pos]
+                       || '.' == json[pos]))
+            {
+                ++pos;
+            }
+            if (start == pos)
+            {
+                error("expected a string value");
+            }
+            std::string ret = json.substr(start, pos - start);
+            return ("null" == ret ? "" : ret);
+        }
+
+
+        std::string read_string()
+        {
+            expect('"');
+            std::string ret;
+            while (true)
+            {
+                size_t end = json.find_first_of("\"\\", pos);
+                if (std::string::npos == end)
+                {
+                    error("unterminated string");
+                }
+                ret.append(json, pos, end - pos);
+                pos = end + 1;
+                if ('"' == json[end])
+                {
+                    return ret;
+                }
+                if (pos >= json.size())
+                {
+                    error("unterminated string");
+                }
+
+                char c = json[pos++];
+                switch (c)
+                {
+                case '"':  ret += '"'; break;
+                case '\\': ret += '\\'; break;
+                case '/':  ret += '/'; break;
+                case 'n':  ret += '\n'; break;
+                case 'r':  ret += '\r'; break;
+                case 't':  ret += '\t'; break;
+                case 'b':  ret += '\b'; break;
+                case 'f':  ret += '\f'; break;
+                case 'u':
+                    append_utf8(ret, read_codepoint());
+                    break;
+                default:
+                    error("invalid escape sequence");
+                }
+            }
+        }
+
+
+        unsigned long read_hex4()
+        {
+            if (pos + 4 > json.size())
+            {
+                error("truncated unicode escape");
+            }
+            unsigned long ret = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                char c = json[pos++];
+                ret <<= 4;
+                if (c >= '0' && c <= '9')
+                {
+                    ret |= c - '0';
+                }
+                else if (c >= 'a' && c <= 'f')
+                {
+                    ret |= c - 'a' + 10;
+                }
+                else if (c >= 'A' && c <= 'F')
+                {
+                    ret |= c - 'A' + 10;
+                }
+                else
+                {
+                    error("invalid unicode escape");
+                }
+            }
+            return ret;
+        }
+
+
+        unsigned long read_codepoint()
+        {
+            unsigned long cp = read_hex4();
+            if (cp >= 0xd800 && cp <= 0xdbff)
+            {
+                // UTF-16 surrogate pair
+                if (pos + 2 > json.size() || '\\' != json[pos]
+                    || 'u' != json[pos + 1])
+                {
+                    error("invalid surrogate pair");
+                }
+                pos += 2;
+                unsigned long low = read_hex4();
+                if (low < 0xdc00 || low > 0xdfff)
+                {
+                    error("invalid surrogate pair");
+                }
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            }
+            return cp;
+        }
+
+
+        static void append_utf8(std::string& out, unsigned long cp)
+        {
+            if (cp < 0x80)
+            {
+                out += (char) cp;
+            }
+            else if (cp < 0x800)
+            {
+                out += (char) (0xc0 | (cp >> 6));
+                out += (char) (0x80 | (cp & 0x3f));
+            }
+            else if (cp < 0x10000)
+            {
+                out += (char) (0xe0 | (cp >> 12));
+                out += (char) (0x80 | ((cp >> 6) & 0x3f));
+                out += (char) (0x80 | (cp & 0x3f));
+            }
+            else
+            {
+                out += (char) (0xf0 | (cp >> 18));
+                out += (char) (0x80 | ((cp >> 12) & 0x3f));
+                out += (char) (0x80 | ((cp >> 6) & 0x3f));
+                out += (char) (0x80 | (cp & 0x3f));
+            }
+        }
+    };
+
+
     class ProfileMergeJSON : public openvpn::ProfileMerge
     {
     public:
         ProfileMergeJSON(const std::string json_str)
         {
-            // Read the JSON formatted input string
-            // and parse it into a JSON::Value object.
-            // This has to go through a std::stringstream, as
-            // the JSON parser is stream based.
-            std::stringstream json_stream;
-            json_stream << json_str;  // Convert std::string to std::stringstream
-            Json::Value data;
-            json_stream >> data;      // Parse into JSON::Value
-
-
-            // Parse the JSON input into a plain/text config file which
-            // is then parsed/imported into the OpenVPN option storage.
-            std::stringstream config_str;
-            for( Json::ValueIterator it = data.begin();
-                 it != data.end(); ++it) {
-                std::string name = it.name();
-                config_str << optparser_mkline(name, data[name].asString());
-            }
-            expand_profile(config_str.str(), "", openvpn::ProfileMerge::FOLLOW_NONE,
+            // Convert the JSON formatted input string straight into
+            // a plain/text config file which is then parsed/imported
+            // into the OpenVPN option storage.
+            std::string config_str = JSONProfileReader(json_str).Profile();
+            expand_profile(config_str, "", openvpn::ProfileMerge::FOLLOW_NONE,
                            openvpn::ProfileParseLimits::MAX_LINE_SIZE,
                            openvpn::ProfileParseLimits::MAX_PROFILE_SIZE,
                            profile_content().size());
@@ -0,0 +1,208 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   memfd.hpp
+ *
+ * @brief  Helpers for passing larger data blobs between processes via
+ *         sealed memfd file descriptors
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <string>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC             0x0001U
+#define MFD_ALLOW_SEALING       0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS             1033
+#define F_GET_SEALS             1034
+#define F_SEAL_SEAL             0x0001
+#define F_SEAL_SHRINK           0x0002
+#define F_SEAL_GROW             0x0004
+#define F_SEAL_WRITE            0x0008
+#endif
+
+
+class MemFDException : public std::exception
+{
+public:
+    MemFDException(const std::string& err)
+        : err(err)
+    {
+    }
+
+    virtual const char* what() const noexcept
+    {
+        return err.c_str();
+    }
+
+private:
+    std::string err;
+};
+
+
+/**
+ *  Creates an anonymous memory backed file containing the given data.
+ *  The file is sealed before it is returned, so neither the sender nor
+ *  the receiver can modify it afterwards.
+ *
+ * @param name  std::string with a name of the file, only used for
+ *              debugging purposes (/proc/$PID/fd/)
+ * @param data  std::string with the data to put into the file
+ *
+ * @return Returns a file descriptor to the sealed memfd.  The caller
+ *         is responsible for closing it.
+ */
+inline int memfd_create_sealed(const std::string& name,
+                               const std::string& data)
+{
+    int fd = (int) ::syscall(SYS_memfd_create, name.c_str(),
+                             MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        throw MemFDException("Could not create memfd: "
+                             + std::string(strerror(errno)));
+    }
+
+    if (0 != ::ftruncate(fd, data.size()))
+    {
+        std::string err(strerror(errno));
+        ::close(fd);
+        throw MemFDException("Could not resize memfd: " + err);
+    }
+
+    const char *p = data.data();
+    size_t left = data.size();
+    while (left > 0)
+    {
+        ssize_t r = ::write(fd, p, left);
+        if (r < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        if (r <= 0)
+        {
+            std::string err(strerror(errno));
+            ::close(fd);
+            throw MemFDException("Could not write to memfd: " + err);
+        }
+        p += r;
+        left -= r;
+    }
+
+    if (0 != ::fcntl(fd, F_ADD_SEALS,
+                     F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL))
+    {
+        std::string err(strerror(errno));
+        ::close(fd);
+        throw MemFDException("Could not seal memfd: " + err);
+    }
+    return fd;
+}
+
+
+/**
+ *  Reads the contents of a sealed memfd.  The file descriptor must be
+ *  sealed against writing, shrinking and growing; this ensures the
+ *  sender cannot modify the contents after it has been validated.
+ *
+ * @param fd        File descriptor of the memfd to read
+ * @param max_size  Maximum size of the contents to accept
+ *
+ * @return Returns a std::string with the contents of the memfd
+ */
+inline std::string memfd_read_sealed(int fd, size_t max_size)
+{
+    const int required = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+    int seals = ::fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || required != (seals & required))
+    {
+        throw MemFDException("File descriptor is not a sealed memfd");
+    }
+
+    struct stat st;
+    if (0 != ::fstat(fd, &st))
+    {
+        throw MemFDException("Could not stat memfd: "
+                             + std::string(strerror(errno)));
+    }
+    if ((size_t) st.st_size > max_size)
+    {
+        throw MemFDException("memfd contents is too large");
+    }
+    if (0 == st.st_size)
+    {
+        return std::string();
+    }
+
+    void *map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == map)
+    {
+        throw MemFDException("Could not map memfd: "
+                             + std::string(strerror(errno)));
+    }
+    std::string ret((const char *) map, st.st_size);
+    ::munmap(map, st.st_size);
+    return ret;
+}
+
+
+/**
+ *  Reads the text contents of a sealed memfd, see memfd_read_sealed().
+ *  The contents must be valid UTF-8 and must not contain any NUL
+ *  characters, as it will later be passed on as a C string.
+ *
+ * @param fd        File descriptor of the memfd to read
+ * @param max_size  Maximum size of the contents to accept
+ *
+ * @return Returns a std::string with the contents of the memfd
+ */
+inline std::string memfd_read_sealed_text(int fd, size_t max_size)
+{
+    std::string ret = memfd_read_sealed(fd, max_size);
+
+    const char *nul = (const char *) ::memchr(ret.data(), '\0', ret.size());
+    if (nullptr != nul)
+    {
+        throw MemFDException("memfd contents contains a NUL character at "
+                             "offset " + std::to_string(nul - ret.data()));
+    }
+
+    const gchar *end = nullptr;
+    if (!g_utf8_validate(ret.data(), ret.size(), &end))
+    {
+        throw MemFDException("memfd contents is not valid UTF-8 at offset "
+                             + std::to_string(end - ret.data()));
+    }
+    return ret;
+}
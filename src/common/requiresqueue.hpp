@@ -34,6 +34,8 @@
 #include <iostream>
 #include <sstream>
 #include <map>
+#include <mutex>
+#include <tuple>
 #include <vector>
 #include <algorithm>
 #include <exception>
@@ -115,8 +117,7 @@ public:
 
     const std::string& err() const noexcept
     {
-        std::string ret(error);
-        return std::move(ret);
+        return error;
     }
 
 
@@ -142,6 +143,17 @@ private:
 
 /**
  *  Implements the service/server side of the RequiresQueue
+ *
+ *  The slots are indexed by type, group and ID, which keeps all slots of
+ *  a type/group next to each other.  Lookups by ID are thus direct and
+ *  lookups by name only need to look at the slots of a single type/group.
+ *
+ *  A RequiresQueue is used both by the D-Bus thread and by the VPN client
+ *  thread (dynamic challenge), so all methods are serialized by a mutex.
+ *  The D-Bus responses are sent after the mutex has been released.
+ *
+ *  Values provided for slots with hidden input are secrets, which are
+ *  overwritten in memory when they are no longer needed.
  */
 class RequiresQueue
 {
@@ -155,8 +167,15 @@ public:
 
     ~RequiresQueue()
     {
+        for (auto& e : slots)
+        {
+            wipe(e.second);
+        }
     }
 
+    RequiresQueue(const RequiresQueue&) = delete;
+    RequiresQueue& operator=(const RequiresQueue&) = delete;
+
     /**
      * Returns a string containing a D-Bus introspection section for the
      * RequiresQueue methods available via D-Bus.  The method names provided
@@ -214,6 +233,11 @@ public:
      * The type and group arguments allows a single RequiresQueue object to
      * process multiple queues in parallel and also be available over D-Bus.
      *
+     * If a requirement with the same name already exists in this
+     * type/group, it is replaced by the new one.  This happens when a
+     * server sends a new dynamic challenge, where the previous challenge
+     * and its response are no longer valid.
+     *
      * @param type   ClientAttentionType reference
      * @param group  ClientAttentionGroup reference
      * @param name   String with a variable name for the requested input
@@ -228,17 +252,26 @@ public:
                     std::string descr,
                     bool hidden_input)
     {
-        struct RequiresSlot elmt;
-        elmt.id = reqids[get_reqid_index(type, group)]++;
+        std::lock_guard<std::mutex> guard(mtx);
+
+        auto old = find_slot(type, group, name);
+        if (slots.end() != old)
+        {
+            wipe(old->second);
+            slots.erase(old);
+        }
+
+        unsigned int id = reqids[ClientAttTypeGroup(type, group)]++;
+        struct RequiresSlot& elmt = slots[SlotKey(type, group, id)];
+        elmt.id = id;
         elmt.type = type;
         elmt.group = group;
-        elmt.name = name;
-        elmt.user_description = descr;
+        elmt.name = std::move(name);
+        elmt.user_description = std::move(descr);
         elmt.provided = false;
         elmt.hidden_input = hidden_input;
-        slots.push_back(elmt);
 
-        return elmt.id;
+        return id;
     }
 
 
@@ -258,34 +291,29 @@ public:
         unsigned int id;
         g_variant_get(parameters, "(uuu)", &type, &group, &id);
 
-        // Fetch the requested slot id
-        for (auto& e : slots)
+        GVariant *elmt = nullptr;
         {
-            if (id == e.id)
+            std::lock_guard<std::mutex> guard(mtx);
+            const struct RequiresSlot& e = get_slot((ClientAttentionType) type,
+                                                    (ClientAttentionGroup) group,
+                                                    id,
+                                                    "net.openvpn.v3.element-not-found",
+                                                    "No requires queue element found");
+            if (e.provided)
             {
-                if (e.type == (ClientAttentionType) type
-                    && e.group == (ClientAttentionGroup) group)
-                {
-                    if (e.provided)
-                    {
-                        throw RequiresQueueException("net.openvpn.v3.already-provided",
-                                                     "User input already provided");
-                    }
-
-                    GVariant *elmt = g_variant_new("(uuussb)",
-                                                   e.type,
-                                                   e.group,
-                                                   e.id,
-                                                   e.name.c_str(),
-                                                   e.user_description.c_str(),
-                                                   e.hidden_input);
-                    g_dbus_method_invocation_return_value(invocation, elmt);
-                    return;
-                }
+                throw RequiresQueueException("net.openvpn.v3.already-provided",
+                                             "User input already provided");
             }
+
+            elmt = g_variant_new("(uuussb)",
+                                 e.type,
+                                 e.group,
+                                 e.id,
+                                 e.name.c_str(),
+                                 e.user_description.c_str(),
+                                 e.hidden_input);
         }
-        throw RequiresQueueException("net.openvpn.v3.element-not-found",
-                                     "No requires queue element found");
+        g_dbus_method_invocation_return_value(invocation, elmt);
     }
 
 
@@ -309,25 +337,18 @@ public:
     void UpdateEntry(ClientAttentionType type, ClientAttentionGroup group,
                      unsigned int id, std::string newvalue)
     {
-        for (auto& e : slots)
+        std::lock_guard<std::mutex> guard(mtx);
+        struct RequiresSlot& e = get_slot(type, group, id,
+                                          "net.openvpn.v3.invalid-input",
+                                          "No matching entry found in the request queue");
+        if (e.provided)
         {
-            if (e.type ==  type && e.group == (ClientAttentionGroup) group && e.id == id)
-            {
-                if (!e.provided)
-                {
-                    e.provided = true;
-                    e.value = newvalue;
-                    return;
-                }
-                else
-                {
-                    throw RequiresQueueException("net.openvpn.v3.error.input-already-provided",
-                                                 "Request ID " + std::to_string(id) + " has already been provided");
-                }
-            }
+            wipe(newvalue);
+            throw RequiresQueueException("net.openvpn.v3.error.input-already-provided",
+                                         "Request ID " + std::to_string(id) + " has already been provided");
         }
-        throw RequiresQueueException("net.openvpn.v3.invalid-input",
-                                     "No matching entry found in the request queue");
+        e.provided = true;
+        e.value = std::move(newvalue);
     }
 
 
@@ -370,9 +391,12 @@ public:
                                          "No value provided for RequiresSlot ID " + std::to_string(id));
         }
 
-        UpdateEntry((ClientAttentionType) type, (ClientAttentionGroup) group, id, std::string(value));
-        g_dbus_method_invocation_return_value(invocation, NULL);
+        std::string newvalue(value);
+        wipe(value);
         g_free(value);  // Avoid leak
+
+        UpdateEntry((ClientAttentionType) type, (ClientAttentionGroup) group, id, std::move(newvalue));
+        g_dbus_method_invocation_return_value(invocation, NULL);
     }
 
 
@@ -389,16 +413,29 @@ public:
      */
     void ResetValue(ClientAttentionType type, ClientAttentionGroup group, unsigned int id)
     {
-        for (auto& e : slots)
+        std::lock_guard<std::mutex> guard(mtx);
+        struct RequiresSlot& e = get_slot(type, group, id, "",
+                                          "No matching entry found in the request queue");
+        wipe(e);
+    }
+
+    /**
+     * Removes all the requirements of a type/group, wiping any values
+     * already provided.  This is used when the requirements are no longer
+     * valid, such as a dynamic challenge when a new connection is started.
+     *
+     * @param type   ClientAttentionType of the requirements to remove
+     * @param group  ClientAttentionGroup of the requirements to remove
+     */
+    void RemoveGroup(ClientAttentionType type, ClientAttentionGroup group)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        auto range = group_range(type, group);
+        for (auto it = range.first; it != range.second; ++it)
         {
-            if (e.type == type && e.group == group && e.id == id)
-            {
-                e.provided = false;
-                e.value = "";
-                return;
-            }
+            wipe(it->second);
         }
-        throw RequiresQueueException("No matching entry found in the request queue");
+        slots.erase(range.first, range.second);
     }
 
     /**
@@ -413,18 +450,9 @@ public:
      */
     std::string GetResponse(ClientAttentionType type, ClientAttentionGroup group, unsigned int id)
     {
-        for (auto& e : slots)
-        {
-            if (e.type == type && e.group == group && e.id == id)
-            {
-                if (!e.provided)
-                {
-                    throw RequiresQueueException("Request never provided by front-end");
-                }
-                return e.value;
-            }
-        }
-        throw RequiresQueueException("No matching entry found in the request queue");
+        std::lock_guard<std::mutex> guard(mtx);
+        return get_provided(get_slot(type, group, id, "",
+                                     "No matching entry found in the request queue")).value;
     }
 
     /**
@@ -439,18 +467,29 @@ public:
      */
     std::string GetResponse(ClientAttentionType type, ClientAttentionGroup group, std::string name)
     {
-        for (auto& e : slots)
-        {
-            if (e.type == type && e.group == group && e.name == name)
-            {
-                if (!e.provided)
-                {
-                    throw RequiresQueueException("Request never provided by front-end");
-                }
-                return e.value;
-            }
-        }
-        throw RequiresQueueException("No matching entry found in the request queue");
+        std::lock_guard<std::mutex> guard(mtx);
+        return get_provided(get_slot(type, group, name)).value;
+    }
+
+    /**
+     * Retrieve a front-end response which can only be used once, such as
+     * a dynamic challenge response.  The stored value is wiped, but the
+     * slot is still considered provided; a later retrieval returns an
+     * empty string.
+     *
+     * @param type   ClientAttentionType which the value is categorised under
+     * @param group  ClientAttentionGroup which the value is categorised under
+     * @param name   A string containing the variable name of the value
+     * @return Returns a string with the value if the value was found and
+     *         provided by the user, otherwise an exception is thrown.
+     */
+    std::string TakeResponse(ClientAttentionType type, ClientAttentionGroup group, std::string name)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        struct RequiresSlot& e = get_provided(get_slot(type, group, name));
+        std::string ret(e.value);
+        wipe(e.value);
+        return ret;
     }
 
     /**
@@ -463,15 +502,9 @@ public:
      */
     unsigned int QueueCount(ClientAttentionType type, ClientAttentionGroup group)
     {
-        unsigned int ret = 0;
-        for (auto& e : slots)
-        {
-            if (type == e.type && group == e.group)
-            {
-                ret++;
-            }
-        }
-        return ret;
+        std::lock_guard<std::mutex> guard(mtx);
+        auto range = group_range(type, group);
+        return (unsigned int) std::distance(range.first, range.second);
     }
 
 
@@ -487,29 +520,19 @@ public:
      */
     std::vector<ClientAttTypeGroup> QueueCheckTypeGroup()
     {
+        std::lock_guard<std::mutex> guard(mtx);
         std::vector<ClientAttTypeGroup> ret;
 
+        // The slots are ordered by type/group, so each type/group
+        // only needs to be compared with the last one added
         for (auto& e : slots)
         {
-            if (!e.provided)
+            if (!e.second.provided)
             {
-                // Check if we've already spotted this type/group
-                bool found = false;
-                for (auto& r : ret)
-                {
-                    ClientAttentionType t;
-                    ClientAttentionGroup g;
-                    std::tie(t, g) = r;
-                    if (t == e.type && g == e.group)
-                    {
-                        // yes, we have
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found)
+                ClientAttTypeGroup tg(e.second.type, e.second.group);
+                if (ret.empty() || ret.back() != tg)
                 {
-                    ret.push_back(std::make_tuple(e.type, e.group));
+                    ret.push_back(tg);
                 }
             }
         }
@@ -561,14 +584,14 @@ public:
      */
     std::vector<unsigned int> QueueCheck(ClientAttentionType type, ClientAttentionGroup group)
     {
+        std::lock_guard<std::mutex> guard(mtx);
         std::vector<unsigned int> ret;
-        for (auto& e : slots)
+        auto range = group_range(type, group);
+        for (auto it = range.first; it != range.second; ++it)
         {
-            if (type == e.type
-                && group == e.group
-                && !e.provided)
+            if (!it->second.provided)
             {
-                ret.push_back(e.id);
+                ret.push_back(it->second.id);
             }
         }
         return ret;
@@ -621,10 +644,11 @@ public:
      */
     unsigned int QueueCheckAll()
     {
+        std::lock_guard<std::mutex> guard(mtx);
         unsigned int ret = 0;
         for (auto& e : slots)
         {
-            if (!e.provided)
+            if (!e.second.provided)
             {
                 ret++;
             }
@@ -676,6 +700,11 @@ public:
         unsigned int id;
         gchar *value = nullptr;
         g_variant_get(parameters, "(uuus)", &type, &group, &id, &value);
+        if (nullptr != value)
+        {
+            wipe(value);
+            g_free(value);
+        }
 
         return QueueCheck((ClientAttentionType) type, (ClientAttentionGroup) group).size() == 0;
     }
@@ -698,8 +727,10 @@ public:
      */
     void _DumpQueue(std::ostream& logdst)
     {
-        for (auto& e : slots)
+        std::lock_guard<std::mutex> guard(mtx);
+        for (auto& s : slots)
         {
+        const struct RequiresSlot& e = s.second;
         logdst << "          Id: " << e.id << std::endl
                << "         Key: " << e.name << std::endl
                << "        Type: [" << std::to_string((int) e.type) << "] "
@@ -719,26 +750,127 @@ public:
 #endif
 
 private:
-    std::map<unsigned int, unsigned int> reqids;
-    std::vector<struct RequiresSlot> slots;
+    typedef std::tuple<ClientAttentionType, ClientAttentionGroup, unsigned int> SlotKey;
+    typedef std::map<SlotKey, struct RequiresSlot> SlotMap;
+
+    std::mutex mtx;
+    std::map<ClientAttTypeGroup, unsigned int> reqids;
+    SlotMap slots;
 
 
     /**
-     * Simple index hashing to be used by a single dimensional integer
-     * array/table.  This is used to have a unique single ID per type:group,
-     * used for a table keeping track of slot IDs used within each type:group.
+     *  The slots of a type/group is the range from the first slot with
+     *  ID 0 up to, but not including, the first slot of the next group.
      *
-     * @param type   ClientAttentionType reference
-     * @param group  ClientAttentionGroup reference
-     *
-     * @return  Returns a unique index based on the two input arguments
+     * @return Returns a std::pair with the first and the end iterator of
+     *         the slots in a type/group
      */
-    unsigned int get_reqid_index(ClientAttentionType type, ClientAttentionGroup group)
+    std::pair<SlotMap::iterator, SlotMap::iterator> group_range(ClientAttentionType type,
+                                                                ClientAttentionGroup group)
+    {
+        SlotMap::iterator first = slots.lower_bound(SlotKey(type, group, 0));
+        SlotMap::iterator last = first;
+        while (slots.end() != last
+               && std::get<0>(last->first) == type
+               && std::get<1>(last->first) == group)
+        {
+            ++last;
+        }
+        return std::make_pair(first, last);
+    }
+
+
+    SlotMap::iterator find_slot(ClientAttentionType type,
+                                ClientAttentionGroup group,
+                                const std::string& name)
     {
-        return ((unsigned int)type *100) + (unsigned int)group;
+        auto range = group_range(type, group);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.name == name)
+            {
+                return it;
+            }
+        }
+        return slots.end();
+    }
 
+
+    struct RequiresSlot& get_slot(ClientAttentionType type,
+                                  ClientAttentionGroup group,
+                                  unsigned int id,
+                                  const std::string& errname,
+                                  const std::string& errmsg)
+    {
+        auto it = slots.find(SlotKey(type, group, id));
+        if (slots.end() == it)
+        {
+            if (errname.empty())
+            {
+                throw RequiresQueueException(errmsg);
+            }
+            throw RequiresQueueException(errname, errmsg);
+        }
+        return it->second;
     }
 
+
+    struct RequiresSlot& get_slot(ClientAttentionType type,
+                                  ClientAttentionGroup group,
+                                  const std::string& name)
+    {
+        auto it = find_slot(type, group, name);
+        if (slots.end() == it)
+        {
+            throw RequiresQueueException("No matching entry found in the request queue");
+        }
+        return it->second;
+    }
+
+
+    static struct RequiresSlot& get_provided(struct RequiresSlot& slot)
+    {
+        if (!slot.provided)
+        {
+            throw RequiresQueueException("Request never provided by front-end");
+        }
+        return slot;
+    }
+
+
+    /**
+     *  Overwrites a string in memory before it is released.  The volatile
+     *  pointer prevents the compiler from optimizing the writes away.
+     */
+    static void wipe(std::string& str)
+    {
+        volatile char *p = &str[0];
+        for (size_t i = 0; i < str.size(); ++i)
+        {
+            p[i] = '\0';
+        }
+        str.clear();
+    }
+
+
+    static void wipe(gchar *str)
+    {
+        volatile gchar *p = str;
+        while ('\0' != *p)
+        {
+            *p++ = '\0';
+        }
+    }
+
+
+    /**
+     *  Clears the response of a slot, making it ready to be provided again
+     */
+    static void wipe(struct RequiresSlot& slot)
+    {
+        wipe(slot.value);
+        slot.provided = false;
+    }
 };
 
 #endif // OPENVPN3_DBUS_REQUIRESQUEUE_HPP
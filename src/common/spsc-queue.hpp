@@ -0,0 +1,313 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   spsc-queue.hpp
+ *
+ * @brief  Bounded lock-free queue between exactly one producer thread
+ *         and one consumer thread
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ *  A fixed size ring buffer where one thread adds elements and another
+ *  thread removes them, without any locking.  Neither side ever blocks;
+ *  Push() fails when the queue is full and Pop() fails when it is empty.
+ *
+ *  Only one thread may call Push() and only one thread may call Pop()
+ *  at any time.  The producer or consumer thread may be replaced, as
+ *  long as the old thread is joined before the new one starts using
+ *  the queue.
+ *
+ * @tparam T  Element type.  It must be default constructible and
+ *            move assignable.
+ */
+template <typename T>
+class SPSCQueue
+{
+public:
+    /**
+     *  Allocates the ring buffer
+     *
+     * @param capacity  Minimum number of elements the queue can hold.  It
+     *                  is rounded up to the next power of two.
+     */
+    SPSCQueue(size_t capacity)
+        : mask(round_up(capacity) - 1),
+          slots(mask + 1)
+    {
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+
+    /**
+     *  Adds an element to the queue.  Must only be called by the
+     *  producer thread.
+     *
+     * @param elem  Element to add.  It is only moved from on success.
+     *
+     * @return Returns false if the queue is full, otherwise true
+     */
+    bool Push(T&& elem)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache > mask)
+        {
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache > mask)
+            {
+                return false;
+            }
+        }
+        slots[t & mask] = std::move(elem);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+
+    /**
+     *  Removes the oldest element from the queue.  Must only be called
+     *  by the consumer thread.
+     *
+     * @param elem  Receives the removed element
+     *
+     * @return Returns false if the queue is empty, otherwise true
+     */
+    bool Pop(T& elem)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache)
+        {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache)
+            {
+                return false;
+            }
+        }
+        elem = std::move(slots[h & mask]);
+        slots[h & mask] = T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+
+    /**
+     * @return Returns the number of elements the queue can hold
+     */
+    size_t GetCapacity() const noexcept
+    {
+        return mask + 1;
+    }
+
+
+    /**
+     * @return Returns an approximate number of queued elements.  The
+     *         value may be outdated as soon as it is returned.
+     */
+    size_t GetSize() const noexcept
+    {
+        return tail.load(std::memory_order_acquire)
+               - head.load(std::memory_order_acquire);
+    }
+
+
+private:
+    static const size_t cacheline = 64;
+
+    const size_t mask;
+    std::vector<T> slots;
+
+    // The producer and consumer indexes are kept on separate cache lines,
+    // each together with its own cached copy of the other side's index.
+    // This is done by padding with a whole cache line rather than with
+    // alignas(), as over-aligned objects allocated with new are not
+    // aligned as requested before C++17.
+    char pad_shared[cacheline];
+    std::atomic<size_t> tail{0};
+    size_t head_cache = 0;
+    char pad_producer[cacheline];
+    std::atomic<size_t> head{0};
+    size_t tail_cache = 0;
+    char pad_consumer[cacheline];
+
+
+    static size_t round_up(size_t v)
+    {
+        size_t r = 1;
+        while (r < v)
+        {
+            r <<= 1;
+        }
+        return r;
+    }
+};
+
+
+/**
+ *  An SPSCQueue which knows which thread is its producer.  Push() from
+ *  that thread uses the lock-free ring buffer.  Any other thread calling
+ *  Push() falls back to a list protected by a mutex, so a stray thread
+ *  can never corrupt the ring buffer.  Pop() returns the elements of
+ *  the ring buffer first, so the ordering is only kept between the
+ *  elements added by the same thread.
+ *
+ *  The producer thread is replaced with SetProducer(), once the old
+ *  producer thread has stopped using the queue.
+ *
+ * @tparam T  Element type, as for SPSCQueue
+ */
+template <typename T>
+class CheckedSPSCQueue
+{
+public:
+    /**
+     *  Allocates the ring buffer
+     *
+     * @param capacity  Minimum number of elements the ring buffer can
+     *                  hold.  It is rounded up to the next power of two.
+     *                  The locked list holds as many elements.
+     */
+    CheckedSPSCQueue(size_t capacity)
+        : ring(capacity)
+    {
+    }
+
+    CheckedSPSCQueue(const CheckedSPSCQueue&) = delete;
+    CheckedSPSCQueue& operator=(const CheckedSPSCQueue&) = delete;
+
+
+    /**
+     *  Sets the thread using the lock-free ring buffer
+     *
+     * @param id  std::thread::id of the producer thread.  A default
+     *            constructed id makes all threads use the locked list.
+     */
+    void SetProducer(std::thread::id id)
+    {
+        producer.store(id, std::memory_order_release);
+    }
+
+
+    /**
+     *  Adds an element to the queue.  It may be called from any thread
+     *  except the consumer thread.
+     *
+     * @param elem  Element to add.  It is only moved from on success.
+     *
+     * @return Returns false if the queue is full, otherwise true
+     */
+    bool Push(T&& elem)
+    {
+        if (std::this_thread::get_id() == producer.load(std::memory_order_acquire))
+        {
+            return ring.Push(std::move(elem));
+        }
+
+        std::lock_guard<std::mutex> guard(locked_mtx);
+        if (locked.size() >= ring.GetCapacity())
+        {
+            return false;
+        }
+        locked.push_back(std::move(elem));
+        locked_size.store(locked.size(), std::memory_order_release);
+        locked_pushes.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+
+    /**
+     *  Removes an element from the queue.  Must only be called by the
+     *  consumer thread.
+     *
+     * @param elem  Receives the removed element
+     *
+     * @return Returns false if the queue is empty, otherwise true
+     */
+    bool Pop(T& elem)
+    {
+        if (ring.Pop(elem))
+        {
+            return true;
+        }
+        if (0 == locked_size.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(locked_mtx);
+        if (locked.empty())
+        {
+            return false;
+        }
+        elem = std::move(locked.front());
+        locked.pop_front();
+        locked_size.store(locked.size(), std::memory_order_release);
+        return true;
+    }
+
+
+    /**
+     * @return Returns the number of elements the ring buffer can hold
+     */
+    size_t GetCapacity() const noexcept
+    {
+        return ring.GetCapacity();
+    }
+
+
+    /**
+     * @return Returns an approximate number of queued elements in the
+     *         ring buffer.  The locked list is not included.
+     */
+    size_t GetSize() const noexcept
+    {
+        return ring.GetSize();
+    }
+
+
+    /**
+     * @return Returns the number of elements which have been added by
+     *         other threads than the producer thread
+     */
+    unsigned long GetLockedPushes() const noexcept
+    {
+        return locked_pushes.load(std::memory_order_relaxed);
+    }
+
+
+private:
+    SPSCQueue<T> ring;
+    std::atomic<std::thread::id> producer{std::thread::id()};
+    std::mutex locked_mtx;
+    std::deque<T> locked;
+    std::atomic<size_t> locked_size{0};
+    std::atomic<unsigned long> locked_pushes{0};
+};
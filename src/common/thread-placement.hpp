@@ -0,0 +1,383 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   thread-placement.hpp
+ *
+ * @brief  CPU affinity, scheduling policy, nice value and NUMA node
+ *         settings for a thread
+ */
+
+#pragma once
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+class ThreadPlacementException : public std::exception
+{
+public:
+    ThreadPlacementException(const std::string& err)
+        : err(err)
+    {
+    }
+
+    virtual const char* what() const noexcept
+    {
+        return err.c_str();
+    }
+
+private:
+    std::string err;
+};
+
+
+/**
+ *  Describes where and how a thread should run: which CPUs it may use,
+ *  its scheduling policy and nice value, and which NUMA node it should
+ *  run on and allocate memory from.  Settings which are not set are not
+ *  changed.
+ *
+ *  The settings are validated when they are set, which throws a
+ *  ThreadPlacementException on invalid values.  Apply() must be called
+ *  from the thread to modify, as all these settings are per thread.
+ */
+class ThreadPlacement
+{
+public:
+    ThreadPlacement()
+    {
+        CPU_ZERO(&cpus);
+    }
+
+
+    /**
+     *  Restricts the thread to a list of CPUs
+     *
+     * @param cpulist  std::string with a comma separated list of CPU
+     *                 numbers and ranges, such as "0-3,8"
+     */
+    void SetCPUs(const std::string& cpulist)
+    {
+        cpus = parse_cpulist(cpulist);
+        cpus_str = cpulist;
+    }
+
+
+    /**
+     *  Sets the scheduling policy.  The real-time policies can be given a
+     *  priority, such as "fifo:10", which otherwise is 1.
+     *
+     * @param policy  std::string with the policy: other, batch, idle,
+     *                fifo[:PRIO] or rr[:PRIO]
+     */
+    void SetSchedPolicy(const std::string& policy)
+    {
+        std::string name = policy.substr(0, policy.find(':'));
+        int pol = SCHED_OTHER;
+        int prio = 0;
+        if ("other" == name)
+        {
+            pol = SCHED_OTHER;
+        }
+        else if ("batch" == name)
+        {
+            pol = SCHED_BATCH;
+        }
+        else if ("idle" == name)
+        {
+            pol = SCHED_IDLE;
+        }
+        else if ("fifo" == name || "rr" == name)
+        {
+            pol = ("fifo" == name ? SCHED_FIFO : SCHED_RR);
+            prio = 1;
+        }
+        else
+        {
+            throw ThreadPlacementException("Invalid scheduling policy '"
+                                           + policy + "'");
+        }
+
+        if (name.size() < policy.size())
+        {
+            if (0 == prio)
+            {
+                throw ThreadPlacementException("Scheduling policy '" + name
+                                               + "' does not take a priority");
+            }
+            prio = parse_int(policy.substr(name.size() + 1),
+                             sched_get_priority_min(pol),
+                             sched_get_priority_max(pol),
+                             "scheduling priority");
+        }
+        sched_policy = pol;
+        sched_priority = prio;
+        sched_str = policy;
+    }
+
+
+    /**
+     *  Sets the nice value
+     *
+     * @param nice  std::string with the nice value, from -20 to 19
+     */
+    void SetNice(const std::string& nice)
+    {
+        nice_value = parse_int(nice, -20, 19, "nice value");
+        nice_set = true;
+    }
+
+
+    /**
+     *  Restricts the thread to the CPUs of a NUMA node and makes it
+     *  prefer memory from this node.  If CPUs are also set with
+     *  SetCPUs(), the thread is restricted to the CPUs in both sets.
+     *
+     * @param node  std::string with the NUMA node number
+     */
+    void SetNUMANode(const std::string& node)
+    {
+        numa_node = parse_int(node, 0, max_numa_nodes - 1, "NUMA node");
+    }
+
+
+    /**
+     * @return Returns true if a real-time scheduling policy or a negative
+     *         nice value has been set.  These settings can starve the
+     *         rest of the system and must only be accepted from trusted
+     *         sources.
+     */
+    bool IsPrivileged() const
+    {
+        return (!sched_str.empty()
+                && (SCHED_FIFO == sched_policy || SCHED_RR == sched_policy))
+               || (nice_set && nice_value < 0);
+    }
+
+
+    /**
+     * @return Returns true if no settings have been set
+     */
+    bool Empty() const
+    {
+        return cpus_str.empty() && sched_str.empty() && !nice_set
+               && numa_node < 0;
+    }
+
+
+    /**
+     * @return Returns a human readable description of the settings
+     */
+    std::string str() const
+    {
+        std::stringstream ret;
+        std::string sep;
+        if (!cpus_str.empty())
+        {
+            ret << "cpus=" << cpus_str;
+            sep = ", ";
+        }
+        if (!sched_str.empty())
+        {
+            ret << sep << "sched-policy=" << sched_str;
+            sep = ", ";
+        }
+        if (nice_set)
+        {
+            ret << sep << "nice=" << nice_value;
+            sep = ", ";
+        }
+        if (numa_node >= 0)
+        {
+            ret << sep << "numa-node=" << numa_node;
+        }
+        return ret.str();
+    }
+
+
+    /**
+     *  Applies the settings to the calling thread.  A setting which
+     *  cannot be applied does not stop the remaining settings from
+     *  being applied.
+     *
+     * @return Returns a std::vector of error messages of the settings
+     *         which could not be applied.  Empty on success.
+     */
+    std::vector<std::string> Apply() const
+    {
+        std::vector<std::string> errors;
+
+        if (numa_node >= 0 || !cpus_str.empty())
+        {
+            try
+            {
+                cpu_set_t set = cpus;
+                if (numa_node >= 0)
+                {
+                    cpu_set_t nodecpus = parse_cpulist(read_node_cpulist());
+                    if (cpus_str.empty())
+                    {
+                        set = nodecpus;
+                    }
+                    else
+                    {
+                        CPU_AND(&set, &set, &nodecpus);
+                    }
+                }
+                if (0 != sched_setaffinity(0, sizeof(set), &set))
+                {
+                    errors.push_back("Could not set the CPU affinity: "
+                                     + std::string(strerror(errno)));
+                }
+            }
+            catch (ThreadPlacementException& excp)
+            {
+                errors.push_back(excp.what());
+            }
+        }
+
+        if (numa_node >= 0)
+        {
+            // MPOL_PREFERRED, without depending on libnuma
+            const int mpol_preferred = 1;
+            unsigned long nodemask[max_numa_nodes / (8 * sizeof(unsigned long))] = {};
+            nodemask[numa_node / (8 * sizeof(unsigned long))]
+                = 1UL << (numa_node % (8 * sizeof(unsigned long)));
+            if (0 != syscall(SYS_set_mempolicy, mpol_preferred, nodemask,
+                             max_numa_nodes + 1))
+            {
+                errors.push_back("Could not set the NUMA memory policy: "
+                                 + std::string(strerror(errno)));
+            }
+        }
+
+        if (!sched_str.empty())
+        {
+            struct sched_param param = {};
+            param.sched_priority = sched_priority;
+            if (0 != sched_setscheduler(0, sched_policy, &param))
+            {
+                errors.push_back("Could not set the scheduling policy: "
+                                 + std::string(strerror(errno)));
+            }
+        }
+
+        if (nice_set)
+        {
+            // On Linux the nice value is a per thread attribute
+            pid_t tid = (pid_t) syscall(SYS_gettid);
+            if (0 != setpriority(PRIO_PROCESS, tid, nice_value))
+            {
+                errors.push_back("Could not set the nice value: "
+                                 + std::string(strerror(errno)));
+            }
+        }
+        return errors;
+    }
+
+
+private:
+    static const int max_numa_nodes = 1024;
+
+    cpu_set_t cpus;
+    std::string cpus_str;
+    int sched_policy = SCHED_OTHER;
+    int sched_priority = 0;
+    std::string sched_str;
+    int nice_value = 0;
+    bool nice_set = false;
+    int numa_node = -1;
+
+
+    static int parse_int(const std::string& val, int min, int max,
+                         const std::string& what)
+    {
+        char *end = nullptr;
+        errno = 0;
+        long ret = std::strtol(val.c_str(), &end, 10);
+        if (val.empty() || '\0' != *end || 0 != errno
+            || ret < min || ret > max)
+        {
+            throw ThreadPlacementException("Invalid " + what + " '" + val
+                                           + "'");
+        }
+        return (int) ret;
+    }
+
+
+    static cpu_set_t parse_cpulist(const std::string& cpulist)
+    {
+        cpu_set_t ret;
+        CPU_ZERO(&ret);
+
+        std::stringstream list(cpulist);
+        std::string item;
+        bool found = false;
+        while (std::getline(list, item, ','))
+        {
+            size_t dash = item.find('-');
+            int first = parse_int(item.substr(0, dash), 0, CPU_SETSIZE - 1,
+                                  "CPU number");
+            int last = first;
+            if (std::string::npos != dash)
+            {
+                last = parse_int(item.substr(dash + 1), first,
+                                 CPU_SETSIZE - 1, "CPU range");
+            }
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                CPU_SET(cpu, &ret);
+            }
+            found = true;
+        }
+        if (!found)
+        {
+            throw ThreadPlacementException("Invalid CPU list '" + cpulist
+                                           + "'");
+        }
+        return ret;
+    }
+
+
+    std::string read_node_cpulist() const
+    {
+        std::string fname = "/sys/devices/system/node/node"
+                            + std::to_string(numa_node) + "/cpulist";
+        std::ifstream f(fname);
+        std::string ret;
+        if (!std::getline(f, ret) || ret.empty())
+        {
+            throw ThreadPlacementException("Could not read the CPUs of NUMA node "
+                                           + std::to_string(numa_node));
+        }
+        return ret;
+    }
+};
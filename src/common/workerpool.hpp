@@ -0,0 +1,167 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   workerpool.hpp
+ *
+ * @brief  A fixed size pool of worker threads running jobs outside of
+ *         the GLib main loop, completing them on the main loop
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ *  Runs CPU heavy jobs in a pool of worker threads, so they do not
+ *  block the GLib main loop.  Each job consists of two functions:
+ *
+ *    - work:  Runs in one of the worker threads.  It must not touch
+ *             any D-Bus objects or other state owned by the main loop.
+ *
+ *    - done:  Called from the default GLib main context once the work
+ *             function has completed.  This is where the result is
+ *             used and any D-Bus method invocation is completed.
+ *
+ *  Pending jobs are discarded when the pool is destroyed.
+ */
+class WorkerPool
+{
+public:
+    typedef std::function<void()> Job;
+
+    /**
+     *  Starts the worker threads
+     *
+     * @param threads  Number of worker threads.  0 starts one thread
+     *                 per available CPU.
+     */
+    WorkerPool(unsigned int threads = 0)
+    {
+        if (0 == threads)
+        {
+            threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+        for (unsigned int i = 0; i < threads; ++i)
+        {
+            workers.emplace_back([this]() { worker_loop(); });
+        }
+    }
+
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            shutdown = true;
+            queue.clear();
+        }
+        cond.notify_all();
+        for (auto& t : workers)
+        {
+            t.join();
+        }
+    }
+
+
+    /**
+     *  Queues a new job
+     *
+     * @param work  Function to run in a worker thread
+     * @param done  Function to run in the main loop when work has completed
+     */
+    void Submit(Job work, Job done)
+    {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            queue.emplace_back(std::move(work), std::move(done));
+        }
+        cond.notify_one();
+    }
+
+
+    /**
+     * @return Returns the number of worker threads
+     */
+    size_t GetThreadCount() const noexcept
+    {
+        return workers.size();
+    }
+
+
+    /**
+     * @return Returns the number of jobs waiting for a worker thread
+     */
+    size_t GetQueueLength()
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        return queue.size();
+    }
+
+
+private:
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::deque<std::pair<Job, Job>> queue;
+    std::vector<std::thread> workers;
+    bool shutdown = false;
+
+
+    void worker_loop()
+    {
+        while (true)
+        {
+            std::pair<Job, Job> job;
+            {
+                std::unique_lock<std::mutex> guard(mtx);
+                cond.wait(guard, [this]() { return shutdown || !queue.empty(); });
+                if (shutdown)
+                {
+                    return;
+                }
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            job.first();
+            g_idle_add_full(G_PRIORITY_DEFAULT, run_done,
+                            new Job(std::move(job.second)),
+                            nullptr);
+        }
+    }
+
+
+    static gboolean run_done(gpointer data)
+    {
+        Job *done = static_cast<Job *>(data);
+        (*done)();
+        delete done;
+        return G_SOURCE_REMOVE;
+    }
+};
@@ -20,13 +20,21 @@
 #ifndef OPENVPN3_DBUS_CONFIGMGR_HPP
 #define OPENVPN3_DBUS_CONFIGMGR_HPP
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <map>
+#include <memory>
+#include <vector>
 #include <ctime>
 
 #include <openvpn/log/logsimple.hpp>
 #include "common/core-extensions.hpp"
+#include "common/memfd.hpp"
+#include "common/workerpool.hpp"
+#include "configmgr/configstore.hpp"
 #include "configmgr/overrides.hpp"
+#include "configmgr/profile-dedup.hpp"
 #include "dbus/core.hpp"
 #include "dbus/connection-creds.hpp"
 #include "dbus/exceptions.hpp"
@@ -155,12 +163,12 @@ public:
                                 "Specified alias is invalid");
         }
 
-        std::string introsp_xml ="<node name='" + new_obj_path + "'>"
+        std::string introsp_xml ="<node>"
             "    <interface name='" + OpenVPN3DBus_interf_configuration + "'>"
             "        <property  type='o' name='config_path' access='read'/>"
             "    </interface>"
             "</node>";
-        ParseIntrospectionXML(introsp_xml);
+        ParseSharedIntrospectionXML(introsp_xml);
     }
 
 
@@ -348,7 +356,10 @@ class ConfigurationObject : public DBusObject,
 {
 public:
     /**
-     *  Constructor creating a new ConfigurationObject
+     *  Constructor creating a new ConfigurationObject from a parsed
+     *  configuration profile, see ParseProfile().  This does not write
+     *  persistent profiles to the ConfigStore; this is left to the
+     *  caller, see ApplyImportSettings().
      *
      * @param dbuscon  D-Bus connection this object is tied to
      * @param remove_callback  Callback function which must be called when
@@ -362,120 +373,308 @@ public:
      * @param creator  An uid reference of the owner of this object.  This is
      *                 typically the uid of the front-end user importing this
      *                 VPN configuration profile.
-     * @param params   Pointer to a GLib2 GVariant object containing both
-     *                 meta data as well as the configuration profile itself
-     *                 to use when initializing this object
+     * @param cfgname  std::string with the name of the configuration profile
+     * @param parsed   Shared pointer to the parsed configuration profile,
+     *                 see ProfileDedup
+     * @param single_use  Boolean flag, if true the configuration is removed
+     *                 after it has been used by a VPN client backend
+     * @param persistent  Boolean flag, if true the configuration is stored
+     *                 in the ConfigStore
+     * @param store    Pointer to the ConfigStore used for persistent
+     *                 configuration profiles.  Can be nullptr, which
+     *                 disables storing persistent profiles.
      */
     ConfigurationObject(GDBusConnection *dbuscon,
                         std::function<void()> remove_callback,
                         std::string objpath, unsigned int default_log_level,
                         LogWriter *logwr, bool signal_broadcast,
-                        uid_t creator, GVariant *params)
+                        uid_t creator, const std::string& cfgname,
+                        ProfileDedup::ProfilePtr parsed, bool single_use,
+                        bool persistent, ConfigStore *store = nullptr)
         : DBusObject(objpath),
           ConfigManagerSignals(dbuscon, objpath, default_log_level, logwr,
                                signal_broadcast),
           DBusCredentials(dbuscon, creator),
           remove_callback(remove_callback),
-          name(""),
+          name(cfgname),
           import_tstamp(std::time(nullptr)),
           last_use_tstamp(0),
           used_count(0),
           valid(false),
           readonly(false),
-          single_use(false),
-          persistent(false),
+          single_use(single_use),
+          persistent(persistent),
+          locked_down(false),
           persist_tun(false),
           alias(nullptr),
-          properties(this)
+          properties(this),
+          store(store),
+          profile(parsed)
     {
-        gchar *cfgstr = nullptr;
-        gchar *cfgname_c = nullptr;
-        g_variant_get (params, "(ssbb)",
-                       &cfgname_c, &cfgstr,
-                       &single_use, &persistent);
-        name = std::string(cfgname_c);
 
-        // Parse the options from the imported configuration
+        // FIXME:  Validate the configuration file, ensure --ca/--key/--cert/--dh/--pkcs12
+        //         contains files
+        valid = true;
+
+        setup_object();
+    }
+
+
+    /**
+     *  Constructor restoring a persistent ConfigurationObject from
+     *  a ConfigStore.  The option list is not loaded until the
+     *  configuration profile is used.
+     *
+     * @param dbuscon  D-Bus connection this object is tied to
+     * @param remove_callback  Callback function which must be called when
+     *                 destroying this configuration object.
+     * @param objpath  D-Bus object path of this object
+     * @param default_log_level  Unsigned integer defining the initial log level
+     * @param logwr    Pointer to LogWriter object; can be nullptr to disable
+     *                 file log.
+     * @param signal_broadcast Should signals be broadcasted (true) or
+     *                         targeted for the log service (false)
+     * @param store    Pointer to the ConfigStore holding the record
+     * @param meta     Json::Value with the meta data of the stored record
+     * @param dedup    Pointer to the ProfileDedup used to share the option
+     *                 list when it is loaded.  Can be nullptr.
+     */
+    ConfigurationObject(GDBusConnection *dbuscon,
+                        std::function<void()> remove_callback,
+                        std::string objpath, unsigned int default_log_level,
+                        LogWriter *logwr, bool signal_broadcast,
+                        ConfigStore *store, const Json::Value& meta,
+                        ProfileDedup *dedup = nullptr)
+        : DBusObject(objpath),
+          ConfigManagerSignals(dbuscon, objpath, default_log_level, logwr,
+                               signal_broadcast),
+          DBusCredentials(dbuscon, meta["owner"].asUInt()),
+          remove_callback(remove_callback),
+          name(meta["name"].asString()),
+          import_tstamp(meta["import_timestamp"].asInt64()),
+          last_use_tstamp(meta["last_used_timestamp"].asInt64()),
+          used_count(meta["used_count"].asUInt()),
+          valid(true),
+          readonly(meta["readonly"].asBool()),
+          single_use(meta["single_use"].asBool()),
+          persistent(true),
+          locked_down(meta["locked_down"].asBool()),
+          persist_tun(meta["persist_tun"].asBool()),
+          alias(nullptr),
+          properties(this),
+          store(store),
+          dedup(dedup),
+          options_loaded(false)
+    {
+        SetPublicAccess(meta["public_access"].asBool());
+        for (const auto& uid : meta["acl"])
+        {
+            GrantAccess(uid.asUInt());
+        }
+
+        const Json::Value& overrides = meta["overrides"];
+        for (const auto& key : overrides.getMemberNames())
+        {
+            const ValidOverride& vo = GetConfigOverride(key);
+            if (!vo.valid())
+            {
+                continue;
+            }
+            if (OverrideType::boolean == vo.type)
+            {
+                override_list.push_back(OverrideValue(vo, overrides[key].asBool()));
+            }
+            else
+            {
+                override_list.push_back(OverrideValue(vo, overrides[key].asString()));
+            }
+        }
+
+        std::string aliasname = meta["alias"].asString();
+        if (!aliasname.empty())
+        {
+            try
+            {
+                alias = new ConfigurationAlias(dbuscon, aliasname, objpath,
+                                               default_log_level, logwr,
+                                               signal_broadcast);
+                alias->RegisterObject(dbuscon);
+            }
+            catch (DBusException& err)
+            {
+                LogWarn("Could not restore alias '" + aliasname
+                        + "' for configuration '" + name + "': "
+                        + err.getRawError());
+                delete alias;
+                alias = nullptr;
+            }
+        }
+
+        setup_object();
+    }
+
+
+    ~ConfigurationObject()
+    {
+        remove_callback();
+        Debug("Configuration removed");
+        IdleCheck_RefDec();
+    };
+
+
+    /**
+     *  Parses a configuration profile, enforcing the profile size limits
+     *  of the OpenVPN 3 Core library.  This does not depend on any
+     *  ConfigurationObject state and can be called from any thread.
+     *
+     * @param cfgstr  std::string with the configuration profile
+     *
+     * @return Returns an OptionListJSON with the parsed profile
+     */
+    static OptionListJSON ParseProfile(const std::string& cfgstr)
+    {
         OptionList::Limits limits("profile is too large",
-				  ProfileParseLimits::MAX_PROFILE_SIZE,
-				  ProfileParseLimits::OPT_OVERHEAD,
-				  ProfileParseLimits::TERM_OVERHEAD,
-				  ProfileParseLimits::MAX_LINE_SIZE,
-				  ProfileParseLimits::MAX_DIRECTIVE_SIZE);
-        options.parse_from_config(cfgstr, &limits);
+                                  ProfileParseLimits::MAX_PROFILE_SIZE,
+                                  ProfileParseLimits::OPT_OVERHEAD,
+                                  ProfileParseLimits::TERM_OVERHEAD,
+                                  ProfileParseLimits::MAX_LINE_SIZE,
+                                  ProfileParseLimits::MAX_DIRECTIVE_SIZE);
+        OptionListJSON ret;
+        ret.parse_from_config(cfgstr, &limits);
+        return ret;
+    }
 
+
+    /**
+     *  Logs the import of a new configuration profile
+     */
+    void LogImport()
+    {
         std::stringstream msg;
         msg << "Parsed "
             << (persistent ? "persistent" : "")
             << (persistent && single_use ? ", " : "")
             << (single_use ? "single-use" : "")
             << " configuration '" << name << "'"
-            << ", owner: " << lookup_username(creator);
+            << ", owner: " << lookup_username(GetOwnerUID());
         LogInfo(msg.str());
+    }
 
-        // FIXME:  Validate the configuration file, ensure --ca/--key/--cert/--dh/--pkcs12
-        //         contains files
-        valid = true;
 
-        properties.AddBinding(new PropertyType<std::time_t>(this, "import_timestamp", "read", false, import_tstamp, "t"));
-        properties.AddBinding(new PropertyType<std::time_t>(this, "last_used_timestamp", "read", false, last_use_tstamp, "t"));
-        properties.AddBinding(new PropertyType<bool>(this, "locked_down", "readwrite", false, locked_down));
-        properties.AddBinding(new PropertyType<bool>(this, "persistent", "read", false, persistent));
-        properties.AddBinding(new PropertyType<bool>(this, "persist_tun",  "readwrite", true, persist_tun));
-        properties.AddBinding(new PropertyType<bool>(this, "readonly", "read", false, readonly));
-        properties.AddBinding(new PropertyType<bool>(this, "single_use", "read", false, single_use));
-        properties.AddBinding(new PropertyType<unsigned int>(this, "used_count", "read", false, used_count));
-        properties.AddBinding(new PropertyType<bool>(this, "valid", "read", false, valid));
-        properties.AddBinding(new PropertyType<decltype(override_list)>(this, "overrides", "read", true, override_list));
+    /**
+     *  Applies the access list, overrides and seal flag of a newly
+     *  imported configuration profile and saves persistent profiles
+     *  to the ConfigStore.  ImportBatch provides these settings together
+     *  with the configuration profile; Import and ImportFD only use this
+     *  to save persistent profiles.
+     *
+     * @param acl        std::vector of UIDs to grant access to
+     * @param overrides  GVariant dictionary (a{sv}) of overrides to set.
+     *                   Can be nullptr.
+     * @param seal       Boolean, if true the configuration is sealed
+     *
+     * @throws DBusException if an override is invalid
+     */
+    void ApplyImportSettings(const std::vector<uid_t>& acl,
+                             GVariant *overrides, bool seal)
+    {
+        for (const auto& uid : acl)
+        {
+            GrantAccess(uid);
+        }
 
-        std::string introsp_xml ="<node name='" + objpath + "'>"
-            "    <interface name='net.openvpn.v3.configuration'>"
-            "        <method name='Fetch'>"
-            "            <arg direction='out' type='s' name='config'/>"
-            "        </method>"
-            "        <method name='FetchJSON'>"
-            "            <arg direction='out' type='s' name='config_json'/>"
-            "        </method>"
-            "        <method name='SetOption'>"
-            "            <arg direction='in' type='s' name='option'/>"
-            "            <arg direction='in' type='s' name='value'/>"
-            "        </method>"
-            "        <method name='SetOverride'>"
-            "            <arg direction='in' type='s' name='name'/>"
-            "            <arg direction='in' type='v' name='value'/>"
-            "        </method>"
-            "        <method name='UnsetOverride'>"
-            "            <arg direction='in' type='s' name='name'/>"
-            "        </method>"
-            "        <method name='AccessGrant'>"
-            "            <arg direction='in' type='u' name='uid'/>"
-            "        </method>"
-            "        <method name='AccessRevoke'>"
-            "            <arg direction='in' type='u' name='uid'/>"
-            "        </method>"
-            "        <method name='Seal'/>"
-            "        <method name='Remove'/>"
-            "        <property type='u' name='owner' access='read'/>"
-            "        <property type='au' name='acl' access='read'/>"
-            "        <property type='s' name='name' access='readwrite'/>"
-            "        <property type='b' name='public_access' access='readwrite'/>"
-            "        <property type='s' name='alias' access='readwrite'/>"
-            + properties.GetIntrospectionXML() +
-            "    </interface>"
-            "</node>";
-        ParseIntrospectionXML(introsp_xml);
+        if (nullptr != overrides)
+        {
+            GVariantIter iter;
+            const gchar *key = nullptr;
+            GVariant *val = nullptr;
+            g_variant_iter_init(&iter, overrides);
+            while (g_variant_iter_next(&iter, "{&sv}", &key, &val))
+            {
+                try
+                {
+                    (void) set_override(key, val);
+                }
+                catch (...)
+                {
+                    g_variant_unref(val);
+                    throw;
+                }
+                g_variant_unref(val);
+            }
+        }
 
-        g_free(cfgname_c);
-        g_free(cfgstr);
+        readonly = seal && valid;
+        SavePersistent();
     }
 
 
-    ~ConfigurationObject()
+    /**
+     *  Saves a persistent configuration profile if its usage counters
+     *  have changed since it was last saved
+     */
+    void SaveUsage()
     {
-        remove_callback();
-        Debug("Configuration removed");
-        IdleCheck_RefDec();
-    };
+        if (usage_unsaved)
+        {
+            SavePersistent();
+        }
+    }
+
+
+    /**
+     *  Writes the current state of a persistent configuration profile
+     *  to the ConfigStore.  This does nothing for non-persistent profiles.
+     */
+    void SavePersistent()
+    {
+        if (!persistent || !store)
+        {
+            return;
+        }
+
+        try
+        {
+            Json::Value meta;
+            meta["object_path"] = GetObjectPath();
+            meta["name"] = name;
+            meta["owner"] = GetOwnerUID();
+            meta["public_access"] = GetPublicAccessFlag();
+            meta["acl"] = Json::Value(Json::arrayValue);
+            for (const auto& uid : GetAccessListUIDs())
+            {
+                meta["acl"].append(uid);
+            }
+            meta["import_timestamp"] = (Json::Int64) import_tstamp;
+            meta["last_used_timestamp"] = (Json::Int64) last_use_tstamp;
+            meta["used_count"] = used_count;
+            meta["readonly"] = readonly;
+            meta["single_use"] = single_use;
+            meta["locked_down"] = locked_down;
+            meta["persist_tun"] = persist_tun;
+            meta["alias"] = (alias ? alias->GetAlias() : "");
+            meta["overrides"] = Json::Value(Json::objectValue);
+            for (const auto& ov : override_list)
+            {
+                if (OverrideType::boolean == ov.override.type)
+                {
+                    meta["overrides"][ov.override.key] = ov.boolValue;
+                }
+                else
+                {
+                    meta["overrides"][ov.override.key] = ov.strValue;
+                }
+            }
+
+            store->Save(store_id(), meta, get_options().json_serialize());
+            usage_unsaved = false;
+        }
+        catch (ConfigStoreException& excp)
+        {
+            LogError("Could not save persistent configuration '" + name
+                     + "': " + excp.what());
+        }
+    }
 
 
     /**
@@ -501,7 +700,10 @@ public:
                               GDBusMethodInvocation *invoc)
     {
         IdleCheck_UpdateTimestamp();
-        if ("Fetch" == method_name)
+        const MethodID method_id = lookup_method_id(method_name);
+        if (MethodID::FETCH == method_id
+            || MethodID::FETCH_BINARY == method_id
+            || MethodID::FETCH_FD == method_id)
         {
             try
             {
@@ -516,9 +718,31 @@ public:
                     // process (root user) or the configuration profile owner
                     CheckOwnerAccess(sender, true);
                 }
-                g_dbus_method_invocation_return_value(invoc,
-                                                      g_variant_new("(s)",
-                                                                    options.string_export().c_str()));
+                if (MethodID::FETCH_BINARY == method_id)
+                {
+                    const std::string& bin = get_profile().GetBinary();
+                    GVariant *data = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                                               bin.data(),
+                                                               bin.size(), 1);
+                    g_dbus_method_invocation_return_value(invoc,
+                                                          g_variant_new("(@ay)", data));
+                }
+                else if (MethodID::FETCH_FD == method_id)
+                {
+                    int fd = memfd_create_sealed("openvpn3-profile",
+                                                 get_profile().GetString());
+                    GUnixFDList *fdlist = g_unix_fd_list_new_from_array(&fd, 1);
+                    g_dbus_method_invocation_return_value_with_unix_fd_list(invoc,
+                                                                            g_variant_new("(h)", 0),
+                                                                            fdlist);
+                    g_object_unref(fdlist);
+                }
+                else
+                {
+                    g_dbus_method_invocation_return_value(invoc,
+                                                          g_variant_new("(s)",
+                                                                        get_profile().GetString().c_str()));
+                }
 
                 // If the fetching user is root, we consider this
                 // configuration to be "used"
@@ -529,12 +753,18 @@ public:
                     if (single_use)
                     {
                         LogVerb2("Single-use configuration fetched");
+                        remove_persistent();
                         RemoveObject(conn);
                         delete this;
                         return;
                     }
+                    // Every backend client start fetches the profile.  The
+                    // usage counters alone are not worth rewriting the
+                    // stored profile for; they are saved with the next
+                    // change or when the service shuts down.
                     used_count++;
                     last_use_tstamp = std::time(nullptr);
+                    usage_unsaved = (persistent && store);
                 }
                 return;
             }
@@ -543,8 +773,20 @@ public:
                 LogWarn(excp.err());
                 excp.SetDBusError(invoc);
             }
+            catch (ConfigStoreException& excp)
+            {
+                return_store_error(invoc, excp);
+            }
+            catch (MemFDException& excp)
+            {
+                LogError(excp.what());
+                GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.configmgr.error",
+                                                              excp.what());
+                g_dbus_method_invocation_return_gerror(invoc, err);
+                g_error_free(err);
+            }
         }
-        else if ("FetchJSON" == method_name)
+        else if (MethodID::FETCH_JSON == method_id)
         {
             try
             {
@@ -560,7 +802,7 @@ public:
                 }
                 g_dbus_method_invocation_return_value(invoc,
                                                       g_variant_new("(s)",
-                                                                    options.json_export().c_str()));
+                                                                    get_profile().GetJSON().c_str()));
 
                 // Do not remove single-use object with this method.
                 // FetchJSON is only used by front-ends, never backends.  So
@@ -575,8 +817,12 @@ public:
                 LogWarn(excp.err());
                 excp.SetDBusError(invoc);
             }
+            catch (ConfigStoreException& excp)
+            {
+                return_store_error(invoc, excp);
+            }
         }
-        else if ("SetOption" == method_name)
+        else if (MethodID::SET_OPTION == method_id)
         {
             if (readonly)
             {
@@ -589,6 +835,8 @@ public:
             {
                 CheckOwnerAccess(sender);
                 // TODO: Implement SetOption
+                //       Any change to the option list must be done
+                //       via modify_options()
                 g_dbus_method_invocation_return_value(invoc, NULL);
                 return;
             }
@@ -598,7 +846,7 @@ public:
                 excp.SetDBusError(invoc);
             }
         }
-        else if ("SetOverride" == method_name)
+        else if (MethodID::SET_OVERRIDE == method_id)
         {
             if (readonly)
             {
@@ -627,6 +875,7 @@ public:
 
                 g_free(key);
                 //g_variant_unref(val);
+                SavePersistent();
                 g_dbus_method_invocation_return_value(invoc, NULL);
                 return;
             }
@@ -641,7 +890,7 @@ public:
                 excp.SetDBusError(invoc, "net.openvpn.v3.configmgr.error");
             }
         }
-        else if ("UnsetOverride" == method_name)
+        else if (MethodID::UNSET_OVERRIDE == method_id)
         {
             if (readonly)
             {
@@ -659,6 +908,7 @@ public:
                 {
                     LogInfo("Unset configuration override '" + std::string(key)
                                 + "' by UID " + std::to_string(GetUID(sender)));
+                    SavePersistent();
 
                     g_dbus_method_invocation_return_value(invoc, NULL);
                 }
@@ -680,7 +930,7 @@ public:
                 excp.SetDBusError(invoc);
             }
         }
-        else if ("AccessGrant" == method_name)
+        else if (MethodID::ACCESS_GRANT == method_id)
         {
             if (readonly)
             {
@@ -697,6 +947,7 @@ public:
                 uid_t uid = -1;
                 g_variant_get(params, "(u)", &uid);
                 GrantAccess(uid);
+                SavePersistent();
                 g_dbus_method_invocation_return_value(invoc, NULL);
 
                 LogInfo("Access granted to UID " + std::to_string(uid)
@@ -709,7 +960,7 @@ public:
                 excp.SetDBusError(invoc);
             }
         }
-        else if ("AccessRevoke" == method_name)
+        else if (MethodID::ACCESS_REVOKE == method_id)
         {
             if (readonly)
             {
@@ -726,6 +977,7 @@ public:
                 uid_t uid = -1;
                 g_variant_get(params, "(u)", &uid);
                 RevokeAccess(uid);
+                SavePersistent();
                 g_dbus_method_invocation_return_value(invoc, NULL);
 
                 LogInfo("Access revoked for UID " + std::to_string(uid)
@@ -738,7 +990,7 @@ public:
                 excp.SetDBusError(invoc);
             }
         }
-        else if ("Seal" == method_name)
+        else if (MethodID::SEAL == method_id)
         {
             try
             {
@@ -746,6 +998,7 @@ public:
 
                 if (valid) {
                     readonly = true;
+                    SavePersistent();
                     g_dbus_method_invocation_return_value(invoc, NULL);
                 }
                 else
@@ -762,7 +1015,7 @@ public:
                 excp.SetDBusError(invoc);
             }
         }
-        else if ("Remove" == method_name)
+        else if (MethodID::REMOVE == method_id)
         {
             try
             {
@@ -770,6 +1023,7 @@ public:
                 std::string sender_name = lookup_username(GetUID(sender));
                 LogInfo("Configuration '" + name + "' was removed by "
                         + sender_name);
+                remove_persistent();
                 RemoveObject(conn);
                 g_dbus_method_invocation_return_value(invoc, NULL);
                 delete this;
@@ -811,9 +1065,10 @@ public:
                                      GError **error)
     {
         IdleCheck_UpdateTimestamp();
+        const PropertyID prop_id = lookup_property_id(property_name);
 
         // Properties available for everyone
-        if ("owner" == property_name)
+        if (PropertyID::OWNER == prop_id)
         {
             return GetOwner();
         }
@@ -824,7 +1079,7 @@ public:
         {
             allow_root = properties.GetRootAllowed(property_name);
         }
-        else if ("name" == property_name)
+        else if (PropertyID::NAME == prop_id)
         {
             // Grant the root user access to the 'name' property
             allow_root = true;
@@ -837,19 +1092,19 @@ public:
 
             GVariant *ret = NULL;
 
-            if ("name"  == property_name)
+            if (PropertyID::NAME == prop_id)
             {
                 ret = g_variant_new_string (name.c_str());
             }
-            else if ("alias" == property_name)
+            else if (PropertyID::ALIAS == prop_id)
             {
                 ret = g_variant_new_string(alias ? alias->GetAlias() : "");
             }
-            else if ("public_access" == property_name)
+            else if (PropertyID::PUBLIC_ACCESS == prop_id)
             {
                 ret = GetPublicAccess();
             }
-            else if ("acl" == property_name)
+            else if (PropertyID::ACL == prop_id)
             {
                     ret = GetAccessList();
             }
@@ -976,6 +1231,7 @@ public:
                                             "Denied");
             };
 
+            SavePersistent();
             return ret;
         }
         catch (DBusCredentialsException& excp)
@@ -1069,6 +1325,7 @@ private:
     std::time_t import_tstamp;
     std::time_t last_use_tstamp;
     unsigned int used_count;
+    bool usage_unsaved = false;
     bool valid;
     bool readonly;
     bool single_use;
@@ -1077,88 +1334,429 @@ private:
     bool persist_tun;
     ConfigurationAlias *alias;
     PropertyCollection properties;
-    OptionListJSON options;
+    ConfigStore *store = nullptr;
+    ProfileDedup *dedup = nullptr;
+    bool options_loaded = true;
+    ProfileDedup::ProfilePtr profile;
     std::vector<OverrideValue> override_list;
-};
-
 
-/**
- *  The ConfigManagerObject is the main object for the Configuration Manager
- *  D-Bus service.  Whenever any user (D-Bus clients) accesses the main
- *  object path, this object is invoked.
- *
- *  This object basically handles the Import method, which takes a
- *  configuration profile as input and creates a ConfigurationObject.  There
- *  will exist a ConfigurationObject for each imported profile, having its
- *  own unique D-Bus object path.  Whenever a user (D-Bus client) accesses
- *  an object, the ConfigurationObject is invoked directly by the D-Bus
- *  implementation.
- */
-class ConfigManagerObject : public DBusObject,
-                            public ConfigManagerSignals,
-                            public RC<thread_safe_refcount>
-{
-public:
-    typedef  RCPtr<ConfigManagerObject> Ptr;
 
     /**
-     *  Constructor initializing the ConfigManagerObject to be registered on
-     *  the D-Bus.
-     *
-     * @param dbuscon  D-Bus this object is tied to
-     * @param objpath  D-Bus object path to this object
-     * @param default_log_level  Unsigned integer defining the initial log level
-     * @param logwr      Pointer to LogWriter object; can be nullptr to disable
-     *                   file log.
-     * @param signal_broadcast Should signals be broadcasted (true) or
-     *                         targeted for the log service (false)
-     *
+     *  Identifiers of the D-Bus methods and properties handled directly
+     *  by callback_method_call() and callback_get_property()
      */
-    ConfigManagerObject(GDBusConnection *dbusc, const std::string objpath,
-                        unsigned int default_log_level, LogWriter *logwr,
-                        bool signal_broadcast)
-        : DBusObject(objpath),
-          ConfigManagerSignals(dbusc, objpath, default_log_level, logwr,
-                               signal_broadcast),
-          dbuscon(dbusc),
-          creds(dbusc)
+    enum class MethodID
     {
-        std::stringstream introspection_xml;
-        introspection_xml << "<node name='" + objpath + "'>"
-                          << "    <interface name='" + OpenVPN3DBus_interf_configuration + "'>"
-                          << "        <method name='Import'>"
-                          << "          <arg type='s' name='name' direction='in'/>"
-                          << "          <arg type='s' name='config_str' direction='in'/>"
-                          << "          <arg type='b' name='single_use' direction='in'/>"
-                          << "          <arg type='b' name='persistent' direction='in'/>"
-                          << "          <arg type='o' name='config_path' direction='out'/>"
-                          << "        </method>"
-                          << "        <method name='FetchAvailableConfigs'>"
-                          << "          <arg type='ao' name='paths' direction='out'/>"
-                          << "        </method>"
-                          << "        <method name='TransferOwnership'>"
-                          << "           <arg type='o' name='path' direction='in'/>"
-                          << "           <arg type='u' name='new_owner_uid' direction='in'/>"
-                          << "        </method>"
-                          << "        <property type='s' name='version' access='read'/>"
-                          << GetLogIntrospection()
-                          << "    </interface>"
-                          << "</node>";
-        ParseIntrospectionXML(introspection_xml);
+        UNKNOWN,
+        FETCH,
+        FETCH_JSON,
+        FETCH_BINARY,
+        FETCH_FD,
+        SET_OPTION,
+        SET_OVERRIDE,
+        UNSET_OVERRIDE,
+        ACCESS_GRANT,
+        ACCESS_REVOKE,
+        SEAL,
+        REMOVE
+    };
 
-        Debug("ConfigManagerObject registered on '" + OpenVPN3DBus_interf_configuration + "':" + objpath);
-    }
 
-    ~ConfigManagerObject()
+    static MethodID lookup_method_id(const std::string& name)
     {
-        LogVerb2("Shutting down");
-        RemoveObject(dbuscon);
+        static const DBusDispatchTable<MethodID> methods(
+            MethodID::UNKNOWN,
+            {{"Fetch", MethodID::FETCH},
+             {"FetchJSON", MethodID::FETCH_JSON},
+             {"FetchBinary", MethodID::FETCH_BINARY},
+             {"FetchFD", MethodID::FETCH_FD},
+             {"SetOption", MethodID::SET_OPTION},
+             {"SetOverride", MethodID::SET_OVERRIDE},
+             {"UnsetOverride", MethodID::UNSET_OVERRIDE},
+             {"AccessGrant", MethodID::ACCESS_GRANT},
+             {"AccessRevoke", MethodID::ACCESS_REVOKE},
+             {"Seal", MethodID::SEAL},
+             {"Remove", MethodID::REMOVE}});
+        return methods.Lookup(name);
     }
 
 
-    /**
-     *  Callback method called each time a method in the
-     *  ConfigurationManagerObject is called over the D-Bus.
+    enum class PropertyID
+    {
+        UNKNOWN,
+        OWNER,
+        NAME,
+        ALIAS,
+        PUBLIC_ACCESS,
+        ACL
+    };
+
+
+    static PropertyID lookup_property_id(const std::string& name)
+    {
+        static const DBusDispatchTable<PropertyID> props(
+            PropertyID::UNKNOWN,
+            {{"owner", PropertyID::OWNER},
+             {"name", PropertyID::NAME},
+             {"alias", PropertyID::ALIAS},
+             {"public_access", PropertyID::PUBLIC_ACCESS},
+             {"acl", PropertyID::ACL}});
+        return props.Lookup(name);
+    }
+
+
+    /**
+     *  Sets up the D-Bus properties and introspection data for
+     *  this configuration object.  The introspection data is identical
+     *  for all configuration objects and is shared between them.
+     */
+    void setup_object()
+    {
+        properties.AddBinding(new PropertyType<std::time_t>(this, "import_timestamp", "read", false, import_tstamp, "t"));
+        properties.AddBinding(new PropertyType<std::time_t>(this, "last_used_timestamp", "read", false, last_use_tstamp, "t"));
+        properties.AddBinding(new PropertyType<bool>(this, "locked_down", "readwrite", false, locked_down));
+        properties.AddBinding(new PropertyType<bool>(this, "persistent", "read", false, persistent));
+        properties.AddBinding(new PropertyType<bool>(this, "persist_tun",  "readwrite", true, persist_tun));
+        properties.AddBinding(new PropertyType<bool>(this, "readonly", "read", false, readonly));
+        properties.AddBinding(new PropertyType<bool>(this, "single_use", "read", false, single_use));
+        properties.AddBinding(new PropertyType<unsigned int>(this, "used_count", "read", false, used_count));
+        properties.AddBinding(new PropertyType<bool>(this, "valid", "read", false, valid));
+        properties.AddBinding(new PropertyType<decltype(override_list)>(this, "overrides", "read", true, override_list));
+
+        std::string introsp_xml ="<node>"
+            "    <interface name='net.openvpn.v3.configuration'>"
+            "        <method name='Fetch'>"
+            "            <arg direction='out' type='s' name='config'/>"
+            "        </method>"
+            "        <method name='FetchJSON'>"
+            "            <arg direction='out' type='s' name='config_json'/>"
+            "        </method>"
+            "        <method name='FetchBinary'>"
+            "            <arg direction='out' type='ay' name='config'/>"
+            "        </method>"
+            "        <method name='FetchFD'>"
+            "            <arg direction='out' type='h' name='config_fd'/>"
+            "        </method>"
+            "        <method name='SetOption'>"
+            "            <arg direction='in' type='s' name='option'/>"
+            "            <arg direction='in' type='s' name='value'/>"
+            "        </method>"
+            "        <method name='SetOverride'>"
+            "            <arg direction='in' type='s' name='name'/>"
+            "            <arg direction='in' type='v' name='value'/>"
+            "        </method>"
+            "        <method name='UnsetOverride'>"
+            "            <arg direction='in' type='s' name='name'/>"
+            "        </method>"
+            "        <method name='AccessGrant'>"
+            "            <arg direction='in' type='u' name='uid'/>"
+            "        </method>"
+            "        <method name='AccessRevoke'>"
+            "            <arg direction='in' type='u' name='uid'/>"
+            "        </method>"
+            "        <method name='Seal'/>"
+            "        <method name='Remove'/>"
+            "        <property type='u' name='owner' access='read'/>"
+            "        <property type='au' name='acl' access='read'/>"
+            "        <property type='s' name='name' access='readwrite'/>"
+            "        <property type='b' name='public_access' access='readwrite'/>"
+            "        <property type='s' name='alias' access='readwrite'/>"
+            + properties.GetIntrospectionXML() +
+            "    </interface>"
+            "</node>";
+        ParseSharedIntrospectionXML(introsp_xml);
+    }
+
+
+    /**
+     *  Returns a D-Bus error to the caller when the option list of a
+     *  persistent configuration profile could not be loaded
+     *
+     * @param invoc  GDBusMethodInvocation to return the error to
+     * @param excp   ConfigStoreException with the error details
+     */
+    void return_store_error(GDBusMethodInvocation *invoc,
+                            ConfigStoreException& excp)
+    {
+        LogError(excp.what());
+        GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.storage",
+                                                      "Could not load the configuration profile");
+        g_dbus_method_invocation_return_gerror(invoc, err);
+        g_error_free(err);
+    }
+
+
+    /**
+     * @return Returns the record ID used in the ConfigStore, which is
+     *         the last element of the D-Bus object path
+     */
+    std::string store_id()
+    {
+        std::string path = GetObjectPath();
+        return path.substr(path.rfind('/') + 1);
+    }
+
+
+    /**
+     *  Retrieve the parsed configuration profile and its rendered forms.
+     *  For configuration profiles restored from the ConfigStore, the
+     *  option list is loaded on the first call.
+     *
+     *  The profile may be shared with other configuration objects
+     *  importing the same profile and must not be modified, see
+     *  modify_options().
+     *
+     * @return Returns a const reference to the SharedProfile object
+     */
+    const SharedProfile& get_profile()
+    {
+        if (!options_loaded)
+        {
+            OptionListJSON loaded;
+            loaded.json_deserialize(store->LoadOptions(store_id()));
+            if (dedup)
+            {
+                size_t hash = ProfileDedup::Hash(loaded);
+                profile = dedup->Intern(hash, std::move(loaded));
+            }
+            else
+            {
+                profile = std::make_shared<const SharedProfile>(std::move(loaded));
+            }
+            options_loaded = true;
+        }
+        return *profile;
+    }
+
+
+    /**
+     *  Retrieve the parsed option list, see get_profile()
+     *
+     * @return Returns a const reference to the OptionListJSON object
+     */
+    const OptionListJSON& get_options()
+    {
+        return get_profile().GetOptions();
+    }
+
+
+    /**
+     *  Retrieve a modifiable option list.  This object gets its own
+     *  private copy of the profile first, without any rendered forms,
+     *  so the profile shared with other configuration objects and its
+     *  rendered forms are left untouched.
+     *
+     * @return Returns a reference to the private OptionListJSON object
+     */
+    OptionListJSON& modify_options()
+    {
+        auto copy = std::make_shared<SharedProfile>(OptionListJSON(get_options()));
+        profile = copy;
+        return copy->ModifyOptions();
+    }
+
+
+    /**
+     *  Removes a persistent configuration profile from the ConfigStore
+     */
+    void remove_persistent()
+    {
+        if (!persistent || !store)
+        {
+            return;
+        }
+
+        try
+        {
+            store->Remove(store_id());
+        }
+        catch (ConfigStoreException& excp)
+        {
+            LogError("Could not remove persistent configuration '" + name
+                     + "': " + excp.what());
+        }
+    }
+};
+
+
+/**
+ *  The ConfigManagerObject is the main object for the Configuration Manager
+ *  D-Bus service.  Whenever any user (D-Bus clients) accesses the main
+ *  object path, this object is invoked.
+ *
+ *  This object basically handles the Import method, which takes a
+ *  configuration profile as input and creates a ConfigurationObject.  There
+ *  will exist a ConfigurationObject for each imported profile, having its
+ *  own unique D-Bus object path.  Whenever a user (D-Bus client) accesses
+ *  an object, the ConfigurationObject is invoked directly by the D-Bus
+ *  implementation.
+ */
+class ConfigManagerObject : public DBusObject,
+                            public ConfigManagerSignals,
+                            public RC<thread_safe_refcount>
+{
+public:
+    typedef  RCPtr<ConfigManagerObject> Ptr;
+
+    /**
+     *  Constructor initializing the ConfigManagerObject to be registered on
+     *  the D-Bus.
+     *
+     * @param dbuscon  D-Bus this object is tied to
+     * @param objpath  D-Bus object path to this object
+     * @param default_log_level  Unsigned integer defining the initial log level
+     * @param logwr      Pointer to LogWriter object; can be nullptr to disable
+     *                   file log.
+     * @param signal_broadcast Should signals be broadcasted (true) or
+     *                         targeted for the log service (false)
+     * @param store      Pointer to the ConfigStore for persistent
+     *                   configuration profiles; can be nullptr
+     *
+     */
+    ConfigManagerObject(GDBusConnection *dbusc, const std::string objpath,
+                        unsigned int default_log_level, LogWriter *logwr,
+                        bool signal_broadcast, ConfigStore *store = nullptr)
+        : DBusObject(objpath),
+          ConfigManagerSignals(dbusc, objpath, default_log_level, logwr,
+                               signal_broadcast),
+          dbuscon(dbusc),
+          creds(dbusc),
+          store(store)
+    {
+        std::stringstream introspection_xml;
+        introspection_xml << "<node name='" + objpath + "'>"
+                          << "    <interface name='" + OpenVPN3DBus_interf_configuration + "'>"
+                          << "        <method name='Import'>"
+                          << "          <arg type='s' name='name' direction='in'/>"
+                          << "          <arg type='s' name='config_str' direction='in'/>"
+                          << "          <arg type='b' name='single_use' direction='in'/>"
+                          << "          <arg type='b' name='persistent' direction='in'/>"
+                          << "          <arg type='o' name='config_path' direction='out'/>"
+                          << "        </method>"
+                          << "        <method name='ImportFD'>"
+                          << "          <arg type='s' name='name' direction='in'/>"
+                          << "          <arg type='h' name='config_fd' direction='in'/>"
+                          << "          <arg type='b' name='single_use' direction='in'/>"
+                          << "          <arg type='b' name='persistent' direction='in'/>"
+                          << "          <arg type='o' name='config_path' direction='out'/>"
+                          << "        </method>"
+                          << "        <method name='ImportBatch'>"
+                          << "          <arg type='a(ssbbaua{sv}b)' name='configs' direction='in'/>"
+                          << "          <arg type='a(os)' name='results' direction='out'/>"
+                          << "        </method>"
+                          << "        <method name='FetchAvailableConfigs'>"
+                          << "          <arg type='ao' name='paths' direction='out'/>"
+                          << "        </method>"
+                          << "        <method name='TransferOwnership'>"
+                          << "           <arg type='o' name='path' direction='in'/>"
+                          << "           <arg type='u' name='new_owner_uid' direction='in'/>"
+                          << "        </method>"
+                          << "        <property type='s' name='version' access='read'/>"
+                          << "        <property type='u' name='shared_profiles' access='read'/>"
+                          << "        <property type='t' name='shared_profiles_memory_saved' access='read'/>"
+                          << GetLogIntrospection()
+                          << "    </interface>"
+                          << "</node>";
+        ParseIntrospectionXML(introspection_xml);
+
+        Debug("ConfigManagerObject registered on '" + OpenVPN3DBus_interf_configuration + "':" + objpath);
+    }
+
+    ~ConfigManagerObject()
+    {
+        LogVerb2("Shutting down");
+        RemoveObject(dbuscon);
+    }
+
+
+    /**
+     *  Saves the usage counters of all the persistent configuration
+     *  profiles which have been used since they were last saved.  This
+     *  must be called before the service exits.
+     */
+    void SaveAll()
+    {
+        for (const auto& ci : config_objects)
+        {
+            ci.second->SaveUsage();
+        }
+    }
+
+
+    /**
+     *  Restores all the persistent configuration profiles found in the
+     *  ConfigStore and registers them on the D-Bus.  Only the meta data
+     *  is loaded here; the option lists are loaded on demand.
+     */
+    void LoadPersistentConfigs()
+    {
+        if (!store)
+        {
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::pair<std::string, Json::Value>> index;
+        try
+        {
+            index = store->LoadIndex();
+        }
+        catch (ConfigStoreException& excp)
+        {
+            LogError(excp.what());
+            return;
+        }
+
+        unsigned int loaded = 0;
+        for (const auto& rec : index)
+        {
+            std::string cfgpath = rec.second["object_path"].asString();
+            if (!g_variant_is_object_path(cfgpath.c_str())
+                || (OpenVPN3DBus_rootp_configuration + "/" + rec.first) != cfgpath
+                || config_objects.find(cfgpath) != config_objects.end())
+            {
+                LogWarn("Ignoring invalid persistent configuration record '"
+                        + rec.first + "'");
+                continue;
+            }
+
+            try
+            {
+                auto *cfgobj = new ConfigurationObject(dbuscon,
+                                                       [self=Ptr(this), cfgpath]()
+                                                       {
+                                                           self->remove_config_object(cfgpath);
+                                                       },
+                                                       cfgpath,
+                                                       GetLogLevel(),
+                                                       GetLogWriterPtr(),
+                                                       GetSignalBroadcast(),
+                                                       store, rec.second,
+                                                       &dedup);
+                IdleCheck_RefInc();
+                cfgobj->IdleCheck_Register(IdleCheck_Get());
+                cfgobj->RegisterObject(dbuscon);
+                config_objects[cfgpath] = cfgobj;
+                ++loaded;
+            }
+            catch (DBusException& excp)
+            {
+                LogError("Could not restore persistent configuration '"
+                         + rec.first + "': " + excp.getRawError());
+            }
+        }
+
+        auto msecs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start);
+        LogInfo("Loaded " + std::to_string(loaded)
+                + " persistent configuration profiles in "
+                + std::to_string(msecs.count()) + " ms");
+    }
+
+
+    /**
+     *  Callback method called each time a method in the
+     *  ConfigurationManagerObject is called over the D-Bus.
      *
      * @param conn        D-Bus connection where the method call occurred
      * @param sender      D-Bus bus name of the sender of the method call
@@ -1179,33 +1777,66 @@ public:
                               GDBusMethodInvocation *invoc)
     {
         IdleCheck_UpdateTimestamp();
-        if ("Import" == method_name)
-        {
-            // Import the configuration
-            std::string cfgpath = generate_path_uuid(OpenVPN3DBus_rootp_configuration, 'x');
-
-            auto *cfgobj = new ConfigurationObject(dbuscon,
-                                                   [self=Ptr(this), cfgpath]()
-                                                   {
-                                                       self->remove_config_object(cfgpath);
-                                                   },
-                                                   cfgpath,
-                                                   GetLogLevel(),
-                                                   GetLogWriterPtr(),
-                                                   GetSignalBroadcast(),
-                                                   creds.GetUID(sender),
-                                                   params);
-            IdleCheck_RefInc();
-            cfgobj->IdleCheck_Register(IdleCheck_Get());
-            cfgobj->RegisterObject(conn);
-            config_objects[cfgpath] = cfgobj;
+        const MethodID method_id = lookup_method_id(method_name);
+        if (MethodID::IMPORT == method_id
+            || MethodID::IMPORT_FD == method_id)
+        {
+            gchar *cfgname_c = nullptr;
+            gchar *cfgstr_c = nullptr;
+            gint32 fd_idx = -1;
+            gboolean single_use = false;
+            gboolean persistent = false;
+            std::string cfgstr;
+
+            if (MethodID::IMPORT_FD == method_id)
+            {
+                g_variant_get(params, "(shbb)",
+                              &cfgname_c, &fd_idx, &single_use, &persistent);
+                try
+                {
+                    cfgstr = read_profile_fd(invoc, fd_idx);
+                }
+                catch (MemFDException& excp)
+                {
+                    g_free(cfgname_c);
+                    GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.import",
+                                                                  excp.what());
+                    g_dbus_method_invocation_return_gerror(invoc, err);
+                    g_error_free(err);
+                    return;
+                }
+            }
+            else
+            {
+                g_variant_get(params, "(ssbb)",
+                              &cfgname_c, &cfgstr_c, &single_use, &persistent);
+                cfgstr = std::string(cfgstr_c);
+                g_free(cfgstr_c);
+            }
+            std::string cfgname(cfgname_c);
+            g_free(cfgname_c);
+
+            // Parse the configuration profile in a worker thread and
+            // complete the import from the main loop when done
+            auto req = std::make_shared<ImportRequest>();
+            req->name = cfgname;
+            req->profile = std::move(cfgstr);
+            req->single_use = single_use;
+            req->persistent = persistent;
+            uid_t owner = creds.GetUID(sender);
 
-            Debug(std::string("ConfigurationObject registered on '")
-                         + intf_name + "': " + cfgpath
-                         + " (owner uid " + std::to_string(creds.GetUID(sender)) + ")");
-            g_dbus_method_invocation_return_value(invoc, g_variant_new("(o)", cfgpath.c_str()));
+            IdleCheck_RefInc();
+            workers.Submit([req]()
+                           {
+                               parse_import_request(*req);
+                           },
+                           [self=Ptr(this), conn, invoc, owner, req]()
+                           {
+                               self->complete_import(conn, invoc, owner, *req);
+                               self->IdleCheck_RefDec();
+                           });
         }
-        else if ("FetchAvailableConfigs" == method_name)
+        else if (MethodID::FETCH_AVAILABLE_CONFIGS == method_id)
         {
             // Build up an array of object paths to available config objects
             GVariantBuilder *bld = g_variant_builder_new(G_VARIANT_TYPE("ao"));
@@ -1236,7 +1867,11 @@ public:
             g_variant_builder_unref(bld);
             g_variant_builder_unref(ret);
         }
-        else if ("TransferOwnership" == method_name)
+        else if (MethodID::IMPORT_BATCH == method_id)
+        {
+            import_batch(conn, sender, params, invoc);
+        }
+        else if (MethodID::TRANSFER_OWNERSHIP == method_id)
         {
             // This feature is quite powerful and is restricted to the
             // root account only.  This is typically used by openvpn3-autoload
@@ -1260,6 +1895,7 @@ public:
                 {
                     uid_t cur_owner = ci.second->GetOwnerUID();
                     ci.second->TransferOwnership(new_uid);
+                    ci.second->SavePersistent();
                     g_dbus_method_invocation_return_value(invoc, NULL);
 
                     std::stringstream msg;
@@ -1283,9 +1919,9 @@ public:
      *  Callback which is used each time a ConfigManagerObject D-Bus
      *  property is being read.
      *
-     *  For the ConfigManagerObject, this method will just return NULL
-     *  with an error set in the GError return pointer.  The
-     *  ConfigManagerObject does not use properties at all.
+     *  The ConfigManagerObject provides the service version and
+     *  statistics about configuration profiles shared between
+     *  configuration objects, see ProfileDedup.
      *
      * @param conn           D-Bus connection this event occurred on
      * @param sender         D-Bus bus name of the requester
@@ -1294,8 +1930,8 @@ public:
      * @param property_name  The property name being accessed
      * @param error          A GLib2 GError object if an error occurs
      *
-     * @return  Returns always NULL, as there are no properties in the
-     *          ConfigManagerObject.
+     * @return  Returns a GVariant with the property value, or NULL with
+     *          error set on unknown properties.
      */
     GVariant * callback_get_property(GDBusConnection *conn,
                                      const std::string sender,
@@ -1311,6 +1947,14 @@ public:
         {
             ret = g_variant_new_string(package_version);
         }
+        else if ("shared_profiles" == property_name)
+        {
+            ret = g_variant_new_uint32(dedup.GetProfileCount());
+        }
+        else if ("shared_profiles_memory_saved" == property_name)
+        {
+            ret = g_variant_new_uint64(dedup.GetMemorySaved());
+        }
         else
         {
             g_set_error (error,
@@ -1355,7 +1999,10 @@ public:
 private:
     GDBusConnection *dbuscon;
     DBusConnectionCreds creds;
+    ConfigStore *store = nullptr;
     std::map<std::string, ConfigurationObject *> config_objects;
+    ProfileDedup dedup;
+    WorkerPool workers;
 
     /**
      * Callback function used by ConfigurationObject instances to remove
@@ -1369,6 +2016,372 @@ private:
     {
         config_objects.erase(cfgpath);
     }
+
+
+    /**
+     *  A single configuration profile to import, from either Import,
+     *  ImportFD or ImportBatch
+     */
+    struct ImportRequest
+    {
+        std::string name;
+        std::string profile;
+        bool single_use = false;
+        bool persistent = false;
+        std::vector<uid_t> acl;
+        GVariant *overrides = nullptr;
+        bool seal = false;
+
+        OptionListJSON options;
+        size_t hash = 0;
+        std::string path;
+        std::string error;
+    };
+
+
+    /**
+     *  The state of an ImportBatch call while its configuration profiles
+     *  are being parsed
+     */
+    struct BatchImport
+    {
+        GDBusMethodInvocation *invoc = nullptr;
+        GDBusConnection *conn = nullptr;
+        uid_t owner = 0;
+        std::vector<ImportRequest> items;
+        size_t remaining = 0;
+    };
+
+
+    /**
+     *  Imports several configuration profiles in a single method call.
+     *  The profiles are parsed by the worker pool; when all of them have
+     *  been parsed the configuration objects are created and registered
+     *  on the D-Bus from the main loop and the method call is completed.
+     *  Each profile gets its own result, with either the object path or
+     *  an error message.
+     *
+     * @param conn    D-Bus connection where the method call occurred
+     * @param sender  D-Bus bus name of the sender of the method call
+     * @param params  GVariant with the method arguments
+     * @param invoc   GDBusMethodInvocation where the result is returned
+     */
+    void import_batch(GDBusConnection *conn, const std::string& sender,
+                      GVariant *params, GDBusMethodInvocation *invoc)
+    {
+        auto batch = std::make_shared<BatchImport>();
+        batch->invoc = invoc;
+        batch->conn = conn;
+        batch->owner = creds.GetUID(sender);
+
+        GVariantIter *cfgs = nullptr;
+        g_variant_get(params, "(a(ssbbaua{sv}b))", &cfgs);
+        batch->items.reserve(g_variant_iter_n_children(cfgs));
+
+        const gchar *cfgname = nullptr;
+        const gchar *cfgstr = nullptr;
+        gboolean single_use = false;
+        gboolean persistent = false;
+        GVariantIter *acl = nullptr;
+        GVariant *overrides = nullptr;
+        gboolean seal = false;
+        while (g_variant_iter_next(cfgs, "(&s&sbbau@a{sv}b)",
+                                   &cfgname, &cfgstr, &single_use,
+                                   &persistent, &acl, &overrides, &seal))
+        {
+            ImportRequest item;
+            item.name = std::string(cfgname);
+            item.profile = std::string(cfgstr);
+            item.single_use = single_use;
+            item.persistent = persistent;
+            item.overrides = overrides;
+            item.seal = seal;
+
+            guint32 uid = 0;
+            while (g_variant_iter_next(acl, "u", &uid))
+            {
+                item.acl.push_back(uid);
+            }
+            g_variant_iter_free(acl);
+            batch->items.push_back(std::move(item));
+        }
+        g_variant_iter_free(cfgs);
+
+        batch->remaining = batch->items.size();
+        if (0 == batch->remaining)
+        {
+            complete_batch(*batch);
+            return;
+        }
+
+        IdleCheck_RefInc();
+        for (size_t i = 0; i < batch->items.size(); ++i)
+        {
+            workers.Submit([batch, i]()
+                           {
+                               parse_import_request(batch->items[i]);
+                           },
+                           [self=Ptr(this), batch]()
+                           {
+                               if (0 == --batch->remaining)
+                               {
+                                   self->complete_batch(*batch);
+                                   self->IdleCheck_RefDec();
+                               }
+                           });
+        }
+    }
+
+
+    /**
+     *  Creates and registers the configuration objects of a parsed
+     *  ImportBatch call and returns the results to the caller
+     *
+     * @param batch  BatchImport with all the profiles parsed
+     */
+    void complete_batch(BatchImport& batch)
+    {
+        unsigned int imported = 0;
+        for (auto& item : batch.items)
+        {
+            if (item.error.empty())
+            {
+                register_import_request(batch.conn, batch.owner, item);
+            }
+            if (nullptr != item.overrides)
+            {
+                g_variant_unref(item.overrides);
+                item.overrides = nullptr;
+            }
+
+            if (item.error.empty())
+            {
+                ++imported;
+            }
+            else
+            {
+                LogWarn("Batch import of configuration '" + item.name
+                        + "' failed: " + item.error);
+            }
+        }
+
+        GVariantBuilder *bld = g_variant_builder_new(G_VARIANT_TYPE("a(os)"));
+        for (const auto& item : batch.items)
+        {
+            g_variant_builder_add(bld, "(os)",
+                                  (item.path.empty() ? "/" : item.path.c_str()),
+                                  item.error.c_str());
+        }
+        g_dbus_method_invocation_return_value(batch.invoc,
+                                              g_variant_new("(a(os))", bld));
+        g_variant_builder_unref(bld);
+
+        LogInfo("Imported " + std::to_string(imported) + " of "
+                + std::to_string(batch.items.size())
+                + " configuration profiles, owner: "
+                + lookup_username(batch.owner));
+    }
+
+
+    /**
+     *  Creates and registers the configuration object of a parsed
+     *  Import or ImportFD call and returns the result to the caller
+     *
+     * @param conn   D-Bus connection where the method call occurred
+     * @param invoc  GDBusMethodInvocation where the result is returned
+     * @param owner  uid_t of the owner of the configuration profile
+     * @param req    ImportRequest with the parsed profile
+     */
+    void complete_import(GDBusConnection *conn, GDBusMethodInvocation *invoc,
+                         uid_t owner, ImportRequest& req)
+    {
+        ConfigurationObject *cfgobj = nullptr;
+        if (req.error.empty())
+        {
+            cfgobj = register_import_request(conn, owner, req);
+        }
+        if (nullptr == cfgobj)
+        {
+            LogWarn("Import of configuration '" + req.name + "' failed: "
+                    + req.error);
+            GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.import",
+                                                          req.error.c_str());
+            g_dbus_method_invocation_return_gerror(invoc, err);
+            g_error_free(err);
+            return;
+        }
+
+        cfgobj->LogImport();
+        Debug(std::string("ConfigurationObject registered on '")
+                     + OpenVPN3DBus_interf_configuration + "': " + req.path
+                     + " (owner uid " + std::to_string(owner) + ")");
+        g_dbus_method_invocation_return_value(invoc, g_variant_new("(o)", req.path.c_str()));
+    }
+
+
+    /**
+     *  Parses the configuration profile of an ImportRequest.  This is
+     *  called from the worker threads and must only touch the request
+     *  itself.
+     *
+     * @param req  ImportRequest to parse
+     */
+    static void parse_import_request(ImportRequest& req)
+    {
+        try
+        {
+            req.options = ConfigurationObject::ParseProfile(req.profile);
+            req.hash = ProfileDedup::Hash(req.options);
+        }
+        catch (const std::exception& excp)
+        {
+            req.error = std::string("Invalid configuration profile: ")
+                        + excp.what();
+        }
+        req.profile.clear();
+        req.profile.shrink_to_fit();
+    }
+
+
+    /**
+     *  Creates and registers the configuration object of a parsed
+     *  ImportRequest.  On success, the request path is set, otherwise
+     *  the request error is set.
+     *
+     * @param conn   D-Bus connection to register the object on
+     * @param owner  uid_t of the owner of the configuration profile
+     * @param req    ImportRequest to register
+     *
+     * @return Returns a pointer to the new ConfigurationObject on success,
+     *         otherwise nullptr
+     */
+    ConfigurationObject * register_import_request(GDBusConnection *conn,
+                                                  uid_t owner,
+                                                  ImportRequest& req)
+    {
+        std::string cfgpath = generate_path_uuid(OpenVPN3DBus_rootp_configuration, 'x');
+
+        auto *cfgobj = new ConfigurationObject(dbuscon,
+                                               [self=Ptr(this), cfgpath]()
+                                               {
+                                                   self->remove_config_object(cfgpath);
+                                               },
+                                               cfgpath,
+                                               GetLogLevel(),
+                                               GetLogWriterPtr(),
+                                               GetSignalBroadcast(),
+                                               owner,
+                                               req.name,
+                                               dedup.Intern(req.hash,
+                                                            std::move(req.options)),
+                                               req.single_use,
+                                               req.persistent,
+                                               store);
+        IdleCheck_RefInc();
+        cfgobj->IdleCheck_Register(IdleCheck_Get());
+
+        try
+        {
+            cfgobj->RegisterObject(conn);
+        }
+        catch (DBusException& excp)
+        {
+            req.error = excp.getRawError();
+            delete cfgobj;
+            return nullptr;
+        }
+
+        try
+        {
+            cfgobj->ApplyImportSettings(req.acl, req.overrides, req.seal);
+        }
+        catch (DBusException& excp)
+        {
+            req.error = excp.getRawError();
+            cfgobj->RemoveObject(conn);
+            delete cfgobj;
+            return nullptr;
+        }
+
+        config_objects[cfgpath] = cfgobj;
+        req.path = cfgpath;
+        return cfgobj;
+    }
+
+
+    /**
+     *  Reads a configuration profile passed as a sealed memfd file
+     *  descriptor in a method call, used by ImportFD.
+     *
+     * @param invoc   GDBusMethodInvocation of the method call
+     * @param fd_idx  Index of the file descriptor in the GUnixFDList
+     *                of the method call
+     *
+     * @return Returns a std::string with the configuration profile
+     */
+    std::string read_profile_fd(GDBusMethodInvocation *invoc, gint32 fd_idx)
+    {
+        GDBusMessage *msg = g_dbus_method_invocation_get_message(invoc);
+        GUnixFDList *fdlist = g_dbus_message_get_unix_fd_list(msg);
+        if (nullptr == fdlist || fd_idx < 0
+            || fd_idx >= g_unix_fd_list_get_length(fdlist))
+        {
+            throw MemFDException("No configuration file descriptor received");
+        }
+
+        GError *error = nullptr;
+        int fd = g_unix_fd_list_get(fdlist, fd_idx, &error);
+        if (fd < 0)
+        {
+            std::string err(error ? error->message : "Unknown error");
+            if (error)
+            {
+                g_error_free(error);
+            }
+            throw MemFDException("Invalid configuration file descriptor: "
+                                 + err);
+        }
+
+        try
+        {
+            std::string ret = memfd_read_sealed_text(fd,
+                                                     ProfileParseLimits::MAX_PROFILE_SIZE);
+            ::close(fd);
+            return ret;
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+    }
+
+
+    /**
+     *  Identifiers of the D-Bus methods handled by callback_method_call()
+     */
+    enum class MethodID
+    {
+        UNKNOWN,
+        IMPORT,
+        IMPORT_FD,
+        IMPORT_BATCH,
+        FETCH_AVAILABLE_CONFIGS,
+        TRANSFER_OWNERSHIP
+    };
+
+
+    static MethodID lookup_method_id(const std::string& name)
+    {
+        static const DBusDispatchTable<MethodID> methods(
+            MethodID::UNKNOWN,
+            {{"Import", MethodID::IMPORT},
+             {"ImportFD", MethodID::IMPORT_FD},
+             {"ImportBatch", MethodID::IMPORT_BATCH},
+             {"FetchAvailableConfigs", MethodID::FETCH_AVAILABLE_CONFIGS},
+             {"TransferOwnership", MethodID::TRANSFER_OWNERSHIP}});
+        return methods.Lookup(name);
+    }
 };
 
 
@@ -1412,6 +2425,19 @@ public:
         procsig->ProcessChange(StatusMinor::PROC_STOPPED);
     }
 
+
+    /**
+     *  Saves the usage counters of the persistent configuration profiles.
+     *  This is called when the main loop has stopped.
+     */
+    void SaveAll()
+    {
+        if (cfgmgr)
+        {
+            cfgmgr->SaveAll();
+        }
+    }
+
     /**
      *  Sets the log level to use for the configuration manager main object
      *  and individual configuration objects.  This is essentially just an
@@ -1426,15 +2452,36 @@ public:
     }
 
 
+    /**
+     *  Enables storing persistent configuration profiles on disk.  The
+     *  profiles are kept in a 'configs' sub-directory of the state
+     *  directory and are restored when the service starts.
+     *
+     * @param stdir  std::string with the state directory to use
+     */
+    void SetStateDirectory(const std::string& stdir)
+    {
+        store.reset(new ConfigStore(stdir + "/configs"));
+    }
+
+
     /**
      *  This callback is called when the service was successfully registered
      *  on the D-Bus.
      */
     void callback_bus_acquired()
     {
+        // Configuration and alias objects are dispatched via a
+        // D-Bus subtree each, instead of registering every single
+        // object separately
+        config_subtree.reset(new DBusObjectSubtree(GetConnection(),
+                                                   GetRootPath()));
+        alias_subtree.reset(new DBusObjectSubtree(GetConnection(),
+                                                  GetRootPath() + "/aliases"));
+
         cfgmgr.reset(new ConfigManagerObject(GetConnection(), GetRootPath(),
                                              default_log_level, logwr,
-                                             signal_broadcast));
+                                             signal_broadcast, store.get()));
         cfgmgr->RegisterObject(GetConnection());
 
         procsig->ProcessChange(StatusMinor::PROC_STARTED);
@@ -1443,6 +2490,8 @@ public:
         {
             cfgmgr->IdleCheck_Register(idle_checker);
         }
+
+        cfgmgr->LoadPersistentConfigs();
     };
 
 
@@ -1480,6 +2529,9 @@ private:
     unsigned int default_log_level = 6; // LogCategory::DEBUG
     LogWriter *logwr = nullptr;
     bool signal_broadcast = true;
+    ConfigStore::Ptr store;
+    DBusObjectSubtree::Ptr config_subtree;
+    DBusObjectSubtree::Ptr alias_subtree;
     ConfigManagerObject::Ptr cfgmgr;
     ProcessSignalProducer::Ptr procsig;
 };
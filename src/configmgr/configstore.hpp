@@ -0,0 +1,335 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   configstore.hpp
+ *
+ * @brief  On-disk storage of persistent configuration profiles
+ */
+
+#pragma once
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <json/json.h>
+
+
+class ConfigStoreException : public std::exception
+{
+public:
+    ConfigStoreException(const std::string& err)
+        : err(err)
+    {
+    }
+
+    virtual const char* what() const noexcept
+    {
+        return err.c_str();
+    }
+
+private:
+    std::string err;
+};
+
+
+/**
+ *  Stores persistent configuration profiles in a directory, one file
+ *  per configuration profile.  Each file contains two lines, each with
+ *  a compact JSON document:
+ *
+ *    1. Meta data: object path, name, owner, ACL, flags, overrides, etc.
+ *    2. The parsed option list, as an array of option arrays
+ *
+ *  On startup only the first line of each file is read and parsed.  The
+ *  option list is only loaded when the configuration profile is actually
+ *  used, which keeps the startup time low even with many profiles.
+ *
+ *  Files are written to a temporary file first, which is synced to disk
+ *  and renamed on top of the old file.  A crash will thus leave either
+ *  the old or the new version of the record, never a partial one.
+ */
+class ConfigStore
+{
+public:
+    typedef std::unique_ptr<ConfigStore> Ptr;
+
+    /**
+     *  Record format version, stored in the meta data
+     */
+    static const unsigned int FormatVersion = 1;
+
+
+    /**
+     *  Prepares the configuration store.  The directory is created if
+     *  it does not exist.
+     *
+     * @param directory  std::string with the directory to use
+     */
+    ConfigStore(const std::string& directory)
+        : directory(directory)
+    {
+        if (0 != ::mkdir(directory.c_str(), 0700) && EEXIST != errno)
+        {
+            throw ConfigStoreException("Could not create directory '"
+                                       + directory + "': "
+                                       + std::string(strerror(errno)));
+        }
+    }
+
+
+    /**
+     * @return Returns the directory used by this configuration store
+     */
+    const std::string& GetDirectory() const noexcept
+    {
+        return directory;
+    }
+
+
+    /**
+     *  Saves or replaces a configuration record
+     *
+     * @param id       std::string with the unique record ID
+     * @param meta     Json::Value with the meta data
+     * @param options  Json::Value with the serialized option list
+     */
+    void Save(const std::string& id, const Json::Value& meta,
+              const Json::Value& options)
+    {
+        Json::Value m(meta);
+        m["format_version"] = FormatVersion;
+
+        std::string data = serialize(m) + "\n" + serialize(options) + "\n";
+        std::string fname = record_filename(id);
+        std::string tmpname = fname + ".tmp";
+
+        int fd = ::open(tmpname.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0)
+        {
+            throw ConfigStoreException("Could not create '" + tmpname + "': "
+                                       + std::string(strerror(errno)));
+        }
+
+        const char *p = data.c_str();
+        size_t left = data.size();
+        while (left > 0)
+        {
+            ssize_t r = ::write(fd, p, left);
+            if (r < 0 && EINTR == errno)
+            {
+                continue;
+            }
+            if (r <= 0)
+            {
+                std::string err(strerror(errno));
+                ::close(fd);
+                ::unlink(tmpname.c_str());
+                throw ConfigStoreException("Could not write '" + tmpname
+                                           + "': " + err);
+            }
+            p += r;
+            left -= r;
+        }
+
+        if (0 != ::fsync(fd) || 0 != ::close(fd))
+        {
+            ::unlink(tmpname.c_str());
+            throw ConfigStoreException("Could not sync '" + tmpname + "'");
+        }
+
+        if (0 != ::rename(tmpname.c_str(), fname.c_str()))
+        {
+            std::string err(strerror(errno));
+            ::unlink(tmpname.c_str());
+            throw ConfigStoreException("Could not rename '" + tmpname
+                                       + "': " + err);
+        }
+        sync_directory();
+    }
+
+
+    /**
+     *  Removes a configuration record.  Removing a non-existing
+     *  record is not an error.
+     *
+     * @param id  std::string with the record ID to remove
+     */
+    void Remove(const std::string& id)
+    {
+        if (0 == ::unlink(record_filename(id).c_str()))
+        {
+            sync_directory();
+        }
+    }
+
+
+    /**
+     *  Reads the meta data of all the stored configuration records.
+     *  Records which cannot be parsed are skipped, and left-over temporary
+     *  files from an interrupted Save() are removed.
+     *
+     * @return Returns a std::vector of record ID and meta data pairs
+     */
+    std::vector<std::pair<std::string, Json::Value>> LoadIndex()
+    {
+        std::vector<std::pair<std::string, Json::Value>> ret;
+
+        DIR *dir = ::opendir(directory.c_str());
+        if (nullptr == dir)
+        {
+            throw ConfigStoreException("Could not open directory '"
+                                       + directory + "': "
+                                       + std::string(strerror(errno)));
+        }
+
+        const std::string sfx = ".json";
+        const std::string tmpsfx = ".json.tmp";
+        Json::CharReaderBuilder rbuilder;
+        std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+
+        struct dirent *de = nullptr;
+        while (nullptr != (de = ::readdir(dir)))
+        {
+            std::string fname(de->d_name);
+            if (ends_with(fname, tmpsfx))
+            {
+                ::unlink((directory + "/" + fname).c_str());
+                continue;
+            }
+            if (!ends_with(fname, sfx))
+            {
+                continue;
+            }
+
+            std::ifstream rec(directory + "/" + fname);
+            std::string line;
+            if (!std::getline(rec, line))
+            {
+                continue;
+            }
+
+            Json::Value meta;
+            std::string errs;
+            if (!reader->parse(line.data(), line.data() + line.size(),
+                               &meta, &errs)
+                || !meta.isObject()
+                || meta["format_version"].asUInt() != FormatVersion)
+            {
+                continue;
+            }
+            ret.emplace_back(fname.substr(0, fname.size() - sfx.size()),
+                             std::move(meta));
+        }
+        ::closedir(dir);
+        return ret;
+    }
+
+
+    /**
+     *  Reads the serialized option list of a configuration record
+     *
+     * @param id  std::string with the record ID
+     *
+     * @return Returns a Json::Value with the serialized option list
+     */
+    Json::Value LoadOptions(const std::string& id)
+    {
+        std::ifstream rec(record_filename(id));
+        std::string line;
+
+        // Skip the meta data line
+        if (!std::getline(rec, line) || !std::getline(rec, line))
+        {
+            throw ConfigStoreException("Could not read configuration record '"
+                                       + id + "'");
+        }
+
+        Json::CharReaderBuilder rbuilder;
+        std::unique_ptr<Json::CharReader> reader(rbuilder.newCharReader());
+        Json::Value options;
+        std::string errs;
+        if (!reader->parse(line.data(), line.data() + line.size(),
+                           &options, &errs)
+            || !options.isArray())
+        {
+            throw ConfigStoreException("Invalid option list in configuration "
+                                       "record '" + id + "': " + errs);
+        }
+        return options;
+    }
+
+
+private:
+    const std::string directory;
+
+
+    std::string record_filename(const std::string& id) const
+    {
+        if (id.empty() || std::string::npos != id.find('/')
+            || '.' == id[0])
+        {
+            throw ConfigStoreException("Invalid configuration record ID '"
+                                       + id + "'");
+        }
+        return directory + "/" + id + ".json";
+    }
+
+
+    static std::string serialize(const Json::Value& data)
+    {
+        Json::StreamWriterBuilder wbuilder;
+        wbuilder["indentation"] = "";
+        return Json::writeString(wbuilder, data);
+    }
+
+
+    static bool ends_with(const std::string& str, const std::string& sfx)
+    {
+        return str.size() > sfx.size()
+               && 0 == str.compare(str.size() - sfx.size(), sfx.size(), sfx);
+    }
+
+
+    /**
+     *  Ensure a rename/unlink in the store directory is on disk
+     */
+    void sync_directory() const
+    {
+        int dfd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dfd >= 0)
+        {
+            ::fsync(dfd);
+            ::close(dfd);
+        }
+    }
+};
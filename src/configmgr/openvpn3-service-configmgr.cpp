@@ -97,6 +97,19 @@ static int config_manager(ParsedArgs args)
     }
     cfgmgr.SetLogLevel(log_level);
 
+    if (args.Present("state-dir"))
+    {
+        try
+        {
+            cfgmgr.SetStateDirectory(args.GetValue("state-dir", 0));
+        }
+        catch (ConfigStoreException& excp)
+        {
+            throw CommandException("openvpn3-service-configmgr",
+                                   excp.what());
+        }
+    }
+
     IdleCheck::Ptr idle_exit;
     if (idle_wait_min > 0)
     {
@@ -114,6 +127,10 @@ static int config_manager(ParsedArgs args)
     g_main_loop_run(main_loop);
     g_main_loop_unref(main_loop);
 
+    // The configuration objects are not released before the process
+    // exits, so their usage counters must be saved explicitly
+    cfgmgr.SaveAll();
+
     if (logsrvprx)
     {
         logsrvprx->Detach(OpenVPN3DBus_interf_configuration);
@@ -145,6 +162,9 @@ int main(int argc, char **argv)
     argparser.AddOption("idle-exit", "MINUTES", true,
                         "How long to wait before exiting if being idle. "
                         "0 disables it (Default: 3 minutes)");
+    argparser.AddOption("state-dir", "DIRECTORY", true,
+                        "Directory where persistent configuration profiles "
+                        "are stored");
 
 
     try
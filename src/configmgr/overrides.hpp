@@ -135,7 +135,20 @@ const ValidOverride configProfileOverrides[] = {
      "HTTP Proxy password to use for authentication"},
 
     {"proxy-auth-cleartext", OverrideType::boolean,
-     "Allows clear text HTTP authentication"}
+     "Allows clear text HTTP authentication"},
+
+    {"cpu-affinity", OverrideType::string,
+     "Runs the VPN client thread on these CPUs only, such as 0-3,8"},
+
+    {"cpu-sched-policy", OverrideType::string,
+     "Sets the scheduling policy of the VPN client thread, real-time policies accept a priority such as fifo:10 and are only allowed in profiles owned by root",
+     [] {return std::string("other batch idle fifo rr");}},
+
+    {"cpu-nice", OverrideType::string,
+     "Sets the nice value of the VPN client thread (-20 to 19), negative values are only allowed in profiles owned by root"},
+
+    {"numa-node", OverrideType::string,
+     "Runs the VPN client thread on the CPUs of this NUMA node and prefers memory from it"}
 };
 
 
@@ -0,0 +1,307 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   profile-dedup.hpp
+ *
+ * @brief  Sharing of identical parsed configuration profiles between
+ *         configuration objects
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "common/core-extensions.hpp"
+
+
+/**
+ *  A parsed configuration profile together with its rendered forms, as
+ *  returned by the Fetch, FetchJSON and FetchBinary D-Bus methods.  The
+ *  rendered forms are created on first use and kept as long as the
+ *  profile, so configuration objects sharing the profile also share
+ *  them.  They are created from the main loop thread only.
+ */
+class SharedProfile
+{
+public:
+    SharedProfile(openvpn::OptionListJSON&& options)
+        : options(std::move(options))
+    {
+    }
+
+
+    /**
+     * @return Returns a const reference to the parsed option list
+     */
+    const openvpn::OptionListJSON& GetOptions() const noexcept
+    {
+        return options;
+    }
+
+
+    /**
+     *  Retrieve a modifiable option list.  This discards the rendered
+     *  forms, so the option list must not be modified later through
+     *  the returned reference.  Shared profiles are only accessible
+     *  through const pointers, so only private copies can be modified.
+     *
+     * @return Returns a reference to the OptionListJSON object
+     */
+    openvpn::OptionListJSON& ModifyOptions()
+    {
+        str.clear();
+        str.shrink_to_fit();
+        json.clear();
+        json.shrink_to_fit();
+        bin.clear();
+        bin.shrink_to_fit();
+        str_valid = false;
+        json_valid = false;
+        bin_valid = false;
+        return options;
+    }
+
+
+    /**
+     * @return Returns the profile rendered as a text string
+     */
+    const std::string& GetString() const
+    {
+        if (!str_valid)
+        {
+            str = options.string_export();
+            str_valid = true;
+        }
+        return str;
+    }
+
+
+    /**
+     * @return Returns the profile rendered as a JSON string
+     */
+    const std::string& GetJSON() const
+    {
+        if (!json_valid)
+        {
+            json = options.json_export();
+            json_valid = true;
+        }
+        return json;
+    }
+
+
+    /**
+     * @return Returns the binary encoded option list, see
+     *         OptionListJSON::binary_serialize()
+     */
+    const std::string& GetBinary() const
+    {
+        if (!bin_valid)
+        {
+            bin = options.binary_serialize();
+            bin_valid = true;
+        }
+        return bin;
+    }
+
+
+    /**
+     * @return Returns an estimate of the memory used by the option list
+     *         and the rendered forms created so far, in bytes
+     */
+    size_t GetSize() const
+    {
+        size_t ret = sizeof(SharedProfile) + sizeof(openvpn::OptionList)
+                     + str.capacity() + json.capacity() + bin.capacity();
+        for (const auto& opt : options)
+        {
+            ret += sizeof(openvpn::Option);
+            for (size_t i = 0; i < opt.size(); ++i)
+            {
+                ret += sizeof(std::string) + opt.ref(i).capacity();
+            }
+        }
+        return ret;
+    }
+
+
+private:
+    openvpn::OptionListJSON options;
+    mutable std::string str;
+    mutable std::string json;
+    mutable std::string bin;
+    mutable bool str_valid = false;
+    mutable bool json_valid = false;
+    mutable bool bin_valid = false;
+};
+
+
+/**
+ *  Keeps track of the parsed configuration profiles in use, indexed by
+ *  a hash of their normalized contents.  Importing a profile identical
+ *  to one already in use returns the existing SharedProfile, so all the
+ *  configuration objects with the same profile share a single immutable
+ *  option list and its rendered forms.  Overrides, ACLs and other
+ *  per-object settings are kept by each configuration object.
+ *
+ *  The normalized form of a profile is its binary encoded option list,
+ *  see OptionListJSON::binary_serialize(), so profiles only differing
+ *  in comments and whitespace are considered identical.
+ *
+ *  Only weak references are kept; a shared profile is released when
+ *  the last configuration object using it is removed.
+ */
+class ProfileDedup
+{
+public:
+    typedef std::shared_ptr<const SharedProfile> ProfilePtr;
+
+
+    /**
+     *  Calculates the content hash of a parsed configuration profile.
+     *  This is thread safe and can be called from worker threads.
+     *
+     * @param options  OptionListJSON to hash
+     *
+     * @return Returns the hash value to pass to Intern()
+     */
+    static size_t Hash(const openvpn::OptionListJSON& options)
+    {
+        return std::hash<std::string>()(options.binary_serialize());
+    }
+
+
+    /**
+     *  Returns a shared profile with an option list identical to the
+     *  given one, if one is already in use.  Otherwise a new shared
+     *  profile is registered and returned.
+     *
+     * @param hash     Content hash of the option list, see Hash()
+     * @param options  OptionListJSON with the parsed profile
+     *
+     * @return Returns a shared pointer to the profile to use
+     */
+    ProfilePtr Intern(size_t hash, openvpn::OptionListJSON&& options)
+    {
+        auto range = entries.equal_range(hash);
+        for (auto it = range.first; it != range.second;)
+        {
+            ProfilePtr existing = it->second.lock();
+            if (!existing)
+            {
+                it = entries.erase(it);
+                continue;
+            }
+            if (equal(existing->GetOptions(), options))
+            {
+                return existing;
+            }
+            ++it;
+        }
+
+        ProfilePtr ret = std::make_shared<const SharedProfile>(std::move(options));
+        entries.emplace(hash, ret);
+        return ret;
+    }
+
+
+    /**
+     * @return Returns the number of distinct profiles in use
+     */
+    unsigned int GetProfileCount()
+    {
+        prune();
+        return entries.size();
+    }
+
+
+    /**
+     * @return Returns an estimate of the memory saved, in bytes, by
+     *         sharing the option lists and their rendered forms instead
+     *         of each configuration object keeping its own copy
+     */
+    uint64_t GetMemorySaved()
+    {
+        prune();
+        uint64_t ret = 0;
+        for (const auto& e : entries)
+        {
+            ProfilePtr profile = e.second.lock();
+            if (!profile)
+            {
+                continue;
+            }
+            long users = profile.use_count() - 1;
+            if (users > 1)
+            {
+                ret += (uint64_t) (users - 1) * profile->GetSize();
+            }
+        }
+        return ret;
+    }
+
+
+private:
+    std::unordered_multimap<size_t, std::weak_ptr<const SharedProfile>> entries;
+
+
+    void prune()
+    {
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->second.expired())
+            {
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+
+    static bool equal(const openvpn::OptionList& a, const openvpn::OptionList& b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (a[i].size() != b[i].size())
+            {
+                return false;
+            }
+            for (size_t j = 0; j < a[i].size(); ++j)
+            {
+                if (a[i].ref(j) != b[i].ref(j))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+};
@@ -22,11 +22,41 @@
 
 #include <vector>
 
+#include "common/memfd.hpp"
 #include "dbus/core.hpp"
 #include "configmgr/overrides.hpp"
 
 using namespace openvpn;
 
+
+/**
+ *  A configuration profile to import with
+ *  OpenVPN3ConfigurationProxy::ImportBatch()
+ */
+struct ConfigImportRequest
+{
+    std::string name;
+    std::string config;
+    bool single_use = false;
+    bool persistent = false;
+    std::vector<uid_t> acl;
+    std::vector<OverrideValue> overrides;
+    bool seal = false;
+};
+
+
+/**
+ *  The result of importing a single configuration profile with
+ *  OpenVPN3ConfigurationProxy::ImportBatch().  On success, path contains
+ *  the D-Bus object path of the configuration and error is empty.
+ */
+struct ConfigImportResult
+{
+    std::string path;
+    std::string error;
+};
+
+
 class OpenVPN3ConfigurationProxy : public DBusProxy {
 public:
     OpenVPN3ConfigurationProxy(GBusType bus_type, std::string target)
@@ -98,6 +128,132 @@ public:
     }
 
 
+    /**
+     *  Imports a configuration profile, passing the profile itself as a
+     *  sealed memfd file descriptor instead of a D-Bus string.  This
+     *  avoids copying and validating larger profiles several times in
+     *  the D-Bus marshalling.
+     *
+     * @param name        std::string with the configuration profile name
+     * @param config_blob std::string with the configuration profile
+     * @param single_use  Boolean, remove the profile after it has been used
+     * @param persistent  Boolean, store the profile persistently
+     *
+     * @return Returns a std::string with the D-Bus object path of the
+     *         imported configuration profile
+     */
+    std::string ImportFD(std::string name, std::string config_blob,
+                         bool single_use, bool persistent)
+    {
+        int fd = -1;
+        try
+        {
+            fd = memfd_create_sealed("openvpn3-import", config_blob);
+        }
+        catch (MemFDException& excp)
+        {
+            THROW_DBUSEXCEPTION("OpenVPN3ConfigurationProxy", excp.what());
+        }
+        GUnixFDList *fdlist = g_unix_fd_list_new_from_array(&fd, 1);
+        GVariant *res = nullptr;
+        try
+        {
+            res = CallWithFD("ImportFD",
+                             g_variant_new("(shbb)",
+                                           name.c_str(), 0,
+                                           single_use, persistent),
+                             fdlist, nullptr);
+        }
+        catch (...)
+        {
+            g_object_unref(fdlist);
+            throw;
+        }
+        g_object_unref(fdlist);
+
+        gchar *buf = nullptr;
+        g_variant_get(res, "(o)", &buf);
+        std::string ret(buf);
+        g_variant_unref(res);
+        g_free(buf);
+
+        return ret;
+    }
+
+
+    /**
+     *  Imports several configuration profiles in a single D-Bus call,
+     *  including the access list, overrides and seal flag of each profile.
+     *
+     * @param configs  std::vector of ConfigImportRequest to import
+     *
+     * @return Returns a std::vector of ConfigImportResult, one per
+     *         imported profile in the same order as configs
+     */
+    std::vector<ConfigImportResult> ImportBatch(const std::vector<ConfigImportRequest>& configs)
+    {
+        GVariantBuilder *bld = g_variant_builder_new(G_VARIANT_TYPE("a(ssbbaua{sv}b)"));
+        for (const auto& cfg : configs)
+        {
+            GVariantBuilder *acl = g_variant_builder_new(G_VARIANT_TYPE("au"));
+            for (const auto& uid : cfg.acl)
+            {
+                g_variant_builder_add(acl, "u", uid);
+            }
+
+            GVariantBuilder *ovr = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+            for (const auto& o : cfg.overrides)
+            {
+                GVariant *val = nullptr;
+                if (OverrideType::boolean == o.override.type)
+                {
+                    val = g_variant_new_boolean(o.boolValue);
+                }
+                else
+                {
+                    val = g_variant_new_string(o.strValue.c_str());
+                }
+                g_variant_builder_add(ovr, "{sv}", o.override.key.c_str(), val);
+            }
+
+            g_variant_builder_add(bld, "(ssbbaua{sv}b)",
+                                  cfg.name.c_str(), cfg.config.c_str(),
+                                  cfg.single_use, cfg.persistent,
+                                  acl, ovr, cfg.seal);
+            g_variant_builder_unref(acl);
+            g_variant_builder_unref(ovr);
+        }
+
+        GVariant *res = Call("ImportBatch", g_variant_new("(a(ssbbaua{sv}b))", bld));
+        g_variant_builder_unref(bld);
+        if (NULL == res)
+        {
+            THROW_DBUSEXCEPTION("OpenVPN3ConfigurationProxy",
+                                "Failed to import configurations");
+        }
+
+        std::vector<ConfigImportResult> ret;
+        ret.reserve(configs.size());
+        GVariantIter *results = nullptr;
+        g_variant_get(res, "(a(os))", &results);
+        const gchar *path = nullptr;
+        const gchar *error = nullptr;
+        while (g_variant_iter_next(results, "(&o&s)", &path, &error))
+        {
+            ConfigImportResult r;
+            r.error = std::string(error);
+            if (r.error.empty())
+            {
+                r.path = std::string(path);
+            }
+            ret.push_back(r);
+        }
+        g_variant_iter_free(results);
+        g_variant_unref(res);
+        return ret;
+    }
+
+
     /**
      * Retrieves a string array of configuration paths which are available
      * to the calling user
@@ -164,6 +320,76 @@ public:
         return ret;
     }
 
+    /**
+     *  Retrieves the configuration profile via a sealed memfd file
+     *  descriptor, see ImportFD()
+     *
+     * @return Returns a std::string with the configuration profile
+     */
+    std::string GetConfigFD()
+    {
+        GUnixFDList *fdlist = nullptr;
+        GVariant *res = CallWithFD("FetchFD", nullptr, nullptr, &fdlist);
+
+        gint32 fd_idx = -1;
+        g_variant_get(res, "(h)", &fd_idx);
+        g_variant_unref(res);
+
+        int fd = -1;
+        if (nullptr != fdlist)
+        {
+            fd = g_unix_fd_list_get(fdlist, fd_idx, nullptr);
+            g_object_unref(fdlist);
+        }
+        if (fd < 0)
+        {
+            THROW_DBUSEXCEPTION("OpenVPN3ConfigurationProxy",
+                                "Failed to retrieve configuration file descriptor");
+        }
+
+        try
+        {
+            std::string ret = memfd_read_sealed(fd, max_fd_config_size);
+            ::close(fd);
+            return ret;
+        }
+        catch (MemFDException& excp)
+        {
+            ::close(fd);
+            THROW_DBUSEXCEPTION("OpenVPN3ConfigurationProxy", excp.what());
+        }
+    }
+
+
+    /**
+     *  Retrieves the parsed configuration profile as a binary encoded
+     *  option list, see OptionListJSON::binary_serialize().  This
+     *  avoids parsing the configuration profile text again.
+     *
+     * @return Returns a std::string with the binary encoded option list
+     */
+    std::string GetConfigBinary()
+    {
+        GVariant *res = Call("FetchBinary");
+        if (NULL == res)
+        {
+            THROW_DBUSEXCEPTION("OpenVPN3ConfigurationProxy", "Failed to retrieve configuration");
+        }
+
+        GVariant *data = g_variant_get_child_value(res, 0);
+        gsize len = 0;
+        const char *buf = (const char *) g_variant_get_fixed_array(data, &len, 1);
+        std::string ret;
+        if (nullptr != buf)
+        {
+            ret.assign(buf, len);
+        }
+        g_variant_unref(data);
+        g_variant_unref(res);
+
+        return ret;
+    }
+
     void Remove()
     {
         GVariant *res = Call("Remove");
@@ -457,6 +683,14 @@ public:
 
 
 private:
+    /**
+     *  Upper limit of a configuration profile received via FetchFD.  This
+     *  is well above the profile size limit enforced by the configuration
+     *  manager when importing profiles.
+     */
+    static const size_t max_fd_config_size = 4 * 1024 * 1024;
+
+
     std::string get_object_path(const GBusType bus_type, std::string target)
     {
         if (target[0] != '/')
@@ -358,6 +358,29 @@ private:
         }
 
 
+        /**
+         *  Retrieve the ACL list of UIDs granted access, as uid_t values.
+         *  The owner UID is not enlisted.
+         *
+         * @return Returns a std::vector<uid_t> with the UIDs
+         */
+        const std::vector<uid_t>& GetAccessListUIDs() const
+        {
+            return acl_list;
+        }
+
+
+        /**
+         *  Retrieves the public access attribute as a bool
+         *
+         * @return Returns true if public access is enabled
+         */
+        bool GetPublicAccessFlag() const
+        {
+            return acl_public;
+        }
+
+
         /**
          *  Adds a user ID (UID) to the access list
          *
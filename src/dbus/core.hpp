@@ -21,10 +21,12 @@
 #define OPENVPN3_DBUS_HPP
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 
 #include "dbus/constants.hpp"
 #include "dbus/exceptions.hpp"
 #include "dbus/object.hpp"
+#include "dbus/object-dispatch.hpp"
 #include "dbus/connection.hpp"
 #include "dbus/proxy.hpp"
 #include "dbus/signals.hpp"
@@ -0,0 +1,96 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   object-dispatch.hpp
+ *
+ * @brief  Lookup table mapping D-Bus method and property names to
+ *         identifiers used when dispatching calls in DBusObject
+ *         implementations.
+ */
+
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace openvpn
+{
+    /**
+     *  Maps D-Bus method or property names to a value of an enum
+     *  defined by the DBusObject implementation.  This allows the
+     *  callback_method_call() and callback_get_property() implementations
+     *  to do a single hash lookup of the name per call and then just
+     *  compare the enum values, instead of comparing the name against
+     *  every known method or property name.
+     *
+     *  A table is intended to be created once per class, as a static
+     *  variable in a lookup function:
+     *
+     *     static MethodID lookup_method_id(const std::string& name)
+     *     {
+     *         static const DBusDispatchTable<MethodID> methods(
+     *             MethodID::UNKNOWN,
+     *             {{"Connect", MethodID::CONNECT},
+     *              {"Disconnect", MethodID::DISCONNECT}});
+     *         return methods.Lookup(name);
+     *     }
+     *
+     *  @param T  Enum type used as identifiers
+     */
+    template <typename T>
+    class DBusDispatchTable
+    {
+    public:
+        /**
+         *  Prepares the lookup table
+         *
+         * @param unknown  Value returned by Lookup() for unknown names
+         * @param entries  List of name and value pairs
+         */
+        DBusDispatchTable(const T unknown,
+                          std::initializer_list<std::pair<const std::string, T>> entries)
+            : unknown(unknown),
+              table(entries)
+        {
+        }
+
+
+        /**
+         *  Looks up the identifier of a method or property name
+         *
+         * @param name  std::string with the method or property name
+         *
+         * @return Returns the identifier of the name or the value for
+         *         unknown names given to the constructor.
+         */
+        T Lookup(const std::string& name) const
+        {
+            auto it = table.find(name);
+            return (table.end() != it ? it->second : unknown);
+        }
+
+
+    private:
+        const T unknown;
+        const std::unordered_map<std::string, T> table;
+    };
+};
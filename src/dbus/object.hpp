@@ -20,10 +20,215 @@
 #ifndef OPENVPN3_DBUS_OBJECT_HPP
 #define OPENVPN3_DBUS_OBJECT_HPP
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "idlecheck.hpp"
 
 namespace openvpn
 {
+    class DBusObject;
+
+
+    /**
+     *  DBusObjectSubtree provides an alternative way of registering
+     *  DBusObjects on the D-Bus, intended for services which can have
+     *  thousands of objects sharing the same parent path.
+     *
+     *  Instead of registering each object separately with
+     *  g_dbus_connection_register_object(), a single subtree is registered
+     *  with g_dbus_connection_register_subtree() for the parent path.  When
+     *  a D-Bus call arrives for a child of that path, the object is looked
+     *  up in an index and the call is dispatched directly to it.
+     *
+     *  While a DBusObjectSubtree exists, DBusObject::RegisterObject() will
+     *  automatically use it for all objects which are direct children of
+     *  the subtree path on the same D-Bus connection.  The object
+     *  implementations themselves do not need to be modified.
+     *
+     *  Objects registered this way do not own a separate D-Bus
+     *  registration, so removing them is just a matter of removing
+     *  them from the index.
+     */
+    class DBusObjectSubtree
+    {
+    public:
+        typedef std::unique_ptr<DBusObjectSubtree> Ptr;
+
+        /**
+         *  Registers a new subtree on the D-Bus
+         *
+         * @param dbuscon    GDBusConnection where to register the subtree
+         * @param root_path  std::string with the parent path of the objects
+         *                   this subtree will handle
+         */
+        DBusObjectSubtree(GDBusConnection *dbuscon,
+                          const std::string& root_path)
+            : dbuscon(dbuscon),
+              root_path(root_path),
+              subtree_id(0)
+        {
+            GError *error = nullptr;
+            subtree_id = g_dbus_connection_register_subtree(dbuscon,
+                                    root_path.c_str(),
+                                    &subtree_vtable,
+                                    G_DBUS_SUBTREE_FLAGS_DISPATCH_TO_UNENUMERATED_NODES,
+                                    this,
+                                    NULL, // destroy function
+                                    &error);
+            if (subtree_id < 1)
+            {
+                std::stringstream err;
+                err << "DBusObjectSubtree(" + root_path + ") failed: ";
+                err << (error != NULL ? error->message : "(unknown)");
+                if (error)
+                {
+                    g_error_free(error);
+                }
+                THROW_DBUSEXCEPTION("DBusObjectSubtree", err.str());
+            }
+
+            std::lock_guard<std::mutex> guard(registry_mutex());
+            registry().push_back(this);
+        }
+
+
+        ~DBusObjectSubtree()
+        {
+            {
+                std::lock_guard<std::mutex> guard(registry_mutex());
+                auto& reg = registry();
+                reg.erase(std::remove(reg.begin(), reg.end(), this),
+                          reg.end());
+            }
+            g_dbus_connection_unregister_subtree(dbuscon, subtree_id);
+
+            // Objects still in the index are no longer reachable
+            // over the D-Bus.  Ensure they will not try to remove
+            // themselves from this subtree later on.
+            for (auto& obj : objects)
+            {
+                detach_object(obj.second);
+            }
+        }
+
+
+        /**
+         *  Looks up a registered subtree which handles a specific
+         *  object path
+         *
+         * @param dbuscon   GDBusConnection the object is to be registered on
+         * @param obj_path  std::string with the D-Bus object path
+         *
+         * @return Returns a pointer to the DBusObjectSubtree handling the
+         *         object path or nullptr if no subtree handles it.
+         */
+        static DBusObjectSubtree * Find(GDBusConnection *dbuscon,
+                                        const std::string& obj_path)
+        {
+            size_t sep = obj_path.rfind('/');
+            if (std::string::npos == sep || 0 == sep)
+            {
+                return nullptr;
+            }
+
+            std::lock_guard<std::mutex> guard(registry_mutex());
+            for (auto& st : registry())
+            {
+                if (st->dbuscon == dbuscon
+                    && 0 == obj_path.compare(0, sep, st->root_path)
+                    && st->root_path.size() == sep)
+                {
+                    return st;
+                }
+            }
+            return nullptr;
+        }
+
+
+        /**
+         * @return Returns the D-Bus object path this subtree handles
+         */
+        const std::string& GetRootPath() const
+        {
+            return root_path;
+        }
+
+
+        /**
+         * @return Returns the number of objects available in this subtree
+         */
+        size_t GetObjectCount() const
+        {
+            return objects.size();
+        }
+
+
+    private:
+        friend class DBusObject;
+
+        GDBusConnection *dbuscon;
+        std::string root_path;
+        guint subtree_id;
+        std::unordered_map<std::string, DBusObject *> objects;
+
+        const GDBusSubtreeVTable subtree_vtable = {
+            subtree_enumerate,
+            subtree_introspect,
+            subtree_dispatch
+        };
+
+
+        static std::vector<DBusObjectSubtree *>& registry()
+        {
+            static std::vector<DBusObjectSubtree *> reg;
+            return reg;
+        }
+
+
+        static std::mutex& registry_mutex()
+        {
+            static std::mutex mtx;
+            return mtx;
+        }
+
+
+        static std::string node_name(const std::string& obj_path)
+        {
+            return obj_path.substr(obj_path.rfind('/') + 1);
+        }
+
+
+        void add_object(DBusObject *obj, const std::string& obj_path);
+        void remove_object(const std::string& obj_path);
+        static void detach_object(DBusObject *obj);
+        DBusObject * lookup(const gchar *node) const;
+
+        static gchar ** subtree_enumerate(GDBusConnection *conn,
+                                          const gchar *sender,
+                                          const gchar *obj_path,
+                                          gpointer this_ptr);
+
+        static GDBusInterfaceInfo ** subtree_introspect(GDBusConnection *conn,
+                                                        const gchar *sender,
+                                                        const gchar *obj_path,
+                                                        const gchar *node,
+                                                        gpointer this_ptr);
+
+        static const GDBusInterfaceVTable * subtree_dispatch(GDBusConnection *conn,
+                                                             const gchar *sender,
+                                                             const gchar *obj_path,
+                                                             const gchar *intf_name,
+                                                             const gchar *node,
+                                                             gpointer *out_user_data,
+                                                             gpointer this_ptr);
+    };
+
+
     /**
      *  DBusObject is the object which carries data, methods
      *  and signals to be provided over the D-Bus.
@@ -56,7 +261,10 @@ namespace openvpn
             registered(false),
             object_path(obj_path),
             object_id(0),
-            idle_checker(nullptr)
+            idle_checker(nullptr),
+            introspection(nullptr),
+            subtree(nullptr),
+            in_subtree(false)
         {
             ParseIntrospectionXML(introspection_xml);
         }
@@ -67,7 +275,9 @@ namespace openvpn
             object_path(obj_path),
             object_id(0),
             idle_checker(nullptr),
-            introspection(nullptr)
+            introspection(nullptr),
+            subtree(nullptr),
+            in_subtree(false)
         {
         }
 
@@ -97,6 +307,13 @@ namespace openvpn
         }
 
 
+        /**
+         *  Registers this object on the D-Bus.  If a DBusObjectSubtree
+         *  handling the parent path of this object exists, the object
+         *  is added to that subtree instead of being registered separately.
+         *
+         * @param dbuscon  GDBusConnection where to register this object
+         */
         void RegisterObject(GDBusConnection *dbuscon)
         {
             if (registered)
@@ -108,6 +325,18 @@ namespace openvpn
                 THROW_DBUSEXCEPTION("DBusObject", "No introspection document parsed");
             }
 
+            DBusObjectSubtree *st = DBusObjectSubtree::Find(dbuscon,
+                                                            object_path);
+            if (nullptr != st)
+            {
+                st->add_object(this, object_path);
+                subtree = st;
+                in_subtree = true;
+                object_id = st->subtree_id;
+                registered = true;
+                return;
+            }
+
             GError *error = NULL;
             object_id = g_dbus_connection_register_object(dbuscon,
                                                           object_path.c_str(),
@@ -146,18 +375,34 @@ namespace openvpn
             }
             registered = false;
 
-            GError *err = nullptr;
-            if (!g_dbus_connection_flush_sync(dbuscon, NULL, &err))
+            if (in_subtree)
             {
-                std::cout << "** ERROR ** Connection flush failed when "
-                          << "removing object ["
-                          << introspection->interfaces[0] << ":"
-                          << object_path << "]:" << err->message
-                          << std::endl;
+                // Registered via a DBusObjectSubtree.  The method
+                // table is looked up for each call, so there is no
+                // per-object registration to tear down and no need to
+                // flush the connection first.
+                if (subtree)
+                {
+                    subtree->remove_object(object_path);
+                    subtree = nullptr;
+                }
+                in_subtree = false;
             }
+            else
+            {
+                GError *err = nullptr;
+                if (!g_dbus_connection_flush_sync(dbuscon, NULL, &err))
+                {
+                    std::cout << "** ERROR ** Connection flush failed when "
+                              << "removing object ["
+                              << introspection->interfaces[0] << ":"
+                              << object_path << "]:" << err->message
+                              << std::endl;
+                }
 
-            // Remove the object from the D-Bus
-            g_dbus_connection_unregister_object(dbuscon, object_id);
+                // Remove the object from the D-Bus
+                g_dbus_connection_unregister_object(dbuscon, object_id);
+            }
 
             // Allow the implementor to add more cleaning up
             callback_destructor();
@@ -472,6 +717,56 @@ namespace openvpn
         }
 
 
+        /**
+         *  Similar to ParseIntrospectionXML(), but the parsed introspection
+         *  data is shared between all objects using an identical
+         *  introspection XML document.  The document is only parsed the
+         *  first time it is seen.
+         *
+         *  This is intended for classes which can have many instances,
+         *  where the introspection document does not depend on the
+         *  instance.  It must not contain the object path in the
+         *  \<node/\> tag.
+         *
+         *  @param xmlstr  std::string containing the introspection XML document to use
+         */
+        void ParseSharedIntrospectionXML(const std::string& xmlstr)
+        {
+            if (registered)
+            {
+                THROW_DBUSEXCEPTION("DBusObject", "Object is already registered in D-Bus. "
+                                    "Cannot modify the introspection document.");
+            }
+
+            std::lock_guard<std::mutex> guard(shared_introspection_mutex());
+            auto& cache = shared_introspection();
+            auto it = cache.find(xmlstr);
+            if (cache.end() == it)
+            {
+                ParseIntrospectionXML(xmlstr);
+                cache[xmlstr] = g_dbus_node_info_ref(introspection);
+                return;
+            }
+            if (introspection)
+            {
+                g_dbus_node_info_unref(introspection);
+            }
+            introspection = g_dbus_node_info_ref(it->second);
+        }
+
+
+        /**
+         *  Parses and processes the introspection XML document, see
+         *  ParseSharedIntrospectionXML(const std::string&)
+         *
+         *  @param xmlstr  std::stringstream containing the introspection XML document to use
+         */
+        void ParseSharedIntrospectionXML(std::stringstream& xmlstr)
+        {
+            ParseSharedIntrospectionXML(xmlstr.str());
+        }
+
+
         /**
          *  Updates the IdleCheck timer's timestamp to indicate this object have been accessed.
          *  If the IdleCheck object times out, the process is stopped.
@@ -514,11 +809,29 @@ namespace openvpn
 
 
     private:
+        friend class DBusObjectSubtree;
+
         bool registered;
         std::string object_path;
         guint object_id;
         IdleCheck *idle_checker;
         GDBusNodeInfo *introspection;
+        DBusObjectSubtree *subtree;
+        bool in_subtree;
+
+
+        static std::unordered_map<std::string, GDBusNodeInfo *>& shared_introspection()
+        {
+            static std::unordered_map<std::string, GDBusNodeInfo *> cache;
+            return cache;
+        }
+
+
+        static std::mutex& shared_introspection_mutex()
+        {
+            static std::mutex mtx;
+            return mtx;
+        }
 
         /**
          *  Callback loook-up table for D-Bus
@@ -583,5 +896,98 @@ namespace openvpn
                                                     error);
         }
     };
+
+
+    inline void DBusObjectSubtree::add_object(DBusObject *obj,
+                                              const std::string& obj_path)
+    {
+        auto r = objects.emplace(node_name(obj_path), obj);
+        if (!r.second)
+        {
+            THROW_DBUSEXCEPTION("DBusObjectSubtree",
+                                "Object " + obj_path + " is already registered");
+        }
+    }
+
+
+    inline void DBusObjectSubtree::remove_object(const std::string& obj_path)
+    {
+        objects.erase(node_name(obj_path));
+    }
+
+
+    inline void DBusObjectSubtree::detach_object(DBusObject *obj)
+    {
+        obj->subtree = nullptr;
+    }
+
+
+    inline DBusObject * DBusObjectSubtree::lookup(const gchar *node) const
+    {
+        if (nullptr == node)
+        {
+            // The root path itself is not handled by the subtree
+            return nullptr;
+        }
+        auto it = objects.find(std::string(node));
+        return (objects.end() != it ? it->second : nullptr);
+    }
+
+
+    inline gchar ** DBusObjectSubtree::subtree_enumerate(GDBusConnection *conn,
+                                                         const gchar *sender,
+                                                         const gchar *obj_path,
+                                                         gpointer this_ptr)
+    {
+        DBusObjectSubtree *st = (DBusObjectSubtree *) this_ptr;
+        gchar **ret = g_new0(gchar *, st->objects.size() + 1);
+        size_t i = 0;
+        for (const auto& obj : st->objects)
+        {
+            ret[i++] = g_strdup(obj.first.c_str());
+        }
+        return ret;
+    }
+
+
+    inline GDBusInterfaceInfo ** DBusObjectSubtree::subtree_introspect(GDBusConnection *conn,
+                                                                       const gchar *sender,
+                                                                       const gchar *obj_path,
+                                                                       const gchar *node,
+                                                                       gpointer this_ptr)
+    {
+        DBusObjectSubtree *st = (DBusObjectSubtree *) this_ptr;
+        DBusObject *obj = st->lookup(node);
+        if (nullptr == obj || nullptr == obj->introspection)
+        {
+            return NULL;
+        }
+
+        // GDBus takes ownership of the array and the references
+        GDBusInterfaceInfo **ret = g_new0(GDBusInterfaceInfo *, 2);
+        ret[0] = g_dbus_interface_info_ref(obj->introspection->interfaces[0]);
+        return ret;
+    }
+
+
+    inline const GDBusInterfaceVTable * DBusObjectSubtree::subtree_dispatch(GDBusConnection *conn,
+                                                                            const gchar *sender,
+                                                                            const gchar *obj_path,
+                                                                            const gchar *intf_name,
+                                                                            const gchar *node,
+                                                                            gpointer *out_user_data,
+                                                                            gpointer this_ptr)
+    {
+        DBusObjectSubtree *st = (DBusObjectSubtree *) this_ptr;
+        DBusObject *obj = st->lookup(node);
+        if (nullptr == obj || nullptr == obj->introspection
+            || 0 != g_strcmp0(intf_name,
+                              obj->introspection->interfaces[0]->name))
+        {
+            return NULL;
+        }
+        *out_user_data = obj;
+        return &obj->dbusobj_interface_vtable;
+    }
 };
 #endif // OPENVPN3_DBUS_OBJECT_HPP
@@ -363,6 +363,63 @@ namespace openvpn
         }
 
 
+        /**
+         *  Calls a D-Bus method which passes file descriptors, either
+         *  as part of the method arguments or in the response.
+         *
+         * @param method   std::string with the method name to call
+         * @param params   GVariant with the method arguments.  File
+         *                 descriptors are referenced by 'h' handles,
+         *                 which are indexes into fds_in.
+         * @param fds_in   GUnixFDList with file descriptors to pass; can
+         *                 be nullptr
+         * @param fds_out  Pointer to a GUnixFDList pointer which will
+         *                 receive the file descriptors in the response.
+         *                 The caller must g_object_unref() it.  Can be
+         *                 nullptr if no file descriptors are expected.
+         *
+         * @return Returns a GVariant with the method response
+         */
+        GVariant * CallWithFD(std::string method, GVariant *params,
+                              GUnixFDList *fds_in, GUnixFDList **fds_out)
+        {
+            if (method.empty())
+            {
+                THROW_DBUSEXCEPTION("DBusProxy", "Method cannot be empty");
+            }
+
+            GError *error = NULL;
+            GVariant *ret = g_dbus_proxy_call_with_unix_fd_list_sync(proxy,
+                                                                     method.c_str(),
+                                                                     params,
+                                                                     call_flags,
+                                                                     -1,  // timeout, -1 == default
+                                                                     fds_in,
+                                                                     fds_out,
+                                                                     NULL, // GCancellable
+                                                                     &error);
+            if (!ret && !error)
+            {
+                THROW_DBUSEXCEPTION("DBusProxy", "Unspecified error");
+            }
+            else if (!ret && error)
+            {
+                std::string dbuserr(error->message);
+                g_error_free(error);
+
+                if (dbuserr.find("GDBus.Error:org.freedesktop.DBus.Error.AccessDenied:") != std::string::npos)
+                {
+                    throw DBusProxyAccessDeniedException("method", dbuserr);
+                }
+
+                THROW_DBUSEXCEPTION("DBusProxy",
+                                    "Failed calling D-Bus method " + method
+                                    + ": " + dbuserr);
+            }
+            return ret;
+        }
+
+
         GVariant * GetProperty(std::string property)
         {
             if (property.empty())
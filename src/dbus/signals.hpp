@@ -287,6 +287,16 @@ namespace openvpn
         }
 
 
+        /**
+         * @return Returns true if signals are broadcast, false if they
+         *         are only sent to the target bus names
+         */
+        bool IsBroadcast() const
+        {
+            return target_bus_names.empty();
+        }
+
+
         void Send(const std::string busn,
                          const std::string interf,
                          const std::string objpath,
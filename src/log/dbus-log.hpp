@@ -20,6 +20,7 @@
 #ifndef OPENVPN3_DBUS_LOG_HPP
 #define OPENVPN3_DBUS_LOG_HPP
 
+#include <bitset>
 #include <fstream>
 #include <ctime>
 #include <exception>
@@ -28,6 +29,7 @@
 #include "client/statusevent.hpp"
 #include "log-helpers.hpp"
 #include "logevent.hpp"
+#include "log-ratelimit.hpp"
 #include "logwriter.hpp"
 
 namespace openvpn
@@ -97,23 +99,7 @@ namespace openvpn
          */
         bool LogFilterAllow(LogCategory catg)
         {
-            switch(catg)
-            {
-            case LogCategory::DEBUG:
-                return log_level >= 6;
-            case LogCategory::VERB2:
-                return log_level >= 5;
-            case LogCategory::VERB1:
-                return log_level >= 4;
-            case LogCategory::INFO:
-                return log_level >= 3;
-            case LogCategory::WARN:
-                return log_level >= 2;
-            case LogCategory::ERROR:
-                return log_level >= 1;
-            default:
-                return true;
-            }
+            return LogLevelAllows(log_level, catg);
         }
 
 
@@ -156,12 +142,21 @@ namespace openvpn
 
         const std::string GetLogIntrospection()
         {
+            std::string ret;
+            for (const auto& signame : LogCategory_signal)
+            {
+                ret += "        <signal name='" + signame + "'>"
+                       "            <arg type='u' name='group' direction='out'/>"
+                       "            <arg type='u' name='level' direction='out'/>"
+                       "            <arg type='s' name='message' direction='out'/>"
+                       "        </signal>";
+            }
             return
                 "        <signal name='Log'>"
                 "            <arg type='u' name='group' direction='out'/>"
                 "            <arg type='u' name='level' direction='out'/>"
                 "            <arg type='s' name='message' direction='out'/>"
-                "        </signal>";
+                "        </signal>" + ret;
         }
 
         const std::string GetStatusChangeIntrospection()
@@ -192,10 +187,58 @@ namespace openvpn
 
             if (LogFilterAllow(catg))
             {
-                Send("Log", values);
+                send_log_signal(catg, values);
             }
         }
 
+        /**
+         *  Enables rate limiting of log events for a specific LogGroup.
+         *  Log events exceeding the rate limit are discarded and a
+         *  summary of discarded events is logged when the rate allows
+         *  it again.  Critical and fatal log events are never
+         *  discarded.
+         *
+         * @param group  LogGroup to limit
+         * @param rate   Average number of log events per second. 0 disables
+         *               rate limiting for this LogGroup
+         * @param burst  Number of log events allowed in a burst
+         */
+        void SetLogRateLimit(const LogGroup group, const double rate,
+                             const unsigned int burst)
+        {
+            ratelimit.SetLimit(group, rate, burst);
+        }
+
+
+        /**
+         *  Enables coalescing identical log events following each other
+         *  into a single "Last message repeated N times" log event.
+         *
+         * @param enable  Boolean flag, true enables duplicate suppression
+         */
+        void SetLogDuplicateSuppression(const bool enable)
+        {
+            ratelimit.SetDuplicateSuppression(enable);
+        }
+
+
+        /**
+         *  Sends the summary of repeated log events which has not been
+         *  sent yet, as no differing log event followed them
+         *
+         * @param quiet  Only send it if the log event has not been
+         *               repeated for this long
+         */
+        void FlushLog(std::chrono::seconds quiet = std::chrono::seconds(0))
+        {
+            ratelimit.Flush([this](const LogEvent& ev)
+                            {
+                                send_log(ev);
+                            },
+                            quiet);
+        }
+
+
         void Log(const LogEvent& logev)
         {
             // Don't log unless the log level filtering allows it
@@ -205,14 +248,10 @@ namespace openvpn
                 return;
             }
 
-            if( logwr )
-            {
-                logwr->Write(logev);
-            }
-            Send("Log", g_variant_new("(uus)",
-                                      (guint) logev.group,
-                                      (guint) logev.category,
-                                      logev.message.c_str()));
+            ratelimit.Process(logev, [this](const LogEvent& ev)
+                              {
+                                  send_log(ev);
+                              });
         }
 
         virtual void Debug(std::string msg)
@@ -268,6 +307,47 @@ namespace openvpn
     protected:
         LogWriter *logwr = nullptr;
         LogGroup log_group;
+
+    private:
+        LogRateLimiter ratelimit;
+
+        void send_log(const LogEvent& logev)
+        {
+            if( logwr )
+            {
+                logwr->Write(logev);
+            }
+            send_log_signal((guint) logev.category,
+                            g_variant_new("(uus)",
+                                          (guint) logev.group,
+                                          (guint) logev.category,
+                                          logev.message.c_str()));
+        }
+
+
+        /**
+         *  Sends the Log signal.  Broadcast Log signals are also sent
+         *  as the per category variant of the Log signal, which lets
+         *  the D-Bus daemon deliver only the log levels a subscriber
+         *  wants.  Signals sent to specific bus names are always
+         *  delivered to them, so only the Log signal is sent then.
+         *
+         * @param catg    LogCategory of the log event, as an integer
+         * @param values  GVariant object with the (uus) Log signal arguments
+         */
+        void send_log_signal(guint catg, GVariant *values)
+        {
+            if (!IsBroadcast() || catg >= LogCategory_signal.size())
+            {
+                Send("Log", values);
+                return;
+            }
+
+            g_variant_ref_sink(values);
+            Send("Log", values);
+            Send(LogCategory_signal[catg], values);
+            g_variant_unref(values);
+        }
     };
 
 
@@ -287,6 +367,71 @@ namespace openvpn
                                      const std::string object_path,
                                      const LogEvent& logev) = 0;
 
+
+        /**
+         *  Sets the log level, see LogFilter::SetLogLevel().  With the
+         *  per category Log signals, the subscriptions are updated to
+         *  the new log level.
+         *
+         * @param loglev  unsigned int with the log level to use
+         */
+        void SetLogLevel(unsigned int loglev)
+        {
+            LogFilter::SetLogLevel(loglev);
+            if (level_signals)
+            {
+                subscribe_level_signals();
+            }
+        }
+
+
+        /**
+         *  Subscribes to the per category variants of the Log signal
+         *  allowed by the log level, instead of the Log signal.  The
+         *  D-Bus daemon then only delivers the log events this consumer
+         *  wants.  Only broadcast Log signals are sent as per category
+         *  variants, so this is only useful for consumers of broadcast
+         *  Log signals.
+         */
+        void SubscribeLogLevelSignals()
+        {
+            level_signals = true;
+            Unsubscribe("Log");
+            subscribe_level_signals();
+        }
+
+
+        /**
+         *  Adds a LogGroup to be excluded when consuming log events
+         *
+         * @param exclgrp LogGroup to exclude
+         */
+        void AddExcludeFilter(const LogGroup exclgrp)
+        {
+            exclude_loggroup.set((size_t) exclgrp);
+        }
+
+
+        /**
+         * @return Returns the number of log events passed on to
+         *         ConsumeLogEvent()
+         */
+        uint64_t GetDeliveredCount() const noexcept
+        {
+            return delivered;
+        }
+
+
+        /**
+         * @return Returns the number of log events received but discarded
+         *         by the log level or log group filters
+         */
+        uint64_t GetDroppedCount() const noexcept
+        {
+            return dropped;
+        }
+
+
         void callback_signal_handler(GDBusConnection *connection,
                                      const std::string sender_name,
                                      const std::string object_path,
@@ -298,26 +443,84 @@ namespace openvpn
         }
 
     protected:
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+
+        /**
+         *  Checks if a received Log signal passes the log level and
+         *  log group filters.  This only looks at the numeric
+         *  arguments of the signal, the log message itself is not
+         *  extracted.
+         *
+         *  The Log signal carries the log group and log category as
+         *  integers; D-Bus match rules can only filter on string
+         *  arguments.  The bus daemon can only filter on the log level
+         *  when the per category Log signals are used, see
+         *  SubscribeLogLevelSignals().
+         *
+         * @param params  GVariant object with the (uus) Log signal arguments
+         *
+         * @return Returns true if the log event should be processed
+         */
+        bool log_event_allowed(GVariant *params)
+        {
+            guint group = 0;
+            guint catg = 0;
+            g_variant_get_child(params, 0, "u", &group);
+            g_variant_get_child(params, 1, "u", &catg);
+
+            if (!LogFilterAllow(catg)
+                || (group < LogGroupCount && exclude_loggroup.test(group)))
+            {
+                ++dropped;
+                return false;
+            }
+            ++delivered;
+            return true;
+        }
+
+
         virtual void process_log_event(const std::string sender,
                                        const std::string interface,
                                        const std::string object_path,
                                        GVariant *params)
         {
+            if (!log_event_allowed(params))
+            {
+                return;
+            }
+
             guint group;
             guint catg;
-            gchar *msg = nullptr;
-            g_variant_get (params, "(uus)", &group, &catg, &msg);
-            auto logev = LogEvent((LogGroup) group, (LogCategory) catg,
-                                  std::string(msg));
+            const gchar *msg = nullptr;
+            g_variant_get (params, "(uu&s)", &group, &catg, &msg);
+            ConsumeLogEvent(sender, interface, object_path,
+                            LogEvent((LogGroup) group, (LogCategory) catg,
+                                     std::string(msg)));
+        }
 
-            if (!LogFilterAllow(catg))
+    private:
+        std::bitset<LogGroupCount> exclude_loggroup;
+        bool level_signals = false;
+
+
+        void subscribe_level_signals()
+        {
+            for (size_t c = 0; c < LogCategory_signal.size(); ++c)
             {
-                goto exit;
+                const std::string& signame = LogCategory_signal[c];
+                if (LogFilterAllow((LogCategory) c))
+                {
+                    if (0 == GetSignalId(signame))
+                    {
+                        Subscribe(signame);
+                    }
+                }
+                else
+                {
+                    Unsubscribe(signame);
+                }
             }
-            ConsumeLogEvent(sender, interface, object_path, logev);
-
-        exit:
-            g_free(msg);
         }
     };
 
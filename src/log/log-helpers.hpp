@@ -127,6 +127,24 @@ const std::array<const std::string, 9> LogCategory_str = {{
         "**!! FATAL !!**",      // LogFlags::FATAL
 }};
 
+/**
+ *  Names of the per category variants of the Log signal.  Log senders
+ *  broadcasting their Log signals also send each log event with the
+ *  signal name of its category, so subscribers can let the D-Bus daemon
+ *  filter on the log level; see LogConsumer::SubscribeLogLevelSignals().
+ */
+const std::array<const std::string, 9> LogCategory_signal = {{
+        "LogUndefined",         // LogCategory::UNDEFINED
+        "LogDebug",             // LogCategory::DEBUG
+        "LogVerb2",             // LogCategory::VERB2
+        "LogVerb1",             // LogCategory::VERB1
+        "LogInfo",              // LogCategory::INFO
+        "LogWarn",              // LogCategory::WARN
+        "LogError",             // LogCategory::ERROR
+        "LogCritical",          // LogCategory::CRIT
+        "LogFatal",             // LogCategory::FATAL
+}};
+
 inline const std::string LogPrefix(LogGroup group, LogCategory catg)
 {
         if ((uint_fast8_t) group >= LogGroupCount) {
@@ -143,4 +161,35 @@ inline const std::string LogPrefix(LogGroup group, LogCategory catg)
         return ret.str();
 }
 
+
+/**
+ *  Checks if a LogCategory is to be logged at a given log level.
+ *  See LogFilter::SetLogLevel() for the meaning of the log levels.
+ *
+ * @param log_level  unsigned int with the log level (0-6)
+ * @param catg       LogCategory to check
+ *
+ * @return Returns true if log events of this category should be logged
+ */
+inline bool LogLevelAllows(const unsigned int log_level, const LogCategory catg)
+{
+        switch(catg)
+        {
+        case LogCategory::DEBUG:
+            return log_level >= 6;
+        case LogCategory::VERB2:
+            return log_level >= 5;
+        case LogCategory::VERB1:
+            return log_level >= 4;
+        case LogCategory::INFO:
+            return log_level >= 3;
+        case LogCategory::WARN:
+            return log_level >= 2;
+        case LogCategory::ERROR:
+            return log_level >= 1;
+        default:
+            return true;
+        }
+}
+
 #endif // OPENVPN3_LOG_HELPERS_HPP
@@ -0,0 +1,292 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   log-history.hpp
+ *
+ * @brief  Bounded in-memory history of log events, with each log
+ *         event tagged with a sequence number for later retrieval.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <ctime>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <gio/gio.h>
+
+#include "logevent.hpp"
+
+
+/**
+ *  A single log event retrieved from a LogHistory buffer
+ */
+struct LogHistoryRecord
+{
+    LogHistoryRecord(const uint64_t seq, const std::time_t tstamp,
+                     const LogEvent& ev)
+        : seq(seq), timestamp(tstamp), event(ev)
+    {
+    }
+
+    uint64_t seq;
+    std::time_t timestamp;
+    LogEvent event;
+};
+
+
+/**
+ *  Ring buffer keeping the last N log events.  Each log event is
+ *  given a sequence number, starting at 1, which can be used to retrieve
+ *  only the log events added after a previous retrieval.
+ *
+ *  The message texts are interned, so repeated log messages (which is
+ *  quite common with reconnecting sessions) are only stored once.
+ */
+class LogHistory
+{
+public:
+    /**
+     *  Default number of log events kept in the history
+     */
+    static const size_t DefaultSize = 500;
+
+    LogHistory(const size_t maxsize = DefaultSize)
+    {
+        SetMaxSize(maxsize);
+    }
+
+
+    /**
+     *  Changes the number of log events to keep.  If the buffer shrinks,
+     *  the oldest log events are discarded.
+     *
+     * @param maxsize  Number of log events to keep.  0 disables the history
+     */
+    void SetMaxSize(const size_t maxsize)
+    {
+        std::vector<Entry> newring;
+        newring.reserve(maxsize);
+
+        size_t skip = (count > maxsize ? count - maxsize : 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Entry& e = ring[(head + i) % ring.size()];
+            if (i < skip)
+            {
+                release(e.message);
+            }
+            else
+            {
+                newring.push_back(e);
+            }
+        }
+        count -= skip;
+        head = 0;
+        ring = std::move(newring);
+        ring.resize(maxsize);
+        max_size = maxsize;
+    }
+
+
+    /**
+     * @return Returns the maximum number of log events kept
+     */
+    size_t GetMaxSize() const noexcept
+    {
+        return max_size;
+    }
+
+
+    /**
+     * @return Returns the number of log events currently in the history
+     */
+    size_t Size() const noexcept
+    {
+        return count;
+    }
+
+
+    /**
+     * @return Returns the sequence number of the last added log event.
+     *         If no log events have been added, 0 is returned.
+     */
+    uint64_t GetLastSeq() const noexcept
+    {
+        return last_seq;
+    }
+
+
+    /**
+     *  Add a new log event to the history.  If the buffer is full, the
+     *  oldest log event is discarded.
+     *
+     * @param logev  LogEvent to record
+     *
+     * @return Returns the sequence number assigned to this log event
+     */
+    uint64_t Add(const LogEvent& logev)
+    {
+        ++last_seq;
+        if (0 == max_size)
+        {
+            return last_seq;
+        }
+
+        size_t pos = (head + count) % max_size;
+        if (count == max_size)
+        {
+            // Buffer full; overwrite the oldest entry
+            release(ring[head].message);
+            head = (head + 1) % max_size;
+        }
+        else
+        {
+            ++count;
+        }
+
+        auto msg = strings.emplace(logev.message, 0).first;
+        ++msg->second;
+        ring[pos] = {last_seq, std::time(nullptr),
+                     logev.group, logev.category, &msg->first};
+        return last_seq;
+    }
+
+
+    /**
+     *  Retrieve log events newer than a given sequence number.  If there
+     *  are more than @max matching log events, only the newest @max
+     *  events are returned.  The result is ordered oldest first.
+     *
+     * @param since_seq  Only return log events with a higher sequence number
+     * @param max        Maximum number of log events to return, 0 for all
+     *
+     * @return Returns a std::vector<LogHistoryRecord> with the log events
+     */
+    std::vector<LogHistoryRecord> Fetch(const uint64_t since_seq,
+                                        const size_t max = 0) const
+    {
+        size_t first = find_first(since_seq, max);
+        std::vector<LogHistoryRecord> ret;
+        ret.reserve(count - first);
+        for (size_t i = first; i < count; ++i)
+        {
+            const Entry& e = ring[(head + i) % max_size];
+            ret.emplace_back(e.seq, e.timestamp,
+                             LogEvent(e.group, e.category, *e.message));
+        }
+        return ret;
+    }
+
+
+    /**
+     *  Same as @Fetch(), but returns a D-Bus result tuple suitable for
+     *  g_dbus_method_invocation_return_value().
+     *
+     *  The D-Bus data type is (ta(ttuus)), where the first element is the
+     *  last sequence number in the history, followed by an array of
+     *  log events: (sequence, timestamp, log group, log category, message)
+     *
+     * @param since_seq  Only return log events with a higher sequence number
+     * @param max        Maximum number of log events to return, 0 for all
+     *
+     * @return Returns a new GVariant object with the log events
+     */
+    GVariant * FetchGVariant(const uint64_t since_seq,
+                             const size_t max = 0) const
+    {
+        GVariantBuilder *b = g_variant_builder_new(G_VARIANT_TYPE("a(ttuus)"));
+        for (size_t i = find_first(since_seq, max); i < count; ++i)
+        {
+            const Entry& e = ring[(head + i) % max_size];
+            g_variant_builder_add(b, "(ttuus)",
+                                  (guint64) e.seq,
+                                  (guint64) e.timestamp,
+                                  (guint32) e.group,
+                                  (guint32) e.category,
+                                  e.message->c_str());
+        }
+        GVariant *ret = g_variant_new("(ta(ttuus))", (guint64) last_seq, b);
+        g_variant_builder_unref(b);
+        return ret;
+    }
+
+
+private:
+    /**
+     *  Compact representation of a log event in the ring buffer.  The
+     *  message is a pointer into the interned strings table.
+     */
+    struct Entry
+    {
+        uint64_t seq;
+        std::time_t timestamp;
+        LogGroup group;
+        LogCategory category;
+        const std::string *message;
+    };
+
+    std::vector<Entry> ring;
+    size_t max_size = 0;
+    size_t head = 0;
+    size_t count = 0;
+    uint64_t last_seq = 0;
+    std::unordered_map<std::string, unsigned int> strings;
+
+
+    /**
+     *  Finds the index (relative to head) of the first log event to
+     *  return for a @Fetch() call
+     */
+    size_t find_first(const uint64_t since_seq, const size_t max) const
+    {
+        if (0 == count)
+        {
+            return 0;
+        }
+
+        // Sequence numbers in the ring are contiguous, so the position
+        // can be calculated directly
+        uint64_t oldest = ring[head].seq;
+        size_t first = (since_seq < oldest ? 0
+                        : std::min<uint64_t>(since_seq - oldest + 1, count));
+        if (max > 0 && (count - first) > max)
+        {
+            first = count - max;
+        }
+        return first;
+    }
+
+
+    /**
+     *  Decrease the reference counter of an interned string, and remove
+     *  it when no longer used
+     */
+    void release(const std::string *msg)
+    {
+        auto it = strings.find(*msg);
+        if (strings.end() != it && 0 == --it->second)
+        {
+            strings.erase(it);
+        }
+    }
+};
@@ -0,0 +1,112 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   log-negotiation.hpp
+ *
+ * @brief  Tracks the log levels requested by the consumers of a log
+ *         event producer, to find the log level to filter on at the source
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+#include "log-helpers.hpp"
+
+
+/**
+ *  A log event producer should not send log events nobody is going to
+ *  use.  Each consumer of the log events, such as the log service or the
+ *  session manager, requests the log level it wants.  The producer then
+ *  uses the highest log level requested.
+ */
+class LogLevelNegotiator
+{
+public:
+    /**
+     * @param fallback  Log level to use when no consumer has requested
+     *                  any log level
+     */
+    LogLevelNegotiator(const unsigned int fallback)
+        : fallback(fallback)
+    {
+    }
+
+
+    /**
+     *  Sets or replaces the log level requested by a log consumer
+     *
+     * @param consumer  std::string identifying the log consumer
+     * @param level     Requested log level (0-6)
+     *
+     * @return Returns true if the resulting log level changed
+     */
+    bool Request(const std::string& consumer, const unsigned int level)
+    {
+        if (level > 6)
+        {
+            THROW_LOGEXCEPTION("LogLevelNegotiator: Invalid log level");
+        }
+        unsigned int prev = GetLogLevel();
+        requests[consumer] = level;
+        return prev != GetLogLevel();
+    }
+
+
+    /**
+     *  Removes the log level request of a log consumer
+     *
+     * @param consumer  std::string identifying the log consumer
+     *
+     * @return Returns true if the resulting log level changed
+     */
+    bool Release(const std::string& consumer)
+    {
+        unsigned int prev = GetLogLevel();
+        requests.erase(consumer);
+        return prev != GetLogLevel();
+    }
+
+
+    /**
+     * @return Returns the highest log level requested, or the fallback
+     *         log level if no consumer has requested any log level
+     */
+    unsigned int GetLogLevel() const
+    {
+        if (requests.empty())
+        {
+            return fallback;
+        }
+        unsigned int ret = 0;
+        for (const auto& r : requests)
+        {
+            ret = std::max(ret, r.second);
+        }
+        return ret;
+    }
+
+
+private:
+    const unsigned int fallback;
+    std::map<std::string, unsigned int> requests;
+};
@@ -0,0 +1,248 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   log-ratelimit.hpp
+ *
+ * @brief  Rate limiting and duplicate suppression of log events,
+ *         used by LogSender before sending Log signals.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include "logevent.hpp"
+
+
+/**
+ *  Limits the number of log events passed through, per LogGroup, using
+ *  a token bucket.  In addition identical log events following each other
+ *  are coalesced into a single "Last message repeated N times" event.
+ *
+ *  Rate limiting is disabled by default for all log groups.  Critical and
+ *  fatal log events are never rate limited nor coalesced.  A pending
+ *  repeat summary is sent with the next differing log event, or by
+ *  Flush() when the repeated log events stop.
+ */
+class LogRateLimiter
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    /**
+     *  How often a summary of repeated log events will be emitted
+     *  while the same log event keeps being repeated.
+     */
+    const std::chrono::seconds repeat_report_interval{30};
+
+
+    LogRateLimiter()
+    {
+    }
+
+
+    /**
+     *  Configure rate limiting for a specific log group
+     *
+     * @param group  LogGroup to configure
+     * @param rate   Number of log events per second allowed on average.
+     *               0 disables rate limiting for this log group.
+     * @param burst  Maximum number of log events which can be sent
+     *               in a burst before the rate limit kicks in.
+     */
+    void SetLimit(const LogGroup group, const double rate,
+                  const unsigned int burst)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        Bucket& b = buckets[(size_t) group];
+        b.rate = rate;
+        b.burst = (burst < 1 ? 1 : burst);
+        b.tokens = b.burst;
+        b.last_refill = clock::now();
+    }
+
+
+    /**
+     *  Enable or disable coalescing of repeated identical log events
+     *
+     * @param enable  Boolean flag, true enables duplicate suppression
+     */
+    void SetDuplicateSuppression(const bool enable)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        suppress_duplicates = enable;
+    }
+
+
+    /**
+     *  Process a log event.  The emit function is called for each log
+     *  event which should be sent; this can be none, the log event itself
+     *  or the log event preceded by a summary of previously suppressed
+     *  log events.
+     *
+     * @param logev  LogEvent to process
+     * @param emit   Function to call for each log event to be sent, with
+     *               the signature void(const LogEvent&)
+     */
+    template <typename EmitFunc>
+    void Process(const LogEvent& logev, EmitFunc emit)
+    {
+        std::unique_lock<std::mutex> guard(mtx);
+        clock::time_point now = clock::now();
+
+        if (suppress_duplicates && logev.category >= LogCategory::CRIT)
+        {
+            // Always sent as they are, after any pending repeat summary
+            if (repeated > 0)
+            {
+                LogEvent summary = repeat_summary();
+                guard.unlock();
+                emit(summary);
+                guard.lock();
+            }
+            have_last = false;
+        }
+        else if (suppress_duplicates)
+        {
+            if (repeats_pending(logev))
+            {
+                ++repeated;
+                last_repeat = now;
+                if ((now - repeat_start) >= repeat_report_interval)
+                {
+                    LogEvent summary = repeat_summary();
+                    repeat_start = now;
+                    guard.unlock();
+                    emit(summary);
+                }
+                return;
+            }
+
+            if (repeated > 0)
+            {
+                LogEvent summary = repeat_summary();
+                guard.unlock();
+                emit(summary);
+                guard.lock();
+            }
+            last = logev;
+            have_last = true;
+            repeat_start = now;
+        }
+
+        Bucket& b = buckets[(size_t) logev.group];
+        if (b.rate > 0 && logev.category < LogCategory::CRIT)
+        {
+            std::chrono::duration<double> elapsed = now - b.last_refill;
+            b.tokens = std::min<double>(b.burst,
+                                        b.tokens + elapsed.count() * b.rate);
+            b.last_refill = now;
+            if (b.tokens < 1.0)
+            {
+                ++b.suppressed;
+                return;
+            }
+            b.tokens -= 1.0;
+        }
+
+        if (b.suppressed > 0)
+        {
+            LogEvent note(logev.group, LogCategory::WARN,
+                          std::to_string(b.suppressed)
+                          + " log messages suppressed due to rate limiting");
+            b.suppressed = 0;
+            guard.unlock();
+            emit(note);
+        }
+        else
+        {
+            guard.unlock();
+        }
+        emit(logev);
+    }
+
+
+    /**
+     *  Sends the summary of repeated log events not reported yet.  This
+     *  is called regularly to report the end of a burst of repeated log
+     *  events, and when no more log events are expected.
+     *
+     * @param emit   Function to call with the summary log event, with
+     *               the signature void(const LogEvent&)
+     * @param quiet  Only send the summary if the log event has not been
+     *               repeated for this long.  By default it is always sent.
+     */
+    template <typename EmitFunc>
+    void Flush(EmitFunc emit, clock::duration quiet = clock::duration::zero())
+    {
+        std::unique_lock<std::mutex> guard(mtx);
+        if (0 == repeated || (clock::now() - last_repeat) < quiet)
+        {
+            return;
+        }
+        LogEvent summary = repeat_summary();
+        have_last = false;
+        guard.unlock();
+        emit(summary);
+    }
+
+
+private:
+    struct Bucket
+    {
+        double rate = 0;
+        unsigned int burst = 1;
+        double tokens = 1;
+        clock::time_point last_refill;
+        unsigned long suppressed = 0;
+    };
+
+    std::mutex mtx;
+    std::array<Bucket, LogGroupCount> buckets;
+    bool suppress_duplicates = false;
+    LogEvent last;
+    bool have_last = false;
+    unsigned long repeated = 0;
+    clock::time_point repeat_start;
+    clock::time_point last_repeat;
+
+
+    bool repeats_pending(const LogEvent& logev) const
+    {
+        return have_last
+               && (logev.group == last.group)
+               && (logev.category == last.category)
+               && (logev.message == last.message);
+    }
+
+
+    LogEvent repeat_summary()
+    {
+        LogEvent ret(last.group, last.category,
+                     "Last message repeated " + std::to_string(repeated)
+                     + " times");
+        repeated = 0;
+        return ret;
+    }
+};
@@ -0,0 +1,276 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   logfile-rotate.hpp
+ *
+ * @brief  std::streambuf implementation writing to a log file which
+ *         is rotated based on size and/or age.  Finished segments can
+ *         optionally be compressed in the background.
+ */
+
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+
+class LogRotateException : public std::exception
+{
+public:
+    LogRotateException(const std::string& err)
+        : err(err)
+    {
+    }
+
+    virtual const char* what() const noexcept
+    {
+        return err.c_str();
+    }
+
+private:
+    std::string err;
+};
+
+
+/**
+ *  Rotation settings for RotatingLogFile.  A max_size of 0 and
+ *  a max_age of 0 disables the automatic rotation; the log file can
+ *  then still be reopened on request (SIGHUP).
+ */
+struct LogRotateSettings
+{
+    std::streamsize max_size = 0;            /**< Rotate when file size exceeds this (bytes) */
+    std::chrono::seconds max_age{0};         /**< Rotate when file has been open this long */
+    unsigned int keep = 5;                   /**< Number of finished segments to keep */
+    bool compress = false;                   /**< gzip finished segments in the background */
+};
+
+
+/**
+ *  Stream buffer which writes everything to a log file, where the log
+ *  file is rotated on a line boundary when it grows too big or too old.
+ *
+ *  The rotation check is done on each sync(), which happens on each
+ *  std::endl call done by the StreamLogWriter.  This ensures a log line
+ *  is never split across two segments.  Finished segments are named
+ *  FILE.1, FILE.2, ... FILE.N (or FILE.N.gz when compressing), where
+ *  FILE.1 is the most recent one.
+ *
+ *  Usage:
+ *      RotatingLogFile rotlog(filename, settings);
+ *      std::ostream logfile(&rotlog);
+ *      StreamLogWriter w(logfile);
+ */
+class RotatingLogFile : public std::streambuf
+{
+public:
+    RotatingLogFile(const std::string& fname,
+                    const LogRotateSettings& settings)
+        : filename(fname), settings(settings)
+    {
+        open_logfile();
+    }
+
+    virtual ~RotatingLogFile()
+    {
+        logfile.close();
+        if (compress_thread.joinable())
+        {
+            compress_thread.join();
+        }
+    }
+
+
+    /**
+     *  Close and reopen the log file, typically called when receiving
+     *  SIGHUP after an external tool have moved the log file away.
+     */
+    void Reopen()
+    {
+        logfile.close();
+        open_logfile();
+    }
+
+
+    /**
+     *  Immediately rotate the current log file, regardless of
+     *  size and age.
+     */
+    void Rotate()
+    {
+        logfile.close();
+
+        // The previous compression job works on FILE.1, which is about
+        // to be renamed.  It is normally completed a long time ago.
+        if (compress_thread.joinable())
+        {
+            compress_thread.join();
+        }
+
+        if (settings.keep > 0)
+        {
+            // Shift FILE.{N-1} -> FILE.N, ..., FILE.1 -> FILE.2.
+            // Both the compressed and uncompressed variants are moved,
+            // in case the compression setting changed between restarts.
+            for (const std::string sfx : {"", ".gz"})
+            {
+                ::unlink(segment_name(settings.keep, sfx).c_str());
+                for (unsigned int i = settings.keep - 1; i > 0; --i)
+                {
+                    ::rename(segment_name(i, sfx).c_str(),
+                             segment_name(i + 1, sfx).c_str());
+                }
+            }
+
+            std::string finished = segment_name(1, "");
+            if (0 != ::rename(filename.c_str(), finished.c_str()))
+            {
+                open_logfile();
+                return;
+            }
+            if (settings.compress)
+            {
+                compress_thread = std::thread(compress_segment, finished);
+            }
+        }
+        else
+        {
+            ::unlink(filename.c_str());
+        }
+        open_logfile();
+    }
+
+
+    /**
+     * @return Returns the number of bytes in the current log file segment
+     */
+    std::streamsize GetCurrentSize() const noexcept
+    {
+        return current_size;
+    }
+
+
+protected:
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            return traits_type::not_eof(c);
+        }
+        ++current_size;
+        return logfile.rdbuf()->sputc(traits_type::to_char_type(c));
+    }
+
+
+    std::streamsize xsputn(const char_type* s, std::streamsize n) override
+    {
+        std::streamsize r = logfile.rdbuf()->sputn(s, n);
+        current_size += r;
+        return r;
+    }
+
+
+    int sync() override
+    {
+        int r = logfile.rdbuf()->pubsync();
+        if (rotation_needed())
+        {
+            Rotate();
+        }
+        return r;
+    }
+
+
+private:
+    const std::string filename;
+    const LogRotateSettings settings;
+    std::ofstream logfile;
+    std::streamsize current_size = 0;
+    std::chrono::steady_clock::time_point opened;
+    std::thread compress_thread;
+
+
+    void open_logfile()
+    {
+        logfile.open(filename, std::ios_base::app);
+        if (!logfile.is_open())
+        {
+            throw LogRotateException("Could not open log file '"
+                                     + filename + "'");
+        }
+
+        struct stat st;
+        current_size = (0 == ::stat(filename.c_str(), &st) ? st.st_size : 0);
+        opened = std::chrono::steady_clock::now();
+    }
+
+
+    bool rotation_needed() const
+    {
+        if (settings.max_size > 0 && current_size >= settings.max_size)
+        {
+            return true;
+        }
+        if (settings.max_age.count() > 0
+            && (std::chrono::steady_clock::now() - opened) >= settings.max_age)
+        {
+            return current_size > 0;
+        }
+        return false;
+    }
+
+
+    std::string segment_name(unsigned int idx, const std::string& sfx) const
+    {
+        return filename + "." + std::to_string(idx) + sfx;
+    }
+
+
+    /**
+     *  Runs gzip on a finished log segment.  This is run in a separate
+     *  thread, to not block the log writing while compressing.
+     *
+     * @param fname  std::string with the file name to compress
+     */
+    static void compress_segment(const std::string fname)
+    {
+        pid_t pid = fork();
+        if (0 == pid)
+        {
+            execlp("gzip", "gzip", "-f", "-q", fname.c_str(), (char *) NULL);
+            _exit(127);
+        }
+        else if (pid > 0)
+        {
+            int status = 0;
+            waitpid(pid, &status, 0);
+        }
+    }
+};
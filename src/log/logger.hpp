@@ -47,29 +47,11 @@ public:
     }
 
 
-    /**
-     *  Adds a LogGroup to be excluded when consuming log events
-     * @param exclgrp LogGroup to exclude
-     */
-    void AddExcludeFilter(LogGroup exclgrp)
-    {
-        exclude_loggroup.push_back(exclgrp);
-    }
-
-
     void ConsumeLogEvent(const std::string sender,
                          const std::string interface,
                          const std::string object_path,
                          const LogEvent& logev)
     {
-        for (const auto& e : exclude_loggroup)
-        {
-            if (e == logev.group)
-            {
-                return;  // Don't do anything if this LogGroup is filtered
-            }
-        }
-
         // Prepend log lines with the log tag
         logwr->WritePrepend(log_tag + std::string(" "), true);
 
@@ -88,5 +70,4 @@ public:
 private:
     LogWriter *logwr;
     const std::string log_tag;
-    std::vector<LogGroup> exclude_loggroup;
 };
@@ -28,8 +28,11 @@
 
 #include <syslog.h>
 
+#include <algorithm>
 #include <fstream>
 #include <exception>
+#include <memory>
+#include <vector>
 
 #include "common/timestamp.hpp"
 #include "colourengine.hpp"
@@ -60,7 +63,7 @@ public:
      * @param tstamp Boolean flag to enable (true) or disable (false)
      *               timestamps
      */
-    virtual void EnableTimestamp(const bool tstamp) final
+    virtual void EnableTimestamp(const bool tstamp)
     {
         timestamp = tstamp;
     }
@@ -77,7 +80,7 @@ public:
      * @param meta  Boolean to enable (true) or disable (false) the
      *              the meta data logging
      */
-    void EnableLogMeta(const bool meta)
+    virtual void EnableLogMeta(const bool meta)
     {
         log_meta= meta;
     }
@@ -154,6 +157,26 @@ public:
     }
 
 
+    /**
+     *  Writes an already formatted log line.  This is used when the same
+     *  log event is written to several LogWriters (see MultiLogWriter),
+     *  where the log line and timestamp is only rendered once.
+     *
+     * @param grp     LogGroup the log message belongs to
+     * @param ctg     LogCategory the log message is categorized as
+     * @param tstamp  std::string with the timestamp of the log event
+     * @param line    std::string with the log prefix and log data
+     */
+    virtual void WriteRendered(const LogGroup grp, const LogCategory ctg,
+                               const std::string& tstamp,
+                               const std::string& line)
+    {
+        rendered_tstamp = &tstamp;
+        Write(line);
+        rendered_tstamp = nullptr;
+    }
+
+
     /**
      *  Adds meta log info, which is printed before the log line
      *  written by Write().  This must be added before each Write() call.
@@ -191,6 +214,17 @@ protected:
     std::string metadata;
     std::string prepend;
     bool prepend_meta;
+    const std::string *rendered_tstamp = nullptr;
+
+
+    /**
+     * @return Returns the timestamp to use for the log line being written.
+     *         If the log line was already rendered, that timestamp is reused.
+     */
+    std::string get_timestamp() const
+    {
+        return (rendered_tstamp ? *rendered_tstamp : GetTimestamp());
+    }
 };
 
 
@@ -239,7 +273,7 @@ public:
     {
         if (!metadata.empty())
         {
-            dest << (timestamp ? GetTimestamp() : "") << " "
+            dest << (timestamp ? get_timestamp() : "") << " "
                  << colour_init
                  << (prepend_meta ? prepend : "")
                  << metadata << colour_reset
@@ -247,7 +281,7 @@ public:
             metadata.clear();
             prepend_meta = false;
         }
-        dest << (timestamp ? GetTimestamp() : "") << " "
+        dest << (timestamp ? get_timestamp() : "") << " "
              << colour_init << prepend << data << colour_reset
              << std::endl;
         prepend.clear();
@@ -321,6 +355,32 @@ public:
     }
 
 
+    virtual void WriteRendered(const LogGroup grp, const LogCategory ctg,
+                               const std::string& tstamp,
+                               const std::string& line) override
+    {
+        rendered_tstamp = &tstamp;
+        switch (colours->GetColourMode())
+        {
+        case ColourEngine::ColourMode::BY_CATEGORY:
+            Write(line, colours->ColourByCategory(ctg), colours->Reset());
+            break;
+
+        case ColourEngine::ColourMode::BY_GROUP:
+            Write(line,
+                  (LogCategory::INFO < ctg ? colours->ColourByCategory(ctg)
+                                           : colours->ColourByGroup(grp)),
+                  colours->Reset());
+            break;
+
+        default:
+            Write(line);
+            break;
+        }
+        rendered_tstamp = nullptr;
+    }
+
+
 private:
     ColourEngine *colours = nullptr;
 };
@@ -482,6 +542,25 @@ public:
     }
 
 
+    virtual void WriteRendered(const LogGroup grp, const LogCategory ctg,
+                               const std::string& tstamp,
+                               const std::string& line) override
+    {
+        // syslog adds its own timestamps, so tstamp is not used
+        if (!metadata.empty())
+        {
+            syslog(logcatg2syslog(ctg), "%s%s",
+                   (prepend_meta ? prepend.c_str() : ""),
+                   metadata.c_str());
+            metadata.clear();
+            prepend_meta = false;
+        }
+
+        syslog(logcatg2syslog(ctg), "%s%s", prepend.c_str(), line.c_str());
+        prepend.clear();
+    }
+
+
 private:
     /**
      *  Simple conversion between LogCategory and a corresponding
@@ -519,3 +598,169 @@ private:
         }
     }
 };
+
+
+
+/**
+ *  LogWriter implementation which writes log events to several other
+ *  LogWriters, where each of them have their own log level.  This makes
+ *  it possible to for example log to syslog at INFO level while a log
+ *  file also gets all the DEBUG messages.
+ *
+ *  Each log event is only formatted once; the rendered log line and
+ *  timestamp is shared between all the LogWriters accepting the event.
+ */
+class MultiLogWriter : public LogWriter
+{
+public:
+    MultiLogWriter()
+        : LogWriter()
+    {
+    }
+
+    virtual ~MultiLogWriter()
+    {
+    }
+
+
+    /**
+     *  Adds a new log destination
+     *
+     * @param writer     LogWriter::Ptr to the LogWriter to write to.  The
+     *                   MultiLogWriter takes over the ownership.
+     * @param log_level  unsigned int with the highest log level (0-6)
+     *                   this LogWriter should receive.
+     */
+    void AddLogWriter(LogWriter::Ptr writer, const unsigned int log_level)
+    {
+        writer->EnableTimestamp(timestamp);
+        writer->EnableLogMeta(log_meta);
+        destinations.push_back({std::move(writer), log_level});
+    }
+
+
+    /**
+     * @return Returns the highest log level used by any of the
+     *         log destinations
+     */
+    unsigned int GetMaxLogLevel() const noexcept
+    {
+        unsigned int ret = 0;
+        for (const auto& d : destinations)
+        {
+            ret = std::max(ret, d.log_level);
+        }
+        return ret;
+    }
+
+
+    virtual void EnableTimestamp(const bool tstamp) override
+    {
+        LogWriter::EnableTimestamp(tstamp);
+        for (auto& d : destinations)
+        {
+            d.writer->EnableTimestamp(tstamp);
+        }
+    }
+
+
+    virtual void EnableLogMeta(const bool meta) override
+    {
+        LogWriter::EnableLogMeta(meta);
+        for (auto& d : destinations)
+        {
+            d.writer->EnableLogMeta(meta);
+        }
+    }
+
+
+    /**
+     *  Writes unformatted log data to all log destinations, regardless
+     *  of their log level.
+     */
+    virtual void Write(const std::string& data,
+                       const std::string& colour_init = "",
+                       const std::string& colour_reset = "") override
+    {
+        for (auto& d : destinations)
+        {
+            pass_meta(d.writer);
+            d.writer->Write(data, colour_init, colour_reset);
+        }
+        reset_meta();
+    }
+
+
+    virtual void Write(const LogGroup grp, const LogCategory ctg,
+                       const std::string& data,
+                       const std::string& colour_init,
+                       const std::string& colour_reset) override
+    {
+        std::string tstamp;
+        std::string line;
+        bool rendered = false;
+        for (auto& d : destinations)
+        {
+            if (!LogLevelAllows(d.log_level, ctg))
+            {
+                continue;
+            }
+            if (!rendered)
+            {
+                tstamp = (timestamp ? GetTimestamp() : "");
+                line = LogPrefix(grp, ctg) + data;
+                rendered = true;
+            }
+            pass_meta(d.writer);
+            d.writer->WriteRendered(grp, ctg, tstamp, line);
+        }
+        reset_meta();
+    }
+
+
+    virtual void WriteRendered(const LogGroup grp, const LogCategory ctg,
+                               const std::string& tstamp,
+                               const std::string& line) override
+    {
+        for (auto& d : destinations)
+        {
+            if (LogLevelAllows(d.log_level, ctg))
+            {
+                pass_meta(d.writer);
+                d.writer->WriteRendered(grp, ctg, tstamp, line);
+            }
+        }
+        reset_meta();
+    }
+
+
+private:
+    struct Destination
+    {
+        LogWriter::Ptr writer;
+        unsigned int log_level;
+    };
+
+    std::vector<Destination> destinations;
+
+
+    void pass_meta(LogWriter::Ptr& writer)
+    {
+        if (!metadata.empty())
+        {
+            writer->AddMeta(metadata);
+        }
+        if (!prepend.empty())
+        {
+            writer->WritePrepend(prepend, prepend_meta);
+        }
+    }
+
+
+    void reset_meta()
+    {
+        metadata.clear();
+        prepend.clear();
+        prepend_meta = false;
+    }
+};
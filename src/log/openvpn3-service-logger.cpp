@@ -29,26 +29,104 @@
 #include "common/cmdargparser.hpp"
 #include "logger.hpp"
 #include "logwriter.hpp"
+#include "logfile-rotate.hpp"
 #include "ansicolours.hpp"
 #include "service.hpp"
 
 using namespace openvpn;
 
 
-static int logger(ParsedArgs args)
+/**
+ *  SIGHUP handler, closes and reopens the log file.  This is used
+ *  when an external log rotation tool has moved the log file.
+ *
+ * @param rotlog  Pointer to the RotatingLogFile object in use
+ *
+ * @return Always returns G_SOURCE_CONTINUE, to keep the handler active
+ */
+static int reopen_handler(void *rotlog)
 {
-    int ret = 0;
+    ((RotatingLogFile *) rotlog)->Reopen();
+    return G_SOURCE_CONTINUE;
+}
 
-    unsigned int log_level = 3;
-    if (args.Present("log-level"))
+
+/**
+ *  Parses a size argument, which may have a K, M or G suffix
+ *
+ * @param arg  std::string containing the size value
+ *
+ * @return Returns the size in bytes.  On parse errors a CommandException
+ *         is thrown.
+ */
+static std::streamsize parse_size_arg(const std::string& arg)
+{
+    size_t pos = 0;
+    unsigned long long val = 0;
+    try
     {
-        log_level = std::atoi(args.GetValue("log-level", 0).c_str());
-        if (log_level > 6)
-        {
-            throw CommandException("openvpn3-service-logger",
-                                   "--log-level can only be between 0 and 6");
-        }
+        val = std::stoull(arg, &pos);
     }
+    catch (std::exception&)
+    {
+        throw CommandException("openvpn3-service-logger",
+                               "Invalid size value: " + arg);
+    }
+
+    std::string sfx = arg.substr(pos);
+    if (sfx.empty())
+    {
+        return val;
+    }
+    switch (sfx.size() == 1 ? sfx[0] : 0)
+    {
+    case 'k': case 'K':
+        return val * 1024;
+    case 'm': case 'M':
+        return val * 1024 * 1024;
+    case 'g': case 'G':
+        return val * 1024 * 1024 * 1024;
+    default:
+        throw CommandException("openvpn3-service-logger",
+                               "Invalid size suffix: " + arg);
+    }
+}
+
+
+/**
+ *  Parses a log level argument
+ *
+ * @param args     ParsedArgs with the command line arguments
+ * @param option   std::string with the option name to parse
+ * @param default_level  unsigned int with the log level to use if the
+ *                       option is not present
+ *
+ * @return Returns the log level, between 0 and 6.  If the value is
+ *         invalid, a CommandException is thrown.
+ */
+static unsigned int parse_log_level(ParsedArgs& args,
+                                    const std::string& option,
+                                    const unsigned int default_level)
+{
+    if (!args.Present(option))
+    {
+        return default_level;
+    }
+    int lvl = std::atoi(args.GetValue(option, 0).c_str());
+    if (lvl < 0 || lvl > 6)
+    {
+        throw CommandException("openvpn3-service-logger",
+                               "--" + option + " can only be between 0 and 6");
+    }
+    return lvl;
+}
+
+
+static int logger(ParsedArgs args)
+{
+    int ret = 0;
+
+    unsigned int log_level = parse_log_level(args, "log-level", 3);
 
     if (args.Present("system")
         && (args.Present("vpn-backend")
@@ -63,18 +141,42 @@ static int logger(ParsedArgs args)
         throw CommandException("openvpn3-service-logger", err.str());
     }
 
-    if (args.Present("syslog") && args.Present("log-file"))
+    if (args.Present("syslog") && args.Present("colour")
+        && !args.Present("log-file"))
     {
         std::stringstream err;
-        err << "--syslog and --log-file cannot be combined.";
+        err << "--syslog and --colour cannot be combined, "
+            << "unless --log-file is used.";
         throw CommandException("openvpn3-service-logger", err.str());
     }
 
-    if (args.Present("syslog") && args.Present("colour"))
+    if ((args.Present("syslog-level") && !args.Present("syslog"))
+        || (args.Present("log-file-level") && !args.Present("log-file")))
     {
-        std::stringstream err;
-        err << "--syslog and --colour cannot be combined.";
-        throw CommandException("openvpn3-service-logger", err.str());
+        throw CommandException("openvpn3-service-logger",
+                               "--syslog-level requires --syslog and "
+                               "--log-file-level requires --log-file");
+    }
+
+    // Each log destination may have its own log level.  If not set,
+    // the destination uses --log-level.  The subscriptions must receive
+    // everything needed by the most verbose log destination, also when
+    // that is above an explicit --log-level.
+    unsigned int syslog_level = parse_log_level(args, "syslog-level",
+                                                log_level);
+    unsigned int logfile_level = parse_log_level(args, "log-file-level",
+                                                 log_level);
+    if (args.Present("syslog") && args.Present("log-file"))
+    {
+        log_level = std::max(syslog_level, logfile_level);
+    }
+    else if (args.Present("syslog"))
+    {
+        log_level = syslog_level;
+    }
+    else if (args.Present("log-file"))
+    {
+        log_level = logfile_level;
     }
 
     if ((args.Present("idle-exit") || args.Present("state-dir"))
@@ -85,6 +187,34 @@ static int logger(ParsedArgs args)
                                "without --service");
     }
 
+    LogRotateSettings rotate_settings;
+    if (args.Present("log-rotate-size") || args.Present("log-rotate-age")
+        || args.Present("log-rotate-keep")
+        || args.Present("log-rotate-compress"))
+    {
+        if (!args.Present("log-file"))
+        {
+            throw CommandException("openvpn3-service-logger",
+                                   "--log-rotate-* options require "
+                                   "--log-file");
+        }
+        if (args.Present("log-rotate-size"))
+        {
+            rotate_settings.max_size = parse_size_arg(args.GetValue("log-rotate-size", 0));
+        }
+        if (args.Present("log-rotate-age"))
+        {
+            int age = std::atoi(args.GetValue("log-rotate-age", 0).c_str());
+            rotate_settings.max_age = std::chrono::minutes(age < 0 ? 0 : age);
+        }
+        if (args.Present("log-rotate-keep"))
+        {
+            int keep = std::atoi(args.GetValue("log-rotate-keep", 0).c_str());
+            rotate_settings.keep = (keep < 0 ? 0 : keep);
+        }
+        rotate_settings.compress = args.Present("log-rotate-compress");
+    }
+
     DBus dbus(G_BUS_TYPE_SYSTEM);
     dbus.Connect();
     GDBusConnection *dbusconn = dbus.GetConnection();
@@ -94,12 +224,20 @@ static int logger(ParsedArgs args)
     LogService::Ptr logsrv = nullptr;
 
     // Open a log destination
-    std::ofstream logfs;
+    std::unique_ptr<RotatingLogFile> logfs;
     std::streambuf * logstream;
     if (args.Present("log-file"))
     {
-        logfs.open(args.GetValue("log-file", 0).c_str(), std::ios_base::app);
-        logstream = logfs.rdbuf();
+        try
+        {
+            logfs.reset(new RotatingLogFile(args.GetValue("log-file", 0),
+                                            rotate_settings));
+        }
+        catch (LogRotateException& excp)
+        {
+            throw CommandException("openvpn3-service-logger", excp.what());
+        }
+        logstream = logfs.get();
     }
     else
     {
@@ -108,8 +246,9 @@ static int logger(ParsedArgs args)
     std::ostream logfile(logstream);
 
 
-    // Prepare the appropriate log writer
-    LogWriter::Ptr logwr = nullptr;
+    // Prepare the appropriate log writers
+    LogWriter::Ptr syslogwr = nullptr;
+    LogWriter::Ptr streamwr = nullptr;
     ColourEngine::Ptr colourengine = nullptr;
     if (args.Present("syslog"))
      {
@@ -126,17 +265,35 @@ static int logger(ParsedArgs args)
                                        excp.what());
             }
         }
-        logwr.reset(new SyslogWriter(args.GetArgv0().c_str(), facility));
+        syslogwr.reset(new SyslogWriter(args.GetArgv0().c_str(), facility));
+     }
+     if (!args.Present("syslog") || args.Present("log-file"))
+     {
+         if (args.Present("colour"))
+         {
+             colourengine.reset(new ANSIColours());
+             streamwr.reset(new ColourStreamWriter(logfile,
+                                                   colourengine.get()));
+         }
+         else
+         {
+             streamwr.reset(new StreamLogWriter(logfile));
+         }
      }
-     else if (args.Present("colour"))
+
+     // When logging to more destinations, each log event is
+     // formatted once and passed to each of them
+     LogWriter::Ptr logwr = nullptr;
+     if (syslogwr && streamwr)
      {
-         colourengine.reset(new ANSIColours());
-         logwr.reset(new ColourStreamWriter(logfile,
-                                            colourengine.get()));
+         MultiLogWriter *multiwr = new MultiLogWriter();
+         logwr.reset(multiwr);
+         multiwr->AddLogWriter(std::move(syslogwr), syslog_level);
+         multiwr->AddLogWriter(std::move(streamwr), logfile_level);
      }
      else
      {
-         logwr.reset(new StreamLogWriter(logfile));
+         logwr = std::move(syslogwr ? syslogwr : streamwr);
      }
      logwr->EnableTimestamp(args.Present("timestamp"));
      logwr->EnableLogMeta(args.Present("service-log-dbus-details"));
@@ -160,6 +317,10 @@ static int logger(ParsedArgs args)
         GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
         g_unix_signal_add(SIGINT, stop_handler, main_loop);
         g_unix_signal_add(SIGTERM, stop_handler, main_loop);
+        if (logfs)
+        {
+            g_unix_signal_add(SIGHUP, reopen_handler, logfs.get());
+        }
 
         if (args.Present("service"))
         {
@@ -211,6 +372,9 @@ static int logger(ParsedArgs args)
             //  uses --signal-broadcast, these subscribers will receive
             //  a lot more Log signals.  These services broadcasts very little
             //  information by default.
+            //
+            //  The per log category Log signals are used, so the D-Bus
+            //  daemon does not deliver log events above the log level.
 
             unsigned int subscribers = 0;
             if (args.Present("vpn-backend"))
@@ -219,6 +383,7 @@ static int logger(ParsedArgs args)
                                                  "[B]", "",
                                                  OpenVPN3DBus_interf_backends,
                                                  log_level));
+                be_subscription->SubscribeLogLevelSignals();
                 ++subscribers;
             }
 
@@ -229,6 +394,7 @@ static int logger(ParsedArgs args)
                                             "[S]", "",
                                             OpenVPN3DBus_interf_sessions,
                                             log_level);
+                session_subscr->SubscribeLogLevelSignals();
                 ++subscribers;
                 if (!args.Present("session-manager-client-proxy"))
                 {
@@ -247,6 +413,7 @@ static int logger(ParsedArgs args)
                                            "[C]", "",
                                            OpenVPN3DBus_interf_configuration,
                                            log_level);
+                config_subscr->SubscribeLogLevelSignals();
                 ++subscribers;
             }
 
@@ -272,6 +439,23 @@ static int logger(ParsedArgs args)
         procsig.ProcessChange(StatusMinor::PROC_STOPPED);
         g_main_loop_unref(main_loop);
 
+        // Report how many log events the subscriptions processed
+        std::map<std::string, Logger::Ptr> subscriptions = {
+            {"[B]", be_subscription},
+            {"[S]", session_subscr},
+            {"[C]", config_subscr}
+        };
+        for (const auto& subscr : subscriptions)
+        {
+            if (subscr.second)
+            {
+                logfile << subscr.first << " Log events: "
+                        << subscr.second->GetDeliveredCount() << " written, "
+                        << subscr.second->GetDroppedCount() << " discarded"
+                        << std::endl;
+            }
+        }
+
         // If the idle check is running, wait for it to complete
         if (idle_wait_min > 0)
         {
@@ -310,13 +494,32 @@ int main(int argc, char **argv)
     argparser.AddOption("vpn-backend", 0,
                         "Subscribe to VPN client log entries");
     argparser.AddOption("log-level", 0, "LEVEL", true,
-                        "Set the log verbosity level (default 3)");
+                        "Set the log verbosity level, used by the log "
+                        "destinations without their own level (default 3)");
     argparser.AddOption("syslog", 0,
                         "Send all log events to syslog");
     argparser.AddOption("syslog-facility", 0, "FACILITY", true,
                         "Use a specific syslog facility (Default: LOG_DAEMON)");
+    argparser.AddOption("syslog-level", 0, "LEVEL", true,
+                        "(Only with --syslog) Log verbosity level for "
+                        "syslog (Default: --log-level)");
     argparser.AddOption("log-file", 0, "FILE", true,
-                        "Log events to file");
+                        "Log events to file.  Can be combined with --syslog");
+    argparser.AddOption("log-file-level", 0, "LEVEL", true,
+                        "(Only with --log-file) Log verbosity level for "
+                        "the log file (Default: --log-level)");
+    argparser.AddOption("log-rotate-size", 0, "SIZE", true,
+                        "(Only with --log-file) Rotate the log file when it "
+                        "exceeds SIZE bytes (K, M, G suffixes allowed)");
+    argparser.AddOption("log-rotate-age", 0, "MINUTES", true,
+                        "(Only with --log-file) Rotate the log file when it "
+                        "has been in use for more than MINUTES");
+    argparser.AddOption("log-rotate-keep", 0, "NUM", true,
+                        "(Only with --log-file) Number of rotated log files "
+                        "to keep (Default: 5)");
+    argparser.AddOption("log-rotate-compress", 0,
+                        "(Only with --log-file) Compress rotated log files "
+                        "in the background using gzip");
     argparser.AddOption("service", 0,
                         "Run as a background D-Bus service");
     argparser.AddOption("service-log-dbus-details", 0,
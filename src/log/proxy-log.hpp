@@ -25,10 +25,13 @@
 
 #pragma once
 
+#include <functional>
+
 #include <openvpn/common/rc.hpp>
 
 #include "dbus/core.hpp"
 #include "dbus/proxy.hpp"
+#include "dbus/signals.hpp"
 
 /**
  *  Client proxy implementation interacting with a
@@ -100,6 +103,30 @@ public:
     }
 
 
+    /**
+     *  Retrieve the number of log events which have been passed on to the
+     *  log writer by the log service.
+     *
+     * @return  Returns the number of log events processed
+     */
+    guint64 GetEventsDelivered()
+    {
+        return GetUInt64Property("events_delivered");
+    }
+
+
+    /**
+     *  Retrieve the number of log events the log service has received but
+     *  discarded due to the log level or log group filtering.
+     *
+     * @return  Returns the number of log events discarded
+     */
+    guint64 GetEventsDropped()
+    {
+        return GetUInt64Property("events_dropped");
+    }
+
+
     /**
      *  Retrieve the current log level (verbosity) of the log service.  This
      *  is a global setting for all subscriptions.
@@ -174,3 +201,51 @@ public:
         SetProperty("log_dbus_details", dbus_details);
     }
 };
+
+
+/**
+ *  Watches the log_level property of the log service.  The log service
+ *  sends a PropertiesChanged signal each time the log level is modified,
+ *  which is passed on to a callback function.
+ */
+class LogServiceLevelSubscription : public DBusSignalSubscription
+{
+public:
+    typedef std::function<void(unsigned int)> Callback;
+
+    /**
+     * @param dbuscon   D-Bus connection to use for the signal subscription
+     * @param callback  Function called with the new log level whenever
+     *                  the log service changes its log level
+     */
+    LogServiceLevelSubscription(GDBusConnection *dbuscon, Callback callback)
+        : DBusSignalSubscription(dbuscon,
+                                 OpenVPN3DBus_name_log,
+                                 "org.freedesktop.DBus.Properties",
+                                 OpenVPN3DBus_rootp_log,
+                                 "PropertiesChanged"),
+          callback(callback)
+    {
+    }
+
+
+    void callback_signal_handler(GDBusConnection *connection,
+                                 const std::string sender_name,
+                                 const std::string object_path,
+                                 const std::string interface_name,
+                                 const std::string signal_name,
+                                 GVariant *parameters)
+    {
+        GVariant *changed = g_variant_get_child_value(parameters, 1);
+        guint32 log_level = 0;
+        if (g_variant_lookup(changed, "log_level", "u", &log_level))
+        {
+            callback(log_level);
+        }
+        g_variant_unref(changed);
+    }
+
+
+private:
+    Callback callback;
+};
@@ -95,6 +95,8 @@ public:
         << "        <property name='log_dbus_details' type='b' access='readwrite'/>"
         << "        <property name='timestamp' type='b' access='readwrite'/>"
         << "        <property name='num_attached' type='u' access='read'/>"
+        << "        <property name='events_delivered' type='t' access='read'/>"
+        << "        <property name='events_dropped' type='t' access='read'/>"
         << "    </interface>"
         << "</node>";
         ParseIntrospectionXML(introspection_xml);
@@ -145,6 +147,7 @@ public:
                                       GVariant *params,
                                       GDBusMethodInvocation *invoc)
     {
+        const MethodID method_id = lookup_method_id(meth_name);
         std::stringstream meta;
         meta << "sender=" << sender
              << ", object_path=" << obj_path
@@ -171,7 +174,7 @@ public:
             tagstr_ << "{tag:" << std::to_string(htag) << "}";
             std::string tagstr(tagstr_.str());
 
-            if ("Attach" == meth_name)
+            if (MethodID::ATTACH == method_id)
             {
                 // Subscribe to signals from a new D-Bus service/client
 
@@ -205,7 +208,7 @@ public:
 
                 g_dbus_method_invocation_return_value(invoc, NULL);
             }
-            else if ("Detach" == meth_name)
+            else if (MethodID::DETACH == method_id)
             {
                 // Ensure the requested logger is truly configured
                 if (loggers.find(htag) == loggers.end())
@@ -229,6 +232,9 @@ public:
                 validate_sender(sender, loggers[htag]->GetBusName());
 
                 // Unsubscribe from signals from a D-Bus service/client
+                // but preserve the log event counters
+                detached_delivered += loggers[htag]->GetDeliveredCount();
+                detached_dropped += loggers[htag]->GetDroppedCount();
                 loggers.erase(htag);
                 std::stringstream l;
                 l << "Detached: " << tag << " " << tagstr;
@@ -284,27 +290,46 @@ public:
                      const std::string property_name,
                      GError **error)
     {
+        const PropertyID prop_id = lookup_property_id(property_name);
         try
         {
             IdleCheck_UpdateTimestamp();
 
-            if ("log_level" == property_name)
+            if (PropertyID::LOG_LEVEL == prop_id)
             {
                 return g_variant_new_uint32(log_level);
             }
-            else if ("log_dbus_details" == property_name)
+            else if (PropertyID::LOG_DBUS_DETAILS == prop_id)
             {
                 return g_variant_new_boolean(logwr->LogMetaEnabled());
             }
 
-            else if ("timestamp" == property_name)
+            else if (PropertyID::TIMESTAMP == prop_id)
             {
                 return g_variant_new_boolean(logwr->TimestampEnabled());
             }
-            else if ("num_attached" == property_name)
+            else if (PropertyID::NUM_ATTACHED == prop_id)
             {
                 return g_variant_new_uint32(loggers.size());
             }
+            else if (PropertyID::EVENTS_DELIVERED == prop_id)
+            {
+                guint64 count = detached_delivered;
+                for (const auto& l : loggers)
+                {
+                    count += l.second->GetDeliveredCount();
+                }
+                return g_variant_new_uint64(count);
+            }
+            else if (PropertyID::EVENTS_DROPPED == prop_id)
+            {
+                guint64 count = detached_dropped;
+                for (const auto& l : loggers)
+                {
+                    count += l.second->GetDroppedCount();
+                }
+                return g_variant_new_uint64(count);
+            }
         }
         catch (...)
         {
@@ -472,11 +497,61 @@ private:
     GDBusConnection *dbuscon = nullptr;
     LogWriter *logwr = nullptr;
     std::map<size_t, Logger::Ptr> loggers = {};
+    uint64_t detached_delivered = 0;
+    uint64_t detached_dropped = 0;
     unsigned int log_level;
     std::string statedir;
     std::vector<std::string> allow_list;
 
 
+    /**
+     *  Identifiers of the D-Bus methods and properties handled by
+     *  callback_method_call() and callback_get_property()
+     */
+    enum class MethodID
+    {
+        UNKNOWN,
+        ATTACH,
+        DETACH
+    };
+
+
+    static MethodID lookup_method_id(const std::string& name)
+    {
+        static const DBusDispatchTable<MethodID> methods(
+            MethodID::UNKNOWN,
+            {{"Attach", MethodID::ATTACH},
+             {"Detach", MethodID::DETACH}});
+        return methods.Lookup(name);
+    }
+
+
+    enum class PropertyID
+    {
+        UNKNOWN,
+        LOG_LEVEL,
+        LOG_DBUS_DETAILS,
+        TIMESTAMP,
+        NUM_ATTACHED,
+        EVENTS_DELIVERED,
+        EVENTS_DROPPED
+    };
+
+
+    static PropertyID lookup_property_id(const std::string& name)
+    {
+        static const DBusDispatchTable<PropertyID> props(
+            PropertyID::UNKNOWN,
+            {{"log_level", PropertyID::LOG_LEVEL},
+             {"log_dbus_details", PropertyID::LOG_DBUS_DETAILS},
+             {"timestamp", PropertyID::TIMESTAMP},
+             {"num_attached", PropertyID::NUM_ATTACHED},
+             {"events_delivered", PropertyID::EVENTS_DELIVERED},
+             {"events_dropped", PropertyID::EVENTS_DROPPED}});
+        return props.Lookup(name);
+    }
+
+
     /**
      *  Validate that the sender is on a list of allowed senders.  If the
      *  sender is not allowed, a DBusCredentialsException is thrown.
@@ -112,6 +112,20 @@ static int cmd_log_listen(ParsedArgs args)
                                    "Configuration does not exist");
         }
 
+        if (args.Present("history"))
+        {
+            // Only dump the log events kept by the session manager
+            unsigned int max = std::atoi(args.GetValue("history", 0).c_str());
+            guint64 last_seq = 0;
+            for (const auto& rec : sesprx.FetchLogHistory(0, max, last_seq))
+            {
+                std::cout << std::put_time(std::localtime(&rec.timestamp),
+                                           "%Y-%m-%d %H:%M:%S ")
+                          << rec.event << std::endl;
+            }
+            return 0;
+        }
+
         if (!sesprx.GetReceiveLogEvents())
         {
             sesprx.SetReceiveLogEvents(true);
@@ -249,6 +263,10 @@ static int cmd_log_service(ParsedArgs args)
 
         std::cout << " Attached log subscriptions: "
                   << logsrvprx.GetNumAttached() << std::endl;
+        std::cout << "         Log events written: "
+                  << logsrvprx.GetEventsDelivered() << std::endl;
+        std::cout << "       Log events discarded: "
+                  << logsrvprx.GetEventsDropped() << std::endl;
         std::cout << "             Log timestamps: "
                   << (newtstamp ? "enabled" : "disabled")
                   << old_tstamp << std::endl;
@@ -298,6 +316,9 @@ void RegisterCommands_log(Commands& ovpn3)
                    arghelper_log_levels);
     cmd->AddOption("config-events",
                    "Receive log events issued by the configuration manager");
+    cmd->AddOption("history", "NUM", true,
+                   "(Only with --session-path) Show the last NUM log events "
+                   "kept by the session manager and exit.  0 shows all");
 
     auto service = ovpn3.AddCommand("log-service",
                                "Manage the OpenVPN 3 Log service",
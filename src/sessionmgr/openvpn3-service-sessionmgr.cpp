@@ -98,6 +98,12 @@ static int session_manager(ParsedArgs args)
     }
     sessmgr.SetManagerLogLevel(log_level);
 
+    if (args.Present("log-history"))
+    {
+        int history = std::atoi(args.GetValue("log-history", 0).c_str());
+        sessmgr.SetLogHistorySize(history < 0 ? 0 : history);
+    }
+
     IdleCheck::Ptr idle_exit;
     if (idle_wait_min > 0)
     {
@@ -141,6 +147,10 @@ int main(int argc, char **argv)
                         "Write log data to FILE.  Use 'stdout:' for console logging.");
     argparser.AddOption("colour", 0,
                         "Make the log lines colourful");
+    argparser.AddOption("log-history", "NUM", true,
+                        "Number of backend log events to keep per session "
+                        "(Default: " + std::to_string(LogHistory::DefaultSize)
+                        + ")");
     argparser.AddOption("signal-broadcast", 0,
                         "Broadcast all D-Bus signals instead of targeted multicast");
     argparser.AddOption("idle-exit", "MINUTES", true,
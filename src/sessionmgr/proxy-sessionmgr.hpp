@@ -36,6 +36,7 @@
 #include "client/statistics.hpp"
 #include "client/statusevent.hpp"
 #include "log/log-helpers.hpp"
+#include "log/log-history.hpp"
 #include "log/dbus-log.hpp"
 
 using namespace openvpn;
@@ -383,6 +384,56 @@ public:
         return ret;
     }
 
+    /**
+     *  Retrieve log events from the session log history kept by the
+     *  session manager.  Only log events newer than @since_seq are
+     *  returned.  If more than @max log events are available, only
+     *  the newest ones are returned.
+     *
+     * @param since_seq  Sequence number of the last log event already seen;
+     *                   0 retrieves the complete history.
+     * @param max        Maximum number of log events to return, 0 for all
+     * @param last_seq   Will be set to the last sequence number in the
+     *                   session log history
+     *
+     * @return Returns a std::vector<LogHistoryRecord> with the log events,
+     *         oldest first.
+     */
+    std::vector<LogHistoryRecord> FetchLogHistory(const guint64 since_seq,
+                                                  const guint32 max,
+                                                  guint64& last_seq)
+    {
+        GVariant *res = Call("FetchLogHistory",
+                             g_variant_new("(tu)", since_seq, max));
+        if (NULL == res)
+        {
+            THROW_DBUSEXCEPTION("OpenVPN3SessionProxy",
+                                "Failed to retrieve the session log history");
+        }
+
+        GVariantIter *events = nullptr;
+        g_variant_get(res, "(ta(ttuus))", &last_seq, &events);
+
+        std::vector<LogHistoryRecord> ret;
+        guint64 seq = 0;
+        guint64 tstamp = 0;
+        guint32 group = 0;
+        guint32 catg = 0;
+        gchar *msg = nullptr;
+        while (g_variant_iter_next(events, "(ttuus)",
+                                   &seq, &tstamp, &group, &catg, &msg))
+        {
+            ret.emplace_back(seq, (std::time_t) tstamp,
+                             LogEvent((LogGroup) group, (LogCategory) catg,
+                                      std::string(msg)));
+            g_free(msg);
+        }
+        g_variant_iter_free(events);
+        g_variant_unref(res);
+        return ret;
+    }
+
+
     /**
      * Retrieves statistics of a running VPN tunnel.  It is gathered by
      * retrieving the 'statistics' session object property.
@@ -410,6 +461,53 @@ public:
     }
 
 
+    /**
+     * Retrieves all the counters of a running VPN tunnel with their rates,
+     * from the 'statistics_details' session object property.
+     *
+     * @return Returns a ConnectionStatsSnapshot
+     */
+    ConnectionStatsSnapshot GetConnectionStatsDetails()
+    {
+        GVariant *res = GetProperty("statistics_details");
+        guint64 timestamp = 0;
+        GVariantIter *counters = nullptr;
+        GVariantIter *rates = nullptr;
+        g_variant_get(res, "(ta(usx)a(uad))", &timestamp, &counters, &rates);
+
+        ConnectionStatsSnapshot ret;
+        ret.timestamp_us = timestamp;
+
+        guint32 id = 0;
+        gchar *name = nullptr;
+        gint64 val = 0;
+        while (g_variant_iter_next(counters, "(usx)", &id, &name, &val))
+        {
+            ret.counters.emplace_back(id, std::string(name), val);
+            g_free(name);
+        }
+
+        guint32 window = 0;
+        GVariantIter *per_second = nullptr;
+        while (g_variant_iter_next(rates, "(uad)", &window, &per_second))
+        {
+            ConnectionStatRates r;
+            r.window_secs = window;
+            gdouble rate = 0;
+            while (g_variant_iter_next(per_second, "d", &rate))
+            {
+                r.per_second.push_back(rate);
+            }
+            g_variant_iter_free(per_second);
+            ret.rates.push_back(r);
+        }
+        g_variant_iter_free(counters);
+        g_variant_iter_free(rates);
+        g_variant_unref(res);
+        return ret;
+    }
+
+
     /**
      *  Manipulate the public-access flag.  When public-access is set to
      *  true, everyone have access to this session regardless of how the
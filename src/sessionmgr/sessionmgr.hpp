@@ -47,6 +47,7 @@
 #include "dbus/connection-creds.hpp"
 #include "dbus/path.hpp"
 #include "log/dbus-log.hpp"
+#include "log/log-history.hpp"
 #include "log/logwriter.hpp"
 #include "client/statusevent.hpp"
 #include "ovpn3cli/lookup.hpp"
@@ -436,7 +437,7 @@ public:
 
         // Register configuration the configuration object
         std::stringstream introspection_xml;
-        introspection_xml << "<node name='" << objpath << "'>"
+        introspection_xml << "<node>"
                           << "    <interface name='" << OpenVPN3DBus_interf_sessions << "'>"
                           << "        <method name='Connect'/>"
                           << "        <method name='Pause'>"
@@ -452,6 +453,12 @@ public:
                           << "        <method name='AccessRevoke'>"
                           << "            <arg direction='in' type='u' name='uid'/>"
                           << "        </method>"
+                          << "        <method name='FetchLogHistory'>"
+                          << "            <arg direction='in' type='t' name='since_seq'/>"
+                          << "            <arg direction='in' type='u' name='max'/>"
+                          << "            <arg direction='out' type='t' name='last_seq'/>"
+                          << "            <arg direction='out' type='a(ttuus)' name='events'/>"
+                          << "        </method>"
                           << dummyqueue.IntrospectionMethods("UserInputQueueGetTypeGroup",
                                                              "UserInputQueueFetch",
                                                              "UserInputQueueCheck",
@@ -470,15 +477,17 @@ public:
                           << "        <property type='(uus)' name='status' access='read'/>"
                           << "        <property type='a{sv}' name='last_log' access='read'/>"
                           << "        <property type='a{sx}' name='statistics' access='read'/>"
+                          << "        <property type='(ta(usx)a(uad))' name='statistics_details' access='read'/>"
                           << "        <property type='o' name='config_path' access='read'/>"
                           << "        <property type='s' name='config_name' access='read'/>"
                           << "        <property type='u' name='backend_pid' access='read'/>"
                           << "        <property type='b' name='restrict_log_access' access='readwrite'/>"
                           << "        <property type='b' name='receive_log_events' access='readwrite'/>"
                           << "        <property type='u' name='log_verbosity' access='readwrite'/>"
+                          << "        <property type='u' name='log_history_size' access='readwrite'/>"
                           << "    </interface>"
                           << "</node>";
-        ParseIntrospectionXML(introspection_xml);
+        ParseSharedIntrospectionXML(introspection_xml);
 
         try
         {
@@ -615,10 +624,12 @@ public:
             {
                 Subscribe(sender_name, be_path, "AttentionRequired");
                 Subscribe(sender_name, be_path, "StatusChange");
+                Subscribe(sender_name, be_path, "Log");
                 register_backend();
                 backend_pid = be_pid;
                 Unsubscribe("RegistrationRequest");
                 SetLogLevel(default_session_log_level);
+                update_backend_log_level();
                 LogVerb2("Backend VPN client process registered");
             }
             catch (DBusException& err)
@@ -654,6 +665,19 @@ public:
                 // listening
                 Send("AttentionRequired", params);
         }
+        else if ((signal_name == "Log")
+                 && (interface_name == OpenVPN3DBus_interf_backends))
+        {
+            // Keep a copy of the backend log events, available
+            // via the FetchLogHistory method
+            guint group = 0;
+            guint catg = 0;
+            gchar *msg = nullptr;
+            g_variant_get(params, "(uus)", &group, &catg, &msg);
+            log_history.Add(LogEvent((LogGroup) group, (LogCategory) catg,
+                                     std::string(msg)));
+            g_free(msg);
+        }
     }
 
     /**
@@ -684,10 +708,25 @@ public:
                               GVariant *params,
                               GDBusMethodInvocation *invoc)
     {
+        const MethodID method_id = lookup_method_id(method_name);
         bool ping = false;
 
         try
         {
+            if (MethodID::FETCH_LOG_HISTORY == method_id)
+            {
+                // The log history is kept in the session manager, so this
+                // is available even if the backend process has died
+                check_log_access(sender);
+
+                guint64 since_seq = 0;
+                guint32 max = 0;
+                g_variant_get(params, "(tu)", &since_seq, &max);
+                g_dbus_method_invocation_return_value(invoc,
+                                   log_history.FetchGVariant(since_seq, max));
+                return;
+            }
+
             if (!be_proxy)
             {
                 THROW_DBUSEXCEPTION("SessionObject", "No backend proxy connection available. Backend died?");
@@ -719,38 +758,38 @@ public:
                 << ", requester:  " << lookup_username(GetUID(sender));
             Debug(msg.str());
 
-            if ("Connect" == method_name)
+            if (MethodID::CONNECT == method_id)
             {
                 CheckACL(sender);
                 be_proxy->Call("Connect");
                 LogVerb2("Starting connection");
             }
-            else if ("Restart" == method_name)
+            else if (MethodID::RESTART == method_id)
             {
                 CheckACL(sender, true);
                 be_proxy->Call("Restart");
                 LogVerb2("Restarting connection");
             }
-            else if ("Pause" == method_name)
+            else if (MethodID::PAUSE == method_id)
             {
                 CheckACL(sender, true);
                 // FIXME: Should check that params contains only the expected formatting
                 be_proxy->Call("Pause", params);
                 LogVerb2("Pausing connection");
             }
-            else if ("Resume"  == method_name)
+            else if (MethodID::RESUME == method_id)
             {
                 CheckACL(sender, true);
                 be_proxy->Call("Resume");
                 LogVerb2("Resuming connection");
             }
-            else if ("Disconnect" == method_name)
+            else if (MethodID::DISCONNECT == method_id)
             {
                 CheckACL(sender, true);
                 LogVerb2("Disconnecting connection");
                 shutdown(false, true);
             }
-            else if ("Ready" == method_name)
+            else if (MethodID::READY == method_id)
             {
                 try
                 {
@@ -766,7 +805,7 @@ public:
                     return;
                 }
             }
-            else if ("UserInputQueueGetTypeGroup" == method_name)
+            else if (MethodID::USER_INPUT_QUEUE_GET_TYPE_GROUP == method_id)
             {
                 CheckACL(sender);
                 try
@@ -781,7 +820,7 @@ public:
                 }
                 return;
             }
-            else if ("UserInputQueueFetch" == method_name)
+            else if (MethodID::USER_INPUT_QUEUE_FETCH == method_id)
             {
                 CheckACL(sender);
                 try
@@ -796,7 +835,7 @@ public:
                 }
                 return;
             }
-            else if ("UserInputQueueCheck" == method_name)
+            else if (MethodID::USER_INPUT_QUEUE_CHECK == method_id)
             {
                 CheckACL(sender);
                 GVariant *res = be_proxy->Call("UserInputQueueCheck", params);
@@ -804,7 +843,7 @@ public:
                 g_variant_unref(res);
                 return;
             }
-            else if ("UserInputProvide" == method_name)
+            else if (MethodID::USER_INPUT_PROVIDE == method_id)
             {
                 CheckACL(sender);
                 try
@@ -821,7 +860,7 @@ public:
                 }
                 return;
             }
-            else if ("AccessGrant" == method_name)
+            else if (MethodID::ACCESS_GRANT == method_id)
             {
                 CheckOwnerAccess(sender);
 
@@ -833,7 +872,7 @@ public:
                 LogInfo("Access granted to UID " + std::to_string(uid));
                 return;
             }
-            else if ("AccessRevoke" == method_name)
+            else if (MethodID::ACCESS_REVOKE == method_id)
             {
                 CheckOwnerAccess(sender);
 
@@ -865,7 +904,7 @@ public:
             Debug("Exception [callback_method_call("+ method_name + ")]: "
                   + dberr.getRawError());
 
-            if (!registered && "Disconnect" == method_name)
+            if (!registered && MethodID::DISCONNECT == method_id)
             {
                 //
                 // This is a special case handling.  If a backend VPN client
@@ -975,6 +1014,7 @@ public:
                                      const std::string property_name,
                                      GError **error)
     {
+        const PropertyID prop_id = lookup_property_id(property_name);
         if (!registered)
         {
             g_set_error(error,
@@ -983,7 +1023,7 @@ public:
                         "Session not active");
             return NULL;
         }
-        if ("owner" == property_name)
+        if (PropertyID::OWNER == prop_id)
         {
             return GetOwner();
         }
@@ -1009,15 +1049,15 @@ public:
                   << std::endl;
         */
         GVariant *ret = NULL;
-        if ("restrict_log_access" == property_name)
+        if (PropertyID::RESTRICT_LOG_ACCESS == prop_id)
         {
             ret = g_variant_new_boolean (restrict_log_access);
         }
-        else if ("receive_log_events" == property_name)
+        else if (PropertyID::RECEIVE_LOG_EVENTS == prop_id)
         {
             ret = g_variant_new_boolean (recv_log_events);
         }
-        else if ("last_log" == property_name)
+        else if (PropertyID::LAST_LOG == prop_id)
         {
             if (nullptr != sig_logevent) {
                 ret = sig_logevent->GetLastLogEntry();
@@ -1031,11 +1071,11 @@ public:
                             "Logging not enabled");
             }
         }
-        else if ("session_created" == property_name)
+        else if (PropertyID::SESSION_CREATED == prop_id)
         {
             ret = g_variant_new_uint64(session_created);
         }
-        else if ("status" == property_name)
+        else if (PropertyID::STATUS == prop_id)
         {
             try
             {
@@ -1065,7 +1105,8 @@ public:
                 ret = NULL;
             }
         }
-        else if ("statistics" == property_name)
+        else if (PropertyID::STATISTICS == prop_id
+                 || PropertyID::STATISTICS_DETAILS == prop_id)
         {
             try
             {
@@ -1075,7 +1116,7 @@ public:
                                 "Backend object not available");
                     return NULL;
                 }
-                ret = be_proxy->GetProperty("statistics");
+                ret = be_proxy->GetProperty(property_name);
             }
             catch (DBusException& exp)
             {
@@ -1084,27 +1125,31 @@ public:
                 ret = NULL;
             }
         }
-        else if ("config_path" == property_name)
+        else if (PropertyID::CONFIG_PATH == prop_id)
         {
             ret = g_variant_new_string (config_path.c_str());
         }
-        else if ("config_name" == property_name)
+        else if (PropertyID::CONFIG_NAME == prop_id)
         {
             ret = g_variant_new_string (config_name.c_str());
         }
-        else if ("backend_pid" == property_name)
+        else if (PropertyID::BACKEND_PID == prop_id)
         {
             ret = g_variant_new_uint32 (backend_pid);
         }
-        else if ("log_verbosity" == property_name)
+        else if (PropertyID::LOG_VERBOSITY == prop_id)
         {
             ret = g_variant_new_uint32 (GetLogLevel());
         }
-        else if ("public_access" == property_name)
+        else if (PropertyID::LOG_HISTORY_SIZE == prop_id)
+        {
+            ret = g_variant_new_uint32 (log_history.GetMaxSize());
+        }
+        else if (PropertyID::PUBLIC_ACCESS == prop_id)
         {
             ret = GetPublicAccess();
         }
-        else if ("acl" == property_name)
+        else if (PropertyID::ACL == prop_id)
         {
             ret = GetAccessList();
         }
@@ -1165,7 +1210,8 @@ public:
         {
             if (!restrict_log_access
                 && ("receive_log_events" == property_name
-                    || "log_verbosity" == property_name))
+                    || "log_verbosity" == property_name
+                    || "log_history_size" == property_name))
             {
                 CheckACL(sender);
             }
@@ -1209,6 +1255,7 @@ public:
                     delete sig_logevent;
                     sig_logevent = nullptr;
                 }
+                update_backend_log_level();
                 return build_set_property_response(property_name, recv_log_events);
             }
             else if (("log_verbosity" == property_name) && be_conn && sig_logevent)
@@ -1216,11 +1263,24 @@ public:
                 unsigned int log_verb = g_variant_get_uint32(value);
                 sig_logevent->SetLogLevel(log_verb);
                 SetLogLevel(log_verb);
-
-                // FIXME: Proxy log level to the OpenVPN3 Core client
+                update_backend_log_level();
                 return build_set_property_response(property_name,
                                                    (guint32) log_verb);
             }
+            else if ("log_history_size" == property_name)
+            {
+                guint32 size = g_variant_get_uint32(value);
+                if (size > max_log_history_size)
+                {
+                    throw DBusPropertyException(G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                                obj_path, intf_name, property_name,
+                                                "Log history size cannot exceed "
+                                                + std::to_string(max_log_history_size));
+                }
+                log_history.SetMaxSize(size);
+                update_backend_log_level();
+                return build_set_property_response(property_name, size);
+            }
             else if (("public_access" == property_name) && conn)
             {
                 bool acl_public = g_variant_get_boolean(value);
@@ -1244,6 +1304,19 @@ public:
     }
 
 
+    /**
+     *  Sets the number of backend log events to keep in the session
+     *  log history.  This can be changed later on by the session owner
+     *  via the log_history_size property.
+     *
+     * @param size  Number of log events to keep
+     */
+    void SetLogHistorySize(const size_t size)
+    {
+        log_history.SetMaxSize(std::min(size, max_log_history_size));
+    }
+
+
     /**
      *  Clean-up function triggered by the D-Bus library when an object
      *  is removed from the D-Bus
@@ -1266,6 +1339,7 @@ public:
 
 private:
     unsigned int default_session_log_level = 4; // LogCategory::INFO messages
+    const size_t max_log_history_size = 100000;
     std::function<void()> remove_callback;
     DBusProxy *be_proxy;
     bool restrict_log_access;
@@ -1275,6 +1349,7 @@ private:
     std::string config_name;
     SessionStatusChange *sig_statuschg;
     SessionLogEvent *sig_logevent;
+    LogHistory log_history;
     std::string backend_token;
     pid_t backend_pid;
     GDBusConnection *be_conn;
@@ -1283,6 +1358,151 @@ private:
     bool registered;
     bool selfdestruct_complete;
     std::mutex selfdestruct_guard;
+    int be_log_level = -1;
+
+
+    /**
+     *  Identifiers of the D-Bus methods and properties handled by
+     *  callback_method_call() and callback_get_property()
+     */
+    enum class MethodID
+    {
+        UNKNOWN,
+        FETCH_LOG_HISTORY,
+        CONNECT,
+        RESTART,
+        PAUSE,
+        RESUME,
+        DISCONNECT,
+        READY,
+        USER_INPUT_QUEUE_GET_TYPE_GROUP,
+        USER_INPUT_QUEUE_FETCH,
+        USER_INPUT_QUEUE_CHECK,
+        USER_INPUT_PROVIDE,
+        ACCESS_GRANT,
+        ACCESS_REVOKE
+    };
+
+
+    static MethodID lookup_method_id(const std::string& name)
+    {
+        static const DBusDispatchTable<MethodID> methods(
+            MethodID::UNKNOWN,
+            {{"FetchLogHistory", MethodID::FETCH_LOG_HISTORY},
+             {"Connect", MethodID::CONNECT},
+             {"Restart", MethodID::RESTART},
+             {"Pause", MethodID::PAUSE},
+             {"Resume", MethodID::RESUME},
+             {"Disconnect", MethodID::DISCONNECT},
+             {"Ready", MethodID::READY},
+             {"UserInputQueueGetTypeGroup", MethodID::USER_INPUT_QUEUE_GET_TYPE_GROUP},
+             {"UserInputQueueFetch", MethodID::USER_INPUT_QUEUE_FETCH},
+             {"UserInputQueueCheck", MethodID::USER_INPUT_QUEUE_CHECK},
+             {"UserInputProvide", MethodID::USER_INPUT_PROVIDE},
+             {"AccessGrant", MethodID::ACCESS_GRANT},
+             {"AccessRevoke", MethodID::ACCESS_REVOKE}});
+        return methods.Lookup(name);
+    }
+
+
+    enum class PropertyID
+    {
+        UNKNOWN,
+        OWNER,
+        RESTRICT_LOG_ACCESS,
+        RECEIVE_LOG_EVENTS,
+        LAST_LOG,
+        SESSION_CREATED,
+        STATUS,
+        STATISTICS,
+        STATISTICS_DETAILS,
+        CONFIG_PATH,
+        CONFIG_NAME,
+        BACKEND_PID,
+        LOG_VERBOSITY,
+        LOG_HISTORY_SIZE,
+        PUBLIC_ACCESS,
+        ACL
+    };
+
+
+    static PropertyID lookup_property_id(const std::string& name)
+    {
+        static const DBusDispatchTable<PropertyID> props(
+            PropertyID::UNKNOWN,
+            {{"owner", PropertyID::OWNER},
+             {"restrict_log_access", PropertyID::RESTRICT_LOG_ACCESS},
+             {"receive_log_events", PropertyID::RECEIVE_LOG_EVENTS},
+             {"last_log", PropertyID::LAST_LOG},
+             {"session_created", PropertyID::SESSION_CREATED},
+             {"status", PropertyID::STATUS},
+             {"statistics", PropertyID::STATISTICS},
+             {"statistics_details", PropertyID::STATISTICS_DETAILS},
+             {"config_path", PropertyID::CONFIG_PATH},
+             {"config_name", PropertyID::CONFIG_NAME},
+             {"backend_pid", PropertyID::BACKEND_PID},
+             {"log_verbosity", PropertyID::LOG_VERBOSITY},
+             {"log_history_size", PropertyID::LOG_HISTORY_SIZE},
+             {"public_access", PropertyID::PUBLIC_ACCESS},
+             {"acl", PropertyID::ACL}});
+        return props.Lookup(name);
+    }
+
+
+    /**
+     *  Checks if the caller has access to the session log.  If
+     *  restrict_log_access is set, only the session owner has access,
+     *  otherwise all users granted access to the session.
+     *
+     *  If access is not granted, a DBusCredentialsException is thrown.
+     *
+     * @param sender  D-Bus bus name of the caller
+     */
+    void check_log_access(const std::string& sender)
+    {
+        if (restrict_log_access)
+        {
+            CheckOwnerAccess(sender);
+        }
+        else
+        {
+            CheckACL(sender);
+        }
+    }
+
+
+    /**
+     *  Tells the backend process which log level this session needs.  The
+     *  backend discards log events not needed by any of its log consumers
+     *  before sending them.  Log events are used by the log history and
+     *  the front-ends receiving log events; if neither is enabled only
+     *  the most critical log events are needed.
+     */
+    void update_backend_log_level()
+    {
+        if (nullptr == be_proxy)
+        {
+            return;
+        }
+
+        int lvl = ((recv_log_events || log_history.GetMaxSize() > 0)
+                   ? GetLogLevel() : 0);
+        if (lvl == be_log_level)
+        {
+            return;
+        }
+
+        try
+        {
+            be_proxy->SetProperty("log_level", (guint32) lvl);
+            be_log_level = lvl;
+        }
+        catch (DBusException& excp)
+        {
+            LogWarn("Could not update the backend log level: "
+                    + std::string(excp.what()));
+        }
+    }
 
 
     /**
@@ -1583,8 +1803,9 @@ public:
                               GVariant *params,
                               GDBusMethodInvocation *invoc)
     {
+        const MethodID method_id = lookup_method_id(method_name);
         // std::cout << "SessionManagerObject::callback_method_call: " << method_name << std::endl;
-        if ("NewTunnel" == method_name)
+        if (MethodID::NEW_TUNNEL == method_id)
         {
             IdleCheck_UpdateTimestamp();
 
@@ -1612,6 +1833,7 @@ public:
                                                        GetLogLevel(),
                                                        logwr,
                                                        GetSignalBroadcast());
+            session->SetLogHistorySize(log_history_size);
             IdleCheck_RefInc();
             session->IdleCheck_Register(IdleCheck_Get());
             session->RegisterObject(conn);
@@ -1621,7 +1843,7 @@ public:
             // The backend object will remind "hidden" for the end-user
             g_dbus_method_invocation_return_value(invoc, g_variant_new("(o)", sesspath.c_str()));
         }
-        else if ("FetchAvailableSessions" == method_name)
+        else if (MethodID::FETCH_AVAILABLE_SESSIONS == method_id)
         {
             // Build up an array of object paths to available session objects
             GVariantBuilder *bld = g_variant_builder_new(G_VARIANT_TYPE("ao"));
@@ -1652,7 +1874,7 @@ public:
             g_variant_builder_unref(bld);
             g_variant_builder_unref(ret);
         }
-        else if ("TransferOwnership" == method_name)
+        else if (MethodID::TRANSFER_OWNERSHIP == method_id)
         {
             // This feature is quite powerful and is restricted to the
             // root account only.  This is typically used by openvpn3-autoload
@@ -1768,15 +1990,51 @@ public:
     }
 
 
+    /**
+     *  Sets the default number of log events each new session object
+     *  will keep in its log history.
+     *
+     * @param size  Number of log events to keep per session
+     */
+    void SetLogHistorySize(const size_t size)
+    {
+        log_history_size = size;
+    }
+
+
 private:
     GDBusConnection *dbuscon;
     DBusConnectionCreds creds;
+    size_t log_history_size = LogHistory::DefaultSize;
     std::map<std::string, SessionObject *> session_objects;
 
     void remove_session_object(const std::string sesspath)
     {
         session_objects.erase(sesspath);
     }
+
+
+    /**
+     *  Identifiers of the D-Bus methods handled by callback_method_call()
+     */
+    enum class MethodID
+    {
+        UNKNOWN,
+        NEW_TUNNEL,
+        FETCH_AVAILABLE_SESSIONS,
+        TRANSFER_OWNERSHIP
+    };
+
+
+    static MethodID lookup_method_id(const std::string& name)
+    {
+        static const DBusDispatchTable<MethodID> methods(
+            MethodID::UNKNOWN,
+            {{"NewTunnel", MethodID::NEW_TUNNEL},
+             {"FetchAvailableSessions", MethodID::FETCH_AVAILABLE_SESSIONS},
+             {"TransferOwnership", MethodID::TRANSFER_OWNERSHIP}});
+        return methods.Lookup(name);
+    }
 };
 
 
@@ -1835,17 +2093,36 @@ public:
     }
 
 
+    /**
+     *  Sets the default number of backend log events each session
+     *  object keeps in its log history, available via the
+     *  FetchLogHistory method.
+     *
+     * @param size  Number of log events to keep per session
+     */
+    void SetLogHistorySize(const size_t size)
+    {
+        log_history_size = size;
+    }
+
+
     /**
      *  This callback is called when the service was successfully registered
      *  on the D-Bus.
      */
     void callback_bus_acquired()
     {
+        // Session objects are dispatched via a D-Bus subtree instead
+        // of registering every single session object separately
+        session_subtree.reset(new DBusObjectSubtree(GetConnection(),
+                                                    GetRootPath()));
+
         // Create a SessionManagerObject which will be the main entrance
         // point to this service
         managobj.reset(new SessionManagerObject(GetConnection(), GetRootPath(),
                                                 manager_log_level, logwr,
                                                 signal_broadcast));
+        managobj->SetLogHistorySize(log_history_size);
 
         // Register this object to on the D-Bus
         managobj->RegisterObject(GetConnection());
@@ -1891,8 +2168,10 @@ public:
 
 private:
     unsigned int manager_log_level = 6; // LogCategory::DEBUG
+    size_t log_history_size = LogHistory::DefaultSize;
     LogWriter *logwr = nullptr;
     bool signal_broadcast = true;
+    DBusObjectSubtree::Ptr session_subtree;
     SessionManagerObject::Ptr managobj;
     ProcessSignalProducer::Ptr procsig;
 };
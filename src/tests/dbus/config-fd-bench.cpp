@@ -0,0 +1,136 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   config-fd-bench.cpp
+ *
+ * @brief  Compares the throughput of passing larger configuration
+ *         profiles as D-Bus strings (Import/Fetch) against passing them
+ *         as sealed memfd file descriptors (ImportFD/FetchFD).
+ *
+ *         Usage: config-fd-bench [SIZE_KB] [ROUNDS]  (default: 240 20)
+ *
+ *         The configuration manager refuses profiles larger than the
+ *         OpenVPN 3 Core profile size limit (256 KB).
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "dbus/core.hpp"
+#include "configmgr/proxy-configmgr.hpp"
+
+using namespace openvpn;
+
+
+static std::string generate_profile(size_t size)
+{
+    std::string ret = "client\n"
+                      "dev tun\n"
+                      "remote vpn.example.org 1194 udp\n"
+                      "cipher AES-256-GCM\n";
+    const std::string pad(200, 'x');
+    for (unsigned int i = 0; ret.size() < size; ++i)
+    {
+        ret += "setenv UV_PAD" + std::to_string(i) + " " + pad + "\n";
+    }
+    return ret;
+}
+
+
+static void report(const std::string& test, unsigned int rounds,
+                   size_t size,
+                   const std::chrono::steady_clock::time_point& start)
+{
+    auto usecs = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+    double mb = (double) size * rounds / (1024 * 1024);
+    std::cout << test << ": " << rounds << " rounds in "
+              << usecs / 1000 << " ms, "
+              << (usecs > 0 ? mb / ((double) usecs / 1000000) : 0)
+              << " MB/s" << std::endl;
+}
+
+
+int main(int argc, char **argv)
+{
+    size_t size = (argc > 1 ? std::atoi(argv[1]) : 240) * 1024;
+    unsigned int rounds = (argc > 2 ? std::atoi(argv[2]) : 20);
+    const std::string config = generate_profile(size);
+
+    try
+    {
+        DBus dbus(G_BUS_TYPE_SYSTEM);
+        dbus.Connect();
+        OpenVPN3ConfigurationProxy cfgmgr(dbus, OpenVPN3DBus_rootp_configuration);
+
+        std::cout << "Profile size: " << config.size() << " bytes"
+                  << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        std::string path;
+        for (unsigned int i = 0; i < rounds; ++i)
+        {
+            if (!path.empty())
+            {
+                OpenVPN3ConfigurationProxy(dbus, path).Remove();
+            }
+            path = cfgmgr.Import("fd-bench", config, false, false);
+        }
+        report("Import (string)", rounds, config.size(), start);
+
+        OpenVPN3ConfigurationProxy cfg(dbus, path);
+        size_t fetched = 0;
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < rounds; ++i)
+        {
+            fetched = cfg.GetConfig().size();
+        }
+        report("Fetch (string)", rounds, fetched, start);
+        cfg.Remove();
+
+        path.clear();
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < rounds; ++i)
+        {
+            if (!path.empty())
+            {
+                OpenVPN3ConfigurationProxy(dbus, path).Remove();
+            }
+            path = cfgmgr.ImportFD("fd-bench", config, false, false);
+        }
+        report("ImportFD (memfd)", rounds, config.size(), start);
+
+        OpenVPN3ConfigurationProxy cfgfd(dbus, path);
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < rounds; ++i)
+        {
+            fetched = cfgfd.GetConfigFD().size();
+        }
+        report("FetchFD (memfd)", rounds, fetched, start);
+        cfgfd.Remove();
+    }
+    catch (DBusException& excp)
+    {
+        std::cerr << "** ERROR ** " << excp.what() << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   config-import-bench.cpp
+ *
+ * @brief  Measures how long it takes to import and remove a large number
+ *         of configuration profiles in the configuration manager
+ *         (openvpn3-service-configmgr).
+ *
+ *         Usage: config-import-bench [COUNT] [BATCH_SIZE]
+ *
+ *         COUNT defaults to 10000.  If BATCH_SIZE is given, the profiles
+ *         are imported with ImportBatch, BATCH_SIZE profiles per call.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "dbus/core.hpp"
+#include "configmgr/proxy-configmgr.hpp"
+
+using namespace openvpn;
+
+
+static long long elapsed_ms(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int count = (argc > 1 ? std::atoi(argv[1]) : 10000);
+    unsigned int batch_size = (argc > 2 ? std::atoi(argv[2]) : 0);
+    const std::string config = "client\n"
+                               "dev tun\n"
+                               "remote vpn.example.org 1194 udp\n"
+                               "cipher AES-256-GCM\n";
+
+    try
+    {
+        DBus dbus(G_BUS_TYPE_SYSTEM);
+        dbus.Connect();
+        OpenVPN3ConfigurationProxy cfgmgr(dbus, OpenVPN3DBus_rootp_configuration);
+
+        std::vector<std::string> paths;
+        paths.reserve(count);
+
+        auto start = std::chrono::steady_clock::now();
+        if (batch_size > 0)
+        {
+            std::vector<ConfigImportRequest> batch;
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                ConfigImportRequest req;
+                req.name = "import-bench-" + std::to_string(i);
+                req.config = config;
+                batch.push_back(req);
+
+                if (batch.size() == batch_size || i + 1 == count)
+                {
+                    for (const auto& r : cfgmgr.ImportBatch(batch))
+                    {
+                        if (!r.error.empty())
+                        {
+                            std::cerr << "** ERROR ** " << r.error << std::endl;
+                            continue;
+                        }
+                        paths.push_back(r.path);
+                    }
+                    batch.clear();
+                }
+            }
+        }
+        else
+        {
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                paths.push_back(cfgmgr.Import("import-bench-" + std::to_string(i),
+                                              config, false, false));
+            }
+        }
+        long long import_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        size_t avail = cfgmgr.FetchAvailableConfigs().size();
+        long long list_ms = elapsed_ms(start);
+
+        start = std::chrono::steady_clock::now();
+        for (const auto& p : paths)
+        {
+            OpenVPN3ConfigurationProxy cfg(dbus, p);
+            cfg.Remove();
+        }
+        long long remove_ms = elapsed_ms(start);
+
+        std::cout << "Imported " << paths.size() << " configurations in "
+                  << import_ms << " ms" << std::endl
+                  << "Listed " << avail << " configurations in "
+                  << list_ms << " ms" << std::endl
+                  << "Removed " << paths.size() << " configurations in "
+                  << remove_ms << " ms" << std::endl;
+    }
+    catch (DBusException& excp)
+    {
+        std::cerr << "** ERROR ** " << excp.what() << std::endl;
+        return 2;
+    }
+    return 0;
+}
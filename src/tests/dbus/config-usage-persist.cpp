@@ -0,0 +1,111 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   config-usage-persist.cpp
+ *
+ * @brief  Test that the usage counters of a persistent configuration
+ *         profile survive a restart of the configuration manager.
+ *
+ *         The profile is fetched once, which counts as a use when run
+ *         as root, and the configuration manager is stopped with
+ *         SIGTERM.  When it has been started again via D-Bus activation,
+ *         used_count must include the fetch.
+ *
+ *         This must run as root, against a configuration manager
+ *         started with --state-dir and a profile imported with the
+ *         persistent flag.
+ *
+ *  Usage: config-usage-persist <configobject path>
+ */
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "dbus/core.hpp"
+#include "dbus/connection-creds.hpp"
+#include "configmgr/proxy-configmgr.hpp"
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <configobject path>" << std::endl;
+        return 1;
+    }
+    if (0 != getuid())
+    {
+        std::cout << "** ERROR ** This test must be run as root" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        std::string cfgpath(argv[1]);
+        DBus dbus(G_BUS_TYPE_SYSTEM);
+        dbus.Connect();
+
+        unsigned int before = 0;
+        {
+            OpenVPN3ConfigurationProxy cfgprx(dbus, cfgpath);
+            (void) cfgprx.GetConfig();
+            before = cfgprx.GetUIntProperty("used_count");
+        }
+        std::cout << "used_count after fetch: " << before << std::endl;
+
+        // Stop the configuration manager and wait for it to be gone
+        DBusConnectionCreds creds(dbus.GetConnection());
+        pid_t cfgmgr_pid = creds.GetPID(OpenVPN3DBus_name_configuration);
+        kill(cfgmgr_pid, SIGTERM);
+        for (unsigned int i = 0; i < 100; ++i)
+        {
+            try
+            {
+                (void) creds.GetUniqueBusID(OpenVPN3DBus_name_configuration);
+                usleep(100000);
+            }
+            catch (DBusException&)
+            {
+                break;
+            }
+        }
+
+        // Accessing the main object starts the configuration manager again
+        OpenVPN3ConfigurationProxy mgrprx(dbus, OpenVPN3DBus_rootp_configuration);
+        OpenVPN3ConfigurationProxy cfgprx(dbus, cfgpath);
+        unsigned int after = cfgprx.GetUIntProperty("used_count");
+        std::cout << "used_count after restart: " << after << std::endl;
+
+        if (after != before)
+        {
+            std::cout << "** FAIL ** Usage counter was not saved" << std::endl;
+            return 3;
+        }
+        std::cout << "PASS" << std::endl;
+        return 0;
+    }
+    catch (std::exception& err)
+    {
+        std::cout << "** ERROR ** " << err.what() << std::endl;
+        return 2;
+    }
+}
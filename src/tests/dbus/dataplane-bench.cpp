@@ -0,0 +1,512 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   dataplane-bench.cpp
+ *
+ * @brief  Measures the data channel performance of VPN sessions run by
+ *         openvpn3-service-client.  UDP packets are sent through the
+ *         tunnel to an echo service on the server side, and the
+ *         throughput, packet rate, round-trip latency and CPU time used
+ *         by the backend client process per Gbit/s are reported.
+ *
+ *         Usage: dataplane-bench [-s SIZES] [-c CIPHERS] [-d SECONDS]
+ *                                CONFIG-FILE ECHO-ADDRESS:PORT
+ *
+ *           -s SIZES    Comma separated UDP payload sizes (default: 64,512,1400)
+ *           -c CIPHERS  Comma separated data channel ciphers to test, each
+ *                       with its own session, by adding a cipher option to
+ *                       the profile.  The server must accept these ciphers
+ *                       without pushing another one.  By default the
+ *                       profile is used as-is.
+ *           -d SECONDS  Duration of each throughput run (default: 10)
+ *
+ *         The configuration profile must not require any user input.
+ *         The OpenVPN 3 Core library does not provide a server, so use an
+ *         OpenVPN 2.x server in a network namespace as the remote end,
+ *         which keeps the traffic local to this host:
+ *
+ *           ip netns add vpnbench
+ *           ip link add vb0 type veth peer name vb1 netns vpnbench
+ *           ip addr add 10.199.0.1/24 dev vb0 && ip link set vb0 up
+ *           ip -n vpnbench addr add 10.199.0.2/24 dev vb1
+ *           ip -n vpnbench link set vb1 up && ip -n vpnbench link set lo up
+ *           ip netns exec vpnbench openvpn --config server.conf --daemon
+ *           ip netns exec vpnbench socat UDP4-LISTEN:7,fork PIPE &
+ *
+ *         With "remote 10.199.0.2" in the client profile and 10.8.0.1 as
+ *         the server tunnel address, run:
+ *
+ *           dataplane-bench -c AES-256-GCM,CHACHA20-POLY1305 client.ovpn 10.8.0.1:7
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "dbus/core.hpp"
+#include "configmgr/proxy-configmgr.hpp"
+#include "sessionmgr/proxy-sessionmgr.hpp"
+
+using namespace openvpn;
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+class BenchException : public std::exception
+{
+public:
+    BenchException(const std::string& err)
+        : err(err)
+    {
+    }
+
+    virtual const char* what() const noexcept
+    {
+        return err.c_str();
+    }
+
+private:
+    std::string err;
+};
+
+
+struct BenchResult
+{
+    double mbit_per_sec = 0;
+    double packets_per_sec = 0;
+    double loss_percent = 0;
+    double rtt_p50_usec = 0;
+    double rtt_p99_usec = 0;
+    double cpu_sec_per_gbit = 0;
+};
+
+
+static std::vector<std::string> split(const std::string& str)
+{
+    std::vector<std::string> ret;
+    std::stringstream s(str);
+    std::string item;
+    while (std::getline(s, item, ','))
+    {
+        if (!item.empty())
+        {
+            ret.push_back(item);
+        }
+    }
+    return ret;
+}
+
+
+/**
+ *  Retrieves the CPU time used by a process so far
+ *
+ * @param pid  pid_t of the process
+ *
+ * @return Returns the user and system CPU time, in seconds
+ */
+static double process_cpu_time(pid_t pid)
+{
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line))
+    {
+        throw BenchException("Could not read the CPU time of pid "
+                             + std::to_string(pid));
+    }
+
+    // The process name may contain spaces, the fields
+    // of interest are counted from the end of it
+    std::stringstream fields(line.substr(line.rfind(')') + 2));
+    std::string f;
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    for (unsigned int i = 3; i <= 15 && (fields >> f); ++i)
+    {
+        if (14 == i)
+        {
+            utime = std::stoull(f);
+        }
+        else if (15 == i)
+        {
+            stime = std::stoull(f);
+        }
+    }
+    return (double) (utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+
+static int echo_socket(const std::string& echo_addr)
+{
+    size_t colon = echo_addr.rfind(':');
+    if (std::string::npos == colon)
+    {
+        throw BenchException("Invalid echo address '" + echo_addr + "'");
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(std::atoi(echo_addr.substr(colon + 1).c_str()));
+    if (1 != inet_pton(AF_INET, echo_addr.substr(0, colon).c_str(),
+                       &addr.sin_addr))
+    {
+        throw BenchException("Invalid echo address '" + echo_addr + "'");
+    }
+
+    int sd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sd < 0
+        || 0 != connect(sd, (struct sockaddr *) &addr, sizeof(addr)))
+    {
+        throw BenchException("Could not open a socket to " + echo_addr
+                             + ": " + std::string(strerror(errno)));
+    }
+
+    int bufsize = 4 * 1024 * 1024;
+    setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(sd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    struct timeval tv = {0, 200000};
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return sd;
+}
+
+
+/**
+ *  Reads and discards all the packets still arriving on the socket
+ */
+static void drain(int sd)
+{
+    char buf[65536];
+    while (recv(sd, buf, sizeof(buf), 0) > 0)
+    {
+    }
+}
+
+
+/**
+ *  Sends packets as fast as possible for the given duration, while
+ *  counting the echoed packets in another thread.
+ */
+static void run_throughput(int sd, size_t size, unsigned int duration,
+                           pid_t backend_pid, BenchResult& res)
+{
+    std::vector<char> pkt(size, 'x');
+    std::atomic<bool> sending{true};
+    unsigned long long sent = 0;
+    unsigned long long received = 0;
+    unsigned long long received_bytes = 0;
+
+    drain(sd);
+    double cpu_start = process_cpu_time(backend_pid);
+    bench_clock::time_point start = bench_clock::now();
+    bench_clock::time_point end = start + std::chrono::seconds(duration);
+
+    std::thread receiver([&]()
+                         {
+                             char buf[65536];
+                             while (true)
+                             {
+                                 ssize_t r = recv(sd, buf, sizeof(buf), 0);
+                                 if (r > 0)
+                                 {
+                                     ++received;
+                                     received_bytes += r;
+                                 }
+                                 else if (!sending.load())
+                                 {
+                                     break;
+                                 }
+                             }
+                         });
+
+    while (bench_clock::now() < end)
+    {
+        for (unsigned int i = 0; i < 64; ++i)
+        {
+            if (send(sd, pkt.data(), pkt.size(), 0) > 0)
+            {
+                ++sent;
+            }
+        }
+    }
+    sending.store(false);
+    receiver.join();
+
+    double secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+    double cpu = process_cpu_time(backend_pid) - cpu_start;
+
+    // Each echoed packet passed the tunnel in both directions
+    double gbit = (double) received_bytes * 8 * 2 / 1e9;
+    res.mbit_per_sec = received_bytes * 8 / secs / 1e6;
+    res.packets_per_sec = received / secs;
+    res.loss_percent = (sent > 0 ? 100.0 * (sent - received) / sent : 0);
+    res.cpu_sec_per_gbit = (gbit > 0 ? cpu / gbit : 0);
+}
+
+
+/**
+ *  Sends one packet at a time, waiting for the echo, and records the
+ *  round trip times.
+ */
+static void run_latency(int sd, size_t size, unsigned int count,
+                        BenchResult& res)
+{
+    std::vector<char> pkt(std::max(size, sizeof(uint64_t)), 'x');
+    std::vector<char> buf(65536);
+    std::vector<double> rtt;
+    rtt.reserve(count);
+
+    drain(sd);
+    for (uint64_t seq = 1; seq <= count; ++seq)
+    {
+        memcpy(pkt.data(), &seq, sizeof(seq));
+        bench_clock::time_point start = bench_clock::now();
+        if (send(sd, pkt.data(), pkt.size(), 0) < 0)
+        {
+            continue;
+        }
+
+        // Wait for this packet, skipping late echoes of earlier ones
+        while (true)
+        {
+            ssize_t r = recv(sd, buf.data(), buf.size(), 0);
+            if (r < 0)
+            {
+                break;  // Lost
+            }
+            uint64_t rseq = 0;
+            if ((size_t) r >= sizeof(rseq))
+            {
+                memcpy(&rseq, buf.data(), sizeof(rseq));
+            }
+            if (rseq == seq)
+            {
+                rtt.push_back(std::chrono::duration<double, std::micro>(
+                                  bench_clock::now() - start).count());
+                break;
+            }
+        }
+    }
+
+    if (rtt.empty())
+    {
+        throw BenchException("No echo replies received");
+    }
+    std::sort(rtt.begin(), rtt.end());
+    res.rtt_p50_usec = rtt[rtt.size() / 2];
+    res.rtt_p99_usec = rtt[std::min(rtt.size() - 1, rtt.size() * 99 / 100)];
+}
+
+
+/**
+ *  Starts a VPN session and waits for it to be connected
+ *
+ * @return Returns the D-Bus object path of the session
+ */
+static std::string start_session(DBus& dbus, const std::string& cfgpath)
+{
+    OpenVPN3SessionProxy sessmgr(dbus, OpenVPN3DBus_rootp_sessions);
+    std::string path = sessmgr.NewTunnel(cfgpath);
+    OpenVPN3SessionProxy session(dbus, path);
+
+    // Wait for the backend client process to be ready
+    for (unsigned int attempts = 50; ; --attempts)
+    {
+        try
+        {
+            session.Ready();
+            break;
+        }
+        catch (ReadyException& excp)
+        {
+            throw BenchException("The configuration profile requires "
+                                 "user input: " + std::string(excp.what()));
+        }
+        catch (DBusException& excp)
+        {
+            if (0 == attempts)
+            {
+                throw;
+            }
+            usleep(100000);
+        }
+    }
+
+    session.Connect();
+    for (unsigned int attempts = 300; attempts > 0; --attempts)
+    {
+        StatusEvent s = session.GetLastStatus();
+        if (StatusMinor::CONN_CONNECTED == s.minor)
+        {
+            return path;
+        }
+        if (StatusMinor::CONN_FAILED == s.minor
+            || StatusMinor::CONN_AUTH_FAILED == s.minor
+            || StatusMinor::CONN_DISCONNECTED == s.minor)
+        {
+            session.Disconnect();
+            throw BenchException("Connection failed: " + s.message);
+        }
+        usleep(100000);
+    }
+    session.Disconnect();
+    throw BenchException("Timed out waiting for the connection");
+}
+
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> sizes = {"64", "512", "1400"};
+    std::vector<std::string> ciphers = {""};
+    unsigned int duration = 10;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "s:c:d:")))
+    {
+        switch (opt)
+        {
+        case 's':
+            sizes = split(optarg);
+            break;
+        case 'c':
+            ciphers = split(optarg);
+            break;
+        case 'd':
+            duration = std::atoi(optarg);
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (argc - optind != 2 || sizes.empty() || ciphers.empty() || 0 == duration)
+    {
+        std::cout << "Usage: " << argv[0] << " [-s SIZES] [-c CIPHERS] "
+                  << "[-d SECONDS] CONFIG-FILE ECHO-ADDRESS:PORT"
+                  << std::endl;
+        return 1;
+    }
+
+    std::ifstream cfgfile(argv[optind]);
+    std::stringstream profile;
+    profile << cfgfile.rdbuf();
+    if (!cfgfile || profile.str().empty())
+    {
+        std::cerr << "** ERROR ** Could not read " << argv[optind] << std::endl;
+        return 1;
+    }
+    const std::string echo_addr(argv[optind + 1]);
+
+    std::cout << std::left
+              << std::setw(20) << "Cipher" << std::setw(8) << "Size"
+              << std::right
+              << std::setw(10) << "Mbit/s" << std::setw(11) << "Packets/s"
+              << std::setw(8) << "Loss%"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+              << std::setw(14) << "CPU s/Gbit" << std::endl;
+
+    int failed = 0;
+    try
+    {
+        DBus dbus(G_BUS_TYPE_SYSTEM);
+        dbus.Connect();
+        OpenVPN3ConfigurationProxy cfgmgr(dbus, OpenVPN3DBus_rootp_configuration);
+
+        for (const auto& cipher : ciphers)
+        {
+            std::string cfg = profile.str();
+            if (!cipher.empty())
+            {
+                cfg += "\ncipher " + cipher + "\n";
+            }
+            std::string cfgpath = cfgmgr.Import("dataplane-bench", cfg,
+                                                false, false);
+            OpenVPN3ConfigurationProxy cfgobj(dbus, cfgpath);
+
+            std::string sesspath;
+            try
+            {
+                sesspath = start_session(dbus, cfgpath);
+                OpenVPN3SessionProxy session(dbus, sesspath);
+                pid_t backend_pid = session.GetUIntProperty("backend_pid");
+
+                int sd = echo_socket(echo_addr);
+                for (const auto& size : sizes)
+                {
+                    BenchResult res;
+                    run_throughput(sd, std::atoi(size.c_str()), duration,
+                                   backend_pid, res);
+                    run_latency(sd, std::atoi(size.c_str()), 1000, res);
+
+                    std::cout << std::left << std::fixed << std::setprecision(1)
+                              << std::setw(20) << (cipher.empty() ? "(profile)" : cipher)
+                              << std::setw(8) << size
+                              << std::right
+                              << std::setw(10) << res.mbit_per_sec
+                              << std::setw(11) << std::setprecision(0) << res.packets_per_sec
+                              << std::setw(8) << std::setprecision(2) << res.loss_percent
+                              << std::setw(10) << std::setprecision(0) << res.rtt_p50_usec
+                              << std::setw(10) << res.rtt_p99_usec
+                              << std::setw(14) << std::setprecision(3) << res.cpu_sec_per_gbit
+                              << std::endl;
+                }
+                close(sd);
+                session.Disconnect();
+            }
+            catch (const std::exception& excp)
+            {
+                std::cerr << "** ERROR ** "
+                          << (cipher.empty() ? "" : cipher + ": ")
+                          << excp.what() << std::endl;
+                if (!sesspath.empty())
+                {
+                    try
+                    {
+                        OpenVPN3SessionProxy(dbus, sesspath).Disconnect();
+                    }
+                    catch (DBusException&)
+                    {
+                    }
+                }
+                ++failed;
+            }
+            cfgobj.Remove();
+        }
+    }
+    catch (DBusException& excp)
+    {
+        std::cerr << "** ERROR ** " << excp.what() << std::endl;
+        return 2;
+    }
+    return (failed > 0 ? 3 : 0);
+}
@@ -21,7 +21,8 @@
  * @file   getconnectionstats.cpp
  *
  * @brief  Simple client which queries an existing VPN session for its
- *         connection statistics and dumps that to stdout
+ *         connection statistics and dumps that to stdout.  With
+ *         --details, all counters are dumped with their IDs and rates.
  */
 
 #include <iostream>
@@ -33,13 +34,45 @@ using namespace openvpn;
 
 int main(int argc, char **argv)
 {
-    if (argc != 2)
+    bool details = (3 == argc && std::string("--details") == argv[1]);
+    if (argc != 2 && !details)
     {
-        std::cout << "Usage: " << argv[0] << " <session path>" << std::endl;
+        std::cout << "Usage: " << argv[0] << " [--details] <session path>"
+                  << std::endl;
         return 1;
     }
 
-    auto session = OpenVPN3SessionProxy(G_BUS_TYPE_SYSTEM, std::string(argv[1]));
+    auto session = OpenVPN3SessionProxy(G_BUS_TYPE_SYSTEM,
+                                        std::string(argv[argc - 1]));
+    if (details)
+    {
+        ConnectionStatsSnapshot snap = session.GetConnectionStatsDetails();
+        std::cout << "  Timestamp: " << snap.timestamp_us << " us" << std::endl;
+        std::cout << "  " << std::setw(5) << "ID" << "  "
+                  << std::left << std::setw(24) << "Counter" << std::right
+                  << std::setw(14) << "Value";
+        for (auto& r : snap.rates)
+        {
+            std::cout << std::setw(12) << (std::to_string(r.window_secs) + "s/s");
+        }
+        std::cout << std::endl;
+
+        for (size_t i = 0; i < snap.counters.size(); ++i)
+        {
+            const ConnectionStatCounter& c = snap.counters[i];
+            std::cout << "  " << std::setw(5) << c.id << "  "
+                      << std::left << std::setw(24) << c.name << std::right
+                      << std::setw(14) << c.value;
+            for (auto& r : snap.rates)
+            {
+                std::cout << std::setw(12) << std::fixed
+                          << std::setprecision(1) << r.per_second[i];
+            }
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+
     for (auto& sd : session.GetConnectionStats())
     {
         std::cout << "  "
@@ -0,0 +1,318 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   restart-bench.cpp
+ *
+ * @brief  Measures how long it takes until a VPN session is connected
+ *         again after a restart, compared to starting a new session.
+ *
+ *         Starting a new session is what a restart required before the
+ *         backend client could restart a connection by itself: a new
+ *         backend client process is started, the configuration profile
+ *         is fetched and evaluated and the connection is established.
+ *         A restart reuses the backend client process, the evaluated
+ *         configuration and the credentials.
+ *
+ *         For each round a new session is started and connected, and
+ *         then restarted with the Restart method.  The restart time is
+ *         measured from the Restart call until the EVENT_CONNECTED
+ *         counter of the session has increased.  The RESTART_TIME_MS
+ *         statistics entry reported by the backend client is shown too.
+ *
+ *         Usage: restart-bench [-n ROUNDS] CONFIG-FILE
+ *
+ *           -n ROUNDS   Number of rounds to run (default: 5)
+ *
+ *         The configuration profile must not require any user input.
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "dbus/core.hpp"
+#include "configmgr/proxy-configmgr.hpp"
+#include "sessionmgr/proxy-sessionmgr.hpp"
+
+using namespace openvpn;
+
+typedef std::chrono::steady_clock bench_clock;
+
+
+class BenchException : public std::exception
+{
+public:
+    BenchException(const std::string& err)
+        : err(err)
+    {
+    }
+
+    virtual const char* what() const noexcept
+    {
+        return err.c_str();
+    }
+
+private:
+    std::string err;
+};
+
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now()
+                                                     - start).count();
+}
+
+
+/**
+ *  Retrieves a counter from the statistics_details property of a session
+ *
+ * @return Returns the counter value, or -1 if the counter is not found
+ */
+static long long get_counter(OpenVPN3SessionProxy& session,
+                             const std::string& name)
+{
+    for (const auto& c : session.GetConnectionStatsDetails().counters)
+    {
+        if (name == c.name)
+        {
+            return c.value;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ *  Retrieves an entry from the statistics property of a session
+ *
+ * @return Returns the value, or -1 if the entry is not found
+ */
+static long long get_statistic(OpenVPN3SessionProxy& session,
+                               const std::string& name)
+{
+    for (const auto& s : session.GetConnectionStats())
+    {
+        if (name == s.key)
+        {
+            return s.value;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ *  Starts a VPN session and waits for it to be connected
+ *
+ * @return Returns the D-Bus object path of the session
+ */
+static std::string start_session(DBus& dbus, const std::string& cfgpath)
+{
+    OpenVPN3SessionProxy sessmgr(dbus, OpenVPN3DBus_rootp_sessions);
+    std::string path = sessmgr.NewTunnel(cfgpath);
+    OpenVPN3SessionProxy session(dbus, path);
+
+    // Wait for the backend client process to be ready
+    for (unsigned int attempts = 500; ; --attempts)
+    {
+        try
+        {
+            session.Ready();
+            break;
+        }
+        catch (ReadyException& excp)
+        {
+            throw BenchException("The configuration profile requires "
+                                 "user input: " + std::string(excp.what()));
+        }
+        catch (DBusException& excp)
+        {
+            if (0 == attempts)
+            {
+                throw;
+            }
+            usleep(10000);
+        }
+    }
+
+    session.Connect();
+    for (unsigned int attempts = 3000; attempts > 0; --attempts)
+    {
+        StatusEvent s = session.GetLastStatus();
+        if (StatusMinor::CONN_CONNECTED == s.minor)
+        {
+            return path;
+        }
+        if (StatusMinor::CONN_FAILED == s.minor
+            || StatusMinor::CONN_AUTH_FAILED == s.minor
+            || StatusMinor::CONN_DISCONNECTED == s.minor)
+        {
+            session.Disconnect();
+            throw BenchException("Connection failed: " + s.message);
+        }
+        usleep(10000);
+    }
+    session.Disconnect();
+    throw BenchException("Timed out waiting for the connection");
+}
+
+
+/**
+ *  Restarts a connected VPN session and waits for it to be connected again
+ *
+ * @return Returns the time until the session was connected, in milliseconds
+ */
+static double restart_session(OpenVPN3SessionProxy& session)
+{
+    const long long connected = get_counter(session, "EVENT_CONNECTED");
+    bench_clock::time_point start = bench_clock::now();
+    session.Restart();
+    for (unsigned int attempts = 3000; attempts > 0; --attempts)
+    {
+        if (get_counter(session, "EVENT_CONNECTED") > connected)
+        {
+            return elapsed_ms(start);
+        }
+        usleep(10000);
+    }
+    throw BenchException("Timed out waiting for the restarted connection");
+}
+
+
+static void print_summary(const std::string& label, std::vector<double> ms)
+{
+    std::sort(ms.begin(), ms.end());
+    std::cout << std::left << std::setw(24) << label
+              << std::right << std::fixed << std::setprecision(0)
+              << std::setw(10) << ms.front()
+              << std::setw(10) << ms[ms.size() / 2]
+              << std::setw(10) << ms.back() << std::endl;
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int rounds = 5;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "n:")))
+    {
+        switch (opt)
+        {
+        case 'n':
+            rounds = std::atoi(optarg);
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (argc - optind != 1 || 0 == rounds)
+    {
+        std::cout << "Usage: " << argv[0] << " [-n ROUNDS] CONFIG-FILE"
+                  << std::endl;
+        return 1;
+    }
+
+    std::ifstream cfgfile(argv[optind]);
+    std::stringstream profile;
+    profile << cfgfile.rdbuf();
+    if (!cfgfile || profile.str().empty())
+    {
+        std::cerr << "** ERROR ** Could not read " << argv[optind] << std::endl;
+        return 1;
+    }
+
+    std::vector<double> new_session;
+    std::vector<double> restart;
+    std::vector<double> restart_reported;
+    try
+    {
+        DBus dbus(G_BUS_TYPE_SYSTEM);
+        dbus.Connect();
+        OpenVPN3ConfigurationProxy cfgmgr(dbus, OpenVPN3DBus_rootp_configuration);
+        std::string cfgpath = cfgmgr.Import("restart-bench", profile.str(),
+                                            false, false);
+        OpenVPN3ConfigurationProxy cfgobj(dbus, cfgpath);
+
+        for (unsigned int r = 0; r < rounds; ++r)
+        {
+            std::string sesspath;
+            try
+            {
+                bench_clock::time_point start = bench_clock::now();
+                sesspath = start_session(dbus, cfgpath);
+                new_session.push_back(elapsed_ms(start));
+
+                OpenVPN3SessionProxy session(dbus, sesspath);
+                restart.push_back(restart_session(session));
+                long long reported = get_statistic(session, "RESTART_TIME_MS");
+                if (reported >= 0)
+                {
+                    restart_reported.push_back(reported);
+                }
+                session.Disconnect();
+            }
+            catch (const std::exception& excp)
+            {
+                std::cerr << "** ERROR ** " << excp.what() << std::endl;
+                if (!sesspath.empty())
+                {
+                    try
+                    {
+                        OpenVPN3SessionProxy(dbus, sesspath).Disconnect();
+                    }
+                    catch (DBusException&)
+                    {
+                    }
+                }
+                cfgobj.Remove();
+                return 3;
+            }
+        }
+        cfgobj.Remove();
+    }
+    catch (DBusException& excp)
+    {
+        std::cerr << "** ERROR ** " << excp.what() << std::endl;
+        return 2;
+    }
+
+    std::cout << std::left << std::setw(24) << "Connected after (ms)"
+              << std::right
+              << std::setw(10) << "min" << std::setw(10) << "median"
+              << std::setw(10) << "max" << std::endl;
+    print_summary("New session", new_session);
+    print_summary("Restart", restart);
+    if (!restart_reported.empty())
+    {
+        print_summary("Restart (backend)", restart_reported);
+    }
+    return 0;
+}
@@ -0,0 +1,372 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2017      OpenVPN Inc. <sales@openvpn.net>
+//  Copyright (C) 2017      David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   sleep-standin.cpp
+ *
+ * @brief  Stand-in for systemd-logind, used to test the --pause-on-sleep
+ *         mode of openvpn3-service-client.  It implements the Inhibit
+ *         method and sends PrepareForSleep signals simulating a suspend
+ *         and wake-up cycle.
+ *
+ *         The stand-in must be allowed to own its bus name on the system
+ *         bus, such as with this D-Bus policy:
+ *
+ *             <policy user="root">
+ *                 <allow own="net.openvpn.v3.tests.login1"/>
+ *             </policy>
+ *
+ *         The backend client is pointed at the stand-in by adding
+ *         --client-sleep-monitor-service net.openvpn.v3.tests.login1
+ *         to the openvpn3-service-backendstart arguments.
+ *
+ *         Run the stand-in while a VPN session is connected.  It reports
+ *         how long the backend held its sleep delay lock, which is the
+ *         time it needed to pause its sessions.  The time from wake-up
+ *         until the VPN session was connected again is reported by the
+ *         backend in the log and as WAKE_TIME_MS in the session
+ *         statistics; see getconnectionstats.
+ *
+ *  Usage: sleep-standin [-n BUS-NAME] [-s SUSPEND-SECONDS]
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include "dbus/core.hpp"
+#include "common/utils.hpp"
+
+using namespace openvpn;
+
+typedef std::chrono::steady_clock Clock;
+
+
+class Login1Standin : public DBusObject
+{
+public:
+    Login1Standin(GDBusConnection *dbuscon, GMainLoop *mainloop,
+                  unsigned int suspend_secs)
+        : DBusObject("/org/freedesktop/login1"),
+          dbuscon(dbuscon),
+          mainloop(mainloop),
+          suspend_secs(suspend_secs)
+    {
+        std::stringstream introspection_xml;
+        introspection_xml << "<node name='/org/freedesktop/login1'>"
+                          << "  <interface name='org.freedesktop.login1.Manager'>"
+                          << "    <method name='Inhibit'>"
+                          << "      <arg type='s' name='what' direction='in'/>"
+                          << "      <arg type='s' name='who' direction='in'/>"
+                          << "      <arg type='s' name='why' direction='in'/>"
+                          << "      <arg type='s' name='mode' direction='in'/>"
+                          << "      <arg type='h' name='fd' direction='out'/>"
+                          << "    </method>"
+                          << "    <signal name='PrepareForSleep'>"
+                          << "      <arg type='b' name='start'/>"
+                          << "    </signal>"
+                          << "  </interface>"
+                          << "</node>";
+        ParseIntrospectionXML(introspection_xml);
+    }
+
+    ~Login1Standin()
+    {
+        for (int fd : locks)
+        {
+            ::close(fd);
+        }
+        RemoveObject(dbuscon);
+    }
+
+
+    /**
+     *  Starts the suspend and wake-up cycle
+     */
+    void Suspend()
+    {
+        std::cout << "Sending PrepareForSleep(true), " << locks.size()
+                  << " delay lock(s) held" << std::endl;
+        sleep_start = Clock::now();
+        send_prepare_for_sleep(true);
+        g_timeout_add(50, wait_locks_callback, this);
+    }
+
+
+    void callback_method_call(GDBusConnection *conn,
+                              const std::string sender,
+                              const std::string object_path,
+                              const std::string interface,
+                              const std::string method_name,
+                              GVariant *params,
+                              GDBusMethodInvocation *invocation)
+    {
+        if ("Inhibit" != method_name)
+        {
+            GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.tests.login1",
+                                                          "Invalid method call");
+            g_dbus_method_invocation_return_gerror(invocation, err);
+            g_error_free(err);
+            return;
+        }
+
+        gchar *what = nullptr;
+        gchar *who = nullptr;
+        gchar *why = nullptr;
+        gchar *mode = nullptr;
+        g_variant_get(params, "(ssss)", &what, &who, &why, &mode);
+        std::cout << "Inhibit(what=" << what << ", who=" << who
+                  << ", why=" << why << ", mode=" << mode << ") from "
+                  << sender << std::endl;
+        g_free(what);
+        g_free(who);
+        g_free(why);
+        g_free(mode);
+
+        // The caller holds the lock as long as it keeps its end of
+        // the pipe open
+        int pipefd[2];
+        if (0 != pipe2(pipefd, O_CLOEXEC))
+        {
+            GError *err = g_dbus_error_new_for_dbus_error("net.openvpn.v3.error.tests.login1",
+                                                          "Could not create pipe");
+            g_dbus_method_invocation_return_gerror(invocation, err);
+            g_error_free(err);
+            return;
+        }
+        fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+        locks.push_back(pipefd[0]);
+
+        GUnixFDList *fdlist = g_unix_fd_list_new_from_array(&pipefd[1], 1);
+        g_dbus_method_invocation_return_value_with_unix_fd_list(invocation,
+                                                                g_variant_new("(h)", 0),
+                                                                fdlist);
+        g_object_unref(fdlist);
+    }
+
+
+    GVariant * callback_get_property(GDBusConnection *conn,
+                                     const std::string sender,
+                                     const std::string obj_path,
+                                     const std::string intf_name,
+                                     const std::string property_name,
+                                     GError **error)
+    {
+        THROW_DBUSEXCEPTION("Login1Standin", "get property not implemented");
+    }
+
+
+    GVariantBuilder * callback_set_property(GDBusConnection *conn,
+                                            const std::string sender,
+                                            const std::string obj_path,
+                                            const std::string intf_name,
+                                            const std::string property_name,
+                                            GVariant *value,
+                                            GError **error)
+    {
+        THROW_DBUSEXCEPTION("Login1Standin", "set property not implemented");
+    }
+
+
+private:
+    GDBusConnection *dbuscon;
+    GMainLoop *mainloop;
+    unsigned int suspend_secs;
+    std::vector<int> locks;
+    Clock::time_point sleep_start;
+
+
+    void send_prepare_for_sleep(bool start)
+    {
+        GError *err = nullptr;
+        g_dbus_connection_emit_signal(dbuscon, NULL, "/org/freedesktop/login1",
+                                      "org.freedesktop.login1.Manager",
+                                      "PrepareForSleep",
+                                      g_variant_new("(b)", start),
+                                      &err);
+        if (err)
+        {
+            std::cerr << "Failed sending PrepareForSleep: " << err->message
+                      << std::endl;
+            g_error_free(err);
+        }
+    }
+
+
+    /**
+     *  Removes the delay locks which have been released, by checking
+     *  if the other end of the pipe has been closed
+     *
+     * @return Returns true when all delay locks are released
+     */
+    bool locks_released()
+    {
+        std::vector<int> held;
+        for (int fd : locks)
+        {
+            char c;
+            if (0 == ::read(fd, &c, 1))
+            {
+                ::close(fd);
+            }
+            else
+            {
+                held.push_back(fd);
+            }
+        }
+        locks = held;
+        return locks.empty();
+    }
+
+
+    static gboolean wait_locks_callback(gpointer this_ptr)
+    {
+        Login1Standin *self = static_cast<Login1Standin *>(this_ptr);
+        auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now()
+                                                                            - self->sleep_start);
+        // logind waits at most 5 seconds by default (InhibitDelayMaxSec)
+        if (!self->locks_released() && waited.count() < 5000)
+        {
+            return G_SOURCE_CONTINUE;
+        }
+
+        std::cout << "Delay locks released after " << waited.count()
+                  << " ms" << (self->locks.empty() ? "" : " (timed out)")
+                  << std::endl
+                  << "Simulating suspend for " << self->suspend_secs
+                  << " seconds" << std::endl;
+        g_timeout_add_seconds(self->suspend_secs, wake_callback, self);
+        return G_SOURCE_REMOVE;
+    }
+
+
+    static gboolean wake_callback(gpointer this_ptr)
+    {
+        Login1Standin *self = static_cast<Login1Standin *>(this_ptr);
+        std::cout << "Sending PrepareForSleep(false)" << std::endl;
+        self->send_prepare_for_sleep(false);
+
+        // Give the backend time to take a new delay lock before exiting
+        g_timeout_add_seconds(2, quit_callback, self);
+        return G_SOURCE_REMOVE;
+    }
+
+
+    static gboolean quit_callback(gpointer this_ptr)
+    {
+        Login1Standin *self = static_cast<Login1Standin *>(this_ptr);
+        std::cout << self->locks.size() << " delay lock(s) held after wake-up"
+                  << std::endl;
+        g_main_loop_quit(self->mainloop);
+        return G_SOURCE_REMOVE;
+    }
+
+};
+
+
+class Login1StandinDBus : public DBus
+{
+public:
+    Login1StandinDBus(const std::string& busname, GMainLoop *mainloop,
+                      unsigned int suspend_secs)
+        : DBus(G_BUS_TYPE_SYSTEM,
+               busname,
+               "/org/freedesktop/login1",
+               "org.freedesktop.login1.Manager"),
+          mainloop(mainloop),
+          suspend_secs(suspend_secs)
+    {
+    }
+
+    void callback_bus_acquired()
+    {
+        mainobj.reset(new Login1Standin(GetConnection(), mainloop, suspend_secs));
+        mainobj->RegisterObject(GetConnection());
+    }
+
+    void callback_name_acquired(GDBusConnection *conn, std::string busname)
+    {
+        std::cout << "Registered as " << busname << ", waiting for "
+                  << "delay locks" << std::endl;
+
+        // Give running backends a moment to take their delay locks
+        // if they were started before this stand-in
+        g_timeout_add_seconds(3, suspend_callback, this);
+    }
+
+    void callback_name_lost(GDBusConnection *conn, std::string busname)
+    {
+        THROW_DBUSEXCEPTION("Login1StandinDBus",
+                            "D-Bus name not registered: " + busname);
+    }
+
+private:
+    GMainLoop *mainloop;
+    unsigned int suspend_secs;
+    std::unique_ptr<Login1Standin> mainobj;
+
+
+    static gboolean suspend_callback(gpointer this_ptr)
+    {
+        Login1StandinDBus *self = static_cast<Login1StandinDBus *>(this_ptr);
+        self->mainobj->Suspend();
+        return G_SOURCE_REMOVE;
+    }
+};
+
+
+int main(int argc, char **argv)
+{
+    std::string busname = "net.openvpn.v3.tests.login1";
+    unsigned int suspend_secs = 10;
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "n:s:")))
+    {
+        switch (opt)
+        {
+        case 'n':
+            busname = optarg;
+            break;
+        case 's':
+            suspend_secs = std::atoi(optarg);
+            break;
+        default:
+            std::cerr << "Usage: " << argv[0]
+                      << " [-n BUS-NAME] [-s SUSPEND-SECONDS]" << std::endl;
+            return 1;
+        }
+    }
+
+    GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
+    Login1StandinDBus standin(busname, main_loop, suspend_secs);
+    standin.Setup();
+
+    g_unix_signal_add(SIGINT, stop_handler, main_loop);
+    g_unix_signal_add(SIGTERM, stop_handler, main_loop);
+    g_main_loop_run(main_loop);
+    g_main_loop_unref(main_loop);
+    return 0;
+}
@@ -0,0 +1,122 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   config-binary-test.cpp
+ *
+ * @brief  Test program reading an OpenVPN configuration file from stdin,
+ *         parsing it with OptionListJSON and checking that the binary
+ *         encoded option list decodes to the same option list.  It also
+ *         reports the size of the text and binary representations and
+ *         the time spent parsing each of them.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include <openvpn/log/logsimple.hpp>
+#include "common/core-extensions.hpp"
+
+using namespace openvpn;
+
+
+static bool compare_options(const OptionList& a, const OptionList& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].size() != b[i].size())
+        {
+            return false;
+        }
+        for (size_t j = 0; j < a[i].size(); j++)
+        {
+            if (a[i].ref(j) != b[i].ref(j))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    std::stringstream conf;
+
+    for (std::string line; std::getline(std::cin, line);) {
+        conf << line << std::endl;
+    }
+
+    OptionList::Limits limits("profile is too large",
+                      ProfileParseLimits::MAX_PROFILE_SIZE,
+                      ProfileParseLimits::OPT_OVERHEAD,
+                      ProfileParseLimits::TERM_OVERHEAD,
+                      ProfileParseLimits::MAX_LINE_SIZE,
+                      ProfileParseLimits::MAX_DIRECTIVE_SIZE);
+    OptionListJSON options;
+    options.parse_from_config(conf.str(), &limits);
+
+    const std::string text = options.string_export();
+    const std::string bin = options.binary_serialize();
+
+    auto start = std::chrono::steady_clock::now();
+    OptionListJSON from_text;
+    from_text.parse_from_config(text, &limits);
+    auto text_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    OptionListJSON from_bin;
+    from_bin.binary_deserialize(bin);
+    auto bin_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+
+    int failed = 0;
+    bool ok = compare_options(options, from_bin);
+    std::cout << (ok ? "PASS: " : "FAIL: ") << "Binary option list round trip"
+              << std::endl;
+    failed += (ok ? 0 : 1);
+
+    bool rejected = false;
+    try
+    {
+        OptionListJSON truncated;
+        truncated.binary_deserialize(bin.substr(0, bin.size() - 1));
+    }
+    catch (Exception&)
+    {
+        rejected = true;
+    }
+    std::cout << (rejected ? "PASS: " : "FAIL: ")
+              << "Truncated binary option list rejected" << std::endl;
+    failed += (rejected ? 0 : 1);
+
+    std::cout << "Text profile:   " << text.size() << " bytes, parsed in "
+              << text_us << " us" << std::endl
+              << "Binary profile: " << bin.size() << " bytes, decoded in "
+              << bin_us << " us" << std::endl;
+
+    return (failed > 0 ? 1 : 0);
+}
@@ -0,0 +1,136 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   config-fetch-bench.cpp
+ *
+ * @brief  Compares the cost of rendering a configuration profile with
+ *         OptionListJSON::string_export() and json_export() on each
+ *         request against copying a cached rendering, which is what
+ *         ConfigurationObject::Fetch and FetchJSON does.
+ *
+ *         Usage: config-fetch-bench [ITERATIONS]  (default: 10000)
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include <openvpn/log/logsimple.hpp>
+#include "common/core-extensions.hpp"
+
+using namespace openvpn;
+
+
+/**
+ *  Generates a PEM like inline block of the given size
+ */
+static std::string pem_block(const std::string& type, size_t size)
+{
+    std::stringstream ret;
+    ret << "-----BEGIN " << type << "-----" << std::endl;
+    for (size_t i = 0; i < size; i += 64)
+    {
+        ret << std::string(64, (char) ('A' + (i / 64) % 26)) << std::endl;
+    }
+    ret << "-----END " << type << "-----" << std::endl;
+    return ret.str();
+}
+
+
+/**
+ *  Builds a configuration profile with large inlined certificates
+ *  and keys, similar to what many VPN providers distribute
+ */
+static std::string generate_profile()
+{
+    std::stringstream cfg;
+    cfg << "client" << std::endl
+        << "dev tun" << std::endl
+        << "remote vpn1.example.org 1194 udp" << std::endl
+        << "remote vpn2.example.org 443 tcp" << std::endl
+        << "cipher AES-256-GCM" << std::endl
+        << "verb 3" << std::endl
+        << "<ca>" << std::endl << pem_block("CERTIFICATE", 6000)
+        << "</ca>" << std::endl
+        << "<cert>" << std::endl << pem_block("CERTIFICATE", 2000)
+        << "</cert>" << std::endl
+        << "<key>" << std::endl << pem_block("PRIVATE KEY", 1700)
+        << "</key>" << std::endl
+        << "<tls-crypt>" << std::endl
+        << pem_block("OpenVPN Static key V1", 600)
+        << "</tls-crypt>" << std::endl;
+    return cfg.str();
+}
+
+
+template <typename F>
+static long long measure(unsigned int iterations, F func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int iterations = (argc > 1 ? std::atoi(argv[1]) : 10000);
+
+    OptionList::Limits limits("profile is too large",
+                      ProfileParseLimits::MAX_PROFILE_SIZE,
+                      ProfileParseLimits::OPT_OVERHEAD,
+                      ProfileParseLimits::TERM_OVERHEAD,
+                      ProfileParseLimits::MAX_LINE_SIZE,
+                      ProfileParseLimits::MAX_DIRECTIVE_SIZE);
+    OptionListJSON options;
+    options.parse_from_config(generate_profile(), &limits);
+
+    size_t total = 0;
+    long long render_str = measure(iterations, [&]() {
+            total += options.string_export().size();
+        });
+    long long render_json = measure(iterations, [&]() {
+            total += options.json_export().size();
+        });
+
+    const std::string cached_str = options.string_export();
+    const std::string cached_json = options.json_export();
+    long long copy_str = measure(iterations, [&]() {
+            std::string s(cached_str);
+            total += s.size();
+        });
+    long long copy_json = measure(iterations, [&]() {
+            std::string s(cached_json);
+            total += s.size();
+        });
+
+    std::cout << "Profile size: " << cached_str.size() << " bytes, "
+              << iterations << " iterations" << std::endl
+              << "  string_export():  " << render_str << " us" << std::endl
+              << "  cached Fetch:     " << copy_str << " us" << std::endl
+              << "  json_export():    " << render_json << " us" << std::endl
+              << "  cached FetchJSON: " << copy_json << " us" << std::endl
+              << "(checksum " << total << ")" << std::endl;
+    return 0;
+}
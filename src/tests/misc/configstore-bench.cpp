@@ -0,0 +1,140 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   configstore-bench.cpp
+ *
+ * @brief  Measures the time used to save and load the index of a
+ *         ConfigStore with many configuration profiles.  This is the
+ *         work done by the configuration manager on startup.
+ *
+ *         Usage: configstore-bench [NUMBER-OF-PROFILES]  (default: 10000)
+ */
+
+#include <chrono>
+#include <iostream>
+#include <unistd.h>
+
+#include "configmgr/configstore.hpp"
+
+
+static long long msecs_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+
+/**
+ *  Generates an option list similar to a typical configuration
+ *  profile with an inlined CA certificate
+ */
+static Json::Value generate_options(unsigned int idx)
+{
+    Json::Value opts(Json::arrayValue);
+    auto add = [&opts](std::initializer_list<std::string> args)
+    {
+        Json::Value o(Json::arrayValue);
+        for (const auto& a : args)
+        {
+            o.append(a);
+        }
+        opts.append(o);
+    };
+
+    add({"client"});
+    add({"dev", "tun"});
+    add({"remote", "vpn" + std::to_string(idx) + ".example.org", "1194", "udp"});
+    add({"remote", "vpn" + std::to_string(idx) + ".example.org", "443", "tcp"});
+    add({"cipher", "AES-256-GCM"});
+    add({"verb", "3"});
+    add({"ca", std::string(1800, 'C')});
+    return opts;
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int count = (argc > 1 ? std::atoi(argv[1]) : 10000);
+
+    char tmpl[] = "/tmp/configstore-bench.XXXXXX";
+    if (nullptr == mkdtemp(tmpl))
+    {
+        std::cerr << "Could not create temporary directory" << std::endl;
+        return 2;
+    }
+
+    int ret = 0;
+    try
+    {
+        ConfigStore store(std::string(tmpl) + "/configs");
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            std::string id = "bench_" + std::to_string(i);
+            Json::Value meta;
+            meta["object_path"] = "/net/openvpn/v3/configuration/" + id;
+            meta["name"] = "Benchmark profile " + std::to_string(i);
+            meta["owner"] = 1000;
+            meta["acl"] = Json::Value(Json::arrayValue);
+            store.Save(id, meta, generate_options(i));
+        }
+        std::cout << "Saved " << count << " profiles in "
+                  << msecs_since(start) << " ms" << std::endl;
+
+        start = std::chrono::steady_clock::now();
+        auto index = store.LoadIndex();
+        std::cout << "Loaded index of " << index.size() << " profiles in "
+                  << msecs_since(start) << " ms" << std::endl;
+        if (index.size() != count)
+        {
+            std::cout << "FAIL: Expected " << count << " profiles" << std::endl;
+            ret = 1;
+        }
+
+        start = std::chrono::steady_clock::now();
+        for (const auto& rec : index)
+        {
+            Json::Value opts = store.LoadOptions(rec.first);
+            if (opts.size() != 7)
+            {
+                std::cout << "FAIL: Incorrect option list in "
+                          << rec.first << std::endl;
+                ret = 1;
+                break;
+            }
+        }
+        std::cout << "Loaded all option lists in "
+                  << msecs_since(start) << " ms" << std::endl;
+
+        for (const auto& rec : index)
+        {
+            store.Remove(rec.first);
+        }
+        rmdir(store.GetDirectory().c_str());
+    }
+    catch (ConfigStoreException& excp)
+    {
+        std::cout << "FAIL: " << excp.what() << std::endl;
+        ret = 1;
+    }
+    rmdir(tmpl);
+    return ret;
+}
@@ -0,0 +1,185 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   json-export-bench.cpp
+ *
+ * @brief  Compares the streaming OptionListJSON::json_export() and
+ *         ProfileMergeJSON implementations against the previous
+ *         implementations building a Json::Value tree.  It also checks
+ *         that repeated options survive an export and import round trip.
+ *
+ *         Usage: json-export-bench [REMOTES] [ITERATIONS]
+ *                (default: 200 1000)
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+#include <openvpn/log/logsimple.hpp>
+#include "common/core-extensions.hpp"
+
+using namespace openvpn;
+
+
+/**
+ *  The previous json_export() implementation, via Json::Value
+ */
+static std::string tree_json_export(const OptionList& options)
+{
+    Json::Value outdata;
+    for (const auto& element : options)
+    {
+        outdata[element.ref(0)] = (element.size() > 1 ? element.ref(1) : "");
+    }
+    std::stringstream output;
+    output << outdata;
+    return output.str();
+}
+
+
+/**
+ *  The previous ProfileMergeJSON conversion, via Json::Value
+ */
+static std::string tree_json_import(const std::string& json_str)
+{
+    std::stringstream json_stream;
+    json_stream << json_str;
+    Json::Value data;
+    json_stream >> data;
+
+    std::stringstream config_str;
+    for (Json::ValueIterator it = data.begin(); it != data.end(); ++it)
+    {
+        std::string name = it.name();
+        config_str << optparser_mkline(name, data[name].asString());
+    }
+    return config_str.str();
+}
+
+
+static std::string pem_block(const std::string& type, size_t size)
+{
+    std::stringstream ret;
+    ret << "-----BEGIN " << type << "-----" << std::endl;
+    for (size_t i = 0; i < size; i += 64)
+    {
+        ret << std::string(64, (char) ('A' + (i / 64) % 26)) << std::endl;
+    }
+    ret << "-----END " << type << "-----" << std::endl;
+    return ret.str();
+}
+
+
+/**
+ *  Builds a large configuration profile with many remote entries
+ *  and inlined certificates and keys
+ */
+static std::string generate_profile(unsigned int remotes)
+{
+    std::stringstream cfg;
+    cfg << "client" << std::endl
+        << "dev tun" << std::endl;
+    for (unsigned int i = 0; i < remotes; ++i)
+    {
+        cfg << "remote vpn" << i << ".example.org " << (1194 + i % 10)
+            << " udp" << std::endl;
+    }
+    cfg << "cipher AES-256-GCM" << std::endl
+        << "<ca>" << std::endl << pem_block("CERTIFICATE", 20000)
+        << "</ca>" << std::endl
+        << "<cert>" << std::endl << pem_block("CERTIFICATE", 2000)
+        << "</cert>" << std::endl
+        << "<key>" << std::endl << pem_block("PRIVATE KEY", 1700)
+        << "</key>" << std::endl;
+    return cfg.str();
+}
+
+
+template <typename F>
+static long long measure(unsigned int iterations, F func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i)
+    {
+        func();
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned int remotes = (argc > 1 ? std::atoi(argv[1]) : 200);
+    unsigned int iterations = (argc > 2 ? std::atoi(argv[2]) : 1000);
+
+    OptionList::Limits limits("profile is too large",
+                      ProfileParseLimits::MAX_PROFILE_SIZE,
+                      ProfileParseLimits::OPT_OVERHEAD,
+                      ProfileParseLimits::TERM_OVERHEAD,
+                      ProfileParseLimits::MAX_LINE_SIZE,
+                      ProfileParseLimits::MAX_DIRECTIVE_SIZE);
+    OptionListJSON options;
+    options.parse_from_config(generate_profile(remotes), &limits);
+
+    size_t total = 0;
+    long long tree_export = measure(iterations, [&]() {
+            total += tree_json_export(options).size();
+        });
+    long long stream_export = measure(iterations, [&]() {
+            total += options.json_export().size();
+        });
+
+    const std::string tree_json = tree_json_export(options);
+    const std::string stream_json = options.json_export();
+    long long tree_import = measure(iterations, [&]() {
+            total += tree_json_import(tree_json).size();
+        });
+    long long stream_import = measure(iterations, [&]() {
+            total += JSONProfileReader(stream_json).Profile().size();
+        });
+
+    std::cout << "Profile: " << options.size() << " options, "
+              << stream_json.size() << " bytes JSON, "
+              << iterations << " iterations" << std::endl
+              << "  Json::Value export: " << tree_export << " us" << std::endl
+              << "  streaming export:   " << stream_export << " us" << std::endl
+              << "  Json::Value import: " << tree_import << " us" << std::endl
+              << "  streaming import:   " << stream_import << " us" << std::endl
+              << "(checksum " << total << ")" << std::endl;
+
+    // Check that the repeated remote options are preserved
+    OptionListJSON reimported;
+    reimported.parse_from_config(JSONProfileReader(stream_json).Profile(),
+                                 &limits);
+    bool ok = (reimported.size() == options.size());
+    for (size_t i = 0; ok && i < options.size(); ++i)
+    {
+        ok = (reimported[i].size() == options[i].size());
+        for (size_t j = 0; ok && j < options[i].size(); ++j)
+        {
+            ok = (reimported[i].ref(j) == options[i].ref(j));
+        }
+    }
+    std::cout << (ok ? "PASS: " : "FAIL: ")
+              << "Export/import round trip preserves all options" << std::endl;
+    return (ok ? 0 : 1);
+}
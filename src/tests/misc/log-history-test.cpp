@@ -0,0 +1,90 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   log-history-test.cpp
+ *
+ * @brief  Simple unit test of the LogHistory ring buffer
+ */
+
+#include <iostream>
+
+#include "log/log-history.hpp"
+#include "unit-test.hpp"
+
+
+/**
+ *  Checks a LogHistory::Fetch() result against the expected
+ *  sequence numbers.
+ *
+ * @param test      Description of the test
+ * @param res       Result from LogHistory::Fetch()
+ * @param first     Expected sequence number of the first record
+ * @param expcount  Expected number of records
+ *
+ * @return Returns 0 on success, otherwise 1
+ */
+static int check(const std::string& test,
+                 const std::vector<LogHistoryRecord>& res,
+                 uint64_t first, size_t expcount)
+{
+    bool ok = (res.size() == expcount);
+    for (size_t i = 0; ok && i < res.size(); ++i)
+    {
+        ok = (res[i].seq == first + i)
+             && (res[i].event.message == "Log line "
+                                         + std::to_string(res[i].seq));
+    }
+    return test_check(test, ok);
+}
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    LogHistory history(10);
+
+    failed += check("Empty history", history.Fetch(0), 0, 0);
+
+    for (unsigned int i = 1; i <= 25; ++i)
+    {
+        history.Add(LogEvent(LogGroup::CLIENT, LogCategory::INFO,
+                             "Log line " + std::to_string(i)));
+    }
+    failed += check("Complete history", history.Fetch(0), 16, 10);
+    failed += check("Last 3 events", history.Fetch(0, 3), 23, 3);
+    failed += check("Events since 20", history.Fetch(20), 21, 5);
+    failed += check("Events since 25", history.Fetch(25), 0, 0);
+    failed += check("Events since 2 (evicted)", history.Fetch(2), 16, 10);
+
+    history.SetMaxSize(4);
+    failed += check("Shrunk history", history.Fetch(0), 22, 4);
+
+    history.SetMaxSize(8);
+    history.Add(LogEvent(LogGroup::CLIENT, LogCategory::INFO, "Log line 26"));
+    failed += check("Grown history", history.Fetch(0), 22, 5);
+
+    history.SetMaxSize(0);
+    history.Add(LogEvent(LogGroup::CLIENT, LogCategory::INFO, "Log line 27"));
+    failed += check("Disabled history", history.Fetch(0), 0, 0);
+    failed += test_check("Sequence number increased when disabled",
+                         27 == history.GetLastSeq());
+
+    return test_summary(failed);
+}
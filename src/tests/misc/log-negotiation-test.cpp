@@ -0,0 +1,74 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   log-negotiation-test.cpp
+ *
+ * @brief  Simple unit test of the LogLevelNegotiator
+ */
+
+#include <iostream>
+
+#include "log/log-negotiation.hpp"
+#include "unit-test.hpp"
+
+
+static int check(const std::string& test, const LogLevelNegotiator& neg,
+                 bool changed, bool expchanged, unsigned int explevel)
+{
+    bool ok = (changed == expchanged) && (neg.GetLogLevel() == explevel);
+    return test_check(test + " (log level "
+                      + std::to_string(neg.GetLogLevel()) + ")", ok);
+}
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    LogLevelNegotiator neg(6);
+
+    failed += check("No consumers, fallback", neg, false, false, 6);
+    failed += check("Log service requests 3",
+                    neg, neg.Request("log-service", 3), true, 3);
+    failed += check("Session manager requests 4",
+                    neg, neg.Request("session-manager", 4), true, 4);
+    failed += check("Log service requests 2",
+                    neg, neg.Request("log-service", 2), false, 4);
+    failed += check("Session manager requests 0",
+                    neg, neg.Request("session-manager", 0), true, 2);
+    failed += check("Unknown consumer released",
+                    neg, neg.Release("unknown"), false, 2);
+    failed += check("Session manager released",
+                    neg, neg.Release("session-manager"), false, 2);
+    failed += check("Log service released",
+                    neg, neg.Release("log-service"), true, 6);
+
+    bool rejected = false;
+    try
+    {
+        neg.Request("log-service", 7);
+    }
+    catch (LogException& excp)
+    {
+        rejected = true;
+    }
+    failed += test_check("Invalid log level rejected", rejected);
+
+    return test_summary(failed);
+}
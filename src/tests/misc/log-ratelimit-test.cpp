@@ -0,0 +1,143 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   log-ratelimit-test.cpp
+ *
+ * @brief  Simple unit test of the LogRateLimiter
+ */
+
+#include <iostream>
+#include <vector>
+
+#include "log/log-ratelimit.hpp"
+#include "unit-test.hpp"
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    std::vector<LogEvent> sent;
+    auto emit = [&sent](const LogEvent& ev) { sent.push_back(ev); };
+
+    // Duplicate suppression
+    {
+        LogRateLimiter rl;
+        rl.SetDuplicateSuppression(true);
+        for (int i = 0; i < 10; ++i)
+        {
+            rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::INFO,
+                                "Same message"), emit);
+        }
+        rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::INFO,
+                            "Other message"), emit);
+
+        failed += test_check("Duplicates coalesced",
+                             3 == sent.size()
+                             && "Same message" == sent[0].message
+                             && "Last message repeated 9 times" == sent[1].message
+                             && "Other message" == sent[2].message);
+    }
+
+    // The end of a burst is only reported by Flush()
+    sent.clear();
+    {
+        LogRateLimiter rl;
+        rl.SetDuplicateSuppression(true);
+        for (int i = 0; i < 5; ++i)
+        {
+            rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::INFO,
+                                "Same message"), emit);
+        }
+        failed += test_check("Repeats pending until flushed", 1 == sent.size());
+
+        rl.Flush(emit, std::chrono::hours(1));
+        failed += test_check("Recent repeats not flushed", 1 == sent.size());
+
+        rl.Flush(emit);
+        failed += test_check("Repeats flushed",
+                             2 == sent.size()
+                             && "Last message repeated 4 times" == sent[1].message);
+
+        rl.Flush(emit);
+        failed += test_check("Nothing more to flush", 2 == sent.size());
+    }
+
+    // An empty first message is not a repeat
+    sent.clear();
+    {
+        LogRateLimiter rl;
+        rl.SetDuplicateSuppression(true);
+        rl.Process(LogEvent(), emit);
+        failed += test_check("Empty first message sent", 1 == sent.size());
+    }
+
+    // Critical events are not coalesced
+    sent.clear();
+    {
+        LogRateLimiter rl;
+        rl.SetDuplicateSuppression(true);
+        rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::WARN,
+                            "Warning"), emit);
+        rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::WARN,
+                            "Warning"), emit);
+        for (int i = 0; i < 3; ++i)
+        {
+            rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::CRIT,
+                                "Critical"), emit);
+        }
+        rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::WARN,
+                            "Warning"), emit);
+
+        failed += test_check("Critical events not coalesced",
+                             6 == sent.size()
+                             && "Last message repeated 1 times" == sent[1].message
+                             && "Critical" == sent[2].message
+                             && "Critical" == sent[4].message
+                             && "Warning" == sent[5].message);
+    }
+
+    // Token bucket; no refill worth mentioning during this test
+    sent.clear();
+    {
+        LogRateLimiter rl;
+        rl.SetLimit(LogGroup::CLIENT, 0.001, 5);
+        for (int i = 0; i < 20; ++i)
+        {
+            rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::INFO,
+                                "Message " + std::to_string(i)), emit);
+        }
+        failed += test_check("Burst limited", 5 == sent.size());
+
+        rl.Process(LogEvent(LogGroup::SESSIONMGR, LogCategory::INFO,
+                            "Other group"), emit);
+        failed += test_check("Other log groups not limited",
+                             6 == sent.size() && "Other group" == sent[5].message);
+
+        rl.Process(LogEvent(LogGroup::CLIENT, LogCategory::CRIT,
+                            "Critical"), emit);
+        failed += test_check("Critical events not limited, suppressed reported",
+                             8 == sent.size()
+                             && "15 log messages suppressed due to rate limiting"
+                                == sent[6].message
+                             && "Critical" == sent[7].message);
+    }
+
+    return test_summary(failed);
+}
@@ -0,0 +1,106 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   logfile-rotate-test.cpp
+ *
+ * @brief  Simple test of the RotatingLogFile implementation.  Writes
+ *         log lines through a StreamLogWriter into a temporary directory
+ *         and checks the expected log segments exists.
+ */
+
+#include <iostream>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "log/logwriter.hpp"
+#include "log/logfile-rotate.hpp"
+#include "unit-test.hpp"
+
+
+static bool file_exists(const std::string& fname)
+{
+    struct stat st;
+    return 0 == stat(fname.c_str(), &st);
+}
+
+
+static off_t file_size(const std::string& fname)
+{
+    struct stat st;
+    return (0 == stat(fname.c_str(), &st) ? st.st_size : -1);
+}
+
+
+int main(int argc, char **argv)
+{
+    char tmpl[] = "/tmp/logrotate-test.XXXXXX";
+    if (nullptr == mkdtemp(tmpl))
+    {
+        std::cerr << "Could not create temporary directory" << std::endl;
+        return 2;
+    }
+    std::string logfname = std::string(tmpl) + "/test.log";
+
+    LogRotateSettings settings;
+    settings.max_size = 1024;
+    settings.keep = 3;
+    settings.compress = (argc > 1 && std::string(argv[1]) == "--compress");
+
+    int failed = 0;
+    {
+        RotatingLogFile rotlog(logfname, settings);
+        std::ostream logfile(&rotlog);
+        StreamLogWriter sw(logfile);
+        sw.EnableTimestamp(false);
+        LogWriter& w = sw;
+
+        // Each line is ~100 bytes; 100 lines => ~10 rotations
+        std::string payload(90, 'x');
+        bool within_size = true;
+        for (int i = 0; within_size && i < 100; i++)
+        {
+            w.Write(LogGroup::LOGGER, LogCategory::INFO, payload);
+            within_size = (rotlog.GetCurrentSize() <= settings.max_size);
+        }
+        failed += test_check("Log file kept within max size", within_size);
+
+        // Reopening must continue appending to the same file
+        off_t before = file_size(logfname);
+        rotlog.Reopen();
+        w.Write(LogGroup::LOGGER, LogCategory::INFO, "After reopen");
+        failed += test_check("Log file appended after Reopen()",
+                             file_size(logfname) > before);
+    }
+
+    std::string sfx = (settings.compress ? ".gz" : "");
+    for (unsigned int i = 1; i <= settings.keep; i++)
+    {
+        std::string seg = logfname + "." + std::to_string(i) + sfx;
+        failed += test_check("Log segment " + seg, file_exists(seg));
+        unlink(seg.c_str());
+    }
+    std::string extra = logfname + "." + std::to_string(settings.keep + 1) + sfx;
+    failed += test_check("No extra log segments kept", !file_exists(extra));
+    unlink(extra.c_str());
+    unlink(logfname.c_str());
+    rmdir(tmpl);
+
+    return test_summary(failed);
+}
@@ -164,6 +164,22 @@ int main(int argc, char **argv)
     run_test_2(cfw);
     run_test_3(cfw);
 
+    // Test writing to more log destinations with different log levels.
+    // The plain destination gets every log line, the coloured destination
+    // only log lines up to LogCategory::INFO
+    std::cout << "Testing MultiLogWriter" << std::endl
+              << "----------------------------------------------------------"
+              << std::endl;
+    MultiLogWriter mlw;
+    mlw.AddLogWriter(LogWriter::Ptr(new StreamLogWriter(std::cout)), 6);
+    mlw.AddLogWriter(LogWriter::Ptr(new ColourStreamWriter(std::cout,
+                                                           colours)),
+                     3);
+    run_test_2(mlw);
+    run_test_3(mlw);
+    run_test_4(mlw);
+    std::cout << std::endl << std::endl;
+
     // Test the syslog implementation of LogWriter.  To validate these
     // log entries, the syslog log files needs to be evaluated.
     std::cout << "Testing SyslogWriter" << std::endl
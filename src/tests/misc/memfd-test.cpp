@@ -0,0 +1,97 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   memfd-test.cpp
+ *
+ * @brief  Unit test of passing data through sealed memfds, and of the
+ *         validation done on the receiving side
+ */
+
+#include <string>
+
+#include "common/memfd.hpp"
+#include "unit-test.hpp"
+
+
+/**
+ *  Passes data through a sealed memfd and reads it back as text
+ *
+ * @param data  std::string with the data to pass through the memfd
+ * @param res   std::string where the data read back is stored
+ *
+ * @return Returns true if the data was accepted by the receiver
+ */
+static bool roundtrip(const std::string& data, std::string& res)
+{
+    int fd = memfd_create_sealed("memfd-test", data);
+    try
+    {
+        res = memfd_read_sealed_text(fd, 1024);
+        ::close(fd);
+        return true;
+    }
+    catch (MemFDException& excp)
+    {
+        ::close(fd);
+        res = excp.what();
+        return false;
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    std::string res;
+
+    const std::string profile = "remote vpn.example.org\n# Blåbærsyltetøy\n";
+    failed += test_check("Valid UTF-8 passed through",
+                         roundtrip(profile, res) && profile == res);
+    failed += test_check("Empty contents",
+                         roundtrip("", res) && res.empty());
+    failed += test_check("Embedded NUL rejected",
+                         !roundtrip(std::string("remote a\0remote b\n", 18), res)
+                         && std::string::npos != res.find("NUL character at offset 8"));
+    failed += test_check("Invalid UTF-8 rejected",
+                         !roundtrip("remote \xc3\x28\n", res)
+                         && std::string::npos != res.find("UTF-8 at offset 7"));
+    failed += test_check("Too large contents rejected",
+                         !roundtrip(std::string(1025, 'x'), res));
+
+    // A plain file descriptor is not sealed and must be rejected
+    int pfd[2];
+    bool rejected = false;
+    if (0 == ::pipe(pfd))
+    {
+        try
+        {
+            memfd_read_sealed_text(pfd[0], 1024);
+        }
+        catch (MemFDException& excp)
+        {
+            rejected = true;
+        }
+        ::close(pfd[0]);
+        ::close(pfd[1]);
+    }
+    failed += test_check("Unsealed file descriptor rejected", rejected);
+
+    return test_summary(failed);
+}
@@ -0,0 +1,106 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   profile-dedup-test.cpp
+ *
+ * @brief  Simple unit test of the ProfileDedup sharing of identical
+ *         parsed configuration profiles
+ */
+
+#include <cstdint>
+#include <iostream>
+
+#include <openvpn/log/logsimple.hpp>
+#include "configmgr/profile-dedup.hpp"
+#include "unit-test.hpp"
+
+using namespace openvpn;
+
+
+static OptionListJSON parse(const std::string& profile)
+{
+    OptionList::Limits limits("profile is too large",
+                      ProfileParseLimits::MAX_PROFILE_SIZE,
+                      ProfileParseLimits::OPT_OVERHEAD,
+                      ProfileParseLimits::TERM_OVERHEAD,
+                      ProfileParseLimits::MAX_LINE_SIZE,
+                      ProfileParseLimits::MAX_DIRECTIVE_SIZE);
+    OptionListJSON ret;
+    ret.parse_from_config(profile, &limits);
+    return ret;
+}
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    ProfileDedup dedup;
+
+    const std::string profile = "client\n"
+                                "dev tun\n"
+                                "remote vpn.example.org 1194 udp\n"
+                                "<ca>\n" + std::string(60, 'A') + "\n</ca>\n";
+
+    OptionListJSON opts1 = parse(profile);
+    ProfileDedup::ProfilePtr p1 = dedup.Intern(ProfileDedup::Hash(opts1),
+                                               std::move(opts1));
+
+    // Same profile with comments and extra whitespace
+    OptionListJSON opts2 = parse("# Corporate profile\n\n" + profile
+                                 + "; end of profile\n");
+    ProfileDedup::ProfilePtr p2 = dedup.Intern(ProfileDedup::Hash(opts2),
+                                               std::move(opts2));
+
+    OptionListJSON opts3 = parse(profile + "verb 4\n");
+    ProfileDedup::ProfilePtr p3 = dedup.Intern(ProfileDedup::Hash(opts3),
+                                               std::move(opts3));
+
+    failed += test_check("Identical profiles are shared", p1 == p2);
+    failed += test_check("Different profiles are not shared", p1 != p3);
+    failed += test_check("Two distinct profiles in use",
+                         2 == dedup.GetProfileCount());
+    failed += test_check("Memory saved reported", dedup.GetMemorySaved() > 0);
+
+    // The rendered forms belong to the shared profile, so the saving
+    // grows when they are created
+    const uint64_t saved = dedup.GetMemorySaved();
+    const std::string& json = p1->GetJSON();
+    failed += test_check("Rendered profile is shared",
+                         &json == &p2->GetJSON());
+    failed += test_check("Rendered profile included in memory saved",
+                         dedup.GetMemorySaved() > saved);
+
+    // A modified private copy does not affect the shared profile
+    SharedProfile copy{OptionListJSON(p1->GetOptions())};
+    copy.GetString();
+    copy.ModifyOptions().clear();
+    failed += test_check("Modified copy rendered again",
+                         copy.GetString() != p1->GetString());
+
+    p2.reset();
+    failed += test_check("No memory saved with one user",
+                         0 == dedup.GetMemorySaved());
+
+    p1.reset();
+    failed += test_check("Released profile removed",
+                         1 == dedup.GetProfileCount());
+
+    return test_summary(failed);
+}
@@ -0,0 +1,151 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   requiresqueue-test.cpp
+ *
+ * @brief  Unit test of the RequiresQueue lookups, with one thread adding
+ *         and reading slots while another thread provides the responses
+ */
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "common/requiresqueue.hpp"
+#include "unit-test.hpp"
+
+
+template <typename F>
+static bool throws(F func)
+{
+    try
+    {
+        func();
+    }
+    catch (RequiresQueueException&)
+    {
+        return true;
+    }
+    return false;
+}
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    const ClientAttentionType cred = ClientAttentionType::CREDENTIALS;
+    const ClientAttentionGroup userpass = ClientAttentionGroup::USER_PASSWORD;
+    const ClientAttentionGroup dynchal = ClientAttentionGroup::CHALLENGE_DYNAMIC;
+
+    RequiresQueue q;
+    unsigned int uid = q.RequireAdd(cred, userpass, "username", "Username", false);
+    unsigned int pid = q.RequireAdd(cred, userpass, "password", "Password", true);
+    unsigned int did = q.RequireAdd(cred, dynchal, "dynamic_challenge", "Code", false);
+    failed += test_check("IDs per type/group", 0 == uid && 1 == pid && 0 == did);
+    failed += test_check("QueueCount", 2 == q.QueueCount(cred, userpass)
+                                       && 1 == q.QueueCount(cred, dynchal)
+                                       && 0 == q.QueueCount(cred, ClientAttentionGroup::CHALLENGE_STATIC));
+    failed += test_check("QueueCheckAll", 3 == q.QueueCheckAll() && !q.QueueAllDone());
+    failed += test_check("QueueCheckTypeGroup", 2 == q.QueueCheckTypeGroup().size());
+
+    q.UpdateEntry(cred, userpass, uid, "user");
+    q.UpdateEntry(cred, userpass, pid, "secret");
+    failed += test_check("QueueCheck after update", q.QueueCheck(cred, userpass).empty()
+                                                    && q.QueueDone(cred, userpass));
+    failed += test_check("GetResponse by ID", "user" == q.GetResponse(cred, userpass, uid));
+    failed += test_check("GetResponse by name", "secret" == q.GetResponse(cred, userpass, "password"));
+    failed += test_check("UpdateEntry twice",
+                         throws([&q, cred, userpass, pid]() { q.UpdateEntry(cred, userpass, pid, "again"); }));
+    failed += test_check("UpdateEntry unknown slot",
+                         throws([&q, cred, userpass]() { q.UpdateEntry(cred, userpass, 42, "x"); }));
+    failed += test_check("GetResponse not provided",
+                         throws([&q, cred, dynchal]() { q.GetResponse(cred, dynchal, "dynamic_challenge"); }));
+
+    q.ResetValue(cred, userpass, pid);
+    failed += test_check("ResetValue",
+                         throws([&q, cred, userpass]() { q.GetResponse(cred, userpass, "password"); })
+                         && 1 == q.QueueCheck(cred, userpass).size());
+
+    q.UpdateEntry(cred, dynchal, did, "123456");
+    failed += test_check("TakeResponse", "123456" == q.TakeResponse(cred, dynchal, "dynamic_challenge")
+                                         && q.GetResponse(cred, dynchal, did).empty()
+                                         && q.QueueDone(cred, dynchal));
+
+    unsigned int did2 = q.RequireAdd(cred, dynchal, "dynamic_challenge", "New code", false);
+    failed += test_check("RequireAdd replaces slot with the same name",
+                         1 == did2 && 1 == q.QueueCount(cred, dynchal)
+                         && throws([&q, cred, dynchal, did]() { q.GetResponse(cred, dynchal, did); }));
+
+    q.RemoveGroup(cred, dynchal);
+    failed += test_check("RemoveGroup", 0 == q.QueueCount(cred, dynchal)
+                                        && 2 == q.QueueCount(cred, userpass));
+
+    // One thread adds slots and waits for their responses, like the
+    // VPN client thread does on a dynamic challenge, while the main thread
+    // provides the responses, like the D-Bus thread does.
+    const unsigned int count = 2000;
+    RequiresQueue cq;
+    std::atomic<bool> reader_ok(true);
+    std::thread reader([&cq, &reader_ok, count, cred, dynchal]()
+                       {
+                           for (unsigned int i = 0; i < count; ++i)
+                           {
+                               std::string name = "slot" + std::to_string(i);
+                               cq.RequireAdd(cred, dynchal, name, "", true);
+                               while (true)
+                               {
+                                   try
+                                   {
+                                       if (std::to_string(i) != cq.TakeResponse(cred, dynchal, name))
+                                       {
+                                           reader_ok = false;
+                                       }
+                                       break;
+                                   }
+                                   catch (RequiresQueueException&)
+                                   {
+                                       std::this_thread::yield();
+                                   }
+                               }
+                           }
+                       });
+
+    unsigned int provided = 0;
+    while (provided < count)
+    {
+        if (cq.QueueCheckTypeGroup().empty())
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        for (auto id : cq.QueueCheck(cred, dynchal))
+        {
+            cq.UpdateEntry(cred, dynchal, id, std::to_string(id));
+            ++provided;
+        }
+    }
+    reader.join();
+    failed += test_check("Concurrent add and provide", reader_ok
+                                                       && count == cq.QueueCount(cred, dynchal)
+                                                       && cq.QueueAllDone());
+
+    return test_summary(failed);
+}
@@ -0,0 +1,161 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   spsc-queue-test.cpp
+ *
+ * @brief  Simple unit test of the SPSCQueue, with one producer and
+ *         one consumer thread, and of the CheckedSPSCQueue with its
+ *         producer thread replaced between runs
+ */
+
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "common/spsc-queue.hpp"
+#include "unit-test.hpp"
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+
+    SPSCQueue<std::string> q(5);
+    failed += test_check("Capacity rounded up", 8 == q.GetCapacity());
+
+    std::string s;
+    failed += test_check("Pop from empty queue", !q.Pop(s));
+
+    bool ok = true;
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+        ok &= q.Push(std::to_string(i));
+    }
+    failed += test_check("Fill queue", ok && 8 == q.GetSize());
+    failed += test_check("Push to full queue", !q.Push("overflow"));
+
+    ok = true;
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+        ok &= q.Pop(s) && std::to_string(i) == s;
+    }
+    failed += test_check("Drain queue in order", ok && !q.Pop(s));
+
+    // One thread pushing, the main thread popping, with a queue
+    // much smaller than the number of elements passed through it
+    const unsigned long count = 1000000;
+    SPSCQueue<unsigned long> nq(64);
+    std::thread producer([&nq, count]()
+                         {
+                             for (unsigned long i = 1; i <= count; ++i)
+                             {
+                                 unsigned long v = i;
+                                 while (!nq.Push(std::move(v)))
+                                 {
+                                     std::this_thread::yield();
+                                 }
+                             }
+                         });
+
+    unsigned long expect = 1;
+    unsigned long v = 0;
+    while (expect <= count)
+    {
+        if (!nq.Pop(v))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (v != expect)
+        {
+            break;
+        }
+        ++expect;
+    }
+    producer.join();
+    failed += test_check("Threaded producer/consumer ordering",
+                         expect == count + 1 && !nq.Pop(v));
+
+    // Two runs, each with a new producer thread which registers itself,
+    // while a thread which is not the producer pushes at the same time
+    const unsigned long run_count = 200000;
+    const unsigned long stray_count = 1000;
+    CheckedSPSCQueue<unsigned long> cq(64);
+    for (unsigned int run = 0; run < 2; ++run)
+    {
+        const unsigned long stray_pushes = cq.GetLockedPushes();
+        auto pusher = [&cq](unsigned long first, unsigned long last,
+                            bool register_producer)
+                      {
+                          if (register_producer)
+                          {
+                              cq.SetProducer(std::this_thread::get_id());
+                          }
+                          for (unsigned long i = first; i <= last; ++i)
+                          {
+                              unsigned long v = i;
+                              while (!cq.Push(std::move(v)))
+                              {
+                                  std::this_thread::yield();
+                              }
+                          }
+                      };
+
+        // Values from 1 are pushed by the producer, values from
+        // 1000000000 by the stray thread
+        const unsigned long stray_base = 1000000000;
+        std::thread producer(pusher, 1, run_count, true);
+        std::thread stray(pusher, stray_base + 1, stray_base + stray_count,
+                          false);
+
+        unsigned long expect_prod = 1;
+        unsigned long expect_stray = stray_base + 1;
+        bool ordered = true;
+        while (ordered && (expect_prod <= run_count
+                           || expect_stray <= stray_base + stray_count))
+        {
+            if (!cq.Pop(v))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            if (v > stray_base)
+            {
+                ordered = (v == expect_stray++);
+            }
+            else
+            {
+                ordered = (v == expect_prod++);
+            }
+        }
+        producer.join();
+        stray.join();
+        cq.SetProducer(std::thread::id());
+
+        const std::string r = " (run " + std::to_string(run + 1) + ")";
+        failed += test_check("Checked queue keeps the order per thread" + r,
+                             ordered && !cq.Pop(v));
+        failed += test_check("Checked queue uses the locked path for "
+                             "the stray thread" + r,
+                             stray_count == cq.GetLockedPushes() - stray_pushes);
+    }
+
+    return test_summary(failed);
+}
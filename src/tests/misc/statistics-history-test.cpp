@@ -0,0 +1,110 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   statistics-history-test.cpp
+ *
+ * @brief  Unit test of the rate calculations in StatisticsHistory
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "client/statistics-history.hpp"
+#include "unit-test.hpp"
+
+
+static bool near(double a, double b)
+{
+    return std::fabs(a - b) < 1e-9;
+}
+
+
+static StatisticsHistory::Sample sample(unsigned int secs, long long a,
+                                        long long b)
+{
+    return StatisticsHistory::Sample{(uint64_t) secs * 1000000, {a, b}};
+}
+
+
+template <typename F>
+static bool throws(F func)
+{
+    try
+    {
+        func();
+    }
+    catch (StatisticsHistoryException&)
+    {
+        return true;
+    }
+    return false;
+}
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+
+    auto w = StatisticsHistory::ParseWindows("60,1,10,10");
+    failed += test_check("ParseWindows sorted and unique",
+                         3 == w.size() && 1 == w[0] && 10 == w[1] && 60 == w[2]);
+    failed += test_check("ParseWindows invalid",
+                         throws([]{ StatisticsHistory::ParseWindows(""); })
+                         && throws([]{ StatisticsHistory::ParseWindows("1,,10"); })
+                         && throws([]{ StatisticsHistory::ParseWindows("0"); })
+                         && throws([]{ StatisticsHistory::ParseWindows("5s"); })
+                         && throws([]{ StatisticsHistory::ParseWindows("99999"); }));
+
+    StatisticsHistory h;
+    h.SetWindows({1, 10});
+    auto r = h.Rates(sample(1, 100, 5), 1);
+    failed += test_check("No history gives zero rates",
+                         2 == r.size() && near(0, r[0]) && near(0, r[1]));
+
+    // Counter A grows with 100 per second, counter B is reset at 15s
+    for (unsigned int t = 0; t <= 20; ++t)
+    {
+        h.Add(sample(t, 100 * t, (t < 15 ? 10 * t : t - 15)));
+    }
+    failed += test_check("History pruned to the longest window", 11 == h.GetSize());
+
+    r = h.Rates(sample(21, 2100, 6), 1);
+    failed += test_check("Rate over 1 second", near(100, r[0]) && near(1, r[1]));
+
+    r = h.Rates(sample(21, 2100, 6), 10);
+    failed += test_check("Counter reset gives zero rate",
+                         near(100, r[0]) && near(0, r[1]));
+
+    StatisticsHistory p;
+    p.SetWindows({60});
+    p.Add(sample(0, 0, 0));
+    p.Add(sample(2, 50, 0));
+    r = p.Rates(sample(4, 100, 0), 60);
+    failed += test_check("Partial window uses the oldest sample", near(25, r[0]));
+
+    p.Add(StatisticsHistory::Sample{6000000, {1, 2, 3}});
+    failed += test_check("Changed counter list clears the history",
+                         1 == p.GetSize());
+    p.Clear();
+    failed += test_check("Clear", 0 == p.GetSize());
+
+    return test_summary(failed);
+}
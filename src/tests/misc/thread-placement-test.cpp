@@ -0,0 +1,156 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   thread-placement-test.cpp
+ *
+ * @brief  Simple unit test of the ThreadPlacement settings parsing
+ *         and of applying them to the running thread
+ */
+
+#include <iostream>
+#include <functional>
+
+#include "common/thread-placement.hpp"
+#include "unit-test.hpp"
+
+
+/**
+ *  Runs a function setting a ThreadPlacement value and checks if it
+ *  was accepted as expected.
+ *
+ * @param test     Description of the test
+ * @param setter   Function modifying a ThreadPlacement object
+ * @param expok    Should the value be accepted
+ * @param expstr   Expected ThreadPlacement::str() result if accepted
+ *
+ * @return Returns 0 on success, otherwise 1
+ */
+static int check(const std::string& test,
+                 std::function<void(ThreadPlacement&)> setter,
+                 bool expok, const std::string& expstr = "")
+{
+    ThreadPlacement tp;
+    bool ok = false;
+    try
+    {
+        setter(tp);
+        ok = expok && (tp.str() == expstr) && !tp.Empty();
+    }
+    catch (ThreadPlacementException& excp)
+    {
+        ok = !expok && tp.Empty();
+    }
+    return test_check(test, ok);
+}
+
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+
+    failed += check("CPU list",
+                    [](ThreadPlacement& tp) { tp.SetCPUs("0-3,8"); },
+                    true, "cpus=0-3,8");
+    failed += check("Invalid CPU range",
+                    [](ThreadPlacement& tp) { tp.SetCPUs("3-1"); },
+                    false);
+    failed += check("Invalid CPU number",
+                    [](ThreadPlacement& tp) { tp.SetCPUs("0,x"); },
+                    false);
+    failed += check("Empty CPU list",
+                    [](ThreadPlacement& tp) { tp.SetCPUs(""); },
+                    false);
+    failed += check("Scheduling policy",
+                    [](ThreadPlacement& tp) { tp.SetSchedPolicy("batch"); },
+                    true, "sched-policy=batch");
+    failed += check("Real-time priority",
+                    [](ThreadPlacement& tp) { tp.SetSchedPolicy("fifo:10"); },
+                    true, "sched-policy=fifo:10");
+    failed += check("Priority on non-real-time policy",
+                    [](ThreadPlacement& tp) { tp.SetSchedPolicy("other:5"); },
+                    false);
+    failed += check("Invalid real-time priority",
+                    [](ThreadPlacement& tp) { tp.SetSchedPolicy("rr:100"); },
+                    false);
+    failed += check("Invalid scheduling policy",
+                    [](ThreadPlacement& tp) { tp.SetSchedPolicy("deadline"); },
+                    false);
+    failed += check("Nice value",
+                    [](ThreadPlacement& tp) { tp.SetNice("-5"); },
+                    true, "nice=-5");
+    failed += check("Invalid nice value",
+                    [](ThreadPlacement& tp) { tp.SetNice("20"); },
+                    false);
+    failed += check("NUMA node",
+                    [](ThreadPlacement& tp) { tp.SetNUMANode("1"); },
+                    true, "numa-node=1");
+    failed += check("Invalid NUMA node",
+                    [](ThreadPlacement& tp) { tp.SetNUMANode("-1"); },
+                    false);
+    failed += check("Combined settings",
+                    [](ThreadPlacement& tp)
+                    {
+                        tp.SetCPUs("0");
+                        tp.SetNice("5");
+                    },
+                    true, "cpus=0, nice=5");
+
+    ThreadPlacement priv;
+    priv.SetCPUs("0");
+    priv.SetSchedPolicy("batch");
+    priv.SetNice("0");
+    failed += test_check("Non-privileged settings", !priv.IsPrivileged());
+    priv.SetNice("-1");
+    failed += test_check("Negative nice value is privileged",
+                         priv.IsPrivileged());
+    priv.SetNice("1");
+    priv.SetSchedPolicy("rr");
+    failed += test_check("Real-time policy is privileged",
+                         priv.IsPrivileged());
+
+    // Settings which an unprivileged user can always apply, using the
+    // first CPU this process is allowed to run on
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    int cpu = 0;
+    while (cpu < CPU_SETSIZE - 1 && !CPU_ISSET(cpu, &set))
+    {
+        ++cpu;
+    }
+
+    ThreadPlacement tp;
+    tp.SetCPUs(std::to_string(cpu));
+    tp.SetSchedPolicy("batch");
+    tp.SetNice("10");
+    std::vector<std::string> errors = tp.Apply();
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    bool applied = errors.empty() && (1 == CPU_COUNT(&set))
+                   && CPU_ISSET(cpu, &set)
+                   && (SCHED_BATCH == sched_getscheduler(0));
+    for (const auto& e : errors)
+    {
+        std::cout << "      " << e << std::endl;
+    }
+    failed += test_check("Applied to the running thread", applied);
+
+    return test_summary(failed);
+}
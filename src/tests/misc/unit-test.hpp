@@ -0,0 +1,61 @@
+//  OpenVPN 3 Linux client -- Next generation OpenVPN client
+//
+//  Copyright (C) 2018         OpenVPN, Inc. <sales@openvpn.net>
+//  Copyright (C) 2018         David Sommerseth <davids@openvpn.net>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Affero General Public License as
+//  published by the Free Software Foundation, version 3 of the
+//  License.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Affero General Public License for more details.
+//
+//  You should have received a copy of the GNU Affero General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/**
+ * @file   unit-test.hpp
+ *
+ * @brief  Result reporting shared by the unit tests in this directory,
+ *         which are run by "make check"
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+
+
+/**
+ *  Reports the result of a single test
+ *
+ * @param test  std::string with a description of the test
+ * @param ok    Boolean, true if the test passed
+ *
+ * @return Returns 0 if the test passed, otherwise 1.  This is meant to
+ *         be added to a counter of failed tests.
+ */
+inline int test_check(const std::string& test, bool ok)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << test << std::endl;
+    return (ok ? 0 : 1);
+}
+
+
+/**
+ *  Reports the overall result of a test program
+ *
+ * @param failed  Number of failed tests
+ *
+ * @return Returns the exit code of the test program
+ */
+inline int test_summary(int failed)
+{
+    std::cout << (failed > 0 ? "Some tests failed" : "All tests passed")
+              << std::endl;
+    return (failed > 0 ? 1 : 0);
+}